@@ -0,0 +1,76 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include "allocationcounter.h"
+#include <QAtomicInteger>
+#include <cstdlib>
+#include <new>
+
+static QAtomicInteger<quint64> allocations(0);
+
+quint64 AllocationCounter::count()
+{
+	return allocations.load();
+}
+
+void* operator new(size_t size)
+{
+	allocations.fetchAndAddRelaxed(1);
+	void* block = std::malloc(size ? size : 1);
+	if (!block)
+		throw std::bad_alloc();
+	return block;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* block) noexcept
+{
+	std::free(block);
+}
+
+void operator delete[](void* block) noexcept
+{
+	std::free(block);
+}
+
+void operator delete(void* block, size_t) noexcept
+{
+	std::free(block);
+}
+
+void operator delete[](void* block, size_t) noexcept
+{
+	std::free(block);
+}
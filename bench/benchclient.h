@@ -0,0 +1,65 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCBENCHCLIENT_H
+#define QTRPCBENCHCLIENT_H
+
+#include <ClientProxy>
+
+using namespace QtRpc;
+
+/**
+	The client side of BenchService
+*/
+class BenchClient : public ClientProxy
+{
+	Q_OBJECT
+	QTRPC_CLIENTPROXY(BenchClient)
+public:
+	BenchClient(QObject *parent = 0);
+	~BenchClient();
+
+signals:
+	Event benchEvent(qint64 sent, QByteArray data);
+	ReturnValue echo(QByteArray data);
+	ReturnValue echo(QObject *obj, const char *slot, QByteArray data);
+	ReturnValue sum(int a, int b, int c, int d, int e, QString s);
+	ReturnValue pingCallback(QByteArray data);
+	ReturnValue pingCallback(QObject *obj, const char *slot, QByteArray data);
+	ReturnValue emitEvents(int count, QByteArray data);
+	ReturnValue subService();
+	ReturnValue slowEcho(QObject *obj, const char *slot, int msecs, QByteArray data);
+
+public slots:
+	ReturnValue echoCallback(QByteArray data);
+};
+
+#endif
@@ -0,0 +1,63 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCBENCHCLOCK_H
+#define QTRPCBENCHCLOCK_H
+
+#include <QElapsedTimer>
+#include <ctime>
+
+/**
+	A monotonic clock shared by every thread of the benchmark. The server runs in the same process as the clients, so timestamps taken on the server can be compared with timestamps taken by the clients.
+*/
+namespace BenchClock
+{
+	/**
+	 * @return Returns the nanoseconds since the first call
+	 */
+	inline qint64 now()
+	{
+		static QElapsedTimer timer;
+		static bool started = (timer.start(), true);
+		Q_UNUSED(started);
+		return timer.nsecsElapsed();
+	}
+
+	/**
+	 * @return Returns the processor time used by all the threads of the process, in nanoseconds
+	 */
+	inline qint64 cpu()
+	{
+		return static_cast<qint64>(std::clock()) * (Q_INT64_C(1000000000) / CLOCKS_PER_SEC);
+	}
+}
+
+#endif
@@ -0,0 +1,251 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include "benchrunner.h"
+#include "benchclock.h"
+#include "allocationcounter.h"
+#include "benchservice.h"
+#include <Server>
+#include <Message>
+#include <QThread>
+#include <QEventLoop>
+#include <QTimer>
+#include <QtAlgorithms>
+
+using namespace QtRpc;
+
+BenchRunner::BenchRunner(Server* server, int timeout, QObject *parent)
+		: QObject(parent),
+		m_server(server),
+		m_timeout(timeout),
+		m_pending(0),
+		m_ok(true),
+		m_loop(0)
+{
+}
+
+BenchRunner::~BenchRunner()
+{
+}
+
+/**
+ * @return Returns the names of the values in the results of run(), in the order they should be reported
+ */
+QStringList BenchRunner::fields()
+{
+	return QStringList() << "transport" << "style" << "payload" << "concurrency" << "services" << "pool" << "calls" << "errors" << "setup_seconds" << "seconds" << "calls_per_second" << "p50_us" << "p99_us" << "p999_us" << "max_us" << "allocations_per_call" << "bytes_per_call" << "cpu_us_per_call" << "cancelled_percent" << "freelist" << "error";
+}
+
+/**
+ * Runs a scenario
+ * @param options The scenario
+ * @return Returns the results, with the names returned by fields()
+ */
+QVariantMap BenchRunner::run(const BenchOptions& options)
+{
+	QVariantMap result;
+	result["transport"] = options.transport;
+	result["style"] = options.style;
+	result["payload"] = options.payload;
+	result["concurrency"] = options.concurrency;
+	result["services"] = options.services;
+	result["pool"] = options.pool;
+	result["freelist"] = qgetenv("QTRPC_FREELIST") == "0" ? "off" : "on";
+
+	// Also drops the instances pooled by the previous scenario
+	m_server->setServicePoolSize("Bench", options.pool);
+
+	QList<QThread*> threads;
+	QList<BenchWorker*> workers;
+	for (int i = 0; i < options.concurrency; i++)
+	{
+		QThread* thread = new QThread();
+		BenchWorker* worker = new BenchWorker(options);
+		worker->moveToThread(thread);
+		QObject::connect(worker, SIGNAL(prepared(bool)), this, SLOT(workerPrepared(bool)), Qt::QueuedConnection);
+		QObject::connect(worker, SIGNAL(finished()), this, SLOT(workerFinished()), Qt::QueuedConnection);
+		thread->start();
+		threads << thread;
+		workers << worker;
+	}
+
+	// Connecting and getting the sub services is timed on its own
+	qint64 setup = BenchClock::now();
+	m_pending = workers.count();
+	m_ok = true;
+	foreach(BenchWorker* worker, workers)
+	{
+		QMetaObject::invokeMethod(worker, "prepare", Qt::QueuedConnection);
+	}
+	bool ok = wait() && m_ok;
+	setup = BenchClock::now() - setup;
+
+	quint64 stopped = BenchService::stoppedCalls();
+	quint64 allocations = AllocationCounter::count();
+	qint64 start = BenchClock::now();
+	qint64 stop = start;
+	qint64 cpu = BenchClock::cpu();
+	if (ok)
+	{
+		m_pending = workers.count();
+		foreach(BenchWorker* worker, workers)
+		{
+			QMetaObject::invokeMethod(worker, "run", Qt::QueuedConnection);
+		}
+		if (options.style == "broadcast")
+		{
+			QByteArray payload(options.payload, 'x');
+			for (int i = 0; i < options.calls; i++)
+				m_server->broadcastEvent("Bench", Signature("benchEvent(qint64, QByteArray)"), Arguments() << BenchClock::now() << payload);
+		}
+		if (!wait())
+			result["error"] = "Timed out";
+		stop = BenchClock::now();
+	}
+	allocations = AllocationCounter::count() - allocations;
+	cpu = BenchClock::cpu() - cpu;
+
+	QVector<qint64> latencies;
+	int errors = 0;
+	foreach(BenchWorker* worker, workers)
+	{
+		latencies += worker->latencies();
+		errors += worker->errors();
+		if (!worker->error().isEmpty() && !result.contains("error"))
+			result["error"] = worker->error();
+	}
+
+	for (int i = 0; i < workers.count(); i++)
+	{
+		QMetaObject::invokeMethod(workers[i], "cleanup", Qt::BlockingQueuedConnection);
+		threads[i]->quit();
+		threads[i]->wait();
+		delete workers[i];
+		delete threads[i];
+	}
+
+	qSort(latencies);
+	int calls = latencies.count();
+	double seconds = (stop - start) / 1e9;
+	result["calls"] = calls;
+	result["errors"] = errors;
+	result["setup_seconds"] = setup / 1e9;
+	result["seconds"] = seconds;
+	result["calls_per_second"] = seconds > 0 ? calls / seconds : 0.0;
+	result["p50_us"] = calls ? latencies[(calls - 1) * 50 / 100] / 1e3 : 0.0;
+	result["p99_us"] = calls ? latencies[(calls - 1) * 99 / 100] / 1e3 : 0.0;
+	result["p999_us"] = calls ? latencies[static_cast<int>((calls - 1) * 999LL / 1000)] / 1e3 : 0.0;
+	result["max_us"] = calls ? latencies.last() / 1e3 : 0.0;
+	result["allocations_per_call"] = calls ? static_cast<double>(allocations) / calls : 0.0;
+	result["bytes_per_call"] = bytesPerCall(options);
+	// An event is sent to every connection, with event it is encoded for each of them, with broadcast once
+	int sent = (options.style == "event" || options.style == "broadcast") ? options.calls : calls;
+	result["cpu_us_per_call"] = sent ? cpu / 1e3 / sent : 0.0;
+	// The share of the cancelled calls the service stopped working on
+	qint64 issued = static_cast<qint64>(options.calls) * options.concurrency;
+	result["cancelled_percent"] = options.style == "cancel" && issued > 0 ? 100.0 * (BenchService::stoppedCalls() - stopped) / issued : 0.0;
+	if (!result.contains("error"))
+		result["error"] = QString();
+	return result;
+}
+
+void BenchRunner::workerPrepared(bool ok)
+{
+	if (!ok)
+		m_ok = false;
+	workerFinished();
+}
+
+void BenchRunner::workerFinished()
+{
+	if (--m_pending <= 0 && m_loop)
+		m_loop->quit();
+}
+
+/**
+ * Runs the event loop until every worker has reported back, or the timeout expires
+ * @return Returns false if the timeout expired
+ */
+bool BenchRunner::wait()
+{
+	if (m_pending <= 0)
+		return true;
+	QEventLoop loop;
+	QTimer timer;
+	timer.setSingleShot(true);
+	QObject::connect(&timer, SIGNAL(timeout()), &loop, SLOT(quit()));
+	timer.start(m_timeout * 1000);
+	m_loop = &loop;
+	loop.exec();
+	m_loop = 0;
+	return m_pending <= 0;
+}
+
+/**
+ * Computes the bytes sent over the connection for one call of the scenario, from the frames of the messages, with the current protocol version
+ */
+qint64 BenchRunner::bytesPerCall(const BenchOptions& options)
+{
+	QByteArray payload(options.payload, 'x');
+	Message function(0, Message::Function, Signature("echo(QByteArray)"), Arguments() << payload, 1);
+	Message reply(1, ReturnValue(payload));
+	Message event(0, Message::Event, Signature("benchEvent(qint64, QByteArray)"), Arguments() << BenchClock::now() << payload, 1);
+	Message sum(0, Message::Function, Signature("sum(int, int, int, int, int, QString)"), Arguments() << 1 << 2 << 3 << 4 << 5 << QString("bench"), 1);
+	Message sumReply(1, ReturnValue(20));
+	QList<Message> messages;
+	if (options.style == "sync" || options.style == "async")
+		messages << function << reply;
+	else if (options.style == "callback")
+		messages << function << reply << function << reply;
+	else if (options.style == "event" || options.style == "broadcast")
+		messages << event;
+	else if (options.style == "args" || options.style == "typed")
+	{
+		if (options.style == "typed")
+		{
+			QByteArray packed;
+			QDataStream out(&packed, QIODevice::WriteOnly);
+			out << 1 << 2 << 3 << 4 << 5 << QString("bench");
+			sum.setPackedArguments(packed);
+		}
+		messages << sum << sumReply;
+	}
+	else
+		return 0;
+
+	qint64 bytes = 0;
+	foreach(Message msg, messages)
+	{
+		msg.setVersion(Message::currentVersion());
+		bytes += msg.frame().size();
+	}
+	return bytes;
+}
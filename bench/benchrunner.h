@@ -0,0 +1,74 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCBENCHRUNNER_H
+#define QTRPCBENCHRUNNER_H
+
+#include <QObject>
+#include <QStringList>
+#include <QVariantMap>
+#include "benchworker.h"
+
+namespace QtRpc
+{
+class Server;
+}
+class QEventLoop;
+
+/**
+	Runs benchmark scenarios against a Server in the same process. Each scenario starts one BenchWorker per connection, waits until all of them are connected, and only measures the calls, not the connecting.
+*/
+class BenchRunner : public QObject
+{
+	Q_OBJECT
+public:
+	BenchRunner(QtRpc::Server* server, int timeout, QObject *parent = 0);
+	~BenchRunner();
+
+	QVariantMap run(const BenchOptions& options);
+	static QStringList fields();
+
+private slots:
+	void workerPrepared(bool ok);
+	void workerFinished();
+
+private:
+	bool wait();
+	static qint64 bytesPerCall(const BenchOptions& options);
+
+	QtRpc::Server* m_server;
+	int m_timeout;
+	int m_pending;
+	bool m_ok;
+	QEventLoop* m_loop;
+};
+
+#endif
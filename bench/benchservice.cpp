@@ -0,0 +1,143 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include "benchservice.h"
+#include "benchclock.h"
+#include <QTimer>
+
+QAtomicInteger<quint64> BenchService::s_stopped(0);
+
+BenchService::BenchService(QObject *parent)
+		: ServiceProxy(parent)
+{
+	QObject::connect(this, SIGNAL(callCancelled(quint32)), this, SLOT(slowEchoCancelled(quint32)));
+}
+
+BenchService::~BenchService()
+{
+}
+
+ReturnValue BenchService::auth(QString user, QString passwd)
+{
+	Q_UNUSED(user);
+	Q_UNUSED(passwd);
+	return(true);
+}
+
+bool BenchService::reset()
+{
+	m_callbacks.clear();
+	qDeleteAll(m_slow);
+	m_slow.clear();
+	return(true);
+}
+
+ReturnValue BenchService::echo(QByteArray data)
+{
+	return(data);
+}
+
+ReturnValue BenchService::sum(int a, int b, int c, int d, int e, QString s)
+{
+	return(a + b + c + d + e + s.size());
+}
+
+/**
+ * Answers by calling a callback on the client, the function returns when the callback does
+ */
+ReturnValue BenchService::pingCallback(QByteArray data)
+{
+	ReturnValue ret = echoCallback(this, SLOT(callbackReturned(uint, ReturnValue)), data);
+	if (ret.isError())
+		return(ret);
+	m_callbacks.insert(ret.toUInt(), currentFunctionId());
+	return(ReturnValue::asyncronous());
+}
+
+void BenchService::callbackReturned(uint id, ReturnValue ret)
+{
+	if (m_callbacks.contains(id))
+		sendReturn(m_callbacks.take(id), ret);
+}
+
+ReturnValue BenchService::emitEvents(int count, QByteArray data)
+{
+	for (int i = 0; i < count; i++)
+		emit benchEvent(BenchClock::now(), data);
+	return(count);
+}
+
+ReturnValue BenchService::subService()
+{
+	return(new BenchService());
+}
+
+/**
+ * @return Returns the number of slowEcho() calls that were stopped because the client cancelled them, in all instances
+ */
+quint64 BenchService::stoppedCalls()
+{
+	return s_stopped.load();
+}
+
+/**
+ * Answers after \a msecs milliseconds, unless the client cancels the call first
+ */
+ReturnValue BenchService::slowEcho(int msecs, QByteArray data)
+{
+	QTimer* timer = new QTimer(this);
+	timer->setSingleShot(true);
+	timer->setProperty("id", currentFunctionId());
+	timer->setProperty("data", data);
+	QObject::connect(timer, SIGNAL(timeout()), this, SLOT(slowEchoDone()));
+	timer->start(msecs);
+	m_slow.insert(currentFunctionId(), timer);
+	return(ReturnValue::asyncronous());
+}
+
+void BenchService::slowEchoDone()
+{
+	QTimer* timer = qobject_cast<QTimer*>(sender());
+	if (timer == 0)
+		return;
+	quint32 id = timer->property("id").toUInt();
+	m_slow.remove(id);
+	sendReturn(id, ReturnValue(timer->property("data")));
+	timer->deleteLater();
+}
+
+void BenchService::slowEchoCancelled(quint32 id)
+{
+	if (!m_slow.contains(id))
+		return;
+	delete m_slow.take(id);
+	s_stopped.fetchAndAddRelaxed(1);
+}
@@ -0,0 +1,278 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#define USE_QTRPC_PRIVATE_API
+#include "benchworker.h"
+#include "benchclient.h"
+#include "benchclock.h"
+#include <ClientMessageBus>
+#include <Message>
+#include <TypedFunction>
+
+BenchWorker::BenchWorker(const BenchOptions& options)
+		: m_options(options),
+		m_client(0),
+		m_bus(0),
+		m_issued(0),
+		m_errors(0),
+		m_done(false)
+{
+	m_latencies.reserve(options.calls);
+}
+
+BenchWorker::~BenchWorker()
+{
+}
+
+/**
+ * @return Returns the latency of every successful call, in nanoseconds
+ */
+const QVector<qint64>& BenchWorker::latencies() const
+{
+	return m_latencies;
+}
+
+int BenchWorker::errors() const
+{
+	return m_errors;
+}
+
+/**
+ * @return Returns the first error, or an empty string
+ */
+QString BenchWorker::error() const
+{
+	return m_error;
+}
+
+/**
+ * Connects to the server and gets everything ready for run(), emits prepared() when done
+ */
+void BenchWorker::prepare()
+{
+	m_payload = QByteArray(m_options.payload, 'x');
+
+	// The test transport has no server, the message bus answers every call itself
+	if (m_options.transport == "test")
+	{
+		m_bus = ClientMessageBus::instance("test");
+		if (!m_bus)
+			m_error = "Failed to create the test message bus";
+		emit prepared(m_bus != 0);
+		return;
+	}
+
+	m_client = new BenchClient();
+	ReturnValue ret = m_client->connect(m_options.url);
+	if (ret.isError())
+	{
+		m_error = ret.errString();
+		emit prepared(false);
+		return;
+	}
+
+	for (int i = 1; i < m_options.services; i++)
+	{
+		ret = m_client->subService();
+		if (ret.isError())
+		{
+			m_error = ret.errString();
+			emit prepared(false);
+			return;
+		}
+		m_services << ret;
+	}
+
+	if (m_options.style == "event" || m_options.style == "broadcast")
+		QObject::connect(m_client, SIGNAL(benchEvent(qint64, QByteArray)), this, SLOT(eventReceived(qint64, QByteArray)));
+	emit prepared(true);
+}
+
+/**
+ * Makes the calls of the scenario, emits finished() when done
+ */
+void BenchWorker::run()
+{
+	if (m_options.style == "async")
+	{
+		for (int i = 0; i < m_options.window && m_issued < m_options.calls; i++)
+			callAsync();
+	}
+	else if (m_options.style == "event")
+	{
+		ReturnValue ret = m_client->emitEvents(m_options.calls, m_payload);
+		if (ret.isError())
+		{
+			m_errors += m_options.calls;
+			if (m_error.isEmpty())
+				m_error = ret.errString();
+			done();
+		}
+	}
+	else if (m_options.style == "broadcast")
+	{
+		// The events are sent by the server
+	}
+	else if (m_options.style == "cancel")
+	{
+		// Long calls, cancelled right after they are made
+		for (int i = 0; i < m_options.calls; i++)
+		{
+			qint64 start = BenchClock::now();
+			ReturnValue ret = m_client->slowEcho(this, SLOT(echoReturned(uint, ReturnValue)), 10000, m_payload);
+			if (!ret.isError() && !m_client->cancel(ret.toUInt()))
+				ret = ReturnValue(1, "The call was answered before it could be cancelled");
+			record(start, ret);
+		}
+		// Messages are handled in order, once this returns the server has seen every cancel
+		ReturnValue ret = m_client->echo(m_payload);
+		if (ret.isError())
+		{
+			m_errors++;
+			if (m_error.isEmpty())
+				m_error = ret.errString();
+		}
+		done();
+	}
+	else
+	{
+		for (int i = 0; i < m_options.calls; i++)
+		{
+			qint64 start = BenchClock::now();
+			record(start, call());
+		}
+		done();
+	}
+}
+
+/**
+ * Disconnects and deletes the connection, this has to run in the thread of the worker
+ */
+void BenchWorker::cleanup()
+{
+	m_services.clear();
+	delete m_client;
+	m_client = 0;
+	if (m_bus)
+		m_bus->deleteLater();
+	m_bus = 0;
+}
+
+/**
+ * Makes one synchronous call of the style of the scenario
+ */
+ReturnValue BenchWorker::call()
+{
+	if (m_bus)
+		return m_bus->callFunction(Message(0, Message::Function, Signature("echo(QByteArray)"), Arguments() << m_payload, 1));
+
+	if (m_options.style == "callback")
+		return m_client->pingCallback(m_payload);
+	if (m_options.style == "args")
+		return m_client->sum(1, 2, 3, 4, 5, "bench");
+	if (m_options.style == "typed")
+	{
+#ifdef Q_COMPILER_VARIADIC_TEMPLATES
+		static const TypedFunction<int, int, int, int, int, QString> sum("sum");
+		return sum(*m_client, 1, 2, 3, 4, 5, QString("bench"));
+#else
+		return ReturnValue(1, "Typed functions need a compiler with variadic templates");
+#endif
+	}
+	if (m_options.style == "select")
+	{
+		ReturnValue ret = m_client->deselectService();
+		if (ret.isError())
+			return ret;
+		return m_client->selectService("Bench");
+	}
+	return m_client->echo(m_payload);
+}
+
+void BenchWorker::callAsync()
+{
+	m_issued++;
+	qint64 start = BenchClock::now();
+	ReturnValue ret;
+	if (m_bus)
+		ret = m_bus->callFunction(this, Signature("echoReturned(uint, ReturnValue)"), Message(0, Message::Function, Signature("echo(QByteArray)"), Arguments() << m_payload, 1));
+	else
+		ret = m_client->echo(this, SLOT(echoReturned(uint, ReturnValue)), m_payload);
+	if (ret.isError())
+	{
+		record(start, ret);
+		if (m_latencies.count() + m_errors >= m_options.calls)
+			done();
+		return;
+	}
+	m_outstanding.insert(ret.toUInt(), start);
+}
+
+void BenchWorker::echoReturned(uint id, ReturnValue ret)
+{
+	if (!m_outstanding.contains(id))
+		return;
+	record(m_outstanding.take(id), ret);
+	if (m_issued < m_options.calls)
+		callAsync();
+	else if (m_outstanding.isEmpty())
+		done();
+}
+
+void BenchWorker::eventReceived(qint64 sent, QByteArray data)
+{
+	Q_UNUSED(data);
+	if (m_done)
+		return;
+	m_latencies << BenchClock::now() - sent;
+	if (m_latencies.count() >= m_options.calls)
+		done();
+}
+
+void BenchWorker::record(qint64 start, const ReturnValue& ret)
+{
+	if (ret.isError())
+	{
+		m_errors++;
+		if (m_error.isEmpty())
+			m_error = ret.errString();
+		return;
+	}
+	m_latencies << BenchClock::now() - start;
+}
+
+void BenchWorker::done()
+{
+	if (m_done)
+		return;
+	m_done = true;
+	emit finished();
+}
@@ -0,0 +1,108 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCBENCHWORKER_H
+#define QTRPCBENCHWORKER_H
+
+#include <QObject>
+#include <QHash>
+#include <QVector>
+#include <ReturnValue>
+
+namespace QtRpc
+{
+class ClientMessageBus;
+}
+class BenchClient;
+
+/**
+	The parameters of one benchmark scenario
+*/
+struct BenchOptions
+{
+	QString transport;	/**< tcp, tcps, socket or test */
+	QString style;		/**< sync, async, callback, event, broadcast, args, typed, select or cancel */
+	QString url;		/**< The url of the Bench service for the transport */
+	int payload;		/**< The size of the QByteArray sent with each call or event */
+	int concurrency;	/**< The number of connections, each one has its own thread */
+	int calls;		/**< The number of calls or events for each connection */
+	int services;		/**< The number of services each connection holds */
+	int window;		/**< The number of asynchronous calls each connection keeps in flight */
+	int pool;		/**< The pool size of the Bench service, see Server::setServicePoolSize() */
+};
+
+/**
+	One connection of a benchmark scenario. A worker lives in its own thread, it connects in prepare(), makes its calls in run(), and records the latency of every call.
+*/
+class BenchWorker : public QObject
+{
+	Q_OBJECT
+public:
+	BenchWorker(const BenchOptions& options);
+	~BenchWorker();
+
+	const QVector<qint64>& latencies() const;
+	int errors() const;
+	QString error() const;
+
+public slots:
+	void prepare();
+	void run();
+	void cleanup();
+
+signals:
+	void prepared(bool ok);
+	void finished();
+
+private slots:
+	void echoReturned(uint id, ReturnValue ret);
+	void eventReceived(qint64 sent, QByteArray data);
+
+private:
+	ReturnValue call();
+	void callAsync();
+	void record(qint64 start, const ReturnValue& ret);
+	void done();
+
+	BenchOptions m_options;
+	BenchClient* m_client;
+	QtRpc::ClientMessageBus* m_bus;
+	QList<ReturnValue> m_services;
+	QByteArray m_payload;
+	QHash<uint, qint64> m_outstanding;
+	QVector<qint64> m_latencies;
+	int m_issued;
+	int m_errors;
+	QString m_error;
+	bool m_done;
+};
+
+#endif
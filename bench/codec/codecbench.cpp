@@ -0,0 +1,313 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include "codecbench.h"
+#include "../allocationcounter.h"
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <AuthToken>
+#include <ReturnValue>
+#include <Signature>
+#include <QtAlgorithms>
+
+using namespace QtRpc;
+
+// Operations are timed in batches, so reading the clock doesn't count
+static const int BatchSize = 64;
+
+// Keeps the compiler from dropping the encoded and decoded values
+static volatile int sink;
+
+/**
+ * @param minTime The time each round of an operation runs for at least, in milliseconds
+ * @param rounds The number of rounds
+ */
+CodecBench::CodecBench(int minTime, int rounds)
+		: m_minTime(qMax(minTime, 1)),
+		m_rounds(qMax(rounds, 1))
+{
+}
+
+/**
+ * @return Returns the kinds of messages runMessage() can encode
+ */
+QStringList CodecBench::kinds()
+{
+	return QStringList() << "function" << "event" << "return";
+}
+
+/**
+ * @return Returns the values runValue() can encode
+ */
+QStringList CodecBench::targets()
+{
+	return QStringList() << "signature" << "returnvalue" << "error" << "authtoken";
+}
+
+/**
+ * @return Returns the argument shapes
+ */
+QStringList CodecBench::shapes()
+{
+	return QStringList() << "empty" << "int" << "ints" << "string" << "bytes" << "list" << "map";
+}
+
+/**
+ * Builds the arguments of a shape
+ * @param shape The name of the shape, see shapes()
+ * @return Returns the arguments
+ */
+Arguments CodecBench::arguments(const QString& shape)
+{
+	Arguments args;
+	if (shape == "int")
+	{
+		args << 42;
+	}
+	else if (shape == "ints")
+	{
+		args << 1 << 2 << 3 << 4 << 5 << 6 << 7 << 8;
+	}
+	else if (shape == "string")
+	{
+		args << QString("The quick brown fox jumps over the lazy dog");
+	}
+	else if (shape == "bytes")
+	{
+		args << QByteArray(4096, 'x');
+	}
+	else if (shape == "list")
+	{
+		QVariantList list;
+		for (int i = 0; i < 100; ++i)
+			list << i;
+		args << QVariant(list);
+	}
+	else if (shape == "map")
+	{
+		QVariantMap map;
+		for (int i = 0; i < 20; ++i)
+		{
+			QVariantMap row;
+			row["id"] = i;
+			row["name"] = QString("row %1").arg(i);
+			row["enabled"] = (i % 2 == 0);
+			map[QString("key%1").arg(i)] = row;
+		}
+		args << QVariant(map);
+	}
+	return args;
+}
+
+/**
+ * @return Returns the names of the values in the results, in the order they should be reported
+ */
+QStringList CodecBench::fields()
+{
+	return QStringList() << "target" << "version" << "kind" << "shape" << "bytes" << "encode_ns" << "encode_min_ns" << "encode_allocations" << "decode_ns" << "decode_min_ns" << "decode_allocations" << "error";
+}
+
+template<typename Operation>
+void CodecBench::measure(QVariantMap& result, const QString& prefix, const Operation& operation)
+{
+	for (int i = 0; i < BatchSize; ++i)
+		operation();
+
+	QList<double> rounds;
+	quint64 allocations = 0;
+	quint64 operations = 0;
+	QElapsedTimer timer;
+	for (int round = 0; round < m_rounds; ++round)
+	{
+		qint64 ops = 0;
+		quint64 before = AllocationCounter::count();
+		timer.start();
+		do
+		{
+			for (int i = 0; i < BatchSize; ++i)
+				operation();
+			ops += BatchSize;
+		}
+		while (timer.elapsed() < m_minTime);
+		qint64 elapsed = timer.nsecsElapsed();
+		allocations += AllocationCounter::count() - before;
+		operations += ops;
+		rounds << double(elapsed) / ops;
+	}
+	qSort(rounds);
+	result[prefix + "_ns"] = rounds.at(rounds.count() / 2);
+	result[prefix + "_min_ns"] = rounds.first();
+	result[prefix + "_allocations"] = double(allocations) / operations;
+}
+
+/**
+ * Measures a Message
+ * @param version The protocol version to encode the message with
+ * @param kind The kind of message, see kinds()
+ * @param shape The arguments, or return value, of the message
+ * @return Returns the results, with the names returned by fields()
+ */
+QVariantMap CodecBench::runMessage(quint32 version, const QString& kind, const QString& shape)
+{
+	QVariantMap result;
+	result["target"] = "message";
+	result["version"] = version;
+	result["kind"] = kind;
+	result["shape"] = shape;
+
+	Arguments args = arguments(shape);
+	Message msg;
+	if (kind == "function")
+	{
+		msg = Message(1234, Message::Function, Signature("call(QVariantList)"), args, 1);
+		msg.setTimeout(30000);
+	}
+	else if (kind == "event")
+		msg = Message(0, Message::Event, Signature("changed(QVariantList)"), args, 1);
+	else if (kind == "return")
+		msg = Message(1234, ReturnValue(args.isEmpty() ? QVariant() : args.first()));
+	else
+	{
+		result["error"] = "Unknown kind";
+		return result;
+	}
+	msg.setVersion(version);
+
+	QByteArray encoded;
+	{
+		QDataStream out(&encoded, QIODevice::WriteOnly);
+		out << msg;
+	}
+	result["bytes"] = encoded.size();
+
+	measure(result, "encode", [&msg]()
+	{
+		QByteArray ba;
+		QDataStream out(&ba, QIODevice::WriteOnly);
+		out << msg;
+		sink += ba.size();
+	});
+	measure(result, "decode", [&encoded, version]()
+	{
+		QDataStream in(encoded);
+		Message decoded;
+		decoded.setVersion(version);
+		in >> decoded;
+		sink += decoded.id();
+	});
+	return result;
+}
+
+/**
+ * Measures one of the values messages are made of
+ * @param target The value, see targets()
+ * @param shape The arguments held by the value
+ * @return Returns the results, with the names returned by fields()
+ */
+QVariantMap CodecBench::runValue(const QString& target, const QString& shape)
+{
+	QVariantMap result;
+	result["target"] = target;
+	result["shape"] = shape;
+	Arguments args = arguments(shape);
+
+	QByteArray encoded;
+	QDataStream out(&encoded, QIODevice::WriteOnly);
+	if (target == "signature")
+	{
+		QStringList types;
+		foreach(const QVariant& arg, args)
+			types << arg.typeName();
+		Signature sig(QString("call(%1)").arg(types.join(",")));
+		out << sig;
+		measure(result, "encode", [&sig]()
+		{
+			QByteArray ba;
+			QDataStream out(&ba, QIODevice::WriteOnly);
+			out << sig;
+			sink += ba.size();
+		});
+		measure(result, "decode", [&encoded]()
+		{
+			QDataStream in(encoded);
+			Signature decoded;
+			in >> decoded;
+			sink += decoded.numArgs();
+		});
+	}
+	else if (target == "returnvalue" || target == "error")
+	{
+		ReturnValue ret = target == "error" ? ReturnValue(1, "The function failed") : ReturnValue(QVariant(args));
+		out << ret;
+		measure(result, "encode", [&ret]()
+		{
+			QByteArray ba;
+			QDataStream out(&ba, QIODevice::WriteOnly);
+			out << ret;
+			sink += ba.size();
+		});
+		measure(result, "decode", [&encoded]()
+		{
+			QDataStream in(encoded);
+			ReturnValue decoded;
+			in >> decoded;
+			sink += decoded.isError();
+		});
+	}
+	else if (target == "authtoken")
+	{
+		AuthToken token("user", "password");
+		for (int i = 0; i < args.count(); ++i)
+			token.clientInsert(QString("arg%1").arg(i), args.at(i));
+		out << token;
+		measure(result, "encode", [&token]()
+		{
+			QByteArray ba;
+			QDataStream out(&ba, QIODevice::WriteOnly);
+			out << token;
+			sink += ba.size();
+		});
+		measure(result, "decode", [&encoded]()
+		{
+			QDataStream in(encoded);
+			AuthToken decoded;
+			in >> decoded;
+			sink += decoded.clientConstData().count();
+		});
+	}
+	else
+	{
+		result["error"] = "Unknown target";
+		return result;
+	}
+	result["bytes"] = encoded.size();
+	return result;
+}
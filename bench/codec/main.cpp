@@ -0,0 +1,146 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QTextStream>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDebug>
+#include <Message>
+#include "codecbench.h"
+
+using namespace QtRpc;
+
+static QString csvValue(const QVariant& value)
+{
+	QString str = value.toString();
+	if (str.contains(',') || str.contains('"'))
+		str = '"' + str.replace("\"", "\"\"") + '"';
+	return str;
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	app.setApplicationName("qtrpc2-codecbench");
+
+	QStringList versions;
+	for (quint32 i = 0; i <= Message::currentVersion(); ++i)
+		versions << QString::number(i);
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Measures the time and allocations of encoding and decoding messages, and the values they are made of, for every combination of the lists given.");
+	parser.addHelpOption();
+	parser.addOption(QCommandLineOption("versions", "Protocol versions to encode messages with.", "list", versions.join(",")));
+	parser.addOption(QCommandLineOption("kinds", "Kinds of messages: " + CodecBench::kinds().join(", ") + ".", "list", CodecBench::kinds().join(",")));
+	parser.addOption(QCommandLineOption("targets", "Values measured on their own: " + CodecBench::targets().join(", ") + ".", "list", CodecBench::targets().join(",")));
+	parser.addOption(QCommandLineOption("shapes", "Argument shapes: " + CodecBench::shapes().join(", ") + ".", "list", CodecBench::shapes().join(",")));
+	parser.addOption(QCommandLineOption("time", "Milliseconds each round of an operation runs for.", "msecs", "50"));
+	parser.addOption(QCommandLineOption("rounds", "Rounds of each operation, the median is reported.", "count", "5"));
+	parser.addOption(QCommandLineOption("format", "Output format, json or csv.", "format", "json"));
+	parser.addOption(QCommandLineOption("output", "Write the results to a file instead of stdout.", "file"));
+	parser.process(app);
+
+	CodecBench bench(parser.value("time").toInt(), parser.value("rounds").toInt());
+	QStringList shapes = parser.value("shapes").split(',', QString::SkipEmptyParts);
+	QList<QVariantMap> results;
+	foreach(QString version, parser.value("versions").split(',', QString::SkipEmptyParts))
+	{
+		if (version.toUInt() > Message::currentVersion())
+		{
+			qWarning() << "Unknown protocol version" << version;
+			continue;
+		}
+		foreach(QString kind, parser.value("kinds").split(',', QString::SkipEmptyParts))
+		{
+			foreach(QString shape, shapes)
+			{
+				QVariantMap result = bench.runMessage(version.toUInt(), kind, shape);
+				qDebug() << "message" << version << kind << shape << result["encode_ns"].toDouble() << "ns encode" << result["decode_ns"].toDouble() << "ns decode" << result["error"].toString();
+				results << result;
+			}
+		}
+	}
+	foreach(QString target, parser.value("targets").split(',', QString::SkipEmptyParts))
+	{
+		foreach(QString shape, shapes)
+		{
+			QVariantMap result = bench.runValue(target, shape);
+			qDebug() << target << shape << result["encode_ns"].toDouble() << "ns encode" << result["decode_ns"].toDouble() << "ns decode" << result["error"].toString();
+			results << result;
+		}
+	}
+
+	QFile file;
+	if (parser.isSet("output"))
+	{
+		file.setFileName(parser.value("output"));
+		if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		{
+			qCritical() << "Failed to open" << file.fileName();
+			return(1);
+		}
+	}
+	else
+		file.open(stdout, QIODevice::WriteOnly);
+
+	if (parser.value("format") == "csv")
+	{
+		QTextStream out(&file);
+		QStringList fields = CodecBench::fields();
+		out << fields.join(",") << "\n";
+		foreach(QVariantMap result, results)
+		{
+			QStringList values;
+			foreach(QString field, fields)
+			{
+				values << csvValue(result.value(field));
+			}
+			out << values.join(",") << "\n";
+		}
+	}
+	else
+	{
+		QJsonObject root;
+		root["version"] = static_cast<int>(Message::currentVersion());
+		QJsonArray array;
+		foreach(QVariantMap result, results)
+		{
+			array.append(QJsonObject::fromVariantMap(result));
+		}
+		root["results"] = array;
+		file.write(QJsonDocument(root).toJson());
+	}
+	return(0);
+}
@@ -0,0 +1,227 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QTextStream>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDir>
+#include <QDebug>
+#include <Server>
+#include <Message>
+#include <ServerProtocolListenerTcp>
+#ifndef Q_OS_WIN32
+#include <ServerProtocolListenerSocket>
+#endif
+#include "benchservice.h"
+#include "benchrunner.h"
+#include "benchclock.h"
+
+using namespace QtRpc;
+
+static QList<int> toIntList(const QString& value)
+{
+	QList<int> list;
+	foreach(QString item, value.split(',', QString::SkipEmptyParts))
+	{
+		list << item.trimmed().toInt();
+	}
+	return list;
+}
+
+static QString csvValue(const QVariant& value)
+{
+	QString str = value.toString();
+	if (str.contains(',') || str.contains('"'))
+		str = '"' + str.replace("\"", "\"\"") + '"';
+	return str;
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	app.setApplicationName("qtrpc2-bench");
+	BenchClock::now();
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Measures the throughput, latency, allocations and wire size of QtRpc2 calls. The server runs in the same process, every combination of the lists given is run.");
+	parser.addHelpOption();
+	parser.addOption(QCommandLineOption("transport", "Transports: tcp, tcps, socket and test. test is the client stack alone, answered by the message bus.", "list", "tcp,socket,test"));
+	parser.addOption(QCommandLineOption("style", "Call styles: sync, async, callback, event, broadcast, args, typed, select and cancel. cancel makes long calls and cancels them right away, cancelled_percent is the share the service stopped working on.", "list", "sync,async,callback,event,broadcast,args,typed,select,cancel"));
+	parser.addOption(QCommandLineOption("payload", "Payload sizes in bytes.", "list", "16,1024,65536"));
+	parser.addOption(QCommandLineOption("concurrency", "Numbers of concurrent connections.", "list", "1,8"));
+	parser.addOption(QCommandLineOption("services", "Numbers of services held by each connection. setup_seconds is the time it took to get them.", "list", "1"));
+	parser.addOption(QCommandLineOption("calls", "Calls or events per scenario, divided between the connections.", "count", "2000"));
+	parser.addOption(QCommandLineOption("window", "Asynchronous calls kept in flight by each connection.", "count", "16"));
+	parser.addOption(QCommandLineOption("pool", "Pool sizes of the service, see Server::setServicePoolSize(). The select style shows what pooling saves.", "list", "0"));
+	parser.addOption(QCommandLineOption("threads", "Number of server threads, -1 for the default.", "count", "-1"));
+	parser.addOption(QCommandLineOption("cert", "Certificate for the tcps transport.", "file"));
+	parser.addOption(QCommandLineOption("timeout", "Seconds to wait for a scenario before giving up.", "seconds", "60"));
+	parser.addOption(QCommandLineOption("freelist", "Turns the free lists the library recycles message objects with on or off, to compare allocations_per_call and latency with and without them.", "on|off", "on"));
+	parser.addOption(QCommandLineOption("format", "Output format, json or csv.", "format", "json"));
+	parser.addOption(QCommandLineOption("output", "Write the results to a file instead of stdout.", "file"));
+	parser.process(app);
+
+	// Read by the library before the first message is created
+	if (parser.value("freelist") == "off")
+		qputenv("QTRPC_FREELIST", "0");
+
+	Server srv(0, Server::ThreadPool, parser.value("threads").toInt());
+	srv.registerService<BenchService>("Bench");
+
+	ServerProtocolListenerTcp tcp(&srv);
+	if (!tcp.listen(QHostAddress::LocalHost, 0))
+	{
+		qCritical() << "Failed to listen on tcp:" << tcp.errorString();
+		return(1);
+	}
+
+	ServerProtocolListenerTcp tcps(&srv);
+	if (parser.isSet("cert"))
+	{
+		tcps.setSslMode(ServerProtocolListenerTcp::SslForced);
+		tcps.setCertificate(parser.value("cert"));
+		if (!tcps.listen(QHostAddress::LocalHost, 0))
+		{
+			qCritical() << "Failed to listen on tcps:" << tcps.errorString();
+			return(1);
+		}
+	}
+
+	QString socketPath = QDir::temp().filePath(QString("qtrpc2-bench-%1").arg(QCoreApplication::applicationPid()));
+#ifndef Q_OS_WIN32
+	ServerProtocolListenerSocket socket(&srv);
+	ReturnValue ret = socket.listen(socketPath);
+	if (ret.isError())
+	{
+		qCritical() << "Failed to listen on socket:" << ret;
+		return(1);
+	}
+#endif
+
+	QHash<QString, QString> urls;
+	urls["tcp"] = QString("tcp://127.0.0.1:%1/Bench").arg(tcp.serverPort());
+	urls["tcps"] = QString("tcps://127.0.0.1:%1/Bench").arg(tcps.serverPort());
+	urls["socket"] = QString("socket://%1:Bench").arg(socketPath);
+	urls["test"] = "test://localhost";
+
+	BenchRunner runner(&srv, parser.value("timeout").toInt());
+	QList<QVariantMap> results;
+	foreach(QString transport, parser.value("transport").split(',', QString::SkipEmptyParts))
+	{
+		if (!urls.contains(transport))
+		{
+			qWarning() << "Unknown transport" << transport;
+			continue;
+		}
+		if (transport == "tcps" && !parser.isSet("cert"))
+		{
+			qWarning() << "Skipping tcps, it needs a certificate (--cert)";
+			continue;
+		}
+		foreach(QString style, parser.value("style").split(',', QString::SkipEmptyParts))
+		{
+			// The test transport has no server, it can only answer plain calls
+			if (transport == "test" && style != "sync" && style != "async")
+				continue;
+			foreach(int payload, toIntList(parser.value("payload")))
+			{
+				foreach(int concurrency, toIntList(parser.value("concurrency")))
+				{
+					foreach(int services, toIntList(parser.value("services")))
+					{
+						foreach(int pool, toIntList(parser.value("pool")))
+						{
+							BenchOptions options;
+							options.transport = transport;
+							options.style = style;
+							options.url = urls[transport];
+							options.payload = payload;
+							options.concurrency = qMax(concurrency, 1);
+							options.calls = qMax(parser.value("calls").toInt() / options.concurrency, 1);
+							options.services = qMax(services, 1);
+							options.window = qMax(parser.value("window").toInt(), 1);
+							options.pool = qMax(pool, 0);
+							QVariantMap result = runner.run(options);
+							qDebug() << transport << style << payload << concurrency << services << pool << result["calls_per_second"].toDouble() << "calls/s" << result["error"].toString();
+							results << result;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	QFile file;
+	if (parser.isSet("output"))
+	{
+		file.setFileName(parser.value("output"));
+		if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		{
+			qCritical() << "Failed to open" << file.fileName();
+			return(1);
+		}
+	}
+	else
+		file.open(stdout, QIODevice::WriteOnly);
+
+	if (parser.value("format") == "csv")
+	{
+		QTextStream out(&file);
+		QStringList fields = BenchRunner::fields();
+		out << fields.join(",") << "\n";
+		foreach(QVariantMap result, results)
+		{
+			QStringList values;
+			foreach(QString field, fields)
+			{
+				values << csvValue(result.value(field));
+			}
+			out << values.join(",") << "\n";
+		}
+	}
+	else
+	{
+		QJsonObject root;
+		root["version"] = static_cast<int>(Message::currentVersion());
+		QJsonArray array;
+		foreach(QVariantMap result, results)
+		{
+			array.append(QJsonObject::fromVariantMap(result));
+		}
+		root["results"] = array;
+		file.write(QJsonDocument(root).toJson());
+	}
+	return(0);
+}
@@ -0,0 +1,185 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QDir>
+#include <QDebug>
+#include <Server>
+#include <ServerProtocolListenerTcp>
+#ifndef Q_OS_WIN32
+#include <ServerProtocolListenerSocket>
+#endif
+#include "stormservice.h"
+#include "stormrunner.h"
+#include "../benchclock.h"
+
+using namespace QtRpc;
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	app.setApplicationName("qtrpc2-storm");
+	BenchClock::now();
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Opens and closes connections to a server in the same process for as long as it is told to, and samples the memory, open files and connection counters while it does. Exits with 2 if the counters are not back to where they started once the server settled.");
+	parser.addHelpOption();
+	parser.addOption(QCommandLineOption("transport", "Transports: tcp and socket.", "list", "tcp,socket"));
+	parser.addOption(QCommandLineOption("scenarios", "Scenarios the workers take turns at: " + StormWorker::scenarios().join(", ") + ".", "list", StormWorker::scenarios().join(",")));
+	parser.addOption(QCommandLineOption("workers", "Connecting threads for each transport.", "count", "4"));
+	parser.addOption(QCommandLineOption("rate", "Connections per second for each transport, 0 for as many as possible.", "count", "1000"));
+	parser.addOption(QCommandLineOption("services", "Sub services each subservice connection gets.", "count", "2"));
+	parser.addOption(QCommandLineOption("duration", "Seconds to run for.", "seconds", "60"));
+	parser.addOption(QCommandLineOption("interval", "Seconds between samples.", "seconds", "5"));
+	parser.addOption(QCommandLineOption("settle", "Seconds the server is given to clean up after the workers stop.", "seconds", "5"));
+	parser.addOption(QCommandLineOption("threads", "Number of server threads, -1 for the default.", "count", "-1"));
+	parser.addOption(QCommandLineOption("timeout", "Milliseconds to wait for a plain socket to connect.", "msecs", "5000"));
+	parser.addOption(QCommandLineOption("stalled", "Connections on the socket transport that select the service and never read, while events are broadcast to them.", "count", "0"));
+	parser.addOption(QCommandLineOption("events", "Events per second broadcast to the stalled connections.", "count", "1000"));
+	parser.addOption(QCommandLineOption("event-size", "Size of the broadcast events in bytes.", "bytes", "1024"));
+	parser.addOption(QCommandLineOption("high-water", "Bytes buffered for a client before the slow client policy applies, 0 for no limit.", "bytes", "0"));
+	parser.addOption(QCommandLineOption("policy", "Slow client policy: buffer, drop, coalesce or disconnect.", "policy", "buffer"));
+	parser.addOption(QCommandLineOption("rss-limit", "Fail if the resident memory grows by more than this many kilobytes while running, 0 for no limit.", "kb", "0"));
+	parser.addOption(QCommandLineOption("format", "Output format, json (one sample per line) or csv.", "format", "json"));
+	parser.addOption(QCommandLineOption("output", "Write the samples to a file instead of stdout.", "file"));
+	parser.process(app);
+
+	Server srv(0, Server::ThreadPool, parser.value("threads").toInt());
+	srv.registerService<StormService>("Storm");
+	qint64 highWater = parser.value("high-water").toLongLong();
+	if (highWater > 0)
+		srv.setWriteQueueLimits(highWater / 2, highWater);
+	QString policy = parser.value("policy");
+	if (policy == "drop")
+		srv.setSlowClientPolicy(Server::DropEvents);
+	else if (policy == "coalesce")
+		srv.setSlowClientPolicy(Server::CoalesceEvents);
+	else if (policy == "disconnect")
+		srv.setSlowClientPolicy(Server::DisconnectClient);
+	else if (policy != "buffer")
+		qWarning() << "Unknown slow client policy" << policy;
+
+	ServerProtocolListenerTcp tcp(&srv);
+	if (!tcp.listen(QHostAddress::LocalHost, 0))
+	{
+		qCritical() << "Failed to listen on tcp:" << tcp.errorString();
+		return(1);
+	}
+
+	QString socketPath = QDir::temp().filePath(QString("qtrpc2-storm-%1").arg(QCoreApplication::applicationPid()));
+#ifndef Q_OS_WIN32
+	ServerProtocolListenerSocket socket(&srv);
+	ReturnValue ret = socket.listen(socketPath);
+	if (ret.isError())
+	{
+		qCritical() << "Failed to listen on socket:" << ret;
+		return(1);
+	}
+#endif
+
+	QStringList scenarios;
+	foreach(QString scenario, parser.value("scenarios").split(',', QString::SkipEmptyParts))
+	{
+		if (StormWorker::scenarios().contains(scenario))
+			scenarios << scenario;
+		else
+			qWarning() << "Unknown scenario" << scenario;
+	}
+	if (scenarios.isEmpty())
+	{
+		qCritical() << "No scenarios to run";
+		return(1);
+	}
+
+	int count = qMax(parser.value("workers").toInt(), 1);
+	QList<StormOptions> workers;
+	foreach(QString transport, parser.value("transport").split(',', QString::SkipEmptyParts))
+	{
+		StormOptions options;
+		options.transport = transport;
+		if (transport == "tcp")
+		{
+			options.url = QString("tcp://127.0.0.1:%1/Storm").arg(tcp.serverPort());
+			options.address = QString::number(tcp.serverPort());
+		}
+#ifndef Q_OS_WIN32
+		else if (transport == "socket")
+		{
+			options.url = QString("socket://%1:Storm").arg(socketPath);
+			options.address = socketPath;
+		}
+#endif
+		else
+		{
+			qWarning() << "Unknown transport" << transport;
+			continue;
+		}
+		options.scenarios = scenarios;
+		options.rate = parser.value("rate").toDouble() / count;
+		options.services = qMax(parser.value("services").toInt(), 1);
+		options.timeout = parser.value("timeout").toInt();
+		for (int i = 0; i < count; i++)
+		{
+			// Workers start at different scenarios, so every scenario runs at the same time
+			options.scenarios = scenarios.mid(i % scenarios.count()) + scenarios.mid(0, i % scenarios.count());
+			workers << options;
+		}
+	}
+	if (workers.isEmpty())
+	{
+		qCritical() << "No transports to run";
+		return(1);
+	}
+
+	QFile file;
+	if (parser.isSet("output"))
+	{
+		file.setFileName(parser.value("output"));
+		if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		{
+			qCritical() << "Failed to open" << file.fileName();
+			return(1);
+		}
+	}
+	else
+		file.open(stdout, QIODevice::WriteOnly);
+
+	StormRunner runner(&srv, &file, parser.value("format") == "csv");
+#ifndef Q_OS_WIN32
+	runner.setStalledReaders(socketPath, parser.value("stalled").toInt(), parser.value("events").toInt(), parser.value("event-size").toInt());
+#endif
+	runner.setRssLimit(parser.value("rss-limit").toLongLong());
+	if (!runner.run(workers, parser.value("duration").toInt(), parser.value("interval").toInt(), parser.value("settle").toInt()))
+		return(2);
+	return(0);
+}
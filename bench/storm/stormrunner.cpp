@@ -0,0 +1,402 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include "stormrunner.h"
+#include "../benchclock.h"
+#include <Server>
+#include <Message>
+#include <QLocalSocket>
+#include <QThread>
+#include <QEventLoop>
+#include <QTimer>
+#include <QDir>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDebug>
+#ifndef Q_OS_WIN32
+#include <unistd.h>
+#endif
+
+using namespace QtRpc;
+
+/**
+ * @return Returns the resident memory of the process in kilobytes, or -1 where /proc isn't available
+ */
+static qint64 residentKb()
+{
+#ifndef Q_OS_WIN32
+	QFile file("/proc/self/statm");
+	if (!file.open(QIODevice::ReadOnly))
+		return -1;
+	QList<QByteArray> fields = file.readAll().split(' ');
+	if (fields.count() < 2)
+		return -1;
+	return fields[1].toLongLong() * sysconf(_SC_PAGESIZE) / 1024;
+#else
+	return -1;
+#endif
+}
+
+/**
+ * @return Returns the number of open file descriptors of the process, or -1 where /proc isn't available
+ */
+static int openFiles()
+{
+	QDir dir("/proc/self/fd");
+	if (!dir.exists())
+		return -1;
+	// Sockets and pipes are links to nothing, they are only listed as system files
+	return dir.entryList(QDir::AllEntries | QDir::System | QDir::NoDotAndDotDot).count();
+}
+
+static QString csvValue(const QVariant& value)
+{
+	QString str = value.toString();
+	if (str.contains(',') || str.contains('"'))
+		str = '"' + str.replace("\"", "\"\"") + '"';
+	return str;
+}
+
+StormRunner::StormRunner(Server* server, QIODevice* output, bool csv, QObject *parent)
+		: QObject(parent),
+		m_server(server),
+		m_output(output),
+		m_csv(csv),
+		m_start(0),
+		m_lastConnections(0),
+		m_lastSample(0),
+		m_pending(0),
+		m_loop(0),
+		m_stalledCount(0),
+		m_eventRate(0),
+		m_events(0),
+		m_rssLimit(0),
+		m_rssPeak(0)
+{
+}
+
+StormRunner::~StormRunner()
+{
+}
+
+/**
+ * @return Returns the names of the values of every sample, in the order of the CSV columns
+ */
+QStringList StormRunner::fields()
+{
+	return QStringList() << "phase" << "seconds" << "connections" << "connections_per_second" << "errors" << "rss_kb" << "fds" << "instances" << "service_objects" << "connection_services" << "pending_callbacks" << "broadcast_targets" << "thread_load" << "thread_connections" << "stalled" << "events" << "error";
+}
+
+/**
+ * @return Returns the values that must be back to where they were before the run once the server has settled
+ */
+QStringList StormRunner::leakFields()
+{
+	return QStringList() << "instances" << "service_objects" << "connection_services" << "pending_callbacks" << "broadcast_targets" << "thread_load" << "thread_connections";
+}
+
+/**
+ * Adds connections that select the service and then never read, and broadcasts events to them while the workers run. They are opened on the socket transport before the workers start, and closed when the workers stop.
+ * @param path The path of the socket listener
+ * @param count The number of stalled connections
+ * @param events The number of events broadcast per second
+ * @param payload The size of the events in bytes
+ */
+void StormRunner::setStalledReaders(const QString& path, int count, int events, int payload)
+{
+	m_stalledPath = path;
+	m_stalledCount = count;
+	m_eventRate = events;
+	m_eventPayload = QByteArray(payload, 'x');
+}
+
+/**
+ * Makes run() fail if the resident memory grows by more than \a kb over the baseline while the workers run
+ * @param kb The limit in kilobytes, or 0 for no limit
+ */
+void StormRunner::setRssLimit(qint64 kb)
+{
+	m_rssLimit = kb;
+}
+
+/**
+ * Runs one worker per entry of \a workers, each in its own thread, and writes a sample every \a interval seconds
+ * @param workers The options of each worker
+ * @param duration The number of seconds the workers run for
+ * @param interval The number of seconds between samples
+ * @param settle The number of seconds the server is given to clean up after the workers stopped
+ * @return Returns false if a counter didn't go back to its value before the run
+ */
+bool StormRunner::run(const QList<StormOptions>& workers, int duration, int interval, int settle)
+{
+	m_start = BenchClock::now();
+	m_lastSample = m_start;
+	m_lastConnections = 0;
+	if (m_csv)
+		m_output->write(fields().join(",").toUtf8() + "\n");
+	QVariantMap baseline = snapshot();
+	baseline["phase"] = "baseline";
+	write(baseline);
+	m_rssPeak = baseline["rss_kb"].toLongLong();
+
+	QTimer broadcaster;
+	QObject::connect(&broadcaster, SIGNAL(timeout()), this, SLOT(broadcast()));
+	if (m_stalledCount > 0)
+	{
+		openStalled();
+		if (m_eventRate > 0)
+			broadcaster.start(10);
+	}
+
+	foreach(StormOptions options, workers)
+	{
+		QThread* thread = new QThread();
+		StormWorker* worker = new StormWorker(options);
+		worker->moveToThread(thread);
+		QObject::connect(worker, SIGNAL(finished()), this, SLOT(workerFinished()), Qt::QueuedConnection);
+		thread->start();
+		m_threads << thread;
+		m_workers << worker;
+		QMetaObject::invokeMethod(worker, "start", Qt::QueuedConnection);
+	}
+
+	m_phase = "running";
+	QTimer timer;
+	QObject::connect(&timer, SIGNAL(timeout()), this, SLOT(sample()));
+	timer.start(qMax(interval, 1) * 1000);
+	wait(duration * 1000);
+
+	m_phase = "stopping";
+	broadcaster.stop();
+	closeStalled();
+	m_pending = m_workers.count();
+	foreach(StormWorker* worker, m_workers)
+	{
+		QMetaObject::invokeMethod(worker, "stop", Qt::QueuedConnection);
+	}
+	if (m_pending > 0)
+		wait(60000);
+	if (m_pending > 0)
+		qWarning() << m_pending << "workers did not stop";
+	foreach(QThread* thread, m_threads)
+	{
+		thread->quit();
+		thread->wait();
+	}
+	qint64 stopped = BenchClock::now();
+
+	// Connections are torn down by the server threads after the clients are gone
+	m_phase = "settling";
+	wait(settle * 1000);
+	timer.stop();
+
+	QVariantMap settled = snapshot();
+	settled["phase"] = "settled";
+	settled["connections_per_second"] = stopped > m_start ? settled["connections"].toDouble() / ((stopped - m_start) / 1e9) : 0.0;
+	write(settled);
+
+	bool clean = true;
+	foreach(QString field, leakFields())
+	{
+		if (settled[field] != baseline[field])
+		{
+			qWarning() << "Leaked" << field << "before" << baseline[field].toLongLong() << "after" << settled[field].toLongLong();
+			clean = false;
+		}
+	}
+	if (m_rssLimit > 0 && m_rssPeak - baseline["rss_kb"].toLongLong() > m_rssLimit)
+	{
+		qWarning() << "Resident memory grew by" << m_rssPeak - baseline["rss_kb"].toLongLong() << "kB while running, the limit is" << m_rssLimit << "kB";
+		clean = false;
+	}
+	qDebug() << settled["connections"].toULongLong() << "connections," << settled["errors"].toULongLong() << "errors, resident memory grew by" << settled["rss_kb"].toLongLong() - baseline["rss_kb"].toLongLong() << "kB, open files by" << settled["fds"].toInt() - baseline["fds"].toInt();
+
+	qDeleteAll(m_workers);
+	qDeleteAll(m_threads);
+	m_workers.clear();
+	m_threads.clear();
+	return clean;
+}
+
+void StormRunner::sample()
+{
+	QVariantMap current = snapshot();
+	qint64 now = BenchClock::now();
+	quint64 connections = current["connections"].toULongLong();
+	current["phase"] = m_phase;
+	current["connections_per_second"] = now > m_lastSample ? (connections - m_lastConnections) / ((now - m_lastSample) / 1e9) : 0.0;
+	m_lastSample = now;
+	m_lastConnections = connections;
+	if (m_phase == "running")
+		m_rssPeak = qMax(m_rssPeak, current["rss_kb"].toLongLong());
+	write(current);
+}
+
+/**
+ * Broadcasts the events of one tick, the timer ticks every 10 ms
+ */
+void StormRunner::broadcast()
+{
+	int count = qMax(m_eventRate / 100, 1);
+	for (int i = 0; i < count; i++)
+		m_server->broadcastEvent("Storm", Signature("benchEvent(qint64, QByteArray)"), Arguments() << BenchClock::now() << m_eventPayload);
+	m_events += count;
+}
+
+/**
+ * Opens the stalled connections. Each one negotiates the protocol version and selects the service in one write, and then never reads again.
+ */
+void StormRunner::openStalled()
+{
+	Message version(0, Message::QtRpc, Signature("setProtocolVersion(quint32)"), Arguments() << Message::currentVersion());
+	Message select(1, Message::QtRpc, Signature("selectService(QString,QString,QString)"), Arguments() << QString("Storm") << QString("storm") << QString("storm"));
+	// The server reads the first message with version 0, and the ones after it with the version it agreed to
+	select.setVersion(Message::currentVersion());
+	QByteArray handshake = version.frame() + select.frame();
+	for (int i = 0; i < m_stalledCount; i++)
+	{
+		QLocalSocket* socket = new QLocalSocket(this);
+		// Qt stops reading from the socket once this much is buffered, the rest stays with the server
+		socket->setReadBufferSize(4096);
+		socket->connectToServer(m_stalledPath);
+		if (!socket->waitForConnected(5000))
+		{
+			qWarning() << "Failed to open a stalled connection:" << socket->errorString();
+			delete socket;
+			continue;
+		}
+		socket->write(handshake);
+		socket->waitForBytesWritten(5000);
+		m_stalled << socket;
+	}
+}
+
+void StormRunner::closeStalled()
+{
+	foreach(QLocalSocket* socket, m_stalled)
+	{
+		socket->abort();
+		delete socket;
+	}
+	m_stalled.clear();
+}
+
+void StormRunner::workerFinished()
+{
+	if (--m_pending <= 0 && m_loop)
+		m_loop->quit();
+}
+
+/**
+ * @return Returns the counters of the workers, the process and the server
+ */
+QVariantMap StormRunner::snapshot() const
+{
+	QVariantMap sample;
+	quint64 connections = 0;
+	quint64 errors = 0;
+	QString error;
+	foreach(StormWorker* worker, m_workers)
+	{
+		connections += worker->connections();
+		errors += worker->errors();
+		if (error.isEmpty())
+			error = worker->error();
+	}
+	sample["seconds"] = (BenchClock::now() - m_start) / 1e9;
+	sample["connections"] = connections;
+	sample["connections_per_second"] = 0.0;
+	sample["errors"] = errors;
+	sample["rss_kb"] = residentKb();
+	sample["fds"] = openFiles();
+
+	QVariantMap resources = m_server->resourceStats();
+	sample["instances"] = resources["instances"];
+	sample["service_objects"] = resources["serviceObjects"];
+	sample["connection_services"] = resources["connectionServices"];
+	sample["pending_callbacks"] = resources["pendingCallbacks"];
+	sample["broadcast_targets"] = resources["broadcastTargets"];
+	int load = 0;
+	foreach(QVariant count, resources["threadLoad"].toList())
+		load += count.toInt();
+	sample["thread_load"] = load;
+	int threadConnections = 0;
+	foreach(QVariant thread, m_server->threadStats())
+		threadConnections += thread.toMap().value("connections").toInt();
+	sample["thread_connections"] = threadConnections;
+	int stalled = 0;
+	foreach(QLocalSocket* socket, m_stalled)
+	{
+		if (socket->state() == QLocalSocket::ConnectedState)
+			stalled++;
+	}
+	sample["stalled"] = stalled;
+	sample["events"] = m_events;
+	sample["error"] = error;
+	return sample;
+}
+
+/**
+ * Writes a sample as a CSV row or a line of JSON, and flushes it so long runs can be followed
+ */
+void StormRunner::write(const QVariantMap& sample)
+{
+	if (m_csv)
+	{
+		QStringList values;
+		foreach(QString field, fields())
+		{
+			values << csvValue(sample.value(field));
+		}
+		m_output->write(values.join(",").toUtf8() + "\n");
+	}
+	else
+		m_output->write(QJsonDocument(QJsonObject::fromVariantMap(sample)).toJson(QJsonDocument::Compact) + "\n");
+	QFile* file = qobject_cast<QFile*>(m_output);
+	if (file != 0)
+		file->flush();
+}
+
+/**
+ * Runs the event loop for \a msecs milliseconds, or until every worker that was asked to stop did
+ */
+void StormRunner::wait(int msecs)
+{
+	QEventLoop loop;
+	QTimer timer;
+	timer.setSingleShot(true);
+	QObject::connect(&timer, SIGNAL(timeout()), &loop, SLOT(quit()));
+	timer.start(msecs);
+	m_loop = &loop;
+	loop.exec();
+	m_loop = 0;
+}
@@ -0,0 +1,100 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCSTORMRUNNER_H
+#define QTRPCSTORMRUNNER_H
+
+#include <QObject>
+#include <QStringList>
+#include <QVariantMap>
+#include "stormworker.h"
+
+namespace QtRpc
+{
+class Server;
+}
+class QIODevice;
+class QThread;
+class QEventLoop;
+class QLocalSocket;
+
+/**
+	Runs StormWorkers against a Server in the same process for a given time, and samples the memory, file descriptors and connection counters of the process while they run. Once the workers are stopped and the server had time to clean up, the counters are compared with the ones sampled before the workers started, anything left over was leaked.
+
+	Stalled readers can be added with setStalledReaders(): connections that select the service and then never read, while events are broadcast to them. With a write queue limit and a slow client policy that drops events, the resident memory must stay within the limit given to setRssLimit().
+*/
+class StormRunner : public QObject
+{
+	Q_OBJECT
+public:
+	StormRunner(QtRpc::Server* server, QIODevice* output, bool csv, QObject *parent = 0);
+	~StormRunner();
+
+	void setStalledReaders(const QString& path, int count, int events, int payload);
+	void setRssLimit(qint64 kb);
+	bool run(const QList<StormOptions>& workers, int duration, int interval, int settle);
+	static QStringList fields();
+	static QStringList leakFields();
+
+private slots:
+	void sample();
+	void workerFinished();
+	void broadcast();
+
+private:
+	QVariantMap snapshot() const;
+	void write(const QVariantMap& sample);
+	void wait(int msecs);
+	void openStalled();
+	void closeStalled();
+
+	QtRpc::Server* m_server;
+	QIODevice* m_output;
+	bool m_csv;
+	QString m_phase;
+	QList<StormWorker*> m_workers;
+	QList<QThread*> m_threads;
+	qint64 m_start;
+	quint64 m_lastConnections;
+	qint64 m_lastSample;
+	int m_pending;
+	QEventLoop* m_loop;
+	QString m_stalledPath;
+	int m_stalledCount;
+	int m_eventRate;
+	QByteArray m_eventPayload;
+	QList<QLocalSocket*> m_stalled;
+	quint64 m_events;
+	qint64 m_rssLimit;
+	qint64 m_rssPeak;
+};
+
+#endif
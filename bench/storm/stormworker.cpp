@@ -0,0 +1,245 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include "stormworker.h"
+#include "../benchclient.h"
+#include "../benchclock.h"
+#include <QTimer>
+#include <QTcpSocket>
+#include <QLocalSocket>
+#include <QHostAddress>
+#include <QUrl>
+#include <QMutexLocker>
+#include <Message>
+#include <AuthToken>
+
+StormWorker::StormWorker(const StormOptions& options)
+		: m_options(options),
+		m_timer(0),
+		m_payload(16, 'x'),
+		m_interval(options.rate > 0 ? static_cast<qint64>(1e9 / options.rate) : 0),
+		m_due(0),
+		m_turn(0),
+		m_running(false),
+		m_stopping(false),
+		m_connections(0),
+		m_errors(0)
+{
+	// Half of a call, the server has to throw it away when the connection drops
+	m_frame = Message(1, Message::Function, Signature("echo(QByteArray)"), Arguments() << m_payload, 1).frame();
+	m_frame.truncate(m_frame.size() / 2);
+}
+
+StormWorker::~StormWorker()
+{
+}
+
+/**
+ * @return Returns the names of every scenario
+ */
+QStringList StormWorker::scenarios()
+{
+	return QStringList() << "clean" << "subservice" << "badauth" << "callback" << "abort" << "garbage";
+}
+
+/**
+ * @return Returns the number of connections made so far, this is safe to call from any thread
+ */
+quint64 StormWorker::connections() const
+{
+	return m_connections.load();
+}
+
+/**
+ * @return Returns the number of connections that didn't go as expected, this is safe to call from any thread
+ */
+quint64 StormWorker::errors() const
+{
+	return m_errors.load();
+}
+
+/**
+ * @return Returns the first error, or an empty string
+ */
+QString StormWorker::error() const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_error;
+}
+
+/**
+ * Starts making connections, this must be called in the thread of the worker
+ */
+void StormWorker::start()
+{
+	m_timer = new QTimer(this);
+	m_timer->setSingleShot(true);
+	QObject::connect(m_timer, SIGNAL(timeout()), this, SLOT(cycle()));
+	m_due = BenchClock::now();
+	m_timer->start(0);
+}
+
+/**
+ * Stops after the current connection, emits finished() when done
+ */
+void StormWorker::stop()
+{
+	m_stopping = true;
+	// Synchronous calls run an event loop, the connection being made finishes first
+	if (m_running)
+		return;
+	delete m_timer;
+	m_timer = 0;
+	emit finished();
+}
+
+/**
+ * Makes one connection, and schedules the next one. Returning to the event loop between connections lets the objects that were deleted later go away.
+ */
+void StormWorker::cycle()
+{
+	qint64 now = BenchClock::now();
+	if (m_due > now)
+	{
+		m_timer->start(static_cast<int>((m_due - now) / 1000000));
+		return;
+	}
+	// Don't make up for a stall with a burst
+	m_due = qMax(m_due + m_interval, now - Q_INT64_C(1000000000));
+
+	QString scenario = m_options.scenarios[m_turn++ % m_options.scenarios.count()];
+	m_running = true;
+	ReturnValue ret;
+	if (scenario == "abort" || scenario == "garbage")
+		ret = connectSocket(scenario == "garbage");
+	else
+		ret = connectClient(scenario);
+	m_connections.fetchAndAddRelaxed(1);
+	if (ret.isError())
+	{
+		m_errors.fetchAndAddRelaxed(1);
+		QMutexLocker locker(&m_mutex);
+		if (m_error.isEmpty())
+			m_error = scenario + ": " + ret.errString();
+	}
+	m_running = false;
+	if (m_stopping)
+		stop();
+	else
+		m_timer->start(0);
+}
+
+void StormWorker::callReturned(uint id, ReturnValue ret)
+{
+	Q_UNUSED(id);
+	Q_UNUSED(ret);
+}
+
+/**
+ * Runs a scenario with a ClientProxy
+ * @return Returns an error if the server didn't behave as expected
+ */
+ReturnValue StormWorker::connectClient(const QString& scenario)
+{
+	BenchClient client;
+	ReturnValue ret = client.connect(QUrl(m_options.url), NULL, NULL, AuthToken("storm", scenario == "badauth" ? "wrong" : "storm"));
+	if (scenario == "badauth")
+	{
+		if (!ret.isError())
+			return ReturnValue(1, "The wrong password was accepted");
+		return ReturnValue();
+	}
+	if (ret.isError())
+		return ret;
+
+	if (scenario == "callback")
+	{
+		// The client goes away with the call and its callback in flight
+		return client.pingCallback(this, SLOT(callReturned(uint, ReturnValue)), m_payload);
+	}
+
+	if (scenario == "subservice")
+	{
+		for (int i = 0; i < m_options.services; i++)
+		{
+			ret = client.subService();
+			if (ret.isError())
+				return ret;
+			BenchClient sub;
+			sub = ret;
+			ret = sub.echo(m_payload);
+			if (ret.isError())
+				return ret;
+		}
+	}
+
+	ret = client.echo(m_payload);
+	client.disconnect();
+	if (ret.isError())
+		return ret;
+	return ReturnValue();
+}
+
+/**
+ * Connects to the listener without a ClientProxy, and aborts the connection
+ * @param garbage Writes half of a frame before aborting
+ * @return Returns an error if the connection failed
+ */
+ReturnValue StormWorker::connectSocket(bool garbage)
+{
+	if (m_options.transport == "socket")
+	{
+		QLocalSocket socket;
+		socket.connectToServer(m_options.address);
+		if (!socket.waitForConnected(m_options.timeout))
+			return ReturnValue(1, socket.errorString());
+		if (garbage)
+		{
+			socket.write(m_frame);
+			socket.waitForBytesWritten(m_options.timeout);
+		}
+		socket.abort();
+	}
+	else
+	{
+		QTcpSocket socket;
+		socket.connectToHost(QHostAddress::LocalHost, m_options.address.toUShort());
+		if (!socket.waitForConnected(m_options.timeout))
+			return ReturnValue(1, socket.errorString());
+		if (garbage)
+		{
+			socket.write(m_frame);
+			socket.waitForBytesWritten(m_options.timeout);
+		}
+		socket.abort();
+	}
+	return ReturnValue();
+}
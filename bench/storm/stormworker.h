@@ -0,0 +1,109 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCSTORMWORKER_H
+#define QTRPCSTORMWORKER_H
+
+#include <QObject>
+#include <QAtomicInteger>
+#include <QMutex>
+#include <QStringList>
+#include <ReturnValue>
+
+class QTimer;
+
+/**
+	The parameters of the connections made by one StormWorker
+*/
+struct StormOptions
+{
+	QString transport;	/**< tcp or socket */
+	QString url;		/**< The url of the Storm service for the transport */
+	QString address;	/**< The path of the socket, or the port for tcp */
+	QStringList scenarios;	/**< The scenarios the worker takes turns at */
+	double rate;		/**< Connections per second, 0 for as many as possible */
+	int services;		/**< The number of sub services each subservice connection gets */
+	int timeout;		/**< Milliseconds to wait for a raw socket */
+};
+
+/**
+	Opens and closes connections in its own thread until it is stopped. Each connection runs one of the scenarios, in turn:
+	- clean: authenticates, makes a call and disconnects
+	- subservice: also gets sub services and calls them
+	- badauth: authenticates with the wrong password
+	- callback: starts a call that sends a callback to the client, and drops the connection without waiting for it
+	- abort: connects a plain socket and aborts it before the handshake
+	- garbage: connects a plain socket, writes half of a frame and aborts it
+*/
+class StormWorker : public QObject
+{
+	Q_OBJECT
+public:
+	StormWorker(const StormOptions& options);
+	~StormWorker();
+
+	static QStringList scenarios();
+
+	quint64 connections() const;
+	quint64 errors() const;
+	QString error() const;
+
+public slots:
+	void start();
+	void stop();
+
+signals:
+	void finished();
+
+private slots:
+	void cycle();
+	void callReturned(uint id, ReturnValue ret);
+
+private:
+	ReturnValue connectClient(const QString& scenario);
+	ReturnValue connectSocket(bool garbage);
+
+	StormOptions m_options;
+	QTimer* m_timer;
+	QByteArray m_payload;
+	QByteArray m_frame;
+	qint64 m_interval;
+	qint64 m_due;
+	int m_turn;
+	bool m_running;
+	bool m_stopping;
+	QAtomicInteger<quint64> m_connections;
+	QAtomicInteger<quint64> m_errors;
+	mutable QMutex m_mutex;
+	QString m_error;
+};
+
+#endif
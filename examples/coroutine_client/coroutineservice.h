@@ -0,0 +1,49 @@
+/***************************************************************************
+ *  Copyright (c) 2010, Resara LLC
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Resara LLC nor the
+ *       names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***************************************************************************/
+#ifndef COROUTINESERVICE_H
+#define COROUTINESERVICE_H
+
+#include <ClientProxy>
+
+using namespace QtRpc;
+
+class CoroutineService : public ClientProxy
+{
+    Q_OBJECT
+    QTRPC_CLIENTPROXY(CoroutineService)
+public:
+    explicit CoroutineService(QObject *parent = 0);
+
+    //Asynchronous calls, a QObject * and a const char * at the end of the
+    //arguments. An AsyncCall provides both, so no slot has to be written.
+signals:
+    ReturnValue addNumbers(QObject *object, const char *slot, int a, int b);
+    ReturnValue traceOf(QObject *object, const char *slot, int msecs);
+};
+
+#endif // COROUTINESERVICE_H
@@ -0,0 +1,86 @@
+/***************************************************************************
+ *  Copyright (c) 2010, Resara LLC
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Resara LLC nor the
+ *       names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***************************************************************************/
+#include <QCoreApplication>
+#include <QDebug>
+#include <AsyncCall>
+#include <TraceContext>
+#include <TraceScope>
+#include <QtRpcCoroutine>
+#include "coroutineservice.h"
+
+//A fire and forget coroutine. It runs until the first co_await, then
+//main() carries on into the event loop, and the coroutine continues from
+//the event loop when the reply arrives.
+Task run(CoroutineService *service)
+{
+    AsyncCall sum;
+    sum.submit(service->addNumbers(sum.receiver(), sum.slot(), 2, 3));
+    //The AsyncCall must outlive the call, here it lives in the coroutine
+    ReturnValue ret = co_await sum;
+    if(ret.isError())
+        qCritical() << "Failed to call addNumbers():" << ret;
+    else
+        qDebug() << "addNumbers() returned" << ret;
+
+    //Start a trace for the next call. The scope is closed before the
+    //co_await, so the trace does not stay current while the coroutine waits.
+    TraceContext trace = TraceContext::root();
+    AsyncCall traced;
+    {
+        TraceScope scope(trace);
+        traced.submit(service->traceOf(traced.receiver(), traced.slot(), 500));
+    }
+    ret = co_await traced;
+    if(ret.isError())
+        qCritical() << "Failed to call traceOf():" << ret;
+    else
+        qDebug() << "Started trace" << trace.traceIdString() << ", the server saw" << ret;
+
+    QCoreApplication::quit();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc,argv);
+
+    //Create an instance of the service object
+    CoroutineService service;
+
+    //Connect to the server, specifying the port, and the remote service to connect to
+    ReturnValue ret = service.connect("tcp://localhost:10123/MyService");
+    if(ret.isError())
+    {
+        qCritical() << "Failed to connect:" << ret;
+        return(1);
+    }
+
+    run(&service);
+
+    //An event loop is needed for asynchronous calls.
+    return(app.exec());
+}
@@ -0,0 +1,97 @@
+/***************************************************************************
+ *  Copyright (c) 2010, Resara LLC
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Resara LLC nor the
+ *       names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***************************************************************************/
+#include "coroutineservice.h"
+#include <QTimer>
+#include <QDebug>
+#include <TraceContext>
+#include <coroutine>
+
+//An awaiter that resumes the coroutine after a number of milliseconds,
+//from the event loop of the thread that is running the service.
+//Anything with await_ready(), await_suspend() and await_resume() can be
+//awaited, the same way QtRpc's own AsyncCall can.
+class Delay
+{
+public:
+    explicit Delay(int msecs) : m_msecs(msecs) {}
+
+    bool await_ready() const
+    {
+        return m_msecs <= 0;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        QTimer::singleShot(m_msecs, [handle]() { handle.resume(); });
+    }
+
+    void await_resume() const
+    {
+    }
+
+private:
+    int m_msecs;
+};
+
+CoroutineService::CoroutineService(QObject *parent) :
+    ServiceProxy(parent)
+{
+}
+
+ReturnValue CoroutineService::auth(QString user, QString pass)
+{
+    return(true);
+}
+
+//This function is a coroutine, because it uses co_await and co_return.
+//The client gets ReturnValue::asyncronous() at the first co_await, and
+//the value passed to co_return is sent to the client once the function
+//finishes, the same as with AsyncReturn::send().
+//
+//While the function waits the thread is free to run other calls.
+ReturnValue CoroutineService::addNumbers(int a, int b)
+{
+    qDebug() << "addNumbers() called, time left:" << remainingTime();
+    co_await Delay(1000);
+    //After resuming, the deadline and the trace of the call are current again,
+    //so calls made from here to other services are still part of this call.
+    qDebug() << "addNumbers() resumed, time left:" << remainingTime();
+    co_return a + b;
+}
+
+//Const member functions can be coroutines too. This returns the trace
+//of the call after waiting, which is the same as the one the client started.
+ReturnValue CoroutineService::traceOf(int msecs) const
+{
+    QString before = TraceContext::current().toTraceparent();
+    co_await Delay(msecs);
+    QString after = TraceContext::current().toTraceparent();
+    if (before != after)
+        co_return ReturnValue(1, "The trace changed while waiting");
+    co_return after;
+}
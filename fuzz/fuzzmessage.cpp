@@ -0,0 +1,107 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include <QCoreApplication>
+#include <QDataStream>
+#include <AuthToken>
+#include <Message>
+#include <ReturnValue>
+#include <Signature>
+
+using namespace QtRpc;
+
+/*
+ * libFuzzer entry points for the wire codecs. The first byte of the input
+ * selects the protocol version, the second one the type that is decoded
+ * from the rest. Messages that decode are encoded again, so the writer is
+ * exercised with whatever the reader accepted.
+ */
+
+static void silentHandler(QtMsgType type, const QMessageLogContext&, const QString&)
+{
+	if (type == QtFatalMsg)
+		abort();
+}
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv)
+{
+	static QCoreApplication app(*argc, *argv);
+	qInstallMessageHandler(silentHandler);
+	return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	if (size < 2)
+		return 0;
+	quint32 version = data[0] % (Message::currentVersion() + 1);
+	int target = data[1] % 4;
+	QByteArray input = QByteArray::fromRawData(reinterpret_cast<const char*>(data + 2), size - 2);
+	QDataStream in(input);
+
+	switch (target)
+	{
+		case 0:
+		{
+			Message msg;
+			msg.setVersion(version);
+			in >> msg;
+			if (in.status() == QDataStream::Ok && msg.type() != Message::Invalid)
+			{
+				QByteArray encoded;
+				QDataStream out(&encoded, QIODevice::WriteOnly);
+				out << msg;
+				msg.frame();
+			}
+			break;
+		}
+		case 1:
+		{
+			Signature sig;
+			in >> sig;
+			sig.toString();
+			break;
+		}
+		case 2:
+		{
+			ReturnValue ret;
+			in >> ret;
+			break;
+		}
+		default:
+		{
+			AuthToken token;
+			in >> token;
+			break;
+		}
+	}
+	return 0;
+}
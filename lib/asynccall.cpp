@@ -0,0 +1,146 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include "asynccall.h"
+#include "asynccall_p.h"
+
+namespace QtRpc
+{
+
+AsyncCall::AsyncCall()
+{
+	QXT_INIT_PRIVATE(AsyncCall);
+	qxt_d().receiver = new AsyncCallReceiver();
+	qxt_d().receiver->call = &qxt_d();
+}
+
+/**
+ * The deconstructor detaches the receiver, any reply that arrives after this point is dropped.
+ */
+AsyncCall::~AsyncCall()
+{
+	if (!qxt_d().receiver.isNull())
+	{
+		qxt_d().receiver->call = 0;
+		qxt_d().receiver->deleteLater();
+	}
+}
+
+/**
+ * @return Returns the object to pass as the QObject* argument of an asynchronous call
+ */
+QObject* AsyncCall::receiver() const
+{
+	return qxt_d().receiver;
+}
+
+/**
+ * @return Returns the slot to pass as the const char* argument of an asynchronous call
+ */
+const char* AsyncCall::slot() const
+{
+	return SLOT(returned(uint, QtRpc::ReturnValue));
+}
+
+/**
+ * Records the immediate ReturnValue of an asynchronous call. If the call could not be made, the error becomes the result and the AsyncCall finishes right away.
+ * @param ret The ReturnValue returned by the asynchronous function
+ * @return Returns \a ret
+ */
+ReturnValue AsyncCall::submit(const ReturnValue& ret)
+{
+	if (ret.isError())
+		qxt_d().finish(0, ret);
+	else
+		qxt_d().id = ret.toUInt();
+	return ret;
+}
+
+/**
+ * @return Returns true once the result of the call is available
+ */
+bool AsyncCall::isFinished() const
+{
+	return qxt_d().finished;
+}
+
+/**
+ * @return Returns the id of the call
+ */
+uint AsyncCall::id() const
+{
+	return qxt_d().id;
+}
+
+/**
+ * @return Returns the result of the call. Only valid once isFinished() returns true.
+ */
+ReturnValue AsyncCall::result() const
+{
+	return qxt_d().result;
+}
+
+/**
+ * Installs a function that is called once the result arrives. If the result is already available the callback is not called, check isFinished() first.
+ * @param callback The function to call
+ * @param context Pointer passed to \a callback
+ */
+void AsyncCall::setCallback(Callback callback, void* context)
+{
+	qxt_d().callback = callback;
+	qxt_d().context = context;
+}
+
+void AsyncCallPrivate::finish(uint callId, const ReturnValue& ret)
+{
+	if (finished)
+		return;
+	finished = true;
+	if (callId != 0)
+		id = callId;
+	result = ret;
+	// The callback may destroy the AsyncCall, so nothing can be touched after it returns
+	AsyncCall::Callback cb = callback;
+	void* ctx = context;
+	callback = 0;
+	context = 0;
+	if (cb != 0)
+		cb(ctx);
+}
+
+void AsyncCallReceiver::returned(uint id, QtRpc::ReturnValue ret)
+{
+	if (call == 0)
+		return;
+	call->finish(id, ret);
+}
+
+}
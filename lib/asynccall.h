@@ -0,0 +1,91 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCASYNCCALL_H
+#define QTRPCASYNCCALL_H
+
+#include <QxtPimpl>
+#include <ReturnValue>
+#include <QtRpcGlobal>
+
+class QObject;
+
+namespace QtRpc
+{
+
+class AsyncCallPrivate;
+
+/**
+	AsyncCall collects the ReturnValue of a single asynchronous ClientProxy call without requiring a slot on the calling object. Pass receiver() and slot() as the QObject* and const char* arguments of any asynchronous function, and hand the immediate ReturnValue of the call to submit().
+
+	@code
+AsyncCall call;
+call.submit(client.addNumbers(call.receiver(), call.slot(), 2, 3));
+...
+if (call.isFinished())
+	qDebug() << call.result();
+	@endcode
+
+	A callback may be installed with setCallback(), it is invoked in the thread that created the AsyncCall once the result arrives. This is the building block used by the coroutine support in QtRpcCoroutine, which allows the call above to be written as
+	@code
+ReturnValue sum = co_await call;
+	@endcode
+
+	The AsyncCall must outlive the call it is waiting for, or the reply is dropped.
+
+	@sa ClientProxy AsyncReturn
+	@brief Collects the result of an asynchronous call
+*/
+class QTRPC2_EXPORT AsyncCall
+{
+	QXT_DECLARE_PRIVATE(AsyncCall);
+public:
+	typedef void (*Callback)(void* context);
+
+	AsyncCall();
+	~AsyncCall();
+
+	QObject* receiver() const;
+	const char* slot() const;
+	ReturnValue submit(const ReturnValue& ret);
+
+	bool isFinished() const;
+	uint id() const;
+	ReturnValue result() const;
+	void setCallback(Callback callback, void* context);
+
+private:
+	Q_DISABLE_COPY(AsyncCall);
+};
+
+}
+
+#endif
@@ -0,0 +1,88 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCASYNCCALL_P_H
+#define QTRPCASYNCCALL_P_H
+
+#include <QxtPimpl>
+#include <QObject>
+#include <QPointer>
+#include <ReturnValue>
+#include "asynccall.h"
+#include <qtrpcprivate.h>
+
+namespace QtRpc
+{
+
+class AsyncCallPrivate;
+
+/*
+The receiver is a separate object from the AsyncCall so that the AsyncCall can be destroyed from inside of the callback (which is exactly what happens when a coroutine finishes). The receiver only goes away through deleteLater().
+*/
+class AsyncCallReceiver : public QObject
+{
+	Q_OBJECT
+public:
+	AsyncCallReceiver()
+			: call(0)
+	{
+	}
+
+	AsyncCallPrivate* call;
+
+public slots:
+	void returned(uint id, QtRpc::ReturnValue ret);
+};
+
+class AsyncCallPrivate : public QxtPrivate<AsyncCall>
+{
+public:
+	AsyncCallPrivate()
+			: finished(false),
+			id(0),
+			callback(0),
+			context(0)
+	{
+	}
+
+	void finish(uint id, const ReturnValue& ret);
+
+	QPointer<AsyncCallReceiver> receiver;
+	bool finished;
+	uint id;
+	ReturnValue result;
+	AsyncCall::Callback callback;
+	void* context;
+};
+
+}
+
+#endif
@@ -0,0 +1,162 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include "asyncreturn.h"
+#include "serviceproxy_p.h"
+#include <ServiceProxy>
+#include <ServerProtocolInstanceBase>
+#include <QPointer>
+#include "callcontext_p.h"
+
+namespace QtRpc
+{
+
+class AsyncReturnPrivate : public QxtPrivate<AsyncReturn>
+{
+public:
+	AsyncReturnPrivate()
+			: id(0),
+			sent(false),
+			deadline(-1),
+			arrival(-1),
+			received(-1)
+	{
+	}
+
+	QPointer<ServiceProxy> service;
+	QPointer<ServerProtocolInstanceBase> instance; //the connection of the call, services may be shared by several
+	quint32 id;
+	bool sent;
+	// the CallContext of the call, restored by AsyncReturnScope
+	qint64 deadline;
+	qint64 arrival;
+	qint64 received;
+	TraceContext trace;
+};
+
+/**
+ * Creates a handle to the function call currently being executed by \a service. This must be called from within the service function, before it returns.
+ * @param service The service object that is answering the call
+ */
+AsyncReturn::AsyncReturn(ServiceProxy* service)
+{
+	QXT_INIT_PRIVATE(AsyncReturn);
+	qxt_d().service = service;
+	if (service != 0)
+	{
+		qxt_d().id = service->currentFunctionId();
+		QMutexLocker locker(&service->qxt_d().datamutex);
+		qxt_d().instance = service->qxt_d().currentInstance();
+	}
+	CallContext* context = CallContext::current();
+	if (context != 0)
+	{
+		qxt_d().deadline = context->deadline();
+		qxt_d().arrival = context->arrival();
+		qxt_d().received = context->received();
+	}
+	qxt_d().trace = TraceContext::current();
+}
+
+AsyncReturn::~AsyncReturn()
+{
+}
+
+/**
+ * @return Returns the id of the function call this handle answers
+ */
+quint32 AsyncReturn::id() const
+{
+	return qxt_d().id;
+}
+
+/**
+ * @return Returns the service object, or NULL if it was destroyed
+ */
+ServiceProxy* AsyncReturn::service() const
+{
+	return qxt_d().service;
+}
+
+/**
+ * @return Returns true once send() has been called
+ */
+bool AsyncReturn::isSent() const
+{
+	return qxt_d().sent;
+}
+
+/**
+ * @return Returns true if the client cancelled the call or disconnected. Nothing will be sent once this is true.
+ * @sa ServiceProxy::callCancelled()
+ */
+bool AsyncReturn::isCancelled() const
+{
+	if (qxt_d().service.isNull() || qxt_d().instance.isNull())
+		return true;
+	return qxt_d().instance->isCancelled(qxt_d().id);
+}
+
+/**
+ * Sends the ReturnValue to the client. Only the first call to this function has any effect.
+ * @param ret The ReturnValue of the function call
+ */
+void AsyncReturn::send(const ReturnValue& ret)
+{
+	if (qxt_d().sent)
+		return;
+	qxt_d().sent = true;
+	if (qxt_d().service.isNull())
+		return;
+	QMutexLocker locker(&qxt_d().service->qxt_d().datamutex);
+	qxt_d().service->qxt_d().sendReturn(qxt_d().instance, qxt_d().id, ret);
+}
+
+/**
+ * Makes the deadline, connection and trace of the call of \a ret current in this thread
+ * @param ret The handle of the call
+ */
+AsyncReturnScope::AsyncReturnScope(const AsyncReturn& ret)
+		: m_context(new CallContext(ret.qxt_d().deadline, ret.qxt_d().arrival, ret.qxt_d().received)),
+		m_trace(ret.qxt_d().trace)
+{
+	m_context->setInstance(ret.qxt_d().instance);
+}
+
+/**
+ * Restores the state that was current before this scope
+ */
+AsyncReturnScope::~AsyncReturnScope()
+{
+	delete m_context;
+}
+
+}
@@ -0,0 +1,114 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCASYNCRETURN_H
+#define QTRPCASYNCRETURN_H
+
+#include <QxtPimpl>
+#include <ReturnValue>
+#include <TraceContext>
+#include <QtRpcGlobal>
+
+namespace QtRpc
+{
+
+class ServiceProxy;
+class AsyncReturnPrivate;
+class CallContext;
+
+/**
+	AsyncReturn is a handle to a function call that a ServiceProxy has chosen to answer asynchronously. It replaces the pattern of saving currentFunctionId() in a member and calling sendReturn() later.
+
+	The handle must be created while the service function is executing, it captures the id of the call that is currently being dispatched. The service may then return ReturnValue::asyncronous(), and call send() once the result is known. The reply is routed through the protocol instance the same way sendReturn() is, including service objects contained in the ReturnValue.
+
+	@code
+ReturnValue BasicService::pauseAsync()
+{
+	m_pause = new AsyncReturn(this);
+	QTimer::singleShot(2000, this, SLOT(returnAsyncPause()));
+	return ReturnValue::asyncronous();
+}
+
+void BasicService::returnAsyncPause()
+{
+	m_pause->send(true);
+	delete m_pause;
+}
+	@endcode
+
+	If the service object is destroyed before send() is called, the reply is silently dropped.
+
+	The handle also keeps the deadline, connection and trace of the call. Code that continues the call later, from a timer or a reply, can make them current again with an AsyncReturnScope.
+
+	@sa ServiceProxy AsyncCall AsyncReturnScope
+	@brief Handle used to answer an asynchronous service call
+*/
+class QTRPC2_EXPORT AsyncReturn
+{
+	QXT_DECLARE_PRIVATE(AsyncReturn);
+public:
+	AsyncReturn(ServiceProxy* service);
+	~AsyncReturn();
+
+	quint32 id() const;
+	ServiceProxy* service() const;
+	bool isSent() const;
+	bool isCancelled() const;
+	void send(const ReturnValue& ret);
+
+private:
+	Q_DISABLE_COPY(AsyncReturn);
+	friend class AsyncReturnScope;
+};
+
+/**
+	Makes the call of an AsyncReturn current again in this thread while the scope exists, the way it was while the service function ran. ServiceProxy::remainingTime(), calls made to other services, which inherit the deadline and the trace, and shared services looking up the connection of the call all see the original call.
+
+	The coroutine support in QtRpcCoroutine uses it each time a service coroutine is resumed. Scopes must be destroyed in the reverse order they were created in.
+
+	@sa AsyncReturn TraceScope
+	@brief Restores the state of an asynchronous call
+*/
+class QTRPC2_EXPORT AsyncReturnScope
+{
+public:
+	explicit AsyncReturnScope(const AsyncReturn& ret);
+	~AsyncReturnScope();
+
+private:
+	Q_DISABLE_COPY(AsyncReturnScope);
+	CallContext* m_context;
+	TraceScope m_trace;
+};
+
+}
+
+#endif
@@ -33,6 +33,12 @@
 #define QTRPCAUTOMATICMETATYPEREGISTRY_H
 
 #include <QMetaType>
+#include <QDataStream>
+#include <QVector>
+#include <QSysInfo>
+#include <QIODevice>
+#include <type_traits>
+#include <climits>
 
 namespace QtRpc
 {
@@ -54,6 +60,128 @@ public:
 	}
 };
 
+/**
+	Registers a trivially copyable type, and QVector of the type, with stream operators that copy the memory of the values instead of streaming their members one at a time. A QVector is written as a single block, no matter how many elements it has.
+
+	The bytes are written in the byte order of the host, and are tagged with the byte order and the size of the type. Reading data written by a host with a different byte order or a different layout of the type fails with QDataStream::ReadCorruptData, use QTRPC_REGISTER_METATYPE() with hand written stream operators for types that have to cross those boundaries.
+
+	Since the memory is sent as it is, padding bytes between the members would send whatever the memory held before. QTRPC_REGISTER_POD_METATYPE() only accepts types without padding, as told by std::has_unique_object_representations, and floating point types, which needs C++17. Types with padding or floating point members, and every type on older compilers, must be registered with QTRPC_REGISTER_PADDED_POD_METATYPE(), which states that the padding of the values never holds anything that may not be sent, for example because the values are always zero initialized.
+*/
+template<typename T, bool Padded = false>
+class AutomaticPodMetatypeRegistry
+{
+	Q_STATIC_ASSERT_X(std::is_trivially_copyable<T>::value, "QTRPC_REGISTER_POD_METATYPE requires a trivially copyable type");
+#if defined(__cpp_lib_has_unique_object_representations)
+	Q_STATIC_ASSERT_X(Padded || std::has_unique_object_representations<T>::value || std::is_floating_point<T>::value, "The type may have padding bytes, which would be sent as they are. Use QTRPC_REGISTER_PADDED_POD_METATYPE if the padding is always zeroed");
+#else
+	Q_STATIC_ASSERT_X(Padded, "Checking a type for padding needs C++17. Use QTRPC_REGISTER_PADDED_POD_METATYPE if the padding is always zeroed");
+#endif
+public:
+	AutomaticPodMetatypeRegistry(const char* name)
+	{
+		int type = qRegisterMetaType<T>(name);
+		QMetaType::registerStreamOperators(type, &save, &load);
+		type = qRegisterMetaType< QVector<T> >(QByteArray("QVector<") + name + ">");
+		QMetaType::registerStreamOperators(type, &saveVector, &loadVector);
+	}
+	~AutomaticPodMetatypeRegistry()
+	{
+	}
+
+private:
+	static void writeHeader(QDataStream& s)
+	{
+		s << static_cast<quint8>(QSysInfo::ByteOrder == QSysInfo::LittleEndian ? 0x01 : 0x00) << static_cast<quint32>(sizeof(T));
+	}
+
+	static bool readHeader(QDataStream& s)
+	{
+		quint8 order;
+		quint32 size;
+		s >> order >> size;
+		if (s.status() != QDataStream::Ok)
+			return false;
+		if (order != (QSysInfo::ByteOrder == QSysInfo::LittleEndian ? 0x01 : 0x00) || size != sizeof(T))
+		{
+			s.setStatus(QDataStream::ReadCorruptData);
+			return false;
+		}
+		return true;
+	}
+
+	static void save(QDataStream& s, const void* data)
+	{
+		writeHeader(s);
+		s.writeRawData(static_cast<const char*>(data), sizeof(T));
+	}
+
+	static void load(QDataStream& s, void* data)
+	{
+		if (!readHeader(s))
+			return;
+		if (s.readRawData(static_cast<char*>(data), sizeof(T)) != sizeof(T))
+			s.setStatus(QDataStream::ReadPastEnd);
+	}
+
+	// The largest number of values that fit in a block of raw data
+	static const quint32 MaxCount = INT_MAX / sizeof(T);
+	// Vectors are written and read in blocks of this many values, so a hostile count can't make the reader allocate more than it received
+	static const int ChunkCount = (1024 * 1024) / sizeof(T) > 0 ? (1024 * 1024) / sizeof(T) : 1;
+
+	static void saveVector(QDataStream& s, const void* data)
+	{
+		const QVector<T>& vector = *static_cast<const QVector<T>*>(data);
+		if (static_cast<quint32>(vector.count()) > MaxCount)
+		{
+			s.setStatus(QDataStream::WriteFailed);
+			return;
+		}
+		writeHeader(s);
+		s << static_cast<quint32>(vector.count());
+		for (int i = 0; i < vector.count(); i += ChunkCount)
+		{
+			int count = qMin(ChunkCount, vector.count() - i);
+			s.writeRawData(reinterpret_cast<const char*>(vector.constData() + i), count * static_cast<int>(sizeof(T)));
+		}
+	}
+
+	static void loadVector(QDataStream& s, void* data)
+	{
+		QVector<T>& vector = *static_cast<QVector<T>*>(data);
+		vector.clear();
+		if (!readHeader(s))
+			return;
+		quint32 count;
+		s >> count;
+		if (s.status() != QDataStream::Ok)
+			return;
+		if (count > MaxCount)
+		{
+			s.setStatus(QDataStream::ReadCorruptData);
+			return;
+		}
+		// Don't trust the count with a huge allocation before the data is known to be there
+		if (s.device() && !s.device()->isSequential() && static_cast<qint64>(count) * sizeof(T) > s.device()->bytesAvailable())
+		{
+			s.setStatus(QDataStream::ReadPastEnd);
+			return;
+		}
+		// The vector grows with the data that actually arrived
+		for (int i = 0; i < static_cast<int>(count); i += ChunkCount)
+		{
+			int chunk = qMin(ChunkCount, static_cast<int>(count) - i);
+			vector.resize(i + chunk);
+			int bytes = chunk * static_cast<int>(sizeof(T));
+			if (s.readRawData(reinterpret_cast<char*>(vector.data() + i), bytes) != bytes)
+			{
+				vector.clear();
+				s.setStatus(QDataStream::ReadPastEnd);
+				return;
+			}
+		}
+	}
+};
+
 }
 
 #define __QTRPC_REGISTER_METATYPE(x,y) static QtRpc::AutomaticMetatypeRegistry<x> __qtrpc_typeRegistry##y (#x);
@@ -61,4 +189,14 @@ public:
 #define QTRPC_REGISTER_METATYPE(x)\
 	___QTRPC_REGISTER_METATYPE(x, __LINE__ );
 
+#define __QTRPC_REGISTER_POD_METATYPE(x,y) static QtRpc::AutomaticPodMetatypeRegistry<x> __qtrpc_podTypeRegistry##y (#x);
+#define ___QTRPC_REGISTER_POD_METATYPE(x, bleh) __QTRPC_REGISTER_POD_METATYPE(x, bleh )
+#define QTRPC_REGISTER_POD_METATYPE(x)\
+	___QTRPC_REGISTER_POD_METATYPE(x, __LINE__ );
+
+#define __QTRPC_REGISTER_PADDED_POD_METATYPE(x,y) static QtRpc::AutomaticPodMetatypeRegistry<x, true> __qtrpc_podTypeRegistry##y (#x);
+#define ___QTRPC_REGISTER_PADDED_POD_METATYPE(x, bleh) __QTRPC_REGISTER_PADDED_POD_METATYPE(x, bleh )
+#define QTRPC_REGISTER_PADDED_POD_METATYPE(x)\
+	___QTRPC_REGISTER_PADDED_POD_METATYPE(x, __LINE__ );
+
 #endif
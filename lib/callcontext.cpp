@@ -0,0 +1,158 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include "callcontext_p.h"
+#include <QThreadStorage>
+#include <QElapsedTimer>
+
+namespace QtRpc
+{
+
+struct CallContextSlot
+{
+	CallContextSlot()
+			: context(0)
+	{
+	}
+
+	CallContext* context;
+};
+
+static QThreadStorage<CallContextSlot> currentContext;
+
+/**
+ * Creates a new context and makes it current for this thread
+ * @param deadline The absolute deadline of the call, as returned by now(), or -1 for no deadline
+ * @param arrival The time the call was read from the network, as returned by now(), or -1 if unknown
+ * @param received The same time in nanoseconds, as returned by CallStats::now(), or -1 if unknown
+ */
+CallContext::CallContext(qint64 deadline, qint64 arrival, qint64 received)
+		: m_deadline(deadline),
+		m_arrival(arrival),
+		m_received(received),
+		m_instance(0)
+{
+	CallContextSlot& slot = currentContext.localData();
+	m_previous = slot.context;
+	slot.context = this;
+}
+
+/**
+ * Restores the context that was current before this one
+ */
+CallContext::~CallContext()
+{
+	currentContext.localData().context = m_previous;
+}
+
+/**
+ * @return Returns the time the call was read from the network, or -1 if unknown
+ */
+qint64 CallContext::arrival() const
+{
+	return m_arrival;
+}
+
+/**
+ * @return Returns the time the call was read from the network in nanoseconds, as returned by CallStats::now(), or -1 if unknown
+ */
+qint64 CallContext::received() const
+{
+	return m_received;
+}
+
+/**
+ * @return Returns the absolute deadline, or -1 if there is none
+ */
+qint64 CallContext::deadline() const
+{
+	return m_deadline;
+}
+
+/**
+ * @return Returns the number of milliseconds left before the deadline, 0 if it has passed, or -1 if there is no deadline
+ */
+qint64 CallContext::remainingTime() const
+{
+	if (m_deadline < 0)
+		return -1;
+	return qMax(Q_INT64_C(0), m_deadline - now());
+}
+
+/**
+ * @return Returns the protocol instance of the connection that made the call, or NULL if unknown
+ */
+ServerProtocolInstanceBase* CallContext::instance() const
+{
+	return m_instance;
+}
+
+/**
+ * Sets the protocol instance of the connection that made the call
+ * @param instance The protocol instance
+ */
+void CallContext::setInstance(ServerProtocolInstanceBase* instance)
+{
+	m_instance = instance;
+}
+
+/**
+ * @return Returns the context of the call executing in this thread, or NULL if there is none
+ */
+CallContext* CallContext::current()
+{
+	if (!currentContext.hasLocalData())
+		return 0;
+	return currentContext.localData().context;
+}
+
+/**
+ * @return Returns remainingTime() of the current context, or -1 if there is no context
+ */
+qint64 CallContext::currentRemainingTime()
+{
+	CallContext* context = current();
+	if (context == 0)
+		return -1;
+	return context->remainingTime();
+}
+
+/**
+ * @return Returns the current time of a monotonic clock, in milliseconds
+ */
+qint64 CallContext::now()
+{
+	QElapsedTimer timer;
+	timer.start();
+	return timer.msecsSinceReference();
+}
+
+}
@@ -0,0 +1,78 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCCALLCONTEXT_P_H
+#define QTRPCCALLCONTEXT_P_H
+
+#include <QtGlobal>
+#include <qtrpcprivate.h>
+
+namespace QtRpc
+{
+
+class ServerProtocolInstanceBase;
+
+/**
+	A CallContext holds the state of the service function call that is currently executing in a thread. It is created on the stack by the protocol instance around each dispatch, and is visible to anything that runs inside of the call through current(). Contexts nest, the previous context is restored when a CallContext is destroyed.
+
+	The arrival time is used by the Server for queue time limits. The deadline is used by ServiceProxy::remainingTime(), and by the ClientMessageBus so that calls made from inside of a service function inherit the deadline of the call that triggered them. The instance is used by services that are shared between clients, to find the connection of the call.
+
+	@brief Thread local state of the function call being dispatched
+*/
+class CallContext
+{
+public:
+	CallContext(qint64 deadline = -1, qint64 arrival = -1, qint64 received = -1);
+	~CallContext();
+
+	qint64 arrival() const;
+	qint64 received() const;
+	qint64 deadline() const;
+	qint64 remainingTime() const;
+	ServerProtocolInstanceBase* instance() const;
+	void setInstance(ServerProtocolInstanceBase* instance);
+
+	static CallContext* current();
+	static qint64 currentRemainingTime();
+	static qint64 now();
+
+private:
+	Q_DISABLE_COPY(CallContext);
+	qint64 m_deadline;
+	qint64 m_arrival;
+	qint64 m_received;
+	ServerProtocolInstanceBase* m_instance;
+	CallContext* m_previous;
+};
+
+}
+
+#endif
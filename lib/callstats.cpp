@@ -0,0 +1,454 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include "callstats_p.h"
+#include "threadshards_p.h"
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QPair>
+#include <QtAlgorithms>
+#include <math.h>
+#include <string.h>
+
+namespace QtRpc
+{
+
+struct CallStatsShard;
+typedef ThreadShards<CallStatsShard> CallStatsShards;
+
+/**
+	A LatencyHistogram that is written by one thread and read by others without a lock.
+*/
+class ShardHistogram
+{
+public:
+	ShardHistogram()
+	{
+		clear();
+	}
+
+	// Only called by the thread that owns the shard
+	void record(qint64 value)
+	{
+		if (value < 0)
+			value = 0;
+		if (m_count.load() == 0 || value < m_min.load())
+			m_min.store(value);
+		if (value > m_max.load())
+			m_max.store(value);
+		CallStatsShards::add(m_count, Q_UINT64_C(1));
+		CallStatsShards::add(m_total, quint64(value));
+		CallStatsShards::add(m_buckets[LatencyHistogram::bucketIndex(value)], Q_UINT64_C(1));
+	}
+
+	void addTo(LatencyHistogram& histogram) const
+	{
+		LatencyHistogram copy;
+		for (int i = 0; i < LatencyHistogram::BucketCount; ++i)
+		{
+			copy.m_buckets[i] = m_buckets[i].load();
+			// Counted from the buckets, so that the count always matches them
+			copy.m_count += copy.m_buckets[i];
+		}
+		copy.m_total = m_total.load();
+		copy.m_min = m_min.load();
+		copy.m_max = m_max.load();
+		histogram.merge(copy);
+	}
+
+	void clear()
+	{
+		m_count.store(0);
+		m_total.store(0);
+		m_min.store(0);
+		m_max.store(0);
+		for (int i = 0; i < LatencyHistogram::BucketCount; ++i)
+			m_buckets[i].store(0);
+	}
+
+private:
+	QAtomicInteger<quint64> m_count;
+	QAtomicInteger<quint64> m_total;
+	QAtomicInteger<qint64> m_min;
+	QAtomicInteger<qint64> m_max;
+	QAtomicInteger<quint64> m_buckets[LatencyHistogram::BucketCount];
+};
+
+// The statistics of one function in one shard
+struct MethodSlot
+{
+	MethodSlot(quint32 id, const QString& s, const QString& m)
+			: server(id),
+			service(s),
+			method(m),
+			next(0)
+	{
+		clear();
+	}
+
+	void clear()
+	{
+		calls.store(0);
+		errors.store(0);
+		queue.clear();
+		execution.clear();
+		serialization.clear();
+	}
+
+	const quint32 server;
+	const QString service;
+	const QString method;
+	QAtomicInteger<quint64> calls;
+	QAtomicInteger<quint64> errors;
+	ShardHistogram queue;
+	ShardHistogram execution;
+	ShardHistogram serialization;
+	MethodSlot* next;
+};
+
+/**
+	The statistics recorded by one thread. Functions are added to the front of the list of slots, so readers can walk it while the thread adds to it. A shard is cleared by its owner when it sees that reset() was called, until then readers skip it.
+*/
+struct CallStatsShard : public ThreadShard
+{
+	CallStatsShard()
+			: generation(0),
+			slots(0)
+	{
+	}
+
+	QAtomicInt generation;
+	QAtomicPointer<MethodSlot> slots;
+	// Only used by the thread that owns the shard
+	QHash<QPair<quint32, QString>, QHash<QString, MethodSlot*> > lookup;
+};
+
+static CallStatsShards* shards()
+{
+	// Never destroyed, so that calls answered during static destruction can still be recorded
+	static CallStatsShards* shards = new CallStatsShards();
+	return shards;
+}
+
+// incremented by reset()
+static QAtomicInt generation;
+static QAtomicInteger<quint32> lastServer;
+
+LatencyHistogram::LatencyHistogram()
+		: m_count(0),
+		m_total(0),
+		m_min(0),
+		m_max(0)
+{
+	memset(m_buckets, 0, sizeof(m_buckets));
+}
+
+/**
+ * Adds a value to the histogram. Values larger than 2^40 are counted as 2^40.
+ * @param value The value, usually a duration in nanoseconds
+ */
+void LatencyHistogram::record(qint64 value)
+{
+	if (value < 0)
+		value = 0;
+	if (m_count == 0 || value < m_min)
+		m_min = value;
+	if (value > m_max)
+		m_max = value;
+	++m_count;
+	m_total += value;
+	++m_buckets[bucketIndex(value)];
+}
+
+/**
+ * Adds the values of \a other to this histogram
+ * @param other The histogram to merge
+ */
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+	if (other.m_count == 0)
+		return;
+	if (m_count == 0 || other.m_min < m_min)
+		m_min = other.m_min;
+	if (other.m_max > m_max)
+		m_max = other.m_max;
+	m_count += other.m_count;
+	m_total += other.m_total;
+	for (int i = 0; i < BucketCount; ++i)
+		m_buckets[i] += other.m_buckets[i];
+}
+
+/**
+ * @return Returns the number of recorded values
+ */
+quint64 LatencyHistogram::count() const
+{
+	return m_count;
+}
+
+/**
+ * @return Returns the sum of the recorded values
+ */
+qint64 LatencyHistogram::total() const
+{
+	return m_total;
+}
+
+/**
+ * Counts the values that are at most \a value. Values are only known to the precision of their bucket, a bucket is counted if all the values it holds are at most \a value.
+ * @param value The upper bound
+ * @return Returns the number of values up to \a value
+ */
+quint64 LatencyHistogram::countAtOrBelow(qint64 value) const
+{
+	if (value < 0)
+		return 0;
+	int last = bucketIndex(value);
+	if (highestValue(last) > value)
+		--last;
+	quint64 ret = 0;
+	for (int i = 0; i <= last; ++i)
+		ret += m_buckets[i];
+	return ret;
+}
+
+/**
+ * @param percentile The percentile, between 0 and 100
+ * @return Returns the highest value that is equivalent to the value at \a percentile, or 0 if the histogram is empty
+ */
+qint64 LatencyHistogram::valueAtPercentile(double percentile) const
+{
+	if (m_count == 0)
+		return 0;
+	quint64 target = quint64(ceil(qBound(0.0, percentile, 100.0) / 100.0 * m_count));
+	if (target == 0)
+		target = 1;
+	quint64 seen = 0;
+	for (int i = 0; i < BucketCount; ++i)
+	{
+		seen += m_buckets[i];
+		if (seen >= target)
+			return qBound(m_min, highestValue(i), m_max);
+	}
+	return m_max;
+}
+
+/**
+ * @return Returns the number of values, and the minimum, maximum, mean, and the 50th, 90th, 99th and 99.9th percentiles in microseconds
+ */
+QVariantMap LatencyHistogram::toMap() const
+{
+	QVariantMap map;
+	map["count"] = qulonglong(m_count);
+	map["min"] = m_min / 1000.0;
+	map["max"] = m_max / 1000.0;
+	map["mean"] = m_count == 0 ? 0.0 : double(m_total) / m_count / 1000.0;
+	map["p50"] = valueAtPercentile(50) / 1000.0;
+	map["p90"] = valueAtPercentile(90) / 1000.0;
+	map["p99"] = valueAtPercentile(99) / 1000.0;
+	map["p999"] = valueAtPercentile(99.9) / 1000.0;
+	return map;
+}
+
+int LatencyHistogram::bucketIndex(qint64 value)
+{
+	if (value >= (Q_INT64_C(1) << MaxBits))
+		value = (Q_INT64_C(1) << MaxBits) - 1;
+	if (value < 2 * SubBuckets)
+		return int(value);
+	int shift = 63 - qCountLeadingZeroBits(quint64(value)) - SubBucketBits;
+	return 2 * SubBuckets + (shift - 1) * SubBuckets + int(value >> shift) - SubBuckets;
+}
+
+qint64 LatencyHistogram::highestValue(int index)
+{
+	if (index < 2 * SubBuckets)
+		return index;
+	int shift = (index - 2 * SubBuckets) / SubBuckets + 1;
+	qint64 sub = (index - 2 * SubBuckets) % SubBuckets + SubBuckets;
+	return ((sub + 1) << shift) - 1;
+}
+
+MethodStats::MethodStats()
+		: calls(0),
+		errors(0)
+{
+}
+
+void MethodStats::merge(const MethodStats& other)
+{
+	calls += other.calls;
+	errors += other.errors;
+	queue.merge(other.queue);
+	execution.merge(other.execution);
+	serialization.merge(other.serialization);
+}
+
+QVariantMap MethodStats::toMap() const
+{
+	QVariantMap map;
+	map["calls"] = qulonglong(calls);
+	map["errors"] = qulonglong(errors);
+	map["queue"] = queue.toMap();
+	map["execution"] = execution.toMap();
+	map["serialization"] = serialization.toMap();
+	return map;
+}
+
+static QElapsedTimer startedClock()
+{
+	QElapsedTimer clock;
+	clock.start();
+	return clock;
+}
+
+/**
+ * @return Returns the current time of a monotonic clock, in nanoseconds
+ */
+qint64 CallStats::now()
+{
+	static const QElapsedTimer clock = startedClock();
+	return clock.nsecsElapsed();
+}
+
+/**
+ * Converts a time returned by now() to wall clock time. The offset between the clocks is taken once, so converted times keep the order and distance of the monotonic ones.
+ * @param time A time returned by now()
+ * @return Returns the time in nanoseconds since the epoch
+ */
+qint64 CallStats::toUnixTime(qint64 time)
+{
+	static const qint64 offset = QDateTime::currentMSecsSinceEpoch() * Q_INT64_C(1000000) - now();
+	return offset + time;
+}
+
+/**
+ * @return Returns a new id to record the calls of a server with, never 0
+ */
+quint32 CallStats::nextServer()
+{
+	return lastServer.fetchAndAddRelaxed(1) + 1;
+}
+
+/**
+ * Records a function call that was answered. The call is added to the shard of the calling thread, without taking a lock.
+ * @param server The id of the server that answered the call, as returned by nextServer()
+ * @param service The name of the service
+ * @param method The signature of the function
+ * @param queue The queue time, or -1 if it is unknown
+ * @param execution The execution time
+ * @param serialization The time spent encoding the reply
+ * @param error True if the call returned an error
+ */
+void CallStats::record(quint32 server, const QString& service, const QString& method, qint64 queue, qint64 execution, qint64 serialization, bool error)
+{
+	CallStatsShard* shard = shards()->local();
+	int current = generation.loadAcquire();
+	if (shard->generation.load() != current)
+	{
+		for (MethodSlot* slot = shard->slots.load(); slot != 0; slot = slot->next)
+			slot->clear();
+		shard->generation.storeRelease(current);
+	}
+	MethodSlot*& slot = shard->lookup[qMakePair(server, service)][method];
+	if (slot == 0)
+	{
+		slot = new MethodSlot(server, service, method);
+		slot->next = shard->slots.load();
+		shard->slots.storeRelease(slot);
+	}
+	CallStatsShards::add(slot->calls, Q_UINT64_C(1));
+	if (error)
+		CallStatsShards::add(slot->errors, Q_UINT64_C(1));
+	if (queue >= 0)
+		slot->queue.record(queue);
+	slot->execution.record(execution);
+	slot->serialization.record(serialization);
+}
+
+/**
+ * Merges the shards of all threads.
+ * @param server The id of the server to report the calls of, or 0 for the calls of every server
+ * @return Returns a map of services, each containing a map of function signatures to the statistics of that function
+ */
+QVariantMap CallStats::snapshot(quint32 server)
+{
+	ServiceStats stats = merged(server);
+	QVariantMap ret;
+	for (ServiceStats::const_iterator service = stats.constBegin(); service != stats.constEnd(); ++service)
+	{
+		QVariantMap methods;
+		for (QHash<QString, MethodStats>::const_iterator method = service.value().constBegin(); method != service.value().constEnd(); ++method)
+			methods[method.key()] = method.value().toMap();
+		ret[service.key()] = methods;
+	}
+	return ret;
+}
+
+/**
+ * Adds up the shards of all threads, without taking a lock. Calls being recorded while the shards are read may be counted in some of the statistics and not yet in others.
+ * @param server The id of the server to report the calls of, or 0 for the calls of every server
+ * @return Returns the statistics of every function of every service
+ */
+ServiceStats CallStats::merged(quint32 server)
+{
+	ServiceStats ret;
+	int current = generation.loadAcquire();
+	for (CallStatsShard* shard = shards()->first(); shard != 0; shard = CallStatsShards::next(shard))
+	{
+		// Not cleared since the last reset() yet
+		if (shard->generation.loadAcquire() != current)
+			continue;
+		for (MethodSlot* slot = shard->slots.loadAcquire(); slot != 0; slot = slot->next)
+		{
+			if (server != 0 && slot->server != server)
+				continue;
+			MethodStats& stats = ret[slot->service][slot->method];
+			stats.calls += slot->calls.load();
+			stats.errors += slot->errors.load();
+			slot->queue.addTo(stats.queue);
+			slot->execution.addTo(stats.execution);
+			slot->serialization.addTo(stats.serialization);
+		}
+	}
+	return ret;
+}
+
+/**
+ * Clears the statistics of all threads. Each thread clears its shard the next time it records a call.
+ */
+void CallStats::reset()
+{
+	generation.fetchAndAddOrdered(1);
+}
+
+}
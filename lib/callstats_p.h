@@ -0,0 +1,120 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCCALLSTATS_P_H
+#define QTRPCCALLSTATS_P_H
+
+#include <QString>
+#include <QHash>
+#include <QVariantMap>
+#include <qtrpcprivate.h>
+
+namespace QtRpc
+{
+
+/**
+	A latency histogram in the style of HdrHistogram. Values below 32 are counted exactly, larger values go to one of 16 buckets per power of two, so every recorded value is kept with a precision of about 6%, up to 2^40 nanoseconds. Histograms of the same kind can be merged by adding the buckets.
+	@brief Log linear histogram of nanosecond durations
+*/
+class LatencyHistogram
+{
+public:
+	enum
+	{
+		SubBucketBits = 4,
+		SubBuckets = 1 << SubBucketBits,
+		MaxBits = 40,
+		BucketCount = 2 * SubBuckets + (MaxBits - SubBucketBits - 1) * SubBuckets
+	};
+
+	LatencyHistogram();
+	void record(qint64 value);
+	void merge(const LatencyHistogram& other);
+	quint64 count() const;
+	qint64 total() const;
+	quint64 countAtOrBelow(qint64 value) const;
+	qint64 valueAtPercentile(double percentile) const;
+	QVariantMap toMap() const;
+
+private:
+	friend class ShardHistogram;
+	static int bucketIndex(qint64 value);
+	static qint64 highestValue(int index);
+
+	quint64 m_count;
+	quint64 m_total;
+	qint64 m_min;
+	qint64 m_max;
+	quint64 m_buckets[BucketCount];
+};
+
+/**
+	Counters and histograms of the calls to one function.
+	@brief Statistics of one service function
+*/
+struct MethodStats
+{
+	MethodStats();
+	void merge(const MethodStats& other);
+	QVariantMap toMap() const;
+
+	quint64 calls;
+	quint64 errors;
+	LatencyHistogram queue;
+	LatencyHistogram execution;
+	LatencyHistogram serialization;
+};
+
+typedef QHash<QString, QHash<QString, MethodStats> > ServiceStats;
+
+/**
+	Collects statistics about the function calls answered by the server, for every service and function. Each thread records into its own shard of atomic counters, so recording a call never waits for another thread, and reading the statistics adds up the shards without a lock. The shard of a thread that exits is taken over by the next thread that records a call.
+
+	Calls are recorded for the server that answered them, identified by nextServer(), so each Server can report its own calls.
+
+	All times are in nanoseconds, as returned by now(). The queue time is measured from when the call was read from the network until it was dispatched to the service, the execution time until the reply was ready to be sent, and the serialization time is the time spent encoding the reply.
+	@brief Process wide function call statistics
+*/
+class CallStats
+{
+public:
+	static qint64 now();
+	static qint64 toUnixTime(qint64 time);
+	static quint32 nextServer();
+	static void record(quint32 server, const QString& service, const QString& method, qint64 queue, qint64 execution, qint64 serialization, bool error);
+	static QVariantMap snapshot(quint32 server = 0);
+	static ServiceStats merged(quint32 server = 0);
+	static void reset();
+};
+
+}
+
+#endif
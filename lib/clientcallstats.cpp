@@ -0,0 +1,170 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include "clientcallstats_p.h"
+#include <QList>
+#include <QMutexLocker>
+#include <SpanSink>
+
+namespace QtRpc
+{
+
+struct ClientCallStatsRegistry
+{
+	QMutex mutex;
+	QList<ClientCallStats*> buses;
+	// statistics of the buses that were destroyed
+	QHash<QString, ClientCallStats::Method> retired;
+};
+
+Q_GLOBAL_STATIC(ClientCallStatsRegistry, registry)
+
+static void mergeMethods(QHash<QString, ClientCallStats::Method>& to, const QHash<QString, ClientCallStats::Method>& from)
+{
+	for (QHash<QString, ClientCallStats::Method>::const_iterator it = from.constBegin(); it != from.constEnd(); ++it)
+		to[it.key()].merge(it.value());
+}
+
+ClientCallStats::Method::Method()
+		: calls(0),
+		errors(0)
+{
+}
+
+void ClientCallStats::Method::merge(const Method& other)
+{
+	calls += other.calls;
+	errors += other.errors;
+	send.merge(other.send);
+	network.merge(other.network);
+	delivery.merge(other.delivery);
+	total.merge(other.total);
+}
+
+ClientCallStats::ClientCallStats()
+{
+	if (registry.isDestroyed())
+		return;
+	QMutexLocker locker(&registry()->mutex);
+	registry()->buses.append(this);
+}
+
+ClientCallStats::~ClientCallStats()
+{
+	if (registry.isDestroyed())
+		return;
+	QMutexLocker locker(&registry()->mutex);
+	registry()->buses.removeOne(this);
+	mergeMethods(registry()->retired, m_methods);
+}
+
+/**
+ * Records a call whose reply was delivered. Timestamps that are -1 are unknown, and the phases they border are not recorded. Sampled calls are also reported to the SpanSink.
+ * @param timing The timestamps of the call, as returned by CallStats::now()
+ * @param error True if the reply is an error
+ * @param delivered The time the reply was delivered to the caller
+ */
+void ClientCallStats::record(const Timing& timing, bool error, qint64 delivered)
+{
+	if (timing.trace.isSampled() && SpanSink::isEnabled())
+	{
+		Span span;
+		span.context = timing.trace;
+		span.name = timing.method;
+		span.kind = Span::Client;
+		span.startTime = CallStats::toUnixTime(timing.submitted);
+		span.endTime = CallStats::toUnixTime(delivered);
+		span.error = error;
+		span.attributes["rpc.system"] = QString("qtrpc2");
+		span.attributes["rpc.method"] = timing.method;
+		SpanSink::submit(span);
+	}
+	QMutexLocker locker(&m_mutex);
+	Method& method = m_methods[timing.method];
+	++method.calls;
+	if (error)
+		++method.errors;
+	if (timing.written >= 0)
+		method.send.record(timing.written - timing.submitted);
+	if (timing.written >= 0 && timing.read >= 0)
+		method.network.record(timing.read - timing.written);
+	if (timing.read >= 0)
+		method.delivery.record(delivered - timing.read);
+	method.total.record(delivered - timing.submitted);
+}
+
+/**
+ * @return Returns a map of function signatures to their statistics, see ClientProxy::callStats()
+ */
+QVariantMap ClientCallStats::snapshot() const
+{
+	QMutexLocker locker(&m_mutex);
+	QVariantMap ret;
+	for (QHash<QString, Method>::const_iterator it = m_methods.constBegin(); it != m_methods.constEnd(); ++it)
+	{
+		QVariantMap map;
+		map["calls"] = qulonglong(it->calls);
+		map["errors"] = qulonglong(it->errors);
+		map["send"] = it->send.toMap();
+		map["network"] = it->network.toMap();
+		map["delivery"] = it->delivery.toMap();
+		map["total"] = it->total.toMap();
+		ret[it.key()] = map;
+	}
+	return ret;
+}
+
+/**
+ * Merges the statistics of all the message buses of the process, including the ones that were destroyed.
+ * @return Returns the statistics of every function signature
+ */
+QHash<QString, ClientCallStats::Method> ClientCallStats::merged()
+{
+	QHash<QString, Method> ret;
+	if (registry.isDestroyed())
+		return ret;
+	QMutexLocker locker(&registry()->mutex);
+	ret = registry()->retired;
+	foreach(ClientCallStats* stats, registry()->buses)
+	{
+		QMutexLocker statsLocker(&stats->m_mutex);
+		mergeMethods(ret, stats->m_methods);
+	}
+	return ret;
+}
+
+void ClientCallStats::reset()
+{
+	QMutexLocker locker(&m_mutex);
+	m_methods.clear();
+}
+
+}
@@ -0,0 +1,94 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCCLIENTCALLSTATS_P_H
+#define QTRPCCLIENTCALLSTATS_P_H
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QVariantMap>
+#include <TraceContext>
+#include "callstats_p.h"
+#include <qtrpcprivate.h>
+
+namespace QtRpc
+{
+
+/**
+	Collects the round trip statistics of the function calls made through one message bus. Every call is timestamped when it is submitted to the bus, when the protocol writes it to the device, when its reply is read, and when the reply is delivered to the caller, so the time spent crossing into the bus thread, the time on the network and in the server, and the time spent delivering the reply can be told apart.
+
+	Delivery of asynchronous replies happens in the thread of the receiving object, so the statistics have their own lock and are shared with the pending deliveries.
+	@brief Client side function call statistics of one connection
+*/
+class ClientCallStats
+{
+public:
+	struct Timing
+	{
+		QString method;
+		qint64 submitted;
+		qint64 written;
+		qint64 read;
+		TraceContext trace;
+	};
+
+	struct Method
+	{
+		Method();
+		void merge(const Method& other);
+
+		quint64 calls;
+		quint64 errors;
+		LatencyHistogram send;
+		LatencyHistogram network;
+		LatencyHistogram delivery;
+		LatencyHistogram total;
+	};
+
+	ClientCallStats();
+	~ClientCallStats();
+
+	void record(const Timing& timing, bool error, qint64 delivered);
+	QVariantMap snapshot() const;
+	void reset();
+
+	static QHash<QString, Method> merged();
+
+private:
+	Q_DISABLE_COPY(ClientCallStats);
+	mutable QMutex m_mutex;
+	QHash<QString, Method> m_methods;
+};
+
+}
+
+#endif
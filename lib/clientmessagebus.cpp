@@ -44,6 +44,7 @@
 #include <ClientProtocolTcp>
 #include <ClientProtocolSocket>
 #include "sleeper.h"
+#include "callcontext_p.h"
 
 namespace QtRpc
 {
@@ -60,6 +61,7 @@ ClientMessageBus::ClientMessageBus(QObject *parent) : QObject(parent)
 		qFatal("Fatal Error: Do not create ClientMessageBus objects directly, use ClientProtocolThread instead.");
 	}
 	qxt_d().curid = 0;
+	qxt_d().stats = QSharedPointer<ClientCallStats>(new ClientCallStats);
 	QObject::connect(this, SIGNAL(disconnected()), &qxt_d(), SLOT(disconnected()));
 }
 
@@ -81,6 +83,7 @@ void ClientMessageBusPrivate::disconnected()
 	disconnect(this, SLOT(returnReceived(Message)));
 	ReturnValue ret(1, "Disconnected from server");
 	QList<uint> keys = wm.keys();
+	cancelled.clear();
 	mutex.unlock();
 	foreach(uint id, keys)
 	{
@@ -139,10 +142,27 @@ ReturnValue ClientMessageBus::callFunction(Message msg, int timeout)
 		qCritical() << "Error: You cannot call functions from the same thread as the message bus, this breaks EVERYTHING.";
 		return ReturnValue(1, "You cannot call functions from the same thread as the message bus, this breaks EVERYTHING.");
 	}
+	if (msg.type() == Message::Function)
+	{
+		// Calls made from inside of a service function can't outlive the call that made them
+		qint64 remaining = CallContext::currentRemainingTime();
+		if (remaining == 0)
+			return ReturnValue(ReturnValue::DeadlineExceeded, "The deadline for the function call expired before it could be sent.");
+		if (remaining > 0 && remaining < timeout)
+			timeout = remaining;
+		if (timeout > 0)
+			msg.setTimeout(timeout);
+		// Calls made while a trace is current get a span of their own in it
+		TraceContext trace = TraceContext::current();
+		if (trace.isValid())
+			msg.setTraceContext(trace.child());
+	}
 	qxt_d().curid++;
 	msg.setId(qxt_d().curid);
 // 	qDebug() << "SEND:" << msg;
 	qxt_d().wm[msg.id()].sync = true;
+	if (msg.type() == Message::Function)
+		qxt_d().startTiming(msg);
 	emit sendFunction(msg); //Make the function call (across thread boundary)
 	QTime timer(0, 0, 0, 0);
 	timer.start();
@@ -150,9 +170,18 @@ ReturnValue ClientMessageBus::callFunction(Message msg, int timeout)
 	{
 		if (qxt_d().returnValues.contains(msg.id()))
 		{
-			return qxt_d().returnValues.take(msg.id()); //data found, return from the function
+			ReturnValue ret = qxt_d().returnValues.take(msg.id()); //data found, return from the function
+			qxt_d().finishTiming(msg.id(), ret.isError());
+			return ret;
 		}
 	}
+	qxt_d().timings.remove(msg.id());
+	//Nobody is waiting for the reply anymore, so the server shouldn't keep working on it either
+	if (msg.type() == Message::Function && qxt_d().wm.remove(msg.id()) > 0)
+	{
+		qxt_d().addCancelled(msg.id());
+		emit sendFunction(Message(0, Message::QtRpc, Signature("cancel(quint32)"), Arguments() << msg.id()));
+	}
 	return ReturnValue(1, "Timed out while waiting for reply on the MessageBus.");
 }
 
@@ -178,16 +207,56 @@ int ClientMessageBus::callFunction(QObject* obj, Signature slot, Message msg)
 	{
 		qWarning() << "You should not call functions from the same thread as the message bus.";
 	}
+	qint64 remaining = -1;
+	if (msg.type() == Message::Function)
+	{
+		remaining = CallContext::currentRemainingTime();
+		if (remaining > 0)
+			msg.setTimeout(remaining);
+		TraceContext trace = TraceContext::current();
+		if (trace.isValid())
+			msg.setTraceContext(trace.child());
+	}
 	qxt_d().curid++;
 	msg.setId(qxt_d().curid);
 // 	qDebug() << "SEND:" << msg;
 	qxt_d().wm[msg.id()].sync = false;
 	qxt_d().wm[msg.id()].object = obj;
 	qxt_d().wm[msg.id()].slot = slot.name();
+	if (msg.type() == Message::Function)
+		qxt_d().startTiming(msg);
+	if (remaining == 0)
+	{
+		//The inherited deadline already passed, deliver the error the same way a reply would be
+		QMetaObject::invokeMethod(&qxt_d(), "returnReceived", Qt::QueuedConnection, Q_ARG(Message, Message(msg.id(), ReturnValue(ReturnValue::DeadlineExceeded, "The deadline for the function call expired before it could be sent."))));
+		return msg.id();
+	}
 	emit sendFunction(msg); //Make the function call (across thread boundary)
 	return msg.id();
 }
 
+/**
+ * Cancels a function call that is still waiting for its reply. The call is removed from the wait list so the reply is never delivered, and the server is asked to stop working on it. A syncronous call blocked in another thread returns a Cancelled error right away.
+ * @param id The id of the function call
+ * @return Returns true if the call was still pending
+ */
+bool ClientMessageBus::cancel(uint id)
+{
+	QMutexLocker locker(&qxt_d().mutex);
+	if (!qxt_d().wm.contains(id))
+		return false;
+	ClientMessageBusPrivate::WaitingMessage wmessage = qxt_d().wm.take(id);
+	qxt_d().addCancelled(id);
+	qxt_d().timings.remove(id);
+	if (wmessage.sync)
+	{
+		qxt_d().returnValues[id] = ReturnValue(ReturnValue::Cancelled, "The function call was cancelled");
+		qxt_d().waiter.wakeAll();
+	}
+	emit sendFunction(Message(0, Message::QtRpc, Signature("cancel(quint32)"), Arguments() << id));
+	return true;
+}
+
 /**
  * This function parses \a ret and routes it to the correct place by \a id . For internal use only.
  * @param id The id number of the function call
@@ -196,12 +265,18 @@ int ClientMessageBus::callFunction(QObject* obj, Signature slot, Message msg)
 void ClientMessageBusPrivate::returnReceived(Message msg)
 {
 // 	qDebug() << "RECV:" << msg;
+	qint64 read = CallStats::now();
 	QMutexLocker locker(&mutex);
+	if (cancelled.remove(msg.id()))
+		return;
 	if (!wm.contains(msg.id()))
 	{
 		qWarning() << "Wait list does not contain id," << msg.id() << "this is likely because the syncronous call timed out.";
 		return;
 	}
+	QHash<uint, ClientCallStats::Timing>::iterator timing = timings.find(msg.id());
+	if (timing != timings.end())
+		timing->read = read;
 	ClientMessageBusPrivate::WaitingMessage wmessage = wm.take(msg.id());
 	if (wmessage.sync) //If it's a syncronous call then simply set the data and wake the threads.
 	{
@@ -211,13 +286,100 @@ void ClientMessageBusPrivate::returnReceived(Message msg)
 	}
 	if (wmessage.object.isNull())
 	{
+		timings.remove(msg.id());
+		return;
+	}
+	if (timing != timings.end())
+	{
+		ClientCallStats::Timing t = *timing;
+		timings.erase(timing);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+		//Deliver through a functor, so the time the reply waits in the event loop of the receiver is measured too
+		QSharedPointer<ClientCallStats> s = stats;
+		QPointer<QObject> object = wmessage.object;
+		QString slot = wmessage.slot;
+		uint id = msg.id();
+		ReturnValue ret = msg.returnValue();
+		QMetaObject::invokeMethod(wmessage.object, [s, t, object, slot, id, ret]()
+		{
+			s->record(t, ret.isError(), CallStats::now());
+			if (!object.isNull() && !QMetaObject::invokeMethod(object, qPrintable(slot), Qt::DirectConnection, Q_ARG(uint, id), Q_ARG(ReturnValue, ret)))
+				qCritical() << "Error: QMetaObject::invokeMethod returned false. (" << object << ", " << slot;
+		}, Qt::QueuedConnection);
 		return;
+#else
+		stats->record(t, msg.returnValue().isError(), CallStats::now());
+#endif
 	}
 	//If it's an asyncronous call then use a QueuedConnection invokeMethod to send the reply to the correct slot.
 	if (!QMetaObject::invokeMethod(wmessage.object, qPrintable(wmessage.slot), Qt::QueuedConnection, Q_ARG(uint, msg.id()), Q_ARG(ReturnValue, msg.returnValue())))
 		qCritical() << "Error: QMetaObject::invokeMethod returned false. (" << wmessage.object << ", " << wmessage.slot;
 }
 
+/**
+ * This function is called by the protocol when a function call was written to the device. For internal use only.
+ * @param id The id number of the function call
+ */
+void ClientMessageBusPrivate::functionWritten(uint id)
+{
+	qint64 written = CallStats::now();
+	QMutexLocker locker(&mutex);
+	QHash<uint, ClientCallStats::Timing>::iterator timing = timings.find(id);
+	if (timing != timings.end() && timing->written < 0)
+		timing->written = written;
+}
+
+/**
+ * Remembers that the reply to \a id must be dropped. Once more than MaxCancelled calls are remembered, the ones made more than MaxCancelled / 2 calls ago are forgotten, their reply is not coming anymore. The mutex must be locked.
+ * @param id The id number of the function call
+ */
+void ClientMessageBusPrivate::addCancelled(uint id)
+{
+	cancelled.insert(id);
+	if (cancelled.count() <= MaxCancelled)
+		return;
+	QSet<uint>::iterator it = cancelled.begin();
+	while (it != cancelled.end())
+	{
+		if (curid - *it > MaxCancelled / 2)
+			it = cancelled.erase(it);
+		else
+			++it;
+	}
+}
+
+void ClientMessageBusPrivate::startTiming(const Message& msg)
+{
+	ClientCallStats::Timing timing = {msg.signature().toString(), CallStats::now(), -1, -1, msg.traceContext()};
+	timings.insert(msg.id(), timing);
+}
+
+void ClientMessageBusPrivate::finishTiming(uint id, bool error)
+{
+	QHash<uint, ClientCallStats::Timing>::iterator timing = timings.find(id);
+	if (timing == timings.end())
+		return;
+	stats->record(*timing, error, CallStats::now());
+	timings.erase(timing);
+}
+
+/**
+ * Returns the round trip statistics of the function calls made through this bus. See ClientProxy::callStats() for a description of the map.
+ * @return Returns a map of function signatures to their statistics
+ */
+QVariantMap ClientMessageBus::callStats() const
+{
+	return qxt_d().stats->snapshot();
+}
+
+/**
+ * Clears the statistics returned by callStats()
+ */
+void ClientMessageBus::resetCallStats()
+{
+	qxt_d().stats->reset();
+}
+
 
 }
 
@@ -68,11 +68,14 @@ public:
 	~ClientMessageBus();
 	ReturnValue callFunction(Signature, Arguments args = Arguments(), int timeout = 60000);
 	static ClientMessageBus* instance(QString);
+	QVariantMap callStats() const;
+	void resetCallStats();
 // 	void deleteLater();
 public slots:
 	int callFunction(QObject*, Signature, Signature, Arguments args = Arguments());
 	int callFunction(QObject* obj, Signature slot, Message msg);
 	ReturnValue callFunction(Message msg, int timeout = 60000);
+	bool cancel(uint id);
 // 	void returnReceived(uint, ReturnValue);
 signals:
 	/**
@@ -37,8 +37,11 @@
 #include <QObject>
 #include <QPointer>
 #include <QHash>
+#include <QSet>
 #include <QMutex>
 #include <QWaitCondition>
+#include <QSharedPointer>
+#include "clientcallstats_p.h"
 #include <qtrpcprivate.h>
 
 namespace QtRpc
@@ -65,10 +68,23 @@ public:
 	QWaitCondition waiter;
 	QHash<uint, ReturnValue> returnValues;
 	QHash<uint, WaitingMessage> wm;
+	enum
+	{
+		MaxCancelled = 4096
+	};
+	// cancelled calls still get exactly one reply from the server, which is dropped quietly. Servers that don't know cancel() may never reply, so old entries are forgotten.
+	QSet<uint> cancelled;
+	// timestamps of the function calls waiting for a reply
+	QHash<uint, ClientCallStats::Timing> timings;
+	QSharedPointer<ClientCallStats> stats;
+	void startTiming(const Message& msg);
+	void finishTiming(uint id, bool error);
+	void addCancelled(uint id);
 
 public slots:
 	void disconnected();
 	void returnReceived(Message msg);
+	void functionWritten(uint id);
 
 };
 
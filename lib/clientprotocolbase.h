@@ -107,6 +107,11 @@ signals:
 	 *        This signal is used to communicate to the ClientMessageBus that the protocol has been disconnected.
 	 */
 	void disconnected();
+	/**
+	 *        This signal is used to tell the ClientMessageBus that a function call was written to the device, for its statistics.
+	 * @param id The id number of the function call.
+	 */
+	void functionWritten(uint id);
 	void aboutToChangeThreads(QThread*);
 protected:
 	virtual QString getServiceName();
@@ -35,8 +35,7 @@
 #include <QDebug>
 #include <QThread>
 #include <QUrl>
-
-// #define DEBUG_MESSAGES
+#include "metrics_p.h"
 
 namespace QtRpc
 {
@@ -209,29 +208,20 @@ void ClientProtocolIODevicePrivate::writeMessage(Message msg)
 		emit qxt_p().returnReceived(Message(msg.id(), ReturnValue(1, "Not Connected")));
 		return;
 	}
-	QByteArray array;
-	QDataStream stream(&array, QIODevice::WriteOnly);
 	msg.setVersion(qxt_p().version());
 
-#ifdef DEBUG_MESSAGES
-	if (msg.type() == Message::Return)
-		qDebug() << "S:" << msg.returnValue();
-	else
-		qDebug() << "S:" << msg.signature();
-#endif
-
-	stream << msg.size() << msg;
-	device->write(array);
-	return;
-	while (device->bytesToWrite() > 0)
+	QByteArray frame = msg.frame();
+	if (WireTapPrivate::isActive())
+		WireTapPrivate::capture(tapId, WireTap::ClientSent, msg.version(), frame, sizeof(qint64));
+	if (device->write(frame) < 0)
 	{
-		if (!device->waitForBytesWritten(25))
-		{
-			qCritical() << "Failed to wait for bytes written";
-			emit qxt_p().returnReceived(Message(msg.id(), ReturnValue(1, device->errorString())));
-			return;
-		}
+		qCritical() << "Failed to write to the device" << device->errorString();
+		emit qxt_p().returnReceived(Message(msg.id(), ReturnValue(1, device->errorString())));
+		return;
 	}
+	Metrics::addBytesSent(Metrics::ClientSide, frame.size());
+	if (msg.type() == Message::Function)
+		emit qxt_p().functionWritten(msg.id());
 }
 
 /**
@@ -259,6 +249,7 @@ This slot is connected to the readyRead() signal on the QIODevice object. It loo
  */
 void ClientProtocolIODevicePrivate::readyRead()
 {
+	qint64 bytes = 0;
 	while (device->bytesAvailable() != 0)
 	{
 		if (totalSize == 0)
@@ -266,6 +257,7 @@ void ClientProtocolIODevicePrivate::readyRead()
 			if (device->bytesAvailable() < sizeof(totalSize))
 				break;
 			stream >> totalSize;
+			bytes += sizeof(totalSize);
 			read = 0;
 			buffer.resize(0);
 			buffer.reserve(totalSize);
@@ -280,21 +272,22 @@ void ClientProtocolIODevicePrivate::readyRead()
 			return;
 		}
 		read += i;
+		bytes += i;
 
 		if (totalSize <= read)
 		{
 			totalSize = 0;
 			read = 0;
+			if (WireTapPrivate::isActive())
+				WireTapPrivate::capture(tapId, WireTap::ClientReceived, qxt_p().version(), buffer);
 			Message msg;
 			msg.setVersion(qxt_p().version());
 			QDataStream stream(buffer);
 			stream >> msg;
-#ifdef DEBUG_MESSAGES
-			qDebug() << "R:" << msg.signature();
-#endif
 			parseMessage(msg);
 		}
 	}
+	Metrics::addBytesReceived(Metrics::ClientSide, bytes);
 }
 
 void ClientProtocolIODevicePrivate::parseMessage(Message msg)
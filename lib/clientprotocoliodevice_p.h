@@ -38,6 +38,7 @@
 #include <Message>
 #include <QMutex>
 #include <qtrpcprivate.h>
+#include "wiretap_p.h"
 
 #include "clientprotocoliodevice.h"
 
@@ -51,6 +52,7 @@ class ClientProtocolIODevicePrivate : public QObject, public QxtPrivate<ClientPr
 	Q_OBJECT
 public:
 	ClientProtocolIODevicePrivate()
+			: tapId(WireTapPrivate::nextConnection())
 	{
 	}
 	bool checkProtocolFunction(Message);
@@ -63,6 +65,8 @@ public:
 	QByteArray buffer;
 	QDataStream stream;
 	QIODevice* device;
+	// id of the connection in wire tap captures
+	quint32 tapId;
 
 public slots:
 	void readyRead();
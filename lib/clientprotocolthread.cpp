@@ -94,6 +94,9 @@ ClientMessageBus* ClientProtocolThread::initialize()
 		//server sends return to client
 	connect(_protocol, SIGNAL(returnReceived(Message)), &_bus->qxt_d(), SLOT(returnReceived(Message)), Qt::DirectConnection);
 
+		//protocol wrote a function call, for the bus statistics
+	connect(_protocol, SIGNAL(functionWritten(uint)), &_bus->qxt_d(), SLOT(functionWritten(uint)), Qt::DirectConnection);
+
 		//server sends event to client
 	connect(_protocol, SIGNAL(sendEvent(Message)), _bus, SIGNAL(sendEvent(Message)), Qt::DirectConnection);
 
@@ -126,6 +126,15 @@ ReturnValue ServiceData::callFunction(QObject* obj, Signature slot, Signature si
 	return connection->bus->callFunction(obj, slot, Message(0, Message::Function, sig, args, id));
 }
 
+ReturnValue ServiceData::callPackedFunction(Signature sig, const QByteArray& packed)
+{
+	if (!connection || !connection->bus)
+		return ReturnValue(1, "Cannot call functions while not connected");
+	Message msg(0, Message::Function, sig, Arguments(), id);
+	msg.setPackedArguments(packed);
+	return connection->bus->callFunction(msg);
+}
+
 ConnectionData::~ConnectionData()
 {
 	// at this point the last servicedata object was deleted, so we can now make the message bus go away, which effectively (via signals and slots and shit) also deletes the qtrpc2 communications internals... clientprotocolthread does all those connections, check both the header and the cpp for details on how that works
@@ -150,6 +159,16 @@ void ConnectionData::sendEvent(Message msg)
 		return;
 	if (serviceDataObjects.value(msg.service()).isNull())
 		return;
+	if (msg.signature().name() == "QtRpc::eventBatch" && msg.arguments().count() > 1)
+	{
+		// several emits of the same event, coalesced by the server
+		Signature sig(msg.arguments()[0].toString());
+		foreach(QVariant args, msg.arguments()[1].toList())
+		{
+			serviceDataObjects.value(msg.service()).data()->sendEvent(sig, args.toList());
+		}
+		return;
+	}
 	serviceDataObjects.value(msg.service()).data()->sendEvent(msg.signature(), msg.arguments());
 }
 
@@ -199,6 +218,22 @@ ReturnValue ConnectionData::callFunction(QObject* obj, Signature slot, Signature
 	return bus->callFunction(obj, slot, Message(0, Message::QtRpc, sig, args));
 }
 
+// The version can't change once the connection is made, every connect() makes a new ConnectionData
+ReturnValue ConnectionData::protocolVersion()
+{
+	{
+		QMutexLocker locker(&mutex);
+		if (version >= 0)
+			return version;
+	}
+	ReturnValue ret = callFunction(Signature("version()"), Arguments());
+	if (ret.isError())
+		return ret;
+	QMutexLocker locker(&mutex);
+	version = ret.toInt();
+	return ret;
+}
+
 ClientProxyPrivate::ClientProxyPrivate() :
 		connection(new ConnectionData()) //we should ALWAYS have a connection object, no matter what
 {
@@ -364,7 +399,7 @@ ReturnValue QtRpc::ClientProxy::connect(QUrl url, QObject *obj, const char *slot
 		qxt_d().connection->state = Connected;
 
 		// at this point the version negotiations are completed
-		ret = qxt_d().connection->callFunction(Signature("version()"), Arguments());
+		ret = qxt_d().connection->protocolVersion();
 		if (ret.isError())
 		{
 			qCritical() << "Failed to get version:" << ret;
@@ -601,6 +636,10 @@ void ClientProxyPrivate::getServiceCompleted(uint id, ReturnValue ret)
 		{
 			// return from version
 			serviceStatus["version"] = ret.toInt();
+			{
+				QMutexLocker locker(&connection->mutex);
+				connection->version = ret.toInt();
+			}
 			if (serviceStatus["version"] == 0)
 			{
 				if (token.isDefault())
@@ -718,7 +757,7 @@ ReturnValue ClientProxy::getService(QString service, AuthToken token)
 {
 	if (!qxt_d().connection)
 		return ReturnValue(1, "Not connected");
-	ReturnValue ret = qxt_d().connection->callFunction(Signature("version()"), Arguments());
+	ReturnValue ret = qxt_d().connection->protocolVersion();
 	if (ret.isError())
 	{
 		qCritical() << "Failed to get version:" << ret;
@@ -797,6 +836,33 @@ ReturnValue ClientProxy::functionCalled(const Signature& sig, const Arguments& a
 	return ret;
 }
 
+/**
+ * Synchronously calls a function of the selected service with arguments that are already packed, see Message::setPackedArguments(). The arguments are not converted to QVariants on either side of the connection, unless the server is too old to accept packed arguments. Normally used through TypedFunction rather than directly.
+ * @param sig The signature of the function
+ * @param packed The arguments, written in order with the QDataStream operators of the types in \a sig
+ * @return Returns the return value of the function, or an error
+ */
+ReturnValue ClientProxy::callPackedFunction(const Signature& sig, const QByteArray& packed)
+{
+	if (qxt_d().connection->bus.isNull())
+	{
+		throwException(ReturnValue(1, "Not Connected"));
+		return(ReturnValue(1, "Not Connected"));
+	}
+
+	if (qxt_d().service.isNull())
+	{
+		throwException(ReturnValue(1, "No service selected"));
+		return(ReturnValue(1, "No service selected"));
+	}
+	ReturnValue ret = qxt_d().parseReturn(qxt_d().service->callPackedFunction(sig, packed));
+
+	if(ret.isError())
+		throwException(ret);
+
+	return ret;
+}
+
 /**
  * Internal function inherited from ProxyBase to handle Asynchronous function calls
  */
@@ -949,6 +1015,97 @@ ReturnValue ClientProxy::listEvents(const QString &service)
 	return qxt_d().connection->callFunction(Signature("listEvents(QString)"), Arguments() << service);
 }
 
+/**
+ * Requests the function call statistics of the server, see Server::callStats(). The server only answers once the connection authenticated, and if Server::setRemoteStatsEnabled() allows it.
+ * @return Returns a QVariantMap of statistics per service and function, or an error
+ */
+ReturnValue ClientProxy::stats()
+{
+	return qxt_d().connection->callFunction(Signature("stats()"), Arguments());
+}
+
+/**
+ * Returns the round trip statistics of the function calls made through the connection of this proxy, measured on the client. The map contains the signature of every function that was called, mapped to the number of calls, the number of errors, and histograms of four times:
+ * - send: from the call until the protocol wrote it to the network, which includes the hop to the thread of the connection
+ * - network: from the write until the reply was read, which includes the time spent by the server
+ * - delivery: from reading the reply until the caller received it, either the waiting thread waking up or the slot of an asynchronous call running
+ * - total: from the call until the caller received the reply
+ *
+ * Each histogram is a map with the count, min, max, mean, p50, p90, p99 and p999 values, in microseconds. Use stats() for the statistics measured by the server.
+ * @return Returns a map of function signatures to their statistics, or an empty map when not connected
+ */
+QVariantMap ClientProxy::callStats() const
+{
+	if (!qxt_d().connection || !qxt_d().connection->bus)
+		return QVariantMap();
+	return qxt_d().connection->bus->callStats();
+}
+
+/**
+ * Clears the statistics returned by callStats()
+ */
+void ClientProxy::resetCallStats()
+{
+	if (!qxt_d().connection || !qxt_d().connection->bus)
+		return;
+	qxt_d().connection->bus->resetCallStats();
+}
+
+/**
+ * Cancels an asynchronous function call. The slot that was passed to the call is never called, and the server is asked to stop working on the call.
+ * @param id The id returned by the asynchronous function
+ * @return Returns true if the call was still waiting for its reply
+ */
+bool ClientProxy::cancel(uint id)
+{
+	qxt_d().functionObjects.remove(id);
+	if (qxt_d().connection.isNull() || qxt_d().connection->bus.isNull())
+		return false;
+	return qxt_d().connection->bus->cancel(id);
+}
+
+/**
+ * Subscribes to an event of the selected service. Until the first subscription the server sends every event, afterwards it only sends the events that were subscribed to, which saves the bandwidth of events nobody listens to. Subscriptions belong to the service object on the server, so they are shared by all ClientProxy objects using it.
+ * @code
+ * proxy.subscribeEvent("valueChanged(QString,int)"); //every valueChanged event
+ * QVariantMap predicate;
+ * predicate["0"] = "temperature";
+ * proxy.subscribeEvent("sensorChanged(QString,double)", predicate); //only when the first argument is "temperature"
+ * @endcode
+ * @param event The signature of the event, as declared on the server
+ * @param predicate Maps argument positions ("0", "1", ...) to the values those arguments must be equal to for the event to be sent
+ * @return Returns true on success, or an error if the server doesn't support subscriptions
+ */
+ReturnValue ClientProxy::subscribeEvent(const Signature& event, const QVariantMap& predicate)
+{
+	if (qxt_d().connection.isNull() || qxt_d().service.isNull())
+		return ReturnValue(1, "No service selected");
+	ReturnValue ret = qxt_d().connection->protocolVersion();
+	if (ret.isError())
+		return ret;
+	if (ret.toUInt() < 3)
+		return ReturnValue(1, "The server does not support event subscriptions");
+	return qxt_d().connection->callFunction(Signature("subscribeEvent(quint32,QString,QVariantMap)"), Arguments() << qxt_d().service->id << event.toString() << predicate);
+}
+
+/**
+ * Unsubscribes from an event of the selected service.
+ * @sa subscribeEvent()
+ * @param event The signature of the event
+ * @return Returns true if the service was subscribed to the event, or an error
+ */
+ReturnValue ClientProxy::unsubscribeEvent(const Signature& event)
+{
+	if (qxt_d().connection.isNull() || qxt_d().service.isNull())
+		return ReturnValue(1, "No service selected");
+	ReturnValue ret = qxt_d().connection->protocolVersion();
+	if (ret.isError())
+		return ret;
+	if (ret.toUInt() < 3)
+		return ReturnValue(1, "The server does not support event subscriptions");
+	return qxt_d().connection->callFunction(Signature("unsubscribeEvent(quint32,QString)"), Arguments() << qxt_d().service->id << event.toString());
+}
+
 void QtRpc::ClientProxyPrivate::disconnectedSlot()
 {
 	{
@@ -235,6 +235,13 @@ public:
 	ReturnValue listFunctions(const QString &service);
 	ReturnValue listCallbacks(const QString &service);
 	ReturnValue listEvents(const QString &service);
+	ReturnValue stats();
+	QVariantMap callStats() const;
+	void resetCallStats();
+	bool cancel(uint id);
+	ReturnValue subscribeEvent(const Signature& event, const QVariantMap& predicate = QVariantMap());
+	ReturnValue unsubscribeEvent(const Signature& event);
+	ReturnValue callPackedFunction(const Signature& sig, const QByteArray& packed);
 	QtRpc::AuthToken authToken() const;
 	QtRpc::AuthToken &authToken();
 
@@ -72,7 +72,8 @@ class ConnectionData : public QObject, public QSharedData
 	Q_OBJECT
 public:
 	ConnectionData()
-			: mutex(QMutex::Recursive)
+			: mutex(QMutex::Recursive),
+			version(-1)
 	{
 	}
 	~ConnectionData();
@@ -84,12 +85,15 @@ public:
 	// Function calling
 	ReturnValue callFunction(Signature sig, Arguments args); //out
 	ReturnValue callFunction(QObject* obj, Signature slot, Signature sig, Arguments args); //out
+	// The protocol version negotiated with the server, asked once per connection
+	ReturnValue protocolVersion();
 
 	QMutex mutex;
 	ClientProxy::State state;
 	QPointer<ClientMessageBus> bus;
 	QHash<quint32, QWeakPointer<ServiceData> > serviceDataObjects;
 	AuthToken token;
+	int version; // -1 until protocolVersion() asked for it
 public slots:
 	void sendEvent(Message msg); //in
 	void sendCallback(Message msg); //in
@@ -113,6 +117,7 @@ public:
 	// function calling
 	ReturnValue callFunction(Signature sig, Arguments args); //out
 	ReturnValue callFunction(QObject* obj, Signature slot, Signature sig, Arguments args); //out
+	ReturnValue callPackedFunction(Signature sig, const QByteArray& packed); //out
 
 	// service ID from the server side
 	quint32 id;
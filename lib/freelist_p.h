@@ -0,0 +1,200 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCFREELIST_P_H
+#define QTRPCFREELIST_P_H
+
+#include <QtGlobal>
+#include <new>
+#include <cstddef>
+#include "threadshards_p.h"
+#include <qtrpcprivate.h>
+
+namespace QtRpc
+{
+
+/**
+ * The free lists can be turned off by setting the QTRPC_FREELIST environment variable to 0, to compare allocations and latency with and without them. The variable is read once, before the first allocation.
+ * @return Returns true if FreeList recycles blocks, false if it hands every allocation to the heap
+ */
+inline bool freeListEnabled()
+{
+	static const bool enabled = qgetenv("QTRPC_FREELIST") != "0";
+	return enabled;
+}
+
+/**
+	A thread local cache of freed blocks for the small private objects that are created and destroyed for every message, like MessageData and SignatureData. Freed blocks are kept, up to a limit, and handed out again by the next allocation instead of going through malloc.
+
+	Every block remembers the cache of the thread that allocated it, and goes back to that cache when it is freed. Blocks are often freed by a different thread than the one that allocated them, whenever a message is passed between threads, for example a call read by a connection thread and answered by a pool thread. Those blocks are pushed on a lock free list of the owning cache, which the owning thread takes over the next time its own blocks run out. This way a thread that only allocates still reuses its blocks, and a thread that only frees does not collect blocks it never uses.
+
+	Caches are ThreadShards, so the cache of a thread that exits is handed to the next thread with the blocks it holds, and a block can always be given back to its cache. Caches are never freed.
+
+	Classes use it through QTRPC_FREELIST_ALLOCATED().
+	@brief Per thread cache of freed blocks for one class
+*/
+template<typename T, int Limit = 128>
+class FreeList
+{
+public:
+	static void* allocate(size_t size)
+	{
+		// Derived classes have a different size, they go to the heap
+		if (size != sizeof(T) || !freeListEnabled())
+			return ::operator new(size);
+		Cache* c = cache();
+		if (c->count == 0)
+			c->collect();
+		Header* block;
+		if (c->count > 0)
+			block = c->blocks[--c->count];
+		else
+		{
+			block = static_cast<Header*>(::operator new(Offset + sizeof(T)));
+			block->owner = c;
+		}
+		return reinterpret_cast<char*>(block) + Offset;
+	}
+
+	static void release(void* data, size_t size)
+	{
+		if (data == 0)
+			return;
+		if (size != sizeof(T) || !freeListEnabled())
+		{
+			::operator delete(data);
+			return;
+		}
+		Header* block = reinterpret_cast<Header*>(static_cast<char*>(data) - Offset);
+		Cache* c = cache();
+		if (block->owner == c)
+		{
+			if (c->count < Limit)
+			{
+				c->blocks[c->count++] = block;
+				return;
+			}
+		}
+		else if (block->owner->giveBack(block))
+			return;
+		::operator delete(block);
+	}
+
+private:
+	struct Cache;
+
+	// Placed in front of every block, the object follows at Offset
+	struct Header
+	{
+		Cache* owner;
+		Header* next;
+	};
+
+	static const size_t Offset = (sizeof(Header) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+
+	struct Cache : public ThreadShard
+	{
+		Cache()
+				: count(0),
+				remote(0),
+				remoteCount(0)
+		{
+		}
+
+		/**
+		 * Gives a block back from another thread. Never blocks.
+		 * @return Returns false if the cache already holds enough blocks from other threads, the block should be freed
+		 */
+		bool giveBack(Header* block)
+		{
+			if (remoteCount.load() >= Limit)
+				return false;
+			remoteCount.ref();
+			Header* head;
+			do
+			{
+				head = remote.load();
+				block->next = head;
+			}
+			while (!remote.testAndSetRelease(head, block));
+			return true;
+		}
+
+		/**
+		 * Moves the blocks given back by other threads to the blocks of the owning thread. Must only be called by the owning thread.
+		 */
+		void collect()
+		{
+			Header* block = remote.fetchAndStoreAcquire(0);
+			while (block != 0)
+			{
+				Header* next = block->next;
+				remoteCount.deref();
+				if (count < Limit)
+					blocks[count++] = block;
+				else
+					::operator delete(block);
+				block = next;
+			}
+		}
+
+		// Only used by the owning thread
+		Header* blocks[Limit];
+		int count;
+		// Blocks given back by other threads
+		QAtomicPointer<Header> remote;
+		QAtomicInt remoteCount;
+	};
+
+	static Cache* cache()
+	{
+		// Never destroyed, so that objects freed during static destruction still find their cache
+		static ThreadShards<Cache>* shards = new ThreadShards<Cache>();
+		return shards->local();
+	}
+};
+
+}
+
+/**
+	Makes a class allocate its objects through a FreeList. Place it in the public section of the class.
+*/
+#define QTRPC_FREELIST_ALLOCATED(Class) \
+	static void* operator new(size_t size) \
+	{ \
+		return QtRpc::FreeList<Class>::allocate(size); \
+	} \
+	static void operator delete(void* block, size_t size) \
+	{ \
+		QtRpc::FreeList<Class>::release(block, size); \
+	}
+
+#endif
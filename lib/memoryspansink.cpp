@@ -0,0 +1,88 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include "memoryspansink.h"
+#include "memoryspansink_p.h"
+#include <QMutexLocker>
+
+namespace QtRpc
+{
+
+MemorySpanSink::MemorySpanSink()
+{
+	QXT_INIT_PRIVATE(MemorySpanSink);
+}
+
+MemorySpanSink::~MemorySpanSink()
+{
+}
+
+void MemorySpanSink::report(const Span& span)
+{
+	QMutexLocker locker(&qxt_d().mutex);
+	qxt_d().spans << span;
+}
+
+/**
+ * @return Returns every span reported so far, in the order they finished
+ */
+QList<Span> MemorySpanSink::spans() const
+{
+	QMutexLocker locker(const_cast<QMutex*>(&qxt_d().mutex));
+	return qxt_d().spans;
+}
+
+/**
+ * @param trace A context of the trace
+ * @return Returns the spans of the trace of \a trace
+ */
+QList<Span> MemorySpanSink::spans(const TraceContext& trace) const
+{
+	QMutexLocker locker(const_cast<QMutex*>(&qxt_d().mutex));
+	QList<Span> ret;
+	foreach(const Span& span, qxt_d().spans)
+	{
+		if (span.context.traceIdHigh() == trace.traceIdHigh() && span.context.traceIdLow() == trace.traceIdLow())
+			ret << span;
+	}
+	return ret;
+}
+
+/**
+ * Forgets the spans reported so far
+ */
+void MemorySpanSink::clear()
+{
+	QMutexLocker locker(&qxt_d().mutex);
+	qxt_d().spans.clear();
+}
+
+}
@@ -0,0 +1,71 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCMEMORYSPANSINK_H
+#define QTRPCMEMORYSPANSINK_H
+
+#include <QxtPimpl>
+#include <QList>
+#include <SpanSink>
+#include <QtRpcGlobal>
+
+namespace QtRpc
+{
+
+class MemorySpanSinkPrivate;
+
+/**
+	Keeps every reported span in memory. It stands in for a trace collector in tests and tools, which can check the spans a call produced.
+	@code
+	QSharedPointer<MemorySpanSink> collector(new MemorySpanSink());
+	SpanSink::setSink(collector);
+	...
+	foreach(Span span, collector->spans())
+		qDebug() << span.name << span.context.traceIdString();
+	@endcode
+	@brief Span sink that collects spans in memory
+*/
+class QTRPC2_EXPORT MemorySpanSink : public SpanSink
+{
+	QXT_DECLARE_PRIVATE(MemorySpanSink);
+public:
+	MemorySpanSink();
+	~MemorySpanSink();
+
+	void report(const Span& span);
+	QList<Span> spans() const;
+	QList<Span> spans(const TraceContext& trace) const;
+	void clear();
+};
+
+}
+
+#endif
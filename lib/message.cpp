@@ -33,12 +33,37 @@
 #include "message_p.h"
 #include <QDebug>
 #include <QDataStream>
+#include <QtEndian>
+#include <QMetaType>
 
 using namespace QtRpc;
 
+// Flags of version 4 and later Function messages
+enum
+{
+	FunctionPacked = 0x01,
+	FunctionTraced = 0x02,
+	TraceSampled = 0x01
+};
+
+static quint8 functionFlags(const MessageData* priv)
+{
+	quint8 flags = 0;
+	if (priv->packed)
+		flags |= FunctionPacked;
+	if (priv->version >= 0x00000005 && priv->trace.isValid())
+		flags |= FunctionTraced;
+	return flags;
+}
+
+static void writeTraceContext(QDataStream& s, const TraceContext& trace)
+{
+	s << trace.traceIdHigh() << trace.traceIdLow() << trace.spanId() << static_cast<quint8>(trace.isSampled() ? TraceSampled : 0x00);
+}
+
 quint32 Message::currentVersion()
 {
-	return 0x00000002;
+	return 0x00000005;
 }
 
 MessageData::MessageData()
@@ -47,6 +72,8 @@ MessageData::MessageData()
 	type = Message::Invalid;
 	version = 0x00000000; // original qtrpc2
 	service = 0;
+	timeout = 0;
+	packed = false;
 }
 
 /**
@@ -216,6 +243,8 @@ void Message::setSignature(const Signature& func)
 Arguments Message::arguments() const
 {
 	QReadLocker lock(qxt_d().constMutex());
+	if (qxt_d().data->packed)
+		return unpackArguments(qxt_d().data->func, qxt_d().data->packedArgs);
 	return qxt_d().data->args;
 }
 
@@ -227,6 +256,8 @@ void Message::setArguments(const Arguments& args)
 {
 	QWriteLocker lock(qxt_d().constMutex());
 	qxt_d().data->args = args;
+	qxt_d().data->packed = false;
+	qxt_d().data->packedArgs = QByteArray();
 	if (qxt_d().data->type == Return)
 	{
 		if (qxt_d().data->args.count() > 1)
@@ -287,6 +318,115 @@ void Message::setService(quint32 id)
 	qxt_d().data->service = id;
 }
 
+/**
+ * Get the time budget of a function call. This is the number of milliseconds the caller is still willing to wait for the reply at the time the message was sent, or 0 if the call has no deadline. Only sent over the network for Function messages, starting with protocol version 3.
+ * @return The remaining time in milliseconds, or 0 for no deadline
+ */
+quint32 Message::timeout() const
+{
+	QReadLocker lock(qxt_d().constMutex());
+	return qxt_d().data->timeout;
+}
+
+/**
+ * Set the time budget of a function call
+ * @param msecs The remaining time in milliseconds, or 0 for no deadline
+ */
+void Message::setTimeout(quint32 msecs)
+{
+	QWriteLocker lock(qxt_d().constMutex());
+	qxt_d().data->timeout = msecs;
+}
+
+/**
+ * Get the trace context of a function call. The server makes the span it runs the call in a child of it. Only sent over the network for Function messages, starting with protocol version 5.
+ * @return The trace context, or an invalid context if the call is not traced
+ */
+TraceContext Message::traceContext() const
+{
+	QReadLocker lock(qxt_d().constMutex());
+	return qxt_d().data->trace;
+}
+
+/**
+ * Set the trace context of a function call
+ * @param trace The trace context, or an invalid context if the call is not traced
+ */
+void Message::setTraceContext(const TraceContext& trace)
+{
+	QWriteLocker lock(qxt_d().constMutex());
+	qxt_d().data->trace = trace;
+}
+
+/**
+ * @return Returns true if the arguments of the message are packed
+ * @sa setPackedArguments()
+ */
+bool Message::isPacked() const
+{
+	QReadLocker lock(qxt_d().constMutex());
+	return qxt_d().data->packed;
+}
+
+/**
+ * @return Returns the packed arguments, or a null QByteArray if the arguments are not packed
+ */
+QByteArray Message::packedArguments() const
+{
+	QReadLocker lock(qxt_d().constMutex());
+	return qxt_d().data->packedArgs;
+}
+
+/**
+ * Sets the arguments of a Function message as a packed buffer. The arguments are written one after another with the QDataStream operators of their types, in the order of the Signature, without being wrapped in QVariants. Packed arguments are sent as they are to servers that speak protocol version 4 or later, and converted to an Arguments list for older servers.
+ * @param packed The packed arguments
+ */
+void Message::setPackedArguments(const QByteArray& packed)
+{
+	QWriteLocker lock(qxt_d().constMutex());
+	qxt_d().data->packed = true;
+	qxt_d().data->packedArgs = packed;
+	qxt_d().data->args = Arguments();
+}
+
+/**
+ * Converts packed arguments to an Arguments list, using the argument types of \a sig .
+ * @param sig The signature the arguments were packed for
+ * @param packed The packed arguments
+ * @return Returns the arguments, or an empty list if they couldn't be read
+ */
+Arguments Message::unpackArguments(const Signature& sig, const QByteArray& packed)
+{
+	Arguments args;
+	QDataStream in(packed);
+	for (int i = 0; i < sig.numArgs(); i++)
+	{
+		int type = QMetaType::type(qPrintable(sig.arg(i)));
+		if (type == QMetaType::QVariant)
+		{
+			QVariant value;
+			in >> value;
+			args << value;
+			continue;
+		}
+		if (type == QMetaType::UnknownType)
+		{
+			qWarning() << "Cannot unpack an argument of unknown type" << sig.arg(i);
+			return Arguments();
+		}
+		QVariant value(type, static_cast<const void*>(0));
+		if (!QMetaType::load(in, type, value.data()))
+		{
+			qWarning() << "Cannot unpack an argument of type" << sig.arg(i) << ", it has no stream operators";
+			return Arguments();
+		}
+		args << value;
+	}
+	if (in.status() != QDataStream::Ok)
+		return Arguments();
+	return args;
+}
+
 qint64 Message::size() const
 {
 	QReadLocker lock(qxt_d().constMutex());
@@ -296,6 +436,72 @@ qint64 Message::size() const
 	return ba.size();
 }
 
+/**
+ * Serializes the message the way the QIODevice protocols send it, the size of the message followed by the message itself. The message is only encoded once, unlike writing size() and the message to a stream.
+ * @return Returns the encoded frame
+ */
+QByteArray Message::frame() const
+{
+	QByteArray ba;
+	{
+		QDataStream out(&ba, QIODevice::WriteOnly);
+		out << static_cast<qint64>(0) << *this;
+	}
+	qToBigEndian<qint64>(ba.size() - sizeof(qint64), reinterpret_cast<uchar*>(ba.data()));
+	return ba;
+}
+
+/**
+ * Encodes the part of the message that is the same on every connection, the id with the Signature and Arguments, or the id with the ReturnValue. Together with header() this allows a message that is sent to many connections to be encoded only once. Not valid for version 0 messages.
+ * @return Returns the encoded body
+ */
+QByteArray Message::body() const
+{
+	const MessageData* priv = qxt_d().data.constData();
+	QByteArray ba;
+	QDataStream out(&ba, QIODevice::WriteOnly);
+	if (priv->type == Return)
+		out << priv->id << priv->ret;
+	else if (priv->packed && priv->version >= 0x00000004 && priv->type == Function)
+		out << priv->id << priv->func << priv->packedArgs;
+	else if (priv->packed)
+		out << priv->id << priv->func << unpackArguments(priv->func, priv->packedArgs);
+	else
+		out << priv->id << priv->func << priv->args;
+	return ba;
+}
+
+/**
+ * Encodes the size prefix and the connection specific part of the message, for the version, type and service id set on this message. Writing the header followed by a body() gives the same bytes as frame(). Not valid for version 0 messages.
+ * @param bodySize The size of the encoded body
+ * @return Returns the encoded header
+ */
+QByteArray Message::header(qint64 bodySize) const
+{
+	const MessageData* priv = qxt_d().data.constData();
+	QByteArray ba;
+	{
+		QDataStream out(&ba, QIODevice::WriteOnly);
+		out << static_cast<qint64>(0);
+		if (priv->version >= 0x00000002)
+			out << static_cast<quint32>(0x1234abcd);
+		out << priv->type;
+		if (priv->type == Function || priv->type == Event)
+			out << priv->service;
+		if (priv->version >= 0x00000003 && priv->type == Function)
+			out << priv->timeout;
+		if (priv->version >= 0x00000004 && priv->type == Function)
+		{
+			quint8 flags = functionFlags(priv);
+			out << flags;
+			if (flags & FunctionTraced)
+				writeTraceContext(out, priv->trace);
+		}
+	}
+	qToBigEndian<qint64>(ba.size() - sizeof(qint64) + bodySize, reinterpret_cast<uchar*>(ba.data()));
+	return ba;
+}
+
 /**
  * Deconstructor
  */
@@ -313,6 +519,10 @@ QDebug operator<<(QDebug dbg, const QtRpc::Message& msg)
 		case QtRpc::Message::Event:
 			if (msg.version() > 0)
 				dbg.nospace() << ", ServiceID: " << msg.service();
+			if (msg.timeout() != 0)
+				dbg.nospace() << ", Timeout: " << msg.timeout();
+			if (msg.traceContext().isValid())
+				dbg.nospace() << ", Trace: " << msg.traceContext().toTraceparent();
 			dbg.nospace() << ", Signature: " << msg.signature() << ", Arguments: " << msg.arguments();
 			break;
 		case QtRpc::Message::Return:
@@ -355,6 +565,9 @@ QDataStream& operator>> (QDataStream& s, QtRpc::Message& p)
 {
 	switch (p.version())
 	{
+		case 0x00000005: //Added trace context
+		case 0x00000004: //Added packed arguments
+		case 0x00000003: //Added function timeouts
 		case 0x00000002: //Added magic number
 		{
 			quint32 i;
@@ -370,6 +583,7 @@ QDataStream& operator>> (QDataStream& s, QtRpc::Message& p)
 			QtRpc::Message::Type type;
 			s >> type;
 			p.setType(type);
+			bool packed = false;
 			switch (type)
 			{
 				case QtRpc::Message::Function:
@@ -378,16 +592,45 @@ QDataStream& operator>> (QDataStream& s, QtRpc::Message& p)
 					quint32 service;
 					s >> service;
 					p.setService(service);
+					if (p.version() >= 0x00000003 && type == QtRpc::Message::Function)
+					{
+						quint32 timeout;
+						s >> timeout;
+						p.setTimeout(timeout);
+					}
+					if (p.version() >= 0x00000004 && type == QtRpc::Message::Function)
+					{
+						quint8 flags;
+						s >> flags;
+						packed = flags & FunctionPacked;
+						if (p.version() >= 0x00000005 && (flags & FunctionTraced))
+						{
+							quint64 traceIdHigh, traceIdLow, spanId;
+							quint8 traceFlags;
+							s >> traceIdHigh >> traceIdLow >> spanId >> traceFlags;
+							p.setTraceContext(TraceContext(traceIdHigh, traceIdLow, spanId, traceFlags & TraceSampled));
+						}
+					}
 				}
 				case QtRpc::Message::QtRpc:
 				{
 					QtRpc::Signature func;
-					QtRpc::Arguments args;
 					uint id;
-					s >> id >> func >> args;
+					s >> id >> func;
 					p.setId(id);
 					p.setSignature(func);
-					p.setArguments(args);
+					if (packed)
+					{
+						QByteArray args;
+						s >> args;
+						p.setPackedArguments(args);
+					}
+					else
+					{
+						QtRpc::Arguments args;
+						s >> args;
+						p.setArguments(args);
+					}
 					break;
 				}
 				case QtRpc::Message::Return:
@@ -428,6 +671,9 @@ QDataStream& operator<< (QDataStream& s, const QtRpc::Message& p)
 	const MessageData* priv = p.qxt_d().data.constData();
 	switch (p.version())
 	{
+		case 0x00000005: //Added trace context
+		case 0x00000004: //Added packed arguments
+		case 0x00000003: //Added function timeouts
 		case 0x00000002: //Added magic number
 			s << static_cast<quint32>(0x1234abcd);
 		case 0x00000001: //updated packing functions
@@ -438,8 +684,23 @@ QDataStream& operator<< (QDataStream& s, const QtRpc::Message& p)
 				case QtRpc::Message::Function:
 				case QtRpc::Message::Event:
 					s << priv->service;
+					if (priv->version >= 0x00000003 && priv->type == QtRpc::Message::Function)
+						s << priv->timeout;
+					if (priv->version >= 0x00000004 && priv->type == QtRpc::Message::Function)
+					{
+						quint8 flags = functionFlags(priv);
+						s << flags;
+						if (flags & FunctionTraced)
+							writeTraceContext(s, priv->trace);
+					}
 				case QtRpc::Message::QtRpc:
-					s << priv->id << priv->func << priv->args;
+					s << priv->id << priv->func;
+					if (priv->packed && priv->version >= 0x00000004 && priv->type == QtRpc::Message::Function)
+						s << priv->packedArgs;
+					else if (priv->packed)
+						s << QtRpc::Message::unpackArguments(priv->func, priv->packedArgs);
+					else
+						s << priv->args;
 					break;
 				case QtRpc::Message::Return:
 				{
@@ -35,6 +35,8 @@
 #include <QxtPimpl>
 #include <QList>
 #include <QVariant>
+#include <QByteArray>
+#include <TraceContext>
 #include <QtRpcGlobal>
 
 namespace QtRpc
@@ -105,7 +107,21 @@ public:
 	quint32 service() const;
 	void setService(quint32 id);
 
+	quint32 timeout() const;
+	void setTimeout(quint32 msecs);
+
+	TraceContext traceContext() const;
+	void setTraceContext(const TraceContext& trace);
+
+	bool isPacked() const;
+	QByteArray packedArguments() const;
+	void setPackedArguments(const QByteArray& packed);
+	static Arguments unpackArguments(const Signature& sig, const QByteArray& packed);
+
 	qint64 size() const;
+	QByteArray frame() const;
+	QByteArray body() const;
+	QByteArray header(qint64 bodySize) const;
 
 	~Message();
 };
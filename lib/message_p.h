@@ -39,6 +39,7 @@
 #include <QSharedDataPointer>
 #include "message.h"
 #include <qtrpcprivate.h>
+#include "freelist_p.h"
 
 namespace QtRpc
 {
@@ -49,6 +50,8 @@ namespace QtRpc
 class MessageData : public QSharedData
 {
 public:
+	QTRPC_FREELIST_ALLOCATED(MessageData)
+
 	MessageData();
 	uint id;
 	Message::Type type;
@@ -57,11 +60,17 @@ public:
 	ReturnValue ret;
 	quint32 version;
 	quint32 service;
+	quint32 timeout;
+	TraceContext trace;
+	bool packed;
+	QByteArray packedArgs;
 };
 
 class MessagePrivate : public QxtPrivate<Message>
 {
 public:
+	QTRPC_FREELIST_ALLOCATED(MessagePrivate)
+
 	MessagePrivate()
 	{
 	}
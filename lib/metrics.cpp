@@ -0,0 +1,390 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include "metrics_p.h"
+#include "callstats_p.h"
+#include "threadshards_p.h"
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+
+namespace QtRpc
+{
+
+// The counters updated for every message, each thread counts in its own shard
+struct MetricsShard : public ThreadShard
+{
+	MetricsShard()
+			: writeQueue(0),
+			eventBroadcasts(0),
+			eventFanOut(0),
+			eventsSent(0),
+			eventsDropped(0)
+	{
+		for (int side = 0; side < 2; ++side)
+		{
+			bytesReceived[side].store(0);
+			bytesSent[side].store(0);
+		}
+	}
+
+	QAtomicInteger<quint64> bytesReceived[2];
+	QAtomicInteger<quint64> bytesSent[2];
+	QAtomicInteger<qint64> writeQueue;
+	QAtomicInteger<quint64> eventBroadcasts;
+	QAtomicInteger<quint64> eventFanOut;
+	QAtomicInteger<quint64> eventsSent;
+	QAtomicInteger<quint64> eventsDropped;
+};
+
+typedef ThreadShards<MetricsShard> MetricsShards;
+
+static MetricsShards* shards()
+{
+	// Never destroyed, so that connections closed during static destruction can still be counted
+	static MetricsShards* shards = new MetricsShards();
+	return shards;
+}
+
+struct MetricsRegistry
+{
+	MetricHistogram handshakes[Metrics::HandshakeCount];
+	QAtomicInteger<qint64> resources[Metrics::ResourceCount];
+
+	QMutex listenersMutex;
+	QList<ListenerMetrics*> listeners;
+	QHash<QString, int> listenerCount;
+
+	~MetricsRegistry()
+	{
+		qDeleteAll(listeners);
+	}
+};
+
+Q_GLOBAL_STATIC(MetricsRegistry, registry)
+
+static const char* const sideNames[] = {"server", "client"};
+static const char* const handshakeNames[] = {"tls", "selectService", "auth"};
+
+// nanoseconds
+static const qint64 bounds[MetricHistogram::BucketCount] =
+{
+	Q_INT64_C(100000), Q_INT64_C(250000), Q_INT64_C(500000),
+	Q_INT64_C(1000000), Q_INT64_C(2500000), Q_INT64_C(5000000),
+	Q_INT64_C(10000000), Q_INT64_C(25000000), Q_INT64_C(50000000),
+	Q_INT64_C(100000000), Q_INT64_C(250000000), Q_INT64_C(500000000),
+	Q_INT64_C(1000000000), Q_INT64_C(2500000000), Q_INT64_C(5000000000),
+	Q_INT64_C(10000000000)
+};
+
+static QByteArray seconds(qint64 nanoseconds)
+{
+	return QByteArray::number(nanoseconds / 1e9, 'g', 12);
+}
+
+static QByteArray withLabel(const QByteArray& labels, const QByteArray& label)
+{
+	if (labels.isEmpty())
+		return '{' + label + '}';
+	return '{' + labels + ',' + label + '}';
+}
+
+MetricHistogram::MetricHistogram()
+		: m_total(0)
+{
+	for (int i = 0; i <= BucketCount; ++i)
+		m_buckets[i].store(0);
+}
+
+/**
+ * Adds a duration to the histogram
+ * @param value The duration in nanoseconds
+ */
+void MetricHistogram::record(qint64 value)
+{
+	int i = 0;
+	while (i < BucketCount && value > bounds[i])
+		++i;
+	m_buckets[i].fetchAndAddRelaxed(1);
+	m_total.fetchAndAddRelaxed(qMax(Q_INT64_C(0), value));
+}
+
+/**
+ * @param index The index of a bucket
+ * @return Returns the upper bound of the bucket in nanoseconds
+ */
+qint64 MetricHistogram::bound(int index)
+{
+	return bounds[index];
+}
+
+/**
+ * Writes the histogram in the Prometheus text format
+ * @param out The text to append to
+ * @param name The name of the metric
+ * @param labels The labels of the metric, without braces
+ */
+void MetricHistogram::write(QByteArray& out, const QByteArray& name, const QByteArray& labels) const
+{
+	quint64 count = 0;
+	for (int i = 0; i < BucketCount; ++i)
+	{
+		count += m_buckets[i].load();
+		out += name + "_bucket" + withLabel(labels, "le=\"" + seconds(bounds[i]) + '"') + ' ' + QByteArray::number(count) + '\n';
+	}
+	count += m_buckets[BucketCount].load();
+	out += name + "_bucket" + withLabel(labels, "le=\"+Inf\"") + ' ' + QByteArray::number(count) + '\n';
+	QByteArray braces = labels.isEmpty() ? QByteArray() : '{' + labels + '}';
+	out += name + "_sum" + braces + ' ' + seconds(m_total.load()) + '\n';
+	out += name + "_count" + braces + ' ' + QByteArray::number(count) + '\n';
+}
+
+void Metrics::addBytesReceived(Side side, qint64 bytes)
+{
+	MetricsShards::add(shards()->local()->bytesReceived[side], quint64(bytes));
+}
+
+void Metrics::addBytesSent(Side side, qint64 bytes)
+{
+	MetricsShards::add(shards()->local()->bytesSent[side], quint64(bytes));
+}
+
+/**
+ * Changes the number of bytes waiting in the outgoing queues of all connections
+ * @param bytes The number of bytes added to the queues, negative if bytes were taken out
+ */
+void Metrics::addWriteQueue(qint64 bytes)
+{
+	// The shards are added up, so bytes may be taken out of the queue by another thread than the one that added them
+	MetricsShards::add(shards()->local()->writeQueue, bytes);
+}
+
+/**
+ * Records how long one phase of a connection handshake took
+ * @param phase The phase
+ * @param duration The duration in nanoseconds
+ */
+void Metrics::recordHandshake(Handshake phase, qint64 duration)
+{
+	if (!registry.isDestroyed())
+		registry()->handshakes[phase].record(duration);
+}
+
+/**
+ * Counts an event broadcast by the Server
+ * @param connections The number of connections the event was queued on
+ */
+void Metrics::eventBroadcast(int connections)
+{
+	MetricsShard* shard = shards()->local();
+	MetricsShards::add(shard->eventBroadcasts, Q_UINT64_C(1));
+	MetricsShards::add(shard->eventFanOut, quint64(connections));
+}
+
+/**
+ * Counts an event written to a connection
+ */
+void Metrics::eventSent()
+{
+	MetricsShards::add(shards()->local()->eventsSent, Q_UINT64_C(1));
+}
+
+/**
+ * Counts an event that was dropped because the client wasn't reading
+ */
+void Metrics::eventDropped()
+{
+	MetricsShards::add(shards()->local()->eventsDropped, Q_UINT64_C(1));
+}
+
+/**
+ * Registers a listener. Listeners of the same kind are numbered in the order they accept their first connection.
+ * @param kind The kind of listener, like "tcp"
+ * @return Returns the counters of the listener, which stay valid until the process exits
+ */
+ListenerMetrics* Metrics::addListener(const QString& kind)
+{
+	if (registry.isDestroyed())
+		return 0;
+	QMutexLocker locker(&registry()->listenersMutex);
+	ListenerMetrics* listener = new ListenerMetrics;
+	listener->name = QString("%1-%2").arg(kind).arg(++registry()->listenerCount[kind]);
+	listener->open.store(0);
+	listener->accepted.store(0);
+	registry()->listeners << listener;
+	return listener;
+}
+
+/**
+ * Changes the number of live objects of a kind
+ * @param resource The kind of object
+ * @param count The number of objects created, negative if objects were freed
+ */
+void Metrics::addResource(Resource resource, int count)
+{
+	if (!registry.isDestroyed())
+		registry()->resources[resource].fetchAndAddRelaxed(count);
+}
+
+/**
+ * @param resource The kind of object
+ * @return Returns the number of live objects of the kind, in all the servers of the process
+ */
+qint64 Metrics::resource(Resource resource)
+{
+	if (registry.isDestroyed())
+		return 0;
+	return registry()->resources[resource].load();
+}
+
+/**
+ * Writes the process wide counters in the Prometheus text format
+ * @param out The text to append to
+ */
+void Metrics::write(QByteArray& out)
+{
+	if (registry.isDestroyed())
+		return;
+	MetricsRegistry* reg = registry();
+
+	// Add up the shards of all threads, without stopping them
+	quint64 bytesReceived[2] = {0, 0};
+	quint64 bytesSent[2] = {0, 0};
+	qint64 writeQueue = 0;
+	quint64 eventBroadcasts = 0;
+	quint64 eventFanOut = 0;
+	quint64 eventsSent = 0;
+	quint64 eventsDropped = 0;
+	for (MetricsShard* shard = shards()->first(); shard != 0; shard = MetricsShards::next(shard))
+	{
+		for (int side = ServerSide; side <= ClientSide; ++side)
+		{
+			bytesReceived[side] += shard->bytesReceived[side].load();
+			bytesSent[side] += shard->bytesSent[side].load();
+		}
+		writeQueue += shard->writeQueue.load();
+		eventBroadcasts += shard->eventBroadcasts.load();
+		eventFanOut += shard->eventFanOut.load();
+		eventsSent += shard->eventsSent.load();
+		eventsDropped += shard->eventsDropped.load();
+	}
+
+	writeHeader(out, "qtrpc2_connections_open", "gauge", "Connections currently open, by listener");
+	QList<ListenerMetrics*> listeners;
+	{
+		QMutexLocker locker(&reg->listenersMutex);
+		listeners = reg->listeners;
+	}
+	foreach(ListenerMetrics* listener, listeners)
+		writeValue(out, "qtrpc2_connections_open", label("listener", listener->name), listener->open.load());
+	writeHeader(out, "qtrpc2_connections_accepted_total", "counter", "Connections accepted, by listener");
+	foreach(ListenerMetrics* listener, listeners)
+		writeValue(out, "qtrpc2_connections_accepted_total", label("listener", listener->name), listener->accepted.load());
+
+	writeHeader(out, "qtrpc2_received_bytes_total", "counter", "Bytes read from connections");
+	for (int side = ServerSide; side <= ClientSide; ++side)
+		writeValue(out, "qtrpc2_received_bytes_total", label("side", sideNames[side]), bytesReceived[side]);
+	writeHeader(out, "qtrpc2_sent_bytes_total", "counter", "Bytes written to connections");
+	for (int side = ServerSide; side <= ClientSide; ++side)
+		writeValue(out, "qtrpc2_sent_bytes_total", label("side", sideNames[side]), bytesSent[side]);
+	writeHeader(out, "qtrpc2_server_write_queue_bytes", "gauge", "Bytes waiting in the outgoing queues of clients that are not reading fast enough");
+	writeValue(out, "qtrpc2_server_write_queue_bytes", QByteArray(), qMax(Q_INT64_C(0), writeQueue));
+
+	writeHeader(out, "qtrpc2_server_handshake_seconds", "histogram", "Duration of the phases of a connection before it is ready");
+	for (int phase = 0; phase < HandshakeCount; ++phase)
+		reg->handshakes[phase].write(out, "qtrpc2_server_handshake_seconds", label("phase", handshakeNames[phase]));
+
+	writeHeader(out, "qtrpc2_server_event_broadcasts_total", "counter", "Events broadcast to every connection using a service");
+	writeValue(out, "qtrpc2_server_event_broadcasts_total", QByteArray(), eventBroadcasts);
+	writeHeader(out, "qtrpc2_server_event_fanout_total", "counter", "Connections broadcast events were queued on");
+	writeValue(out, "qtrpc2_server_event_fanout_total", QByteArray(), eventFanOut);
+	writeHeader(out, "qtrpc2_server_events_sent_total", "counter", "Events written to connections");
+	writeValue(out, "qtrpc2_server_events_sent_total", QByteArray(), eventsSent);
+	writeHeader(out, "qtrpc2_server_events_dropped_total", "counter", "Events dropped for clients that are not reading fast enough");
+	writeValue(out, "qtrpc2_server_events_dropped_total", QByteArray(), eventsDropped);
+
+	writeHeader(out, "qtrpc2_server_service_objects", "gauge", "Service objects alive, including the templates of registered services");
+	writeValue(out, "qtrpc2_server_service_objects", QByteArray(), reg->resources[ServiceObjects].load());
+	writeHeader(out, "qtrpc2_server_protocol_instances", "gauge", "Protocol instances alive, one for every connection that has not been freed yet");
+	writeValue(out, "qtrpc2_server_protocol_instances", QByteArray(), reg->resources[ProtocolInstances].load());
+	writeHeader(out, "qtrpc2_server_connection_services", "gauge", "Services held by connections, including sub services");
+	writeValue(out, "qtrpc2_server_connection_services", QByteArray(), reg->resources[ConnectionServices].load());
+	writeHeader(out, "qtrpc2_server_pending_callbacks", "gauge", "Callbacks sent to clients that have not returned yet");
+	writeValue(out, "qtrpc2_server_pending_callbacks", QByteArray(), reg->resources[PendingCallbacks].load());
+}
+
+/**
+ * Writes the HELP and TYPE lines of a metric
+ */
+void Metrics::writeHeader(QByteArray& out, const char* name, const char* type, const char* help)
+{
+	out += QByteArray("# HELP ") + name + ' ' + help + '\n';
+	out += QByteArray("# TYPE ") + name + ' ' + type + '\n';
+}
+
+/**
+ * Writes one sample of a metric
+ * @param labels The labels of the sample, without braces
+ */
+void Metrics::writeValue(QByteArray& out, const char* name, const QByteArray& labels, double value)
+{
+	out += name;
+	if (!labels.isEmpty())
+		out += '{' + labels + '}';
+	out += ' ' + QByteArray::number(value, 'g', 15) + '\n';
+}
+
+/**
+ * Writes a LatencyHistogram with the buckets of MetricHistogram. Values are only known to the precision of the LatencyHistogram, about 6%.
+ */
+void Metrics::writeHistogram(QByteArray& out, const QByteArray& name, const QByteArray& labels, const LatencyHistogram& histogram)
+{
+	for (int i = 0; i < MetricHistogram::BucketCount; ++i)
+		out += name + "_bucket" + withLabel(labels, "le=\"" + seconds(bounds[i]) + '"') + ' ' + QByteArray::number(histogram.countAtOrBelow(bounds[i])) + '\n';
+	out += name + "_bucket" + withLabel(labels, "le=\"+Inf\"") + ' ' + QByteArray::number(histogram.count()) + '\n';
+	QByteArray braces = labels.isEmpty() ? QByteArray() : '{' + labels + '}';
+	out += name + "_sum" + braces + ' ' + seconds(histogram.total()) + '\n';
+	out += name + "_count" + braces + ' ' + QByteArray::number(histogram.count()) + '\n';
+}
+
+/**
+ * Formats a label, escaping the value
+ * @return Returns name="value"
+ */
+QByteArray Metrics::label(const char* name, const QString& value)
+{
+	QByteArray escaped = value.toUtf8();
+	escaped.replace('\\', "\\\\").replace('"', "\\\"").replace('\n', "\\n");
+	return QByteArray(name) + "=\"" + escaped + '"';
+}
+
+}
@@ -0,0 +1,137 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCMETRICS_P_H
+#define QTRPCMETRICS_P_H
+
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QString>
+#include <qtrpcprivate.h>
+
+namespace QtRpc
+{
+
+class LatencyHistogram;
+
+/**
+	A histogram with the fixed buckets used for every exported duration, from 100 microseconds to 10 seconds. Recording is a few atomic increments, so it can be shared by all threads without a lock.
+	@brief Lock free histogram of nanosecond durations
+*/
+class MetricHistogram
+{
+public:
+	enum
+	{
+		BucketCount = 16
+	};
+
+	MetricHistogram();
+	void record(qint64 value);
+	void write(QByteArray& out, const QByteArray& name, const QByteArray& labels) const;
+
+	static qint64 bound(int index);
+
+private:
+	Q_DISABLE_COPY(MetricHistogram);
+	QAtomicInteger<quint64> m_buckets[BucketCount + 1];
+	QAtomicInteger<qint64> m_total;
+};
+
+/**
+	Connection counters of one listener. Listeners are never forgotten, so the counters can be updated without looking them up.
+	@brief Connection counters of a listener
+*/
+struct ListenerMetrics
+{
+	QString name;
+	QAtomicInteger<int> open;
+	QAtomicInteger<quint64> accepted;
+};
+
+/**
+	Process wide counters of the traffic, handshakes and events of servers and clients, exported by MetricsExporter. The traffic and event counters are kept in a shard per thread, the others are shared atomics. Updating them never takes a lock, and reading them never blocks the threads that update them.
+	@brief Process wide protocol counters
+*/
+class Metrics
+{
+public:
+	/**
+	 * The side of a connection that counts the traffic
+	 */
+	enum Side
+	{
+		ServerSide,
+		ClientSide
+	};
+	/**
+	 * The phases of a connection before it is ready
+	 */
+	enum Handshake
+	{
+		Tls,
+		SelectService,
+		Auth,
+		HandshakeCount
+	};
+	/**
+	 * Objects that are created for every connection, and must be freed with it
+	 */
+	enum Resource
+	{
+		ServiceObjects,		/**< ServiceProxy objects alive, including the templates of registered services */
+		ProtocolInstances,	/**< ServerProtocolInstanceBase objects alive */
+		ConnectionServices,	/**< Services held by the protocol instances */
+		PendingCallbacks,	/**< Callbacks sent to clients that have not returned yet */
+		ResourceCount
+	};
+
+	static void addBytesReceived(Side side, qint64 bytes);
+	static void addBytesSent(Side side, qint64 bytes);
+	static void addWriteQueue(qint64 bytes);
+	static void recordHandshake(Handshake phase, qint64 duration);
+	static void eventBroadcast(int connections);
+	static void eventSent();
+	static void eventDropped();
+	static ListenerMetrics* addListener(const QString& kind);
+	static void addResource(Resource resource, int count);
+	static qint64 resource(Resource resource);
+
+	static void write(QByteArray& out);
+	static void writeHeader(QByteArray& out, const char* name, const char* type, const char* help);
+	static void writeValue(QByteArray& out, const char* name, const QByteArray& labels, double value);
+	static void writeHistogram(QByteArray& out, const QByteArray& name, const QByteArray& labels, const LatencyHistogram& histogram);
+	static QByteArray label(const char* name, const QString& value);
+};
+
+}
+
+#endif
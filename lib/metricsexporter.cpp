@@ -0,0 +1,277 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include "metricsexporter.h"
+#include "metricsexporter_p.h"
+#include "callstats_p.h"
+#include "clientcallstats_p.h"
+#include "metrics_p.h"
+#include "serverthread.h"
+#include "serverthread_p.h"
+
+namespace QtRpc
+{
+
+// Requests larger than this are not from a scraper
+static const int MaxRequestSize = 8192;
+
+/**
+ * Constructor
+ * @param parent Qt parent object
+ */
+MetricsExporter::MetricsExporter(QObject* parent)
+		: QObject(parent)
+{
+	QXT_INIT_PRIVATE(MetricsExporter);
+	connect(&qxt_d().listener, SIGNAL(newConnection()), &qxt_d(), SLOT(newConnection()));
+}
+
+/**
+ * Deconstructor
+ */
+MetricsExporter::~MetricsExporter()
+{
+	close();
+}
+
+/**
+ * Adds the admission control counters of \a server to the exported metrics. The other statistics are process wide, and exported without adding a server.
+ * @param server The server
+ */
+void MetricsExporter::addServer(Server* server)
+{
+	if (server != 0 && !qxt_d().servers.contains(server))
+		qxt_d().servers << server;
+}
+
+/**
+ * Returns the current metrics in the Prometheus text exposition format, version 0.0.4.
+ * @return Returns the metrics
+ */
+QByteArray MetricsExporter::text() const
+{
+	QByteArray out;
+	Metrics::write(out);
+
+	ServiceStats server = CallStats::merged();
+	Metrics::writeHeader(out, "qtrpc2_server_calls_total", "counter", "Function calls answered by the server");
+	for (ServiceStats::const_iterator service = server.constBegin(); service != server.constEnd(); ++service)
+		for (QHash<QString, MethodStats>::const_iterator method = service->constBegin(); method != service->constEnd(); ++method)
+			Metrics::writeValue(out, "qtrpc2_server_calls_total", Metrics::label("service", service.key()) + ',' + Metrics::label("method", method.key()), method->calls);
+	Metrics::writeHeader(out, "qtrpc2_server_call_errors_total", "counter", "Function calls the server answered with an error");
+	for (ServiceStats::const_iterator service = server.constBegin(); service != server.constEnd(); ++service)
+		for (QHash<QString, MethodStats>::const_iterator method = service->constBegin(); method != service->constEnd(); ++method)
+			Metrics::writeValue(out, "qtrpc2_server_call_errors_total", Metrics::label("service", service.key()) + ',' + Metrics::label("method", method.key()), method->errors);
+	Metrics::writeHeader(out, "qtrpc2_server_call_duration_seconds", "histogram", "Time from when a function call was run until its reply was ready");
+	for (ServiceStats::const_iterator service = server.constBegin(); service != server.constEnd(); ++service)
+		for (QHash<QString, MethodStats>::const_iterator method = service->constBegin(); method != service->constEnd(); ++method)
+			Metrics::writeHistogram(out, "qtrpc2_server_call_duration_seconds", Metrics::label("service", service.key()) + ',' + Metrics::label("method", method.key()), method->execution);
+	Metrics::writeHeader(out, "qtrpc2_server_call_queue_seconds", "histogram", "Time from when a function call was read until it was run");
+	for (ServiceStats::const_iterator service = server.constBegin(); service != server.constEnd(); ++service)
+		for (QHash<QString, MethodStats>::const_iterator method = service->constBegin(); method != service->constEnd(); ++method)
+			Metrics::writeHistogram(out, "qtrpc2_server_call_queue_seconds", Metrics::label("service", service.key()) + ',' + Metrics::label("method", method.key()), method->queue);
+
+	QHash<QString, ClientCallStats::Method> client = ClientCallStats::merged();
+	Metrics::writeHeader(out, "qtrpc2_client_calls_total", "counter", "Function calls made by clients that were answered");
+	for (QHash<QString, ClientCallStats::Method>::const_iterator method = client.constBegin(); method != client.constEnd(); ++method)
+		Metrics::writeValue(out, "qtrpc2_client_calls_total", Metrics::label("method", method.key()), method->calls);
+	Metrics::writeHeader(out, "qtrpc2_client_call_errors_total", "counter", "Function calls made by clients that returned an error");
+	for (QHash<QString, ClientCallStats::Method>::const_iterator method = client.constBegin(); method != client.constEnd(); ++method)
+		Metrics::writeValue(out, "qtrpc2_client_call_errors_total", Metrics::label("method", method.key()), method->errors);
+	Metrics::writeHeader(out, "qtrpc2_client_call_duration_seconds", "histogram", "Time from when a client made a function call until the reply was delivered");
+	for (QHash<QString, ClientCallStats::Method>::const_iterator method = client.constBegin(); method != client.constEnd(); ++method)
+		Metrics::writeHistogram(out, "qtrpc2_client_call_duration_seconds", Metrics::label("method", method.key()), method->total);
+
+	// Never waits for the server threads, unlike ServerThread::threadStats()
+	QVariantList threads = ServerThreadPrivate::counters();
+	Metrics::writeHeader(out, "qtrpc2_server_thread_connections", "gauge", "Connections run by each server thread");
+	foreach(const QVariant& thread, threads)
+		Metrics::writeValue(out, "qtrpc2_server_thread_connections", Metrics::label("thread", thread.toMap().value("thread").toString()), thread.toMap().value("connections").toDouble());
+	Metrics::writeHeader(out, "qtrpc2_server_thread_calls_total", "counter", "Function calls run by each server thread");
+	foreach(const QVariant& thread, threads)
+		Metrics::writeValue(out, "qtrpc2_server_thread_calls_total", Metrics::label("thread", thread.toMap().value("thread").toString()), thread.toMap().value("calls").toDouble());
+	Metrics::writeHeader(out, "qtrpc2_server_thread_slow_calls_total", "counter", "Function calls that ran for longer than the slow call threshold");
+	foreach(const QVariant& thread, threads)
+		Metrics::writeValue(out, "qtrpc2_server_thread_slow_calls_total", Metrics::label("thread", thread.toMap().value("thread").toString()), thread.toMap().value("slowCalls").toDouble());
+	Metrics::writeHeader(out, "qtrpc2_server_thread_blocked_seconds", "gauge", "How long each server thread has been running its current function call, 0 if it is idle");
+	foreach(const QVariant& thread, threads)
+		Metrics::writeValue(out, "qtrpc2_server_thread_blocked_seconds", Metrics::label("thread", thread.toMap().value("thread").toString()), thread.toMap().value("blockedFor").toDouble() / 1000.0);
+
+	// Admission control is per server, the servers of the process are added up
+	QHash<QString, double> active;
+	QHash<QString, double> admission;
+	foreach(const QPointer<Server>& server, qxt_d().servers)
+	{
+		if (server.isNull())
+			continue;
+		QVariantMap stats = server->admissionStats();
+		QVariantMap calls = stats.take("active").toMap();
+		for (QVariantMap::const_iterator it = calls.constBegin(); it != calls.constEnd(); ++it)
+			active[it.key()] += it.value().toDouble();
+		for (QVariantMap::const_iterator it = stats.constBegin(); it != stats.constEnd(); ++it)
+			admission[it.key()] += it.value().toDouble();
+	}
+	Metrics::writeHeader(out, "qtrpc2_server_active_calls", "gauge", "Function calls admitted and not answered yet, by service");
+	for (QHash<QString, double>::const_iterator it = active.constBegin(); it != active.constEnd(); ++it)
+		Metrics::writeValue(out, "qtrpc2_server_active_calls", Metrics::label("service", it.key()), it.value());
+	Metrics::writeHeader(out, "qtrpc2_server_admitted_calls_total", "counter", "Function calls admitted by admission control");
+	Metrics::writeValue(out, "qtrpc2_server_admitted_calls_total", QByteArray(), admission.value("admitted"));
+	Metrics::writeHeader(out, "qtrpc2_server_rejected_calls_total", "counter", "Function calls rejected by admission control, by limit");
+	Metrics::writeValue(out, "qtrpc2_server_rejected_calls_total", Metrics::label("limit", "service"), admission.value("rejectedService"));
+	Metrics::writeValue(out, "qtrpc2_server_rejected_calls_total", Metrics::label("limit", "connection"), admission.value("rejectedConnection"));
+	Metrics::writeValue(out, "qtrpc2_server_rejected_calls_total", Metrics::label("limit", "queueTime"), admission.value("rejectedQueueTime"));
+	return out;
+}
+
+/**
+ * Serves the metrics over HTTP. Prometheus can scrape http://host:port/metrics.
+ * @param address The address to listen on
+ * @param port The port to listen on, 9464 by default
+ * @return Returns true on success, see errorString() otherwise
+ */
+bool MetricsExporter::listen(const QHostAddress& address, quint16 port)
+{
+	return qxt_d().listener.listen(address, port);
+}
+
+/**
+ * Stops serving the metrics
+ */
+void MetricsExporter::close()
+{
+	qxt_d().listener.close();
+	foreach(QTcpSocket* socket, qxt_d().requests.keys())
+		socket->abort();
+}
+
+/**
+ * @return Returns true if the metrics are being served
+ */
+bool MetricsExporter::isListening() const
+{
+	return qxt_d().listener.isListening();
+}
+
+/**
+ * @return Returns the port the metrics are served on
+ */
+quint16 MetricsExporter::serverPort() const
+{
+	return qxt_d().listener.serverPort();
+}
+
+/**
+ * @return Returns a description of the last error of listen()
+ */
+QString MetricsExporter::errorString() const
+{
+	return qxt_d().listener.errorString();
+}
+
+void MetricsExporterPrivate::newConnection()
+{
+	while (listener.hasPendingConnections())
+	{
+		QTcpSocket* socket = listener.nextPendingConnection();
+		requests.insert(socket, QByteArray());
+		connect(socket, SIGNAL(readyRead()), this, SLOT(readyRead()));
+		connect(socket, SIGNAL(disconnected()), this, SLOT(disconnected()));
+	}
+}
+
+void MetricsExporterPrivate::readyRead()
+{
+	QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+	if (socket == 0 || !requests.contains(socket))
+		return;
+	QByteArray& request = requests[socket];
+	request += socket->readAll();
+	if (request.contains("\r\n\r\n") || request.contains("\n\n"))
+	{
+		QByteArray done = request;
+		request.clear();
+		respond(socket, done);
+	}
+	else if (request.size() > MaxRequestSize)
+	{
+		socket->abort();
+	}
+}
+
+void MetricsExporterPrivate::disconnected()
+{
+	QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+	if (socket == 0)
+		return;
+	requests.remove(socket);
+	socket->deleteLater();
+}
+
+/**
+ * Answers a HTTP request and closes the connection
+ * @param socket The connection
+ * @param request The request line and headers
+ */
+void MetricsExporterPrivate::respond(QTcpSocket* socket, const QByteArray& request)
+{
+	QList<QByteArray> line = request.left(request.indexOf('\n')).trimmed().split(' ');
+	QByteArray status;
+	QByteArray type;
+	QByteArray body;
+	QByteArray path = line.value(1);
+	if (path.contains('?'))
+		path = path.left(path.indexOf('?'));
+	if (line.value(0) != "GET" && line.value(0) != "HEAD")
+	{
+		status = "405 Method Not Allowed";
+		type = "text/plain";
+		body = "Only GET is supported\n";
+	}
+	else if (path == "/metrics")
+	{
+		status = "200 OK";
+		type = "text/plain; version=0.0.4; charset=utf-8";
+		body = qxt_p().text();
+	}
+	else
+	{
+		status = "404 Not Found";
+		type = "text/plain";
+		body = "The metrics are at /metrics\n";
+	}
+	QByteArray response = "HTTP/1.0 " + status + "\r\nContent-Type: " + type + "\r\nContent-Length: " + QByteArray::number(body.size()) + "\r\nConnection: close\r\n\r\n";
+	if (line.value(0) != "HEAD")
+		response += body;
+	socket->write(response);
+	socket->disconnectFromHost();
+}
+
+}
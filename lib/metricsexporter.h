@@ -0,0 +1,78 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCMETRICSEXPORTER_H
+#define QTRPCMETRICSEXPORTER_H
+
+#include <QObject>
+#include <QHostAddress>
+#include <QxtPimpl>
+#include <QtRpcGlobal>
+
+namespace QtRpc
+{
+
+class MetricsExporterPrivate;
+class Server;
+
+/**
+	Exports the statistics of the servers and clients of the process in the Prometheus text format. text() returns the current metrics, and listen() serves them over HTTP on /metrics, so Prometheus can scrape the process directly.
+	@code
+	MetricsExporter* exporter = new MetricsExporter(&server);
+	exporter->addServer(&server);
+	exporter->listen(QHostAddress::Any, 9464);
+	@endcode
+	The exported metrics are the connections open and accepted per listener and per server thread, the calls, errors and latency histograms of every function on the server and the client, the bytes received and sent, the duration of the TLS, selectService and auth handshakes, the bytes queued for slow clients and the calls running per service, and how many connections broadcast events were sent to.
+
+	The counters are updated with atomic operations or in per thread shards, so scraping never waits for the server threads, and they only wait for a scrape while their shard is being read.
+	@brief Prometheus exporter for QtRpc2 statistics
+*/
+class QTRPC2_EXPORT MetricsExporter : public QObject
+{
+	QXT_DECLARE_PRIVATE(MetricsExporter);
+	Q_OBJECT
+public:
+	MetricsExporter(QObject* parent = 0);
+	~MetricsExporter();
+
+	void addServer(Server* server);
+	QByteArray text() const;
+
+	bool listen(const QHostAddress& address = QHostAddress::Any, quint16 port = 9464);
+	void close();
+	bool isListening() const;
+	quint16 serverPort() const;
+	QString errorString() const;
+};
+
+}
+
+#endif
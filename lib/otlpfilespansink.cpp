@@ -0,0 +1,187 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include "otlpfilespansink.h"
+#include "otlpfilespansink_p.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+
+namespace QtRpc
+{
+
+// OTLP span kinds and status codes
+enum
+{
+	SpanKindServer = 2,
+	SpanKindClient = 3,
+	StatusCodeOk = 1,
+	StatusCodeError = 2
+};
+
+static QJsonObject attributeValue(const QVariant& value)
+{
+	QJsonObject ret;
+	switch (value.type())
+	{
+		case QVariant::Bool:
+			ret["boolValue"] = value.toBool();
+			break;
+		case QVariant::Int:
+		case QVariant::UInt:
+		case QVariant::LongLong:
+		case QVariant::ULongLong:
+			// 64 bit integers are strings in OTLP JSON
+			ret["intValue"] = value.toString();
+			break;
+		case QVariant::Double:
+			ret["doubleValue"] = value.toDouble();
+			break;
+		default:
+			ret["stringValue"] = value.toString();
+			break;
+	}
+	return ret;
+}
+
+static QJsonArray attributes(const QVariantMap& map)
+{
+	QJsonArray ret;
+	for (QVariantMap::const_iterator it = map.constBegin(); it != map.constEnd(); ++it)
+	{
+		QJsonObject attribute;
+		attribute["key"] = it.key();
+		attribute["value"] = attributeValue(it.value());
+		ret << attribute;
+	}
+	return ret;
+}
+
+/**
+ * Opens the file to append spans to
+ * @param path The path of the file
+ * @param serviceName The service.name resource attribute of the spans, defaults to the application name
+ * @param batchSize The number of spans written at once
+ */
+OtlpFileSpanSink::OtlpFileSpanSink(const QString& path, const QString& serviceName, int batchSize)
+{
+	QXT_INIT_PRIVATE(OtlpFileSpanSink);
+	qxt_d().serviceName = serviceName.isEmpty() ? QCoreApplication::applicationName() : serviceName;
+	qxt_d().batchSize = qMax(1, batchSize);
+	qxt_d().lastWrite = QDateTime::currentMSecsSinceEpoch();
+	qxt_d().file.setFileName(path);
+	qxt_d().file.open(QIODevice::WriteOnly | QIODevice::Append);
+}
+
+/**
+ * Writes the spans that are still pending
+ */
+OtlpFileSpanSink::~OtlpFileSpanSink()
+{
+	flush();
+}
+
+/**
+ * @return Returns true if the file could be opened
+ */
+bool OtlpFileSpanSink::isOpen() const
+{
+	return qxt_d().file.isOpen();
+}
+
+void OtlpFileSpanSink::report(const Span& span)
+{
+	QJsonObject json;
+	json["traceId"] = span.context.traceIdString();
+	json["spanId"] = span.context.spanIdString();
+	if (span.context.parentSpanId() != 0)
+		json["parentSpanId"] = QString("%1").arg(span.context.parentSpanId(), 16, 16, QChar('0'));
+	json["name"] = span.name;
+	json["kind"] = span.kind == Span::Server ? SpanKindServer : SpanKindClient;
+	json["startTimeUnixNano"] = QString::number(span.startTime);
+	json["endTimeUnixNano"] = QString::number(span.endTime);
+	if (!span.attributes.isEmpty())
+		json["attributes"] = attributes(span.attributes);
+	QJsonObject status;
+	status["code"] = span.error ? StatusCodeError : StatusCodeOk;
+	if (!span.statusMessage.isEmpty())
+		status["message"] = span.statusMessage;
+	json["status"] = status;
+
+	QMutexLocker locker(&qxt_d().mutex);
+	qxt_d().pending << json;
+	if (qxt_d().pending.count() >= qxt_d().batchSize || QDateTime::currentMSecsSinceEpoch() - qxt_d().lastWrite >= 1000)
+		qxt_d().write();
+}
+
+/**
+ * Writes the pending spans to the file
+ */
+void OtlpFileSpanSink::flush()
+{
+	QMutexLocker locker(&qxt_d().mutex);
+	qxt_d().write();
+}
+
+void OtlpFileSpanSinkPrivate::write()
+{
+	lastWrite = QDateTime::currentMSecsSinceEpoch();
+	if (pending.isEmpty() || !file.isOpen())
+		return;
+	QJsonObject serviceNameValue;
+	serviceNameValue["stringValue"] = serviceName;
+	QJsonObject serviceNameAttribute;
+	serviceNameAttribute["key"] = QString("service.name");
+	serviceNameAttribute["value"] = serviceNameValue;
+	QJsonObject resource;
+	resource["attributes"] = QJsonArray() << serviceNameAttribute;
+
+	QJsonObject scope;
+	scope["name"] = QString("qtrpc2");
+	QJsonObject scopeSpans;
+	scopeSpans["scope"] = scope;
+	scopeSpans["spans"] = pending;
+
+	QJsonObject resourceSpans;
+	resourceSpans["resource"] = resource;
+	resourceSpans["scopeSpans"] = QJsonArray() << scopeSpans;
+
+	QJsonObject request;
+	request["resourceSpans"] = QJsonArray() << resourceSpans;
+	file.write(QJsonDocument(request).toJson(QJsonDocument::Compact));
+	file.write("\n");
+	file.flush();
+	pending = QJsonArray();
+}
+
+}
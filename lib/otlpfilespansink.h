@@ -0,0 +1,67 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCOTLPFILESPANSINK_H
+#define QTRPCOTLPFILESPANSINK_H
+
+#include <QxtPimpl>
+#include <SpanSink>
+#include <QtRpcGlobal>
+
+namespace QtRpc
+{
+
+class OtlpFileSpanSinkPrivate;
+
+/**
+	Writes spans to a file in the OpenTelemetry protocol JSON encoding, one ExportTraceServiceRequest per line. The file can be read by the otlpjsonfile receiver of the OpenTelemetry collector, or by any tool that reads OTLP JSON.
+
+	Spans are written in batches, when a batch is full, when a second has passed since the last write, by flush(), and when the sink is destroyed.
+	@code
+	SpanSink::setSink(QSharedPointer<SpanSink>(new OtlpFileSpanSink("/var/log/myserver/spans.json", "myserver")));
+	@endcode
+	@brief Span sink that writes OTLP JSON files
+*/
+class QTRPC2_EXPORT OtlpFileSpanSink : public SpanSink
+{
+	QXT_DECLARE_PRIVATE(OtlpFileSpanSink);
+public:
+	OtlpFileSpanSink(const QString& path, const QString& serviceName = QString(), int batchSize = 64);
+	~OtlpFileSpanSink();
+
+	bool isOpen() const;
+	void report(const Span& span);
+	void flush();
+};
+
+}
+
+#endif
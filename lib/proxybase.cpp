@@ -61,6 +61,7 @@
 #include <QUrl>
 #include <QThread>
 #include <QScopedPointer>
+#include <QDataStream>
 #include <Message>
 #include <authtoken.h>
 
@@ -133,8 +134,8 @@ int QtRpc::ProxyBase::qt_metacall(QMetaObject::Call _c, int _id, void **_a)
 	{
 		QMutexLocker locker(&qxt_d().mutex);
 		// Make sure this isn't being run from the wrong thread....
-		Q_ASSERT(thread() == QThread::currentThread());
-		if (thread() != QThread::currentThread())
+		Q_ASSERT(qxt_d().threadSafe || thread() == QThread::currentThread());
+		if (!qxt_d().threadSafe && thread() != QThread::currentThread())
 		{
 			qCritical() << "You cannot call functions from other threads in QtRpc2";
 		}
@@ -178,29 +179,29 @@ int QtRpc::ProxyBase::qt_metacall(QMetaObject::Call _c, int _id, void **_a)
 
 
 
-/*!
-	Initialized the ProxyBase Object. This needs to be run before any other functions are called.
-
-	See the class description for an example of how to use this function
-
-	@param funclist A list of strings to be used when searching for functions calls
-	@param callbacklist A list of strings to used when searching for callbacks
-	@param eventlist A list of strings to used when searching for events
+/**
+ * Scans the methods of \a meta for functions, callbacks and events. The result is cached, so each class is only scanned once.
+ * @param meta The meta object to scan
+ * @param functionlist A list of strings to be used when searching for functions calls
+ * @param callbacklist A list of strings to used when searching for callbacks
+ * @param eventlist A list of strings to used when searching for events
+ * @return Returns the functions, callbacks and events of the class
  */
-void ProxyBase::init(QStringList functionlist, QStringList callbacklist, QStringList eventlist)
+static ProxyBaseReflection reflect(const QMetaObject* meta, const QStringList& functionlist, const QStringList& callbacklist, const QStringList& eventlist)
 {
-	QMutexLocker locker(&qxt_d().mutex);
+	static QMutex cacheMutex;
+	static QHash<QString, ProxyBaseReflection> cache;
+
+	//the type lists are part of the key, ClientProxy and ServiceProxy scan for different types
+	QString key = QString("%1:%2|%3|%4").arg(reinterpret_cast<quintptr>(meta)).arg(functionlist.join(",")).arg(callbacklist.join(",")).arg(eventlist.join(","));
+	QMutexLocker locker(&cacheMutex);
+	if (cache.contains(key))
+		return cache.value(key);
+
+	ProxyBaseReflection reflection;
 	//Initialize method counters
 	int numfunctions = 1000;
 
-	//clear old lists in case init() is run twice
-	qxt_d().signalHash.clear();
-	qxt_d().functions.clear();
-	qxt_d().callbacks.clear();
-	qxt_d().asyncfunctions.clear();
-
-	//Get the meta object so we can see signals and slots
-	const QMetaObject *meta = metaObject();
 	//Get the number of methods
 	int methods = meta->methodCount();
 
@@ -224,7 +225,7 @@ void ProxyBase::init(QStringList functionlist, QStringList callbacklist, QString
 					//If a function begins with QObject*, char*, then its an asyn function
 					if (sig.numArgs() >= 2 && sig.arg(0) == "QObject*" && (sig.arg(1) == "const char*" || sig.arg(1) == "char*"))
 					{
-						qxt_d().asyncfunctions << numfunctions; //add this function id to the list of async functions
+						reflection.asyncfunctions << numfunctions; //add this function id to the list of async functions
 
 						QVector<QString> args = sig.args(); //get the list of arguments
 						//remove the first two arguments
@@ -233,16 +234,16 @@ void ProxyBase::init(QStringList functionlist, QStringList callbacklist, QString
 						sig.setArgs(args); //update the argument list with the new list
 					}
 					Q_ASSERT(sig.validate());
-					//connect the signal to a local event
-					meta->connect(this, i, this, numfunctions, Qt::DirectConnection);
-					qxt_d().functions[numfunctions] = sig;
-					qxt_d().functiontypes[numfunctions] = method.typeName();
+					//remember to connect the signal to a local event
+					reflection.connections[i] = numfunctions;
+					reflection.functions[numfunctions] = sig;
+					reflection.functiontypes[numfunctions] = method.typeName();
 					numfunctions++;
 				}
 				else if (eventlist.contains(type))
 				{
 					Q_ASSERT(sig.validate());
-					qxt_d().signalHash[i] = sig;
+					reflection.signalHash[i] = sig;
 				}
 				//if its not one of the two, we don't care about it
 				break;
@@ -251,7 +252,7 @@ void ProxyBase::init(QStringList functionlist, QStringList callbacklist, QString
 				if (callbacklist.contains(type))
 				{
 					Q_ASSERT(sig.validate());
-					qxt_d().callbacks[i] = sig;
+					reflection.callbacks[i] = sig;
 				}
 				break;
 
@@ -260,9 +261,46 @@ void ProxyBase::init(QStringList functionlist, QStringList callbacklist, QString
 				break;
 		}
 	}
+
+	cache.insert(key, reflection);
+	return reflection;
 }
 
 
+/*!
+	Initialized the ProxyBase Object. This needs to be run before any other functions are called.
+
+	See the class description for an example of how to use this function
+
+	@param funclist A list of strings to be used when searching for functions calls
+	@param callbacklist A list of strings to used when searching for callbacks
+	@param eventlist A list of strings to used when searching for events
+ */
+void ProxyBase::init(QStringList functionlist, QStringList callbacklist, QStringList eventlist)
+{
+	QMutexLocker locker(&qxt_d().mutex);
+
+	//Get the meta object so we can see signals and slots
+	const QMetaObject *meta = metaObject();
+	ProxyBaseReflection reflection = reflect(meta, functionlist, callbacklist, eventlist);
+
+	//the hashes are implicitly shared, so this doesn't copy anything
+	qxt_d().functions = reflection.functions;
+	qxt_d().functiontypes = reflection.functiontypes;
+	qxt_d().signalHash = reflection.signalHash;
+	qxt_d().callbacks = reflection.callbacks;
+	qxt_d().asyncfunctions = reflection.asyncfunctions;
+
+	//connect the function signals to local events, unless init() was already run on this object
+	if (qxt_d().connectedMeta == meta)
+		return;
+	qxt_d().connectedMeta = meta;
+	for (QHash<int, int>::const_iterator it = reflection.connections.constBegin(); it != reflection.connections.constEnd(); ++it)
+	{
+		meta->connect(this, it.key(), this, it.value(), Qt::DirectConnection);
+	}
+}
+
 /**
  * Converts a void * pointer into a QVariant. For internal use only.
  *
@@ -384,6 +422,69 @@ ReturnValue ProxyBase::callMetacall(Signature sig, Arguments args)
 	return(ret);
 }
 
+/**
+ * Calls a callback function with arguments packed by Message::setPackedArguments(). The arguments are read directly into storage of their own types, so they are never wrapped in QVariants. This function is for internal use only
+ * @sa callMetacall
+ * @param sig Signature of the callback to be called
+ * @param packed The packed arguments for the callback
+ * @return Returns the ReturnValue from the function, or an error.
+ */
+ReturnValue ProxyBase::callPackedMetacall(const Signature& sig, const QByteArray& packed)
+{
+	int id;
+	{
+		QMutexLocker locker(&qxt_d().mutex);
+		id = qxt_d().callbacks.key(sig, -1);
+	}
+	if (id < 0)
+		return(ReturnValue(1, "Callback not found"));
+
+	QMetaMethod method = metaObject()->method(id);
+	if (method.parameterCount() > 10)
+		return(ReturnValue(2, "Failed to call " + sig.toString() + ": Too many arguments"));
+
+	ReturnValue ret;
+	void *param[] = {(void *)&ret, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
+	int types[10];
+	int count = 0;
+	QDataStream in(packed);
+	for (; count < method.parameterCount(); count++)
+	{
+		types[count] = method.parameterType(count);
+		if (types[count] == QMetaType::UnknownType)
+			break;
+		param[count+1] = QMetaType::create(types[count]);
+		if (!QMetaType::load(in, types[count], param[count+1]))
+		{
+			QMetaType::destroy(types[count], param[count+1]);
+			break;
+		}
+	}
+
+	if (count == method.parameterCount() && in.status() == QDataStream::Ok)
+	{
+		int retid = qt_metacall(QMetaObject::InvokeMetaMethod, id, param);
+		if (retid > 0)
+			ret = ReturnValue(5, "Failed to call " + sig.toString() + ": Failed to find it in metacall");
+	}
+	else
+		ret = ReturnValue(2, "Failed to call " + sig.toString() + ": The packed arguments do not match the signature");
+
+	for (int i = 0; i < count; i++)
+		QMetaType::destroy(types[i], param[i+1]);
+	return(ret);
+}
+
+/**
+ * Allows the functions of this object to be called from threads other than the one it lives in. Only use this if functionCalled() is thread safe.
+ * @param threadSafe True to allow calls from any thread
+ */
+void ProxyBase::setThreadSafe(bool threadSafe)
+{
+	QMutexLocker locker(&qxt_d().mutex);
+	qxt_d().threadSafe = threadSafe;
+}
+
 QList<Signature> ProxyBase::listFunctions()
 {
 	QMutexLocker locker(&qxt_d().mutex);
@@ -143,6 +143,8 @@ public:
 protected:
 
 	ReturnValue callMetacall(Signature , Arguments);
+	ReturnValue callPackedMetacall(const Signature& sig, const QByteArray& packed);
+	void setThreadSafe(bool threadSafe);
 	QVariant convertQVariant(QString name, void *data);
 	ReturnValue emitSignal(Signature sig, Arguments args);
 	ReturnValue callCallback(Signature sig, Arguments args);
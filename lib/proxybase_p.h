@@ -43,6 +43,19 @@
 namespace QtRpc
 {
 
+/**
+	The result of scanning a QMetaObject in ProxyBase::init(). It only depends on the class and the type lists, so it is built once and shared by every object of the class.
+*/
+struct ProxyBaseReflection
+{
+	QHash<int, Signature> functions;
+	QHash<int, QString> functiontypes;
+	QHash<int, Signature> signalHash;
+	QHash<int, Signature> callbacks;
+	QList<uint> asyncfunctions;
+	QHash<int, int> connections; //signal index -> local function id
+};
+
 /**
 	@author Chris Vickery <chris@resara.com>
 */
@@ -50,6 +63,8 @@ class ProxyBasePrivate : public QxtPrivate<ProxyBase>
 {
 public:
 	ProxyBasePrivate()
+			: connectedMeta(0),
+			threadSafe(false)
 	{
 	}
 
@@ -59,6 +74,8 @@ public:
 	QHash<int, Signature> callbacks;
 	QList<uint> asyncfunctions;
 	QMutex mutex;
+	const QMetaObject* connectedMeta; //the class whose function signals are connected to this object
+	bool threadSafe;
 
 };
 }
@@ -0,0 +1,286 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCCOROUTINE_H
+#define QTRPCCOROUTINE_H
+
+/*
+Coroutine support requires a C++20 compiler, the rest of the library does not. Everything in this file compiles away on older compilers.
+
+Service functions that are coroutines must be members of a ServiceProxy subclass, const or not (or free functions taking the service by reference as their first parameter), since the promise needs to know which ServiceProxy to answer through:
+
+	ReturnValue MyService::add(int a, int b)
+	{
+		AsyncCall call;
+		call.submit(other->add(call.receiver(), call.slot(), a, b));
+		ReturnValue r = co_await call;
+		co_return r.toInt() + 1;
+	}
+
+The function returns ReturnValue::asyncronous() to its caller at the first suspension point, and the result is sent with AsyncReturn once the coroutine finishes. Each time the coroutine is resumed the deadline, connection and trace of its call are made current again with an AsyncReturnScope, so remainingTime() and the calls it makes after a co_await behave as they did before it. currentFunctionId() is not restored, it belongs to whatever call the thread runs at the time.
+
+The parameters of a service coroutine must be taken by value, not by reference like "const QString&". The arguments a call is dispatched with are freed as soon as the function returns ReturnValue::asyncronous() at its first suspension point, so a reference would point to freed memory once the coroutine resumes. The coroutine keeps its own copies of parameters taken by value. Reference parameters are rejected at compile time.
+
+examples/coroutine_server and examples/coroutine_client show both sides.
+
+On the client side any function can co_await an AsyncCall. QtRpc::Task can be used as the return type of a fire and forget coroutine.
+*/
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+
+#include <coroutine>
+#include <exception>
+#include <type_traits>
+#include <utility>
+#include <AsyncCall>
+#include <AsyncReturn>
+#include <ReturnValue>
+#include <ServiceProxy>
+
+namespace QtRpc
+{
+
+/**
+	Awaiter returned by operator co_await(AsyncCall&). The coroutine is resumed in the thread that owns the AsyncCall, from the event loop.
+	@brief Awaiter for AsyncCall
+*/
+class AsyncCallAwaiter
+{
+public:
+	explicit AsyncCallAwaiter(AsyncCall& call)
+			: m_call(call)
+	{
+	}
+
+	bool await_ready() const
+	{
+		return m_call.isFinished();
+	}
+
+	void await_suspend(std::coroutine_handle<> handle)
+	{
+		m_call.setCallback(&AsyncCallAwaiter::resume, handle.address());
+	}
+
+	ReturnValue await_resume() const
+	{
+		return m_call.result();
+	}
+
+private:
+	static void resume(void* address)
+	{
+		std::coroutine_handle<>::from_address(address).resume();
+	}
+
+	AsyncCall& m_call;
+};
+
+inline AsyncCallAwaiter operator co_await(AsyncCall& call)
+{
+	return AsyncCallAwaiter(call);
+}
+
+/**
+	Return type for fire and forget coroutines. The coroutine starts immediately and frees itself when it finishes.
+	@brief Fire and forget coroutine
+*/
+struct Task
+{
+	struct promise_type
+	{
+		Task get_return_object()
+		{
+			return Task();
+		}
+		std::suspend_never initial_suspend() noexcept
+		{
+			return std::suspend_never();
+		}
+		std::suspend_never final_suspend() noexcept
+		{
+			return std::suspend_never();
+		}
+		void return_void()
+		{
+		}
+		void unhandled_exception()
+		{
+			std::terminate();
+		}
+	};
+};
+
+/**
+	Wraps the awaiters of a service coroutine, so that the ServiceCoroutinePromise can leave the call when the coroutine suspends and enter it again when it resumes.
+	@brief Awaiter used by service coroutines
+*/
+template<typename Promise, typename Awaiter>
+class ServiceCoroutineAwaiter
+{
+public:
+	ServiceCoroutineAwaiter(Promise& promise, Awaiter&& awaiter)
+			: m_promise(promise),
+			m_awaiter(std::forward<Awaiter>(awaiter))
+	{
+	}
+
+	bool await_ready()
+	{
+		return m_awaiter.await_ready();
+	}
+
+	template<typename Handle>
+	decltype(auto) await_suspend(Handle handle)
+	{
+		m_promise.leave();
+		return m_awaiter.await_suspend(handle);
+	}
+
+	decltype(auto) await_resume()
+	{
+		m_promise.enter();
+		return m_awaiter.await_resume();
+	}
+
+private:
+	Promise& m_promise;
+	Awaiter m_awaiter;
+};
+
+/**
+	Promise used for service functions that are coroutines. The AsyncReturn is created before the coroutine body runs, while the service is still dispatching the call, so it captures the right function id, and the deadline, connection and trace of the call, which are made current again every time the coroutine resumes.
+	@brief Coroutine promise for service functions
+*/
+class ServiceCoroutinePromise
+{
+public:
+	template<typename Service, typename... Args>
+	ServiceCoroutinePromise(Service& service, Args&&...)
+			: m_return(const_cast<ServiceProxy*>(static_cast<const ServiceProxy*>(&service))),
+			m_scope(0)
+	{
+	}
+
+	~ServiceCoroutinePromise()
+	{
+		leave();
+	}
+
+	template<typename Awaitable>
+	auto await_transform(Awaitable&& awaitable)
+	{
+		typedef decltype(awaiter(std::forward<Awaitable>(awaitable))) Awaiter;
+		return ServiceCoroutineAwaiter<ServiceCoroutinePromise, Awaiter>(*this, awaiter(std::forward<Awaitable>(awaitable)));
+	}
+
+	/**
+	 * Makes the call current again, once the coroutine resumed
+	 */
+	void enter()
+	{
+		if (m_scope == 0)
+			m_scope = new AsyncReturnScope(m_return);
+	}
+
+	/**
+	 * Restores the state of the thread, before the coroutine suspends
+	 */
+	void leave()
+	{
+		delete m_scope;
+		m_scope = 0;
+	}
+
+	ReturnValue get_return_object()
+	{
+		return ReturnValue::asyncronous();
+	}
+	std::suspend_never initial_suspend() noexcept
+	{
+		return std::suspend_never();
+	}
+	std::suspend_never final_suspend() noexcept
+	{
+		return std::suspend_never();
+	}
+	void return_value(const ReturnValue& ret)
+	{
+		m_return.send(ret);
+	}
+	void unhandled_exception()
+	{
+		m_return.send(ReturnValue(ReturnValue::GenericError, "Unhandled exception in service coroutine"));
+	}
+
+private:
+	// Finds the awaiter of an awaitable, the same way co_await does
+	template<typename Awaitable>
+	static decltype(auto) awaiter(Awaitable&& awaitable)
+	{
+		if constexpr (requires { std::forward<Awaitable>(awaitable).operator co_await(); })
+			return std::forward<Awaitable>(awaitable).operator co_await();
+		else if constexpr (requires { operator co_await(std::forward<Awaitable>(awaitable)); })
+			return operator co_await(std::forward<Awaitable>(awaitable));
+		else
+			return std::forward<Awaitable>(awaitable);
+	}
+
+	AsyncReturn m_return;
+	AsyncReturnScope* m_scope;
+};
+
+}
+
+namespace std
+{
+
+template<typename Service, typename... Args>
+struct coroutine_traits<QtRpc::ReturnValue, Service&, Args...>
+{
+	static_assert(is_base_of<QtRpc::ServiceProxy, Service>::value, "A coroutine returning ReturnValue must take a ServiceProxy reference as its first parameter");
+	static_assert((!is_reference<Args>::value && ...), "The parameters of a service coroutine must be taken by value, references point to arguments that are freed at the first co_await");
+	typedef QtRpc::ServiceCoroutinePromise promise_type;
+};
+
+template<typename Service, typename... Args>
+struct coroutine_traits<QtRpc::ReturnValue, const Service&, Args...>
+{
+	static_assert(is_base_of<QtRpc::ServiceProxy, Service>::value, "A coroutine returning ReturnValue must take a ServiceProxy reference as its first parameter");
+	static_assert((!is_reference<Args>::value && ...), "The parameters of a service coroutine must be taken by value, references point to arguments that are freed at the first co_await");
+	typedef QtRpc::ServiceCoroutinePromise promise_type;
+};
+
+}
+
+#endif
+
+#endif
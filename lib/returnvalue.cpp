@@ -69,6 +69,11 @@ void registerMetaTypes()
 		qRegisterMetaTypeStreamOperators<QList<Signature> >("QList<Signature>");
 		qRegisterMetaType<QList<Signature> >("QList<Signature>");
 
+		qRegisterMetaType<QtRpc::Table>("QtRpc::Table");
+		qRegisterMetaTypeStreamOperators<QtRpc::Table>("QtRpc::Table");
+		qRegisterMetaType<QtRpc::Table>("Table");
+		qRegisterMetaTypeStreamOperators<QtRpc::Table>("Table");
+
 		qRegisterMetaType<QtRpc::Arguments>("QtRpc::Arguments");
 		qRegisterMetaType<Arguments>("Arguments");
 
@@ -121,6 +126,13 @@ QtRpc::ReturnValue::ReturnValue(int num, QString str)
 	qxt_d().data.data()->string = str;
 }
 
+QtRpc::ReturnValue::ReturnValue(const QtRpc::Table& val) : QVariant(QVariant::fromValue(val))
+{
+	QXT_INIT_PRIVATE(ReturnValue);
+	qxt_d().data = new ReturnValueData();
+	qxt_d().data.data()->type = ReturnValueData::Variant;
+}
+
 QtRpc::ReturnValue::ReturnValue(QtRpc::ServiceProxy* srv)
 {
 	QXT_INIT_PRIVATE(ReturnValue);
@@ -285,6 +297,15 @@ QDebug operator<<(QDebug dbg, QtRpc::ReturnValue::Error err)
 		case QtRpc::ReturnValue::NoExists:
 			dbg << "Does not exist";
 			break;
+		case QtRpc::ReturnValue::DeadlineExceeded:
+			dbg << "Deadline exceeded";
+			break;
+		case QtRpc::ReturnValue::Cancelled:
+			dbg << "Cancelled";
+			break;
+		case QtRpc::ReturnValue::Overloaded:
+			dbg << "Overloaded";
+			break;
 		case QtRpc::ReturnValue::EverythingIsBroken:
 			dbg << "Everything is broken";
 			break;
@@ -35,6 +35,7 @@
 #include <QVariant>
 #include <QxtPimpl>
 #include <AutomaticMetatypeRegistry>
+#include <Table>
 #include <QtRpcGlobal>
 #include <QDebug>
 
@@ -97,6 +98,9 @@ public:
 		GenericFatalError,
 		PermissionDenied,
 		NoExists,
+		DeadlineExceeded = 20,
+		Cancelled,
+		Overloaded,
 		EverythingIsBroken = 99,
 		WeGotHaxed = 1337
 	};
@@ -132,6 +136,7 @@ public:
 	ReturnValue(const QUrl & val);
 	ReturnValue(const QLocale & val);
 	ReturnValue(const QRegExp & val);
+	ReturnValue(const QtRpc::Table & val);
 
 	/**
 	 * Creates a ReturnValue with an error
@@ -40,6 +40,7 @@
 #include "clientproxy_p.h"
 #include "returnvalue.h"
 #include <qtrpcprivate.h>
+#include "freelist_p.h"
 
 namespace QtRpc
 {
@@ -51,6 +52,8 @@ namespace QtRpc
 class ReturnValueData : public QSharedData
 {
 public:
+	QTRPC_FREELIST_ALLOCATED(ReturnValueData)
+
 	~ReturnValueData()
 	{
 		// I guess this doesn't need to be done, because it should be done by whatever is reveiving the pointer..
@@ -80,6 +83,8 @@ public:
 class ReturnValuePrivate : public QxtPrivate<ReturnValue>
 {
 public:
+	QTRPC_FREELIST_ALLOCATED(ReturnValuePrivate)
+
 	ReturnValuePrivate()
 	{
 	}
@@ -45,6 +45,11 @@
 #endif
 #include <ServerThread>
 #include <ServiceProxy>
+#include "callcontext_p.h"
+#include "callstats_p.h"
+#include "metrics_p.h"
+#include <ServerProtocolInstanceBase>
+#include <Message>
 
 namespace QtRpc
 {
@@ -125,7 +130,10 @@ QThread * Server::requestThread()
 					return qxt_d().threads[i];
 				}
 				if (lowest > qxt_d().threadCount[i])
+				{
+					lowest = qxt_d().threadCount[i];
 					thread = i;
+				}
 			}
 			qxt_d().threadCount[thread]++;
 			return qxt_d().threads[thread];
@@ -155,13 +163,28 @@ Server::ThreadType Server::threadType()
 }
 
 /**
- * This function is called to lower the count on a given thread when using threadpool. This function should never be called directly as it for internal use only.
+ * This function is called to lower the count on the current thread when using threadpool. This function should never be called directly as it for internal use only. Protocol instances release the thread they were given by requestThread() themselves when they are destroyed, in whichever thread that happens.
  * @sa requestThread
  */
 void Server::removeService()
+{
+	if (!releaseThread(QThread::currentThread()))
+		qWarning() << "Server::removeService() was called outside of the thread pool, no thread was released";
+}
+
+/**
+ * Lowers the count of a thread of the pool, once a protocol instance that was given the thread by requestThread() is destroyed.
+ * @param thread The thread the instance was given
+ * @return Returns false if the thread is not part of the pool
+ */
+bool Server::releaseThread(QThread* thread)
 {
 	QMutexLocker locker(&qxt_d().threadMutex);
-	qxt_d().threadCount[qxt_d().threads.indexOf(QThread::currentThread())]--;
+	int index = qxt_d().threads.indexOf(thread);
+	if (index < 0)
+		return false;
+	qxt_d().threadCount[index]--;
+	return true;
 }
 
 /**
@@ -175,9 +198,10 @@ ServiceProxy* Server::requestService(QString name, ServerProtocolInstanceBase* p
 	QMutexLocker locker(&qxt_d().servicemutex);
 	if (_serviceFactories.contains(name))
 	{
-		ServiceProxy* service = _serviceFactories[name]->newInstance();
+		ServiceProxy* service = _serviceFactories[name]->acquire();
 		service->initProxy(this, protocol, _serviceFactories[name]->instance().getRawData());
 		service->setServiceName(_serviceFactories[name]->instance().serviceName());
+		addServiceInstance(service, protocol);
 		return service;
 	}
 	return NULL;
@@ -216,6 +240,399 @@ QList<Signature> Server::listEvents(const QString &service)
 	return _serviceFactories[service]->instance().listEvents();
 }
 
+/**
+ * Keeps up to \a size idle instances of \a service per thread, and reuses them for new clients instead of creating new instances. The service must reimplement ServiceProxy::reset() for its instances to be pooled.
+ * @param service The name of the service
+ * @param size The number of idle instances kept per thread, or 0 to disable pooling
+ */
+void Server::setServicePoolSize(const QString &service, int size)
+{
+	QMutexLocker locker(&qxt_d().servicemutex);
+	if (!_serviceFactories.contains(service))
+	{
+		qWarning() << "Failed to find service:" << service << _serviceFactories.keys();
+		return;
+	}
+	_serviceFactories[service]->setPoolSize(size);
+}
+
+/**
+ * Limits the number of calls to \a service that may be running or waiting for an asynchronous reply at the same time, across all connections.
+ * @param service The name of the service
+ * @param max The maximum number of calls, or 0 for no limit
+ */
+void Server::setMaxConcurrentCalls(const QString &service, int max)
+{
+	QMutexLocker locker(&qxt_d().limitsMutex);
+	const QHash<QString, ServiceLimit*>* limits = qxt_d().serviceLimits.load();
+	ServiceLimit* limit = limits->value(service, 0);
+	if (limit == 0)
+	{
+		if (max <= 0)
+			return;
+		QHash<QString, ServiceLimit*>* copy = new QHash<QString, ServiceLimit*>(*limits);
+		limit = new ServiceLimit();
+		copy->insert(service, limit);
+		qxt_d().retiredLimits << limits;
+		qxt_d().serviceLimits.storeRelease(copy);
+	}
+	limit->max.store(qMax(0, max));
+	qxt_d().updateLimited();
+}
+
+/**
+ * @param service The name of the service
+ * @return Returns the maximum number of concurrent calls to \a service, or 0 for no limit
+ */
+int Server::maxConcurrentCalls(const QString &service) const
+{
+	ServiceLimit* limit = qxt_d().serviceLimits.loadAcquire()->value(service, 0);
+	return limit == 0 ? 0 : limit->max.load();
+}
+
+/**
+ * Limits the number of calls a single connection may have running or waiting for an asynchronous reply at the same time.
+ * @param max The maximum number of calls, or 0 for no limit
+ */
+void Server::setMaxConcurrentCallsPerConnection(int max)
+{
+	QMutexLocker locker(&qxt_d().limitsMutex);
+	qxt_d().maxConnectionCalls.store(qMax(0, max));
+	qxt_d().updateLimited();
+}
+
+/**
+ * @return Returns the maximum number of concurrent calls per connection, or 0 for no limit
+ */
+int Server::maxConcurrentCallsPerConnection() const
+{
+	return qxt_d().maxConnectionCalls.load();
+}
+
+/**
+ * Rejects calls that waited longer than \a msecs between being read from the network and being run, which happens when the thread is busy with other calls.
+ * @param msecs The maximum queue time in milliseconds, or 0 for no limit
+ */
+void Server::setMaxQueueTime(int msecs)
+{
+	QMutexLocker locker(&qxt_d().limitsMutex);
+	qxt_d().maxQueueTime.store(qMax(0, msecs));
+	qxt_d().updateLimited();
+}
+
+/**
+ * @return Returns the maximum queue time in milliseconds, or 0 for no limit
+ */
+int Server::maxQueueTime() const
+{
+	return qxt_d().maxQueueTime.load();
+}
+
+/**
+ * Returns the admission control counters. The map contains the number of calls that were admitted, the number rejected by each limit (rejectedService, rejectedConnection and rejectedQueueTime), and a map of the calls currently active per service that has a limit. Calls are only counted while a limit is set, without limits admission costs nothing.
+ * @return Returns a map of counters
+ */
+QVariantMap Server::admissionStats() const
+{
+	QVariantMap stats;
+	stats["admitted"] = qxt_d().admitted.load();
+	stats["rejectedService"] = qxt_d().rejectedService.load();
+	stats["rejectedConnection"] = qxt_d().rejectedConnection.load();
+	stats["rejectedQueueTime"] = qxt_d().rejectedQueueTime.load();
+	QVariantMap active;
+	const QHash<QString, ServiceLimit*>* limits = qxt_d().serviceLimits.loadAcquire();
+	for (QHash<QString, ServiceLimit*>::const_iterator it = limits->constBegin(); it != limits->constEnd(); ++it)
+		active[it.key()] = it.value()->active.load();
+	stats["active"] = active;
+	return stats;
+}
+
+/**
+ * Returns the function call statistics. The map contains a map for every service, which maps the signature of each function that was called to its statistics: the number of calls, the number of errors, and the queue, execution and serialization times. Each time is a map with the count, min, max, mean, p50, p90, p99 and p999 values, in microseconds. The queue time is measured from when the call was read from the network until it was run, the execution time until the reply was ready, which includes the time asynchronous functions took to send their reply, and the serialization time is the time spent encoding the reply.
+ *
+ * Only the calls answered by this server are counted.
+ * @return Returns a map of statistics per service and function
+ */
+QVariantMap Server::callStats() const
+{
+	return CallStats::snapshot(qxt_d().statsId);
+}
+
+/**
+ * Lets clients read callStats() with ClientProxy::stats(), once they authenticated with a service. This is off by default, the statistics tell which functions are called how often.
+ * @param enabled True to answer the stats() requests of clients
+ */
+void Server::setRemoteStatsEnabled(bool enabled)
+{
+	QMutexLocker locker(&qxt_d().limitsMutex);
+	qxt_d().remoteStats = enabled;
+}
+
+/**
+ * @return Returns true if clients may read the call statistics, see setRemoteStatsEnabled()
+ */
+bool Server::remoteStatsEnabled() const
+{
+	QMutexLocker locker(const_cast<QMutex*>(&qxt_d().limitsMutex));
+	return qxt_d().remoteStats;
+}
+
+/**
+ * Clears the statistics returned by callStats(), for all the servers of the process
+ */
+void Server::resetCallStats()
+{
+	CallStats::reset();
+}
+
+/**
+ * Logs function calls that are still running after \a msecs milliseconds. The call is logged with its arguments and the calls it was made from, and again with the time it took once it returns. The threshold applies to all the servers of the process, and can also be set with the QTRPC_SLOW_CALL_MS environment variable. Only calls running in the threads of the ThreadPool and ThreadPerInstance models are watched. While the log is off the calls and their arguments are not recorded, only the per thread counters of threadStats() are kept.
+ * @param msecs The threshold in milliseconds, or 0 to turn the slow call log off
+ */
+void Server::setSlowCallThreshold(int msecs)
+{
+	ServerThread::setSlowCallThreshold(msecs);
+}
+
+/**
+ * @return Returns the slow call threshold in milliseconds, or 0 if the slow call log is off
+ * @sa setSlowCallThreshold()
+ */
+int Server::slowCallThreshold() const
+{
+	return ServerThread::slowCallThreshold();
+}
+
+/**
+ * Returns the state of the server threads of the process. The list contains a map for every thread, with its name (thread), the number of connections it runs (connections), the number of calls it ran (calls), the number of calls that were logged as slow (slowCalls), and whether it is running a call (busy). For a busy thread the map also contains the time the outermost call started (blockedSince), how long it has been running in milliseconds (blockedFor), and, while the slow call log is on, its service and method.
+ * @return Returns a list with a map for every thread
+ */
+QVariantList Server::threadStats() const
+{
+	return ServerThread::threadStats();
+}
+
+/**
+ * Returns the number of objects that belong to connections. The map contains the number of service objects alive (serviceObjects), including the templates of registered services, the number of protocol instances alive (instances), the number of services they hold (connectionServices), and the number of callbacks sent to clients that have not returned yet (pendingCallbacks). These are counted for all the servers of the process. For this server the map also contains the number of service objects events are broadcast to (broadcastTargets), and, with the ThreadPool model, a list with the number of connections assigned to each thread (threadLoad).
+ * @return Returns a map of counters
+ */
+QVariantMap Server::resourceStats() const
+{
+	QVariantMap stats;
+	stats["serviceObjects"] = Metrics::resource(Metrics::ServiceObjects);
+	stats["instances"] = Metrics::resource(Metrics::ProtocolInstances);
+	stats["connectionServices"] = Metrics::resource(Metrics::ConnectionServices);
+	stats["pendingCallbacks"] = Metrics::resource(Metrics::PendingCallbacks);
+	{
+		QMutexLocker locker(const_cast<QMutex*>(&qxt_d().registryMutex));
+		int targets = 0;
+		foreach(const QMultiHash<ServiceProxy*, ServerProtocolInstanceBase*>& services, qxt_d().registry)
+			targets += services.count();
+		stats["broadcastTargets"] = targets;
+	}
+	if (qxt_d().threadType == ThreadPool)
+	{
+		QMutexLocker locker(const_cast<QMutex*>(&qxt_d().threadMutex));
+		QVariantList load;
+		foreach(int count, qxt_d().threadCount)
+			load << count;
+		stats["threadLoad"] = load;
+	}
+	return stats;
+}
+
+/**
+ * This function is used internally by the protocol instances before running a function call. Every call that is admitted must be released with releaseCall() once it has been answered. Do not call this function directly.
+ * @param service The name of the service being called
+ * @param connectionCalls The number of calls the connection already has running
+ * @param limit Set to the limit the call was counted against, to be passed to releaseCall(), or NULL
+ * @return Returns an Overloaded error if the call should be rejected
+ */
+ReturnValue Server::admitCall(const QString &service, int connectionCalls, ServiceLimit** limit)
+{
+	*limit = 0;
+	// Without limits there is nothing to count, the worker threads don't share anything here
+	if (qxt_d().limited.load() == 0)
+		return ReturnValue();
+	int maxQueueTime = qxt_d().maxQueueTime.load();
+	if (maxQueueTime > 0)
+	{
+		CallContext* context = CallContext::current();
+		if (context != 0 && context->arrival() >= 0 && CallContext::now() - context->arrival() > maxQueueTime)
+		{
+			qxt_d().rejectedQueueTime.fetchAndAddRelaxed(1);
+			return ReturnValue(ReturnValue::Overloaded, "The server is overloaded, the call waited too long to be run");
+		}
+	}
+	int maxConnectionCalls = qxt_d().maxConnectionCalls.load();
+	if (maxConnectionCalls > 0 && connectionCalls >= maxConnectionCalls)
+	{
+		qxt_d().rejectedConnection.fetchAndAddRelaxed(1);
+		return ReturnValue(ReturnValue::Overloaded, "The server is overloaded, too many calls are running for this connection");
+	}
+	ServiceLimit* serviceLimit = qxt_d().serviceLimits.loadAcquire()->value(service, 0);
+	if (serviceLimit != 0)
+	{
+		int max = serviceLimit->max.load();
+		if (max > 0)
+		{
+			if (serviceLimit->active.fetchAndAddRelaxed(1) >= max)
+			{
+				serviceLimit->active.fetchAndAddRelaxed(-1);
+				qxt_d().rejectedService.fetchAndAddRelaxed(1);
+				return ReturnValue(ReturnValue::Overloaded, "The server is overloaded, too many calls are running for " + service);
+			}
+			*limit = serviceLimit;
+		}
+	}
+	qxt_d().admitted.fetchAndAddRelaxed(1);
+	return ReturnValue();
+}
+
+/**
+ * Emits an event on every instance of \a service that is connected to a client. The event is encoded once and the same buffer is queued on every connection, only the small connection specific header is encoded per client. This is much cheaper than emitting the event on each service object when there are many clients.
+ * @param service The name of the service
+ * @param sig The Signature of the event
+ * @param args Arguments list for the event
+ * @return Returns the number of connections the event was queued on
+ */
+int Server::broadcastEvent(const QString &service, const Signature &sig, const Arguments &args)
+{
+	Message msg(0, Message::Event, sig, args);
+	msg.setVersion(Message::currentVersion());
+	QByteArray body = msg.body();
+
+	QMutexLocker locker(&qxt_d().registryMutex);
+	const QMultiHash<ServiceProxy*, ServerProtocolInstanceBase*> targets = qxt_d().registry.value(service);
+	for (QMultiHash<ServiceProxy*, ServerProtocolInstanceBase*>::const_iterator it = targets.constBegin(); it != targets.constEnd(); ++it)
+	{
+		// Instances remove their services under registryMutex before they go away, so the instance is alive here. Queued events are dropped if it is deleted later.
+		QMetaObject::invokeMethod(it.value(), "sendEncodedEvent", Qt::QueuedConnection, Q_ARG(ServiceProxy*, it.key()), Q_ARG(Signature, sig), Q_ARG(Arguments, args), Q_ARG(QByteArray, body));
+	}
+	Metrics::eventBroadcast(targets.count());
+	return targets.count();
+}
+
+/**
+ * Emits an event of \a service on every connection using it. This is how events of services registered as ServiceFactoryParent::Shared or ServiceFactoryParent::PerThread are sent, it is safe to call from any thread.
+ * @param service The service object
+ * @param sig The Signature of the event
+ * @param args Arguments list for the event
+ * @return Returns the number of connections the event was queued on
+ */
+int Server::broadcastEvent(ServiceProxy* service, const Signature &sig, const Arguments &args)
+{
+	Message msg(0, Message::Event, sig, args);
+	msg.setVersion(Message::currentVersion());
+	QByteArray body = msg.body();
+
+	QMutexLocker locker(&qxt_d().registryMutex);
+	const QList<ServerProtocolInstanceBase*> targets = qxt_d().registry.value(service->serviceName()).values(service);
+	foreach(ServerProtocolInstanceBase* instance, targets)
+	{
+		QMetaObject::invokeMethod(instance, "sendEncodedEvent", Qt::QueuedConnection, Q_ARG(ServiceProxy*, service), Q_ARG(Signature, sig), Q_ARG(Arguments, args), Q_ARG(QByteArray, body));
+	}
+	Metrics::eventBroadcast(targets.count());
+	return targets.count();
+}
+
+/**
+ * This function is used internally to keep track of the service objects that clients are connected to. Do not call this function directly.
+ * @param service The service object
+ * @param instance The protocol instance the service belongs to
+ */
+void Server::addServiceInstance(ServiceProxy* service, ServerProtocolInstanceBase* instance)
+{
+	if (service == 0 || instance == 0)
+		return;
+	QMutexLocker locker(&qxt_d().registryMutex);
+	QMultiHash<ServiceProxy*, ServerProtocolInstanceBase*>& services = qxt_d().registry[service->serviceName()];
+	if (!services.contains(service, instance))
+		services.insert(service, instance);
+}
+
+/**
+ * This function is used internally when a service object or its protocol instance goes away. Do not call this function directly.
+ * @param service The service object
+ */
+void Server::removeServiceInstance(ServiceProxy* service)
+{
+	QMutexLocker locker(&qxt_d().registryMutex);
+	for (QHash<QString, QMultiHash<ServiceProxy*, ServerProtocolInstanceBase*> >::iterator it = qxt_d().registry.begin(); it != qxt_d().registry.end(); ++it)
+		it->remove(service);
+}
+
+/**
+ * This function is used internally when a protocol instance stops using a service object, that may be shared with other connections. Do not call this function directly.
+ * @param service The service object
+ * @param instance The protocol instance
+ */
+void Server::removeServiceInstance(ServiceProxy* service, ServerProtocolInstanceBase* instance)
+{
+	QMutexLocker locker(&qxt_d().registryMutex);
+	for (QHash<QString, QMultiHash<ServiceProxy*, ServerProtocolInstanceBase*> >::iterator it = qxt_d().registry.begin(); it != qxt_d().registry.end(); ++it)
+		it->remove(service, instance);
+}
+
+/**
+ * Sets the limits of the outgoing buffer of each connection. Above \a highWater bytes the connection is considered congested and the SlowClientPolicy is applied, it stops being congested once the buffer drains below \a lowWater bytes. The limits are read when a connection is made.
+ * @param lowWater The low water mark in bytes
+ * @param highWater The high water mark in bytes, or 0 to never apply backpressure
+ */
+void Server::setWriteQueueLimits(qint64 lowWater, qint64 highWater)
+{
+	QMutexLocker locker(&qxt_d().limitsMutex);
+	qxt_d().highWater = qMax(Q_INT64_C(0), highWater);
+	qxt_d().lowWater = qBound(Q_INT64_C(0), lowWater, qxt_d().highWater);
+}
+
+/**
+ * @return Returns the low water mark of the outgoing buffers, in bytes
+ */
+qint64 Server::writeQueueLowWater() const
+{
+	QMutexLocker locker(const_cast<QMutex*>(&qxt_d().limitsMutex));
+	return qxt_d().lowWater;
+}
+
+/**
+ * @return Returns the high water mark of the outgoing buffers in bytes, or 0 if there is none
+ */
+qint64 Server::writeQueueHighWater() const
+{
+	QMutexLocker locker(const_cast<QMutex*>(&qxt_d().limitsMutex));
+	return qxt_d().highWater;
+}
+
+/**
+ * Sets what happens to messages sent to clients that have more than the high water mark buffered. The policy is read when a connection is made.
+ * @param policy The new policy
+ */
+void Server::setSlowClientPolicy(SlowClientPolicy policy)
+{
+	QMutexLocker locker(&qxt_d().limitsMutex);
+	qxt_d().slowClientPolicy = policy;
+}
+
+/**
+ * @return Returns the policy for slow clients
+ */
+Server::SlowClientPolicy Server::slowClientPolicy() const
+{
+	QMutexLocker locker(const_cast<QMutex*>(&qxt_d().limitsMutex));
+	return qxt_d().slowClientPolicy;
+}
+
+/**
+ * This function is used internally by the protocol instances once a call admitted by admitCall() has been answered. Do not call this function directly.
+ * @param limit The limit set by admitCall(), or NULL
+ */
+void Server::releaseCall(ServiceLimit* limit)
+{
+	if (limit != 0)
+		limit->active.fetchAndAddRelaxed(-1);
+}
+
 
 }
 
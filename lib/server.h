@@ -35,7 +35,9 @@
 #include <QObject>
 #include <QxtPimpl>
 #include <QHash>
+#include <QVariant>
 #include <ServiceFactory>
+#include <ReturnValue>
 #include <QtRpcGlobal>
 
 class QThread;
@@ -46,11 +48,22 @@ namespace QtRpc
 {
 
 class ServerProtocolInstanceBase;
+struct ServiceLimit;
 class ServerPrivate;
 class ServiceProxy;
 
 /**
 This is the main peice of the server side of QtRpc2. This object by itself does virtually nothing, instead you attach listeners and services to it which do most of the work. The only real work this class does is managing all the other classes.
+
+The server can also limit how much work it accepts. setMaxConcurrentCalls() limits the number of unanswered calls to a service across all connections, setMaxConcurrentCallsPerConnection() limits the unanswered calls of a single connection, and setMaxQueueTime() rejects calls that waited too long before they could be run. Calls over a limit are answered right away with a ReturnValue::Overloaded error, without running the service function, so clients can retry somewhere else. admissionStats() returns the counters.
+
+callStats() returns how many times each function of each service was called, how many of the calls returned an error, and histograms of the time the calls waited before they were run, the time they ran and the time spent encoding their replies. Clients that authenticated can read the same statistics with ClientProxy::stats(), once setRemoteStatsEnabled() allows it.
+
+A service function that blocks, in the ThreadPool model, also blocks every other connection that runs in the same thread. setSlowCallThreshold() logs the calls that run for longer than the threshold, with their arguments and the calls they were made from, and threadStats() shows what each thread is running and since when.
+
+resourceStats() counts the objects that are created for every connection and must be freed with it, so leaks show up as counters that keep growing while the number of connections stays the same.
+
+Outgoing data for each connection is limited by setWriteQueueLimits(). Once more than the high water mark is buffered for a client, services are told through ServiceProxy::backpressureChanged() and the SlowClientPolicy decides what happens to further messages, until the buffer drains below the low water mark.
 	@brief Central server object for use by QtRpc2
 	@author Brendan Powers <brendan@resara.com>
 	@author Chris Vickery <chris@resara.com>
@@ -72,18 +85,29 @@ public:
 		ProcessPerInstance	/**< This threading model actually forks off and execv's for each incoming connection. This makes centralized services that manage other services not work (like LaptopManager etc) */
 #endif
 	};
+	/**
+	 * This enum represents what happens to outgoing messages when a client is not reading fast enough, and the data buffered for the connection is above the high water mark.
+	 */
+	enum SlowClientPolicy
+	{
+		BufferAll,		/**< Everything is buffered, services are only told about the backpressure. This is the default. */
+		DropEvents,		/**< Events are dropped until the buffer drains below the low water mark. Return values and callbacks are always buffered. */
+		CoalesceEvents,		/**< Only the latest buffered emission of each event is kept. Return values and callbacks are always buffered. */
+		DisconnectClient	/**< The client is disconnected. */
+	};
 	Server(QObject *parent = 0, ThreadType thread = ThreadPool, int threadCount = -1, bool cleanChildren = false);
 	~Server();
 
 	QThread * requestThread();
 	template<class Service>
-	ServiceProxy* registerService(QString name)
+	ServiceProxy* registerService(QString name, ServiceFactoryParent::InstanceMode mode = ServiceFactoryParent::PerClient)
 	{
 		if (!_serviceFactories.contains(name))
 		{
 			_serviceFactories[name] = new ServiceFactory<Service>();
 		}
 
+		_serviceFactories[name]->setInstanceMode(mode);
 		_serviceFactories[name]->instance().setServiceName(name);
 		return &_serviceFactories[name]->instance();
 	}
@@ -94,10 +118,45 @@ public:
 	QList<Signature> listFunctions(const QString &service);
 	QList<Signature> listCallbacks(const QString &service);
 	QList<Signature> listEvents(const QString &service);
+	void setServicePoolSize(const QString &service, int size);
+
+	void setMaxConcurrentCalls(const QString &service, int max);
+	int maxConcurrentCalls(const QString &service) const;
+	void setMaxConcurrentCallsPerConnection(int max);
+	int maxConcurrentCallsPerConnection() const;
+	void setMaxQueueTime(int msecs);
+	int maxQueueTime() const;
+	QVariantMap admissionStats() const;
+	QVariantMap callStats() const;
+	void setRemoteStatsEnabled(bool enabled);
+	bool remoteStatsEnabled() const;
+	void resetCallStats();
+	void setSlowCallThreshold(int msecs);
+	int slowCallThreshold() const;
+	QVariantList threadStats() const;
+	QVariantMap resourceStats() const;
+
+	void setWriteQueueLimits(qint64 lowWater, qint64 highWater);
+	qint64 writeQueueLowWater() const;
+	qint64 writeQueueHighWater() const;
+	void setSlowClientPolicy(SlowClientPolicy policy);
+	SlowClientPolicy slowClientPolicy() const;
+
+	int broadcastEvent(const QString &service, const Signature &sig, const Arguments &args);
+	int broadcastEvent(ServiceProxy* service, const Signature &sig, const Arguments &args);
+	void addServiceInstance(ServiceProxy* service, ServerProtocolInstanceBase* instance);
+	void removeServiceInstance(ServiceProxy* service);
+	void removeServiceInstance(ServiceProxy* service, ServerProtocolInstanceBase* instance);
 public slots:
 	void removeService();
 
 private:
+	friend class ServerProtocolInstanceBase;
+	friend class ServerProtocolInstanceBasePrivate;
+	ReturnValue admitCall(const QString &service, int connectionCalls, ServiceLimit** limit);
+	void releaseCall(ServiceLimit* limit);
+	bool releaseThread(QThread* thread);
+
 	QHash<QString, ServiceFactoryParent*> _serviceFactories;
 	/*
 	QHash<QString, ServiceProxy *> _services;
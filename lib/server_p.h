@@ -38,6 +38,9 @@
 #include <ServiceFactory>
 #include <QHash>
 #include <QMutex>
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include "callstats_p.h"
 #include <qtrpcprivate.h>
 
 namespace QtRpc
@@ -46,19 +49,88 @@ namespace QtRpc
 /**
 	@author Chris Vickery <chris@resara.com>
 */
+/**
+	The limit of concurrent calls to a service, and the number of calls to it that are active. Created by Server::setMaxConcurrentCalls() and kept until the server is destroyed, so admission can use it without a lock.
+*/
+struct ServiceLimit
+{
+	ServiceLimit()
+			: max(0),
+			active(0)
+	{
+	}
+
+	QAtomicInt max;
+	QAtomicInt active;
+};
+
 class ServerPrivate : public QxtPrivate<Server>
 {
 public:
 	ServerPrivate()
-	: threadMutex(QMutex::Recursive)
+	: threadMutex(QMutex::Recursive),
+	maxConnectionCalls(0),
+	maxQueueTime(0),
+	admitted(0),
+	rejectedService(0),
+	rejectedConnection(0),
+	rejectedQueueTime(0),
+	lowWater(1024 * 1024),
+	highWater(4 * 1024 * 1024),
+	slowClientPolicy(Server::BufferAll),
+	statsId(CallStats::nextServer()),
+	remoteStats(false),
+	limited(0),
+	serviceLimits(new QHash<QString, ServiceLimit*>())
 	{
 	}
+
+	~ServerPrivate()
+	{
+		qDeleteAll(*serviceLimits.load());
+		delete serviceLimits.load();
+		qDeleteAll(retiredLimits);
+	}
+
+	// Must be called with limitsMutex locked, after a limit changed
+	void updateLimited()
+	{
+		bool any = maxConnectionCalls.load() > 0 || maxQueueTime.load() > 0;
+		foreach(ServiceLimit* limit, *serviceLimits.load())
+			any = any || limit->max.load() > 0;
+		limited.store(any ? 1 : 0);
+	}
+
 	QMutex servicemutex;
 	Server::ThreadType threadType;
 	QList<int> threadCount;
 	QList<QThread*> threads;
 	QMutex threadMutex;
 
+	// taken by the functions that change the limits, admitCall() and releaseCall() only use atomics
+	QMutex limitsMutex;
+	QAtomicInt maxConnectionCalls;
+	QAtomicInt maxQueueTime;
+	// set while any limit is configured, calls are not counted otherwise
+	QAtomicInt limited;
+	// replaced by a copy when a service gets its first limit, the replaced hashes are kept for the calls still reading them
+	QAtomicPointer<const QHash<QString, ServiceLimit*> > serviceLimits;
+	QList<const QHash<QString, ServiceLimit*>*> retiredLimits;
+	QAtomicInteger<quint64> admitted;
+	QAtomicInteger<quint64> rejectedService;
+	QAtomicInteger<quint64> rejectedConnection;
+	QAtomicInteger<quint64> rejectedQueueTime;
+	qint64 lowWater;
+	qint64 highWater;
+	Server::SlowClientPolicy slowClientPolicy;
+	// the id the calls of this server are recorded with by CallStats
+	quint32 statsId;
+	bool remoteStats;
+
+	// every service object handed to a client, by service name, for broadcastEvent(). Shared service objects appear once for every connection using them.
+	QMutex registryMutex;
+	QHash<QString, QMultiHash<ServiceProxy*, ServerProtocolInstanceBase*> > registry;
+
 };
 
 }
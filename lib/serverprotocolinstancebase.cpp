@@ -42,6 +42,12 @@
 #include "returnvalue_p.h"
 #include "serviceproxy_p.h"
 #include "authtoken.h"
+#include "callcontext_p.h"
+#include "callstats_p.h"
+#include "server_p.h"
+#include "serverthread_p.h"
+#include "metrics_p.h"
+#include <SpanSink>
 
 namespace QtRpc
 {
@@ -59,6 +65,9 @@ ServerProtocolInstanceBase::ServerProtocolInstanceBase(Server* serv, QObject *pa
 	qxt_d().curid = 0;
 	qxt_d().curServiceId = 0;
 	qxt_d().currentFunctionId = 0;
+	qxt_d().backpressured = false;
+	qxt_d().listener = 0;
+	Metrics::addResource(Metrics::ProtocolInstances, 1);
 }
 
 /**
@@ -66,11 +75,34 @@ ServerProtocolInstanceBase::ServerProtocolInstanceBase(Server* serv, QObject *pa
  */
 ServerProtocolInstanceBase::~ServerProtocolInstanceBase()
 {
+	Metrics::addResource(Metrics::ProtocolInstances, -1);
+	Metrics::addResource(Metrics::ConnectionServices, -qxt_d().services.count());
+	Metrics::addResource(Metrics::PendingCallbacks, -qxt_d().queue.count());
+	// Nobody is going to answer the outstanding callbacks anymore, let the services waiting on them know
+	foreach(uint id, qxt_d().queue.keys())
+	{
+		ReplySlot slot = qxt_d().queue.take(id);
+		if (slot.object.isNull())
+			continue;
+		QMetaObject::invokeMethod(slot.object, qPrintable(slot.slot.name()), Qt::QueuedConnection, Q_ARG(uint, id), Q_ARG(ReturnValue, ReturnValue(ReturnValue::Cancelled, "The client disconnected before the callback returned")));
+	}
+	foreach(const ServerProtocolInstanceBasePrivate::PendingCall& call, qxt_d().pendingCalls)
+		qxt_d().releaseCall(call);
+	if (qxt_d().listener != 0)
+		qxt_d().listener->open.fetchAndAddRelaxed(-1);
+	if (!qxt_d().thread.isNull())
+		qxt_d().thread->connectionClosed();
+	// The instance may be destroyed in another thread than the one it was given, like the thread of the server during shutdown
+	if (!qxt_d().poolThread.isNull() && !qxt_d().serv.isNull())
+		qxt_d().serv->releaseThread(qxt_d().poolThread);
 	foreach(QSharedPointer<ServiceProxy> srv, qxt_d().services.values())
 	{
 		if (srv.isNull())
 			continue;
-		srv->qxt_d().instance = 0;
+		if (!qxt_d().serv.isNull())
+			qxt_d().serv->removeServiceInstance(srv.data(), this);
+		if (srv->qxt_d().instance == this)
+			srv->qxt_d().instance = 0;
 	}
 }
 
@@ -85,8 +117,9 @@ ServiceProxy* ServerProtocolInstanceBase::service(quint32 id) const
 {
 	if (id == 0)
 		return service();
-	if (qxt_d().services.contains(id))
-		return qxt_d().services.value(id).data();
+	QHash<quint32, QSharedPointer<ServiceProxy> >::const_iterator it = qxt_d().services.constFind(id);
+	if (it != qxt_d().services.constEnd())
+		return it.value().data();
 	return 0;
 }
 
@@ -110,32 +143,38 @@ uint ServerProtocolInstanceBase::nextId()
 ReturnValue ServerProtocolInstanceBase::getServiceObject(QString name, QString username, QString pass)
 {
 	qxt_d().servicename = name;
-	QSharedPointer<ServiceProxy> srv(qxt_d().serv->requestService(name, this));
+	QSharedPointer<ServiceProxy> srv(qxt_d().serv->requestService(name, this), &ServiceFactoryParent::release);
 	if (srv == 0)
 		return ReturnValue(1, "Received service template object was null (" + name + ")");
-	srv->qxt_d().weakPointer = srv;
-	qxt_d().curServiceId++;
-	qxt_d().services[qxt_d().curServiceId] = srv;
+	if (!srv->qxt_d().shared)
+		srv->qxt_d().weakPointer = srv;
+	quint32 id = qxt_d().addService(srv);
 	srv->setParent(0);
-	ReturnValue ret = srv->auth(AuthToken(username, pass));
+	AuthToken token(username, pass);
+	ReturnValue ret = srv->auth(token);
 	if (!ret.isError())
-		ret.setServiceId(qxt_d().curServiceId);
+	{
+		qxt_d().tokens.insert(id, token);
+		if (!srv->qxt_d().shared)
+			srv->qxt_d().token = token;
+		ret.setServiceId(id);
+	}
 	return ret;
 }
 
 ReturnValue ServerProtocolInstanceBase::getServiceObject(QString name)
 {
 	qxt_d().servicename = name;
-	QSharedPointer<ServiceProxy> srv(qxt_d().serv->requestService(name, this));
+	QSharedPointer<ServiceProxy> srv(qxt_d().serv->requestService(name, this), &ServiceFactoryParent::release);
 	if (srv == 0)
 		return ReturnValue(1, "Received service template object was null (" + name + ")");
-	srv->qxt_d().weakPointer = srv;
-	qxt_d().curServiceId++;
-	qxt_d().services[qxt_d().curServiceId] = srv;
+	if (!srv->qxt_d().shared)
+		srv->qxt_d().weakPointer = srv;
+	quint32 id = qxt_d().addService(srv);
 	srv->setParent(0);
-	qxt_d().needsAuth.append(qxt_d().curServiceId);
+	qxt_d().needsAuth.insert(id);
 	ReturnValue ret;
-	ret.setServiceId(qxt_d().curServiceId);
+	ret.setServiceId(id);
 	return ret;
 }
 
@@ -146,13 +185,28 @@ void ServerProtocolInstanceBase::moveToThread(QThread* thread)
 }
 
 ReturnValue ServerProtocolInstanceBase::callFunction(quint32 id, quint32 serviceId, Signature sig, Arguments args)
+{
+	return callFunction(id, serviceId, sig, args, QByteArray());
+}
+
+/**
+ * Calls a function of a service. If \a packed is not null the function is called with the packed arguments instead of \a args, without converting them to QVariants.
+ * @param id The id of the call
+ * @param serviceId The id of the service
+ * @param sig The signature of the function
+ * @param args The arguments of the function
+ * @param packed The packed arguments of the function, or a null QByteArray
+ * @return Returns the return value of the function
+ */
+ReturnValue ServerProtocolInstanceBase::callFunction(quint32 id, quint32 serviceId, Signature sig, Arguments args, const QByteArray& packed)
 {
 	ServiceProxy* srv = service(serviceId);
 	if (srv == 0)
 		return ReturnValue(1, "The service object does not exist");
-	if (sig.name() != "auth" && qxt_d().needsAuth.contains(serviceId))
+	bool isAuth = sig.name() == "auth";
+	if (!isAuth && qxt_d().needsAuth.contains(serviceId))
 		return ReturnValue(1, "You must authenticate before selecting a service!");
-	if (sig == "auth(QString, QString)")
+	if (isAuth && sig == "auth(QString, QString)")
 	{
 		if (args.count() < 2)
 			return ReturnValue(1, "Not enough paramters for that signature");
@@ -167,12 +221,40 @@ ReturnValue ServerProtocolInstanceBase::callFunction(quint32 id, quint32 service
 				args[i] = QVariant::fromValue(defaultToken());
 		}
 	}
+	ServerProtocolInstanceBasePrivate::PendingCall call = {serviceId, srv->serviceName(), 0};
+	if (!qxt_d().serv.isNull())
+	{
+		ReturnValue admission = qxt_d().serv->admitCall(call.serviceName, qxt_d().pendingCalls.count(), &call.limit);
+		if (admission.isError())
+			return admission;
+	}
+	qxt_d().pendingCalls.insert(id, call);
 	qxt_d().currentFunctionId = id;
-	ReturnValue ret = srv->callFunction(sig, args);
-	if (sig.name() == "auth" && !ret.isError())
+	// Services shared between connections find the connection of the call through the context
+	CallContext* parent = CallContext::current();
+	ServerProtocolInstanceBasePrivate::CallTiming timing = {call.serviceName, sig.toString(), parent ? parent->received() : -1, CallStats::now(), TraceContext()};
+	TraceContext trace = TraceContext::current();
+	if (trace.isSampled())
+		timing.trace = trace;
+	qxt_d().timings.insert(id, timing);
+	CallContext context(parent ? parent->deadline() : -1, parent ? parent->arrival() : -1, timing.received);
+	context.setInstance(this);
+	ReturnValue ret;
 	{
-		qxt_d().needsAuth.removeAll(serviceId);
-		srv->qxt_d().token = args[0].value<AuthToken>();
+		BlockingCall blocking(call.serviceName, timing.method, args, packed.isNull() ? -1 : packed.size());
+		ret = packed.isNull() ? srv->callFunction(sig, args) : srv->callPackedFunction(sig, packed);
+	}
+	if (isAuth)
+		Metrics::recordHandshake(Metrics::Auth, CallStats::now() - timing.started);
+	if (!ret.isAsyncronous() && qxt_d().pendingCalls.contains(id))
+		qxt_d().releaseCall(qxt_d().pendingCalls.take(id));
+	if (isAuth && !ret.isError())
+	{
+		qxt_d().needsAuth.remove(serviceId);
+		AuthToken token = args[0].value<AuthToken>();
+		qxt_d().tokens.insert(findService(srv), token);
+		if (!srv->qxt_d().shared)
+			srv->qxt_d().token = token;
 	}
 
 	qxt_d().currentFunctionId = 0;
@@ -188,7 +270,15 @@ void ServerProtocolInstanceBase::parseReturn(ReturnValue& ret)
 		case ReturnValueData::Service:
 		{
 			QSharedPointer<ServiceProxy> srv;
-			if (rvData->service.isNull())
+			ServiceProxy* raw = rvData->rawServicePointer;
+			if (rvData->service.isNull() && raw->qxt_d().shared)
+			{
+				// Shared instances belong to their factory, every connection holds its own reference
+				quint32 existing = findService(raw);
+				srv = existing != 0 ? qxt_d().services.value(existing) : QSharedPointer<ServiceProxy>(raw, &ServiceFactoryParent::release);
+				rvData->service = srv;
+			}
+			else if (rvData->service.isNull())
 			{
 				if (rvData->rawServicePointer->qxt_d().weakPointer.isNull())
 					srv = QSharedPointer<ServiceProxy>(rvData->rawServicePointer, &QObject::deleteLater);
@@ -200,12 +290,15 @@ void ServerProtocolInstanceBase::parseReturn(ReturnValue& ret)
 			else
 				srv = rvData->service;
 
-			rvData->rawServicePointer->initProxy(qxt_d().serv, this, QHash<QString, void *>());
-			quint32 id = qxt_d().services.key(srv, static_cast<quint32>(-1));
-			if (id == static_cast<quint32>(-1))
+			if (!raw->qxt_d().shared)
+				raw->initProxy(qxt_d().serv, this, QHash<QString, void *>());
+			quint32 id = qxt_d().serviceIds.value(srv.data(), 0);
+			if (id == 0)
 			{
-				id = ++qxt_d().curServiceId;
-				qxt_d().services.insert(qxt_d().curServiceId, srv);
+				id = qxt_d().addService(srv);
+				// Sub services get broadcast events like the services selected by name
+				if (!qxt_d().serv.isNull())
+					qxt_d().serv->addServiceInstance(srv.data(), this);
 			}
 			rvData->serviceId = id;
 			break;
@@ -224,12 +317,25 @@ AuthToken ServerProtocolInstanceBase::defaultToken()
 
 quint32 ServerProtocolInstanceBase::serviceId(ServiceProxy* service) const
 {
-	return qxt_d().services.key(service->qxt_d().weakPointer, 0);
+	return findService(service);
+}
+
+/**
+ * @param service A service held by this connection
+ * @return Returns the token the connection authenticated \a service with, or an empty token
+ */
+AuthToken ServerProtocolInstanceBase::authToken(const ServiceProxy* service) const
+{
+	return qxt_d().tokens.value(findService(service));
 }
 
 ReturnValue ServerProtocolInstanceBase::callFunction(const Message &msg)
 {
-	return callFunction(msg.id(), msg.service(), msg.signature(), msg.arguments());
+	// Calls that need their arguments inspected are unpacked
+	Signature sig = msg.signature();
+	if (msg.isPacked() && sig.name() != "auth" && !sig.args().contains("AuthToken") && !sig.args().contains("QtRpc::AuthToken"))
+		return callFunction(msg.id(), msg.service(), sig, Arguments(), msg.packedArguments());
+	return callFunction(msg.id(), msg.service(), sig, msg.arguments());
 }
 
 quint32 ServerProtocolInstanceBase::currentFunctionId() const
@@ -237,11 +343,187 @@ quint32 ServerProtocolInstanceBase::currentFunctionId() const
 	return qxt_d().currentFunctionId;
 }
 
+/**
+ * @param id The id of a function call
+ * @return Returns true if the client is no longer waiting for the function call \a id, because it was cancelled or already answered
+ */
+bool ServerProtocolInstanceBase::isCancelled(quint32 id) const
+{
+	return !qxt_d().pendingCalls.contains(id);
+}
+
+/**
+ * Cancels a function call that has not been answered yet. The client receives a Cancelled error right away, the service is notified through ServiceProxy::callCancelled(), and the reply the service sends later is dropped. Calls that already returned are ignored.
+ *
+ * The call is forgotten right away, so it no longer counts against the limits of the Server, even if the service never answers it.
+ * @param id The id of the function call
+ */
+void ServerProtocolInstanceBase::cancelCall(quint32 id)
+{
+	QHash<quint32, ServerProtocolInstanceBasePrivate::PendingCall>::iterator it = qxt_d().pendingCalls.find(id);
+	if (it == qxt_d().pendingCalls.end())
+		return;
+	ServerProtocolInstanceBasePrivate::PendingCall call = *it;
+	qxt_d().pendingCalls.erase(it);
+	qxt_d().releaseCall(call);
+	writeMessage(Message(id, ReturnValue(ReturnValue::Cancelled, "The function call was cancelled")));
+	// Protocols that don't report their replies through callReturned() would keep the timing until the connection closes
+	qxt_d().timings.remove(id);
+	ServiceProxy* srv = service(call.service);
+	if (srv != 0)
+		emit srv->callCancelled(id);
+}
+
+/**
+ * Marks an asynchronous function call as answered.
+ * @param id The id of the function call
+ * @return Returns false if the reply should not be sent, because the call was cancelled or already answered
+ */
+bool ServerProtocolInstanceBase::finishCall(quint32 id)
+{
+	QHash<quint32, ServerProtocolInstanceBasePrivate::PendingCall>::iterator it = qxt_d().pendingCalls.find(id);
+	if (it == qxt_d().pendingCalls.end())
+		return false;
+	qxt_d().releaseCall(*it);
+	qxt_d().pendingCalls.erase(it);
+	return true;
+}
+
+/**
+ * Records the statistics of a function call once its reply is encoded. Protocol instances call this from writeMessage() for every Return message, replies that don't belong to a function call are ignored. Sampled calls are also reported to the SpanSink.
+ * @param id The id of the function call
+ * @param error True if the reply is an error
+ * @param encoding The time the reply started being encoded, as returned by CallStats::now()
+ * @param serialization The time spent encoding the reply, in nanoseconds
+ */
+void ServerProtocolInstanceBase::callReturned(quint32 id, bool error, qint64 encoding, qint64 serialization)
+{
+	QHash<quint32, ServerProtocolInstanceBasePrivate::CallTiming>::iterator it = qxt_d().timings.find(id);
+	if (it == qxt_d().timings.end())
+		return;
+	qint64 queue = it->received < 0 ? -1 : it->started - it->received;
+	CallStats::record(qxt_d().serv.isNull() ? 0 : qxt_d().serv->qxt_d().statsId, it->service, it->method, queue, encoding - it->started, serialization, error);
+	if (it->trace.isSampled() && SpanSink::isEnabled())
+	{
+		Span span;
+		span.context = it->trace;
+		span.name = it->service + '/' + it->method;
+		span.kind = Span::Server;
+		span.startTime = CallStats::toUnixTime(it->received < 0 ? it->started : it->received);
+		span.endTime = CallStats::toUnixTime(encoding + serialization);
+		span.error = error;
+		span.attributes["rpc.system"] = QString("qtrpc2");
+		span.attributes["rpc.service"] = it->service;
+		span.attributes["rpc.method"] = it->method;
+		SpanSink::submit(span);
+	}
+	qxt_d().timings.erase(it);
+}
+
+/**
+ * Stops waiting for the reply to a callback. The slot that was waiting for the reply receives a Cancelled error, and the reply is ignored if it arrives later.
+ * @param id The id of the callback, as returned by callCallback()
+ */
+void ServerProtocolInstanceBase::cancelCallback(uint id)
+{
+	if (!qxt_d().queue.contains(id))
+		return;
+	ReplySlot slot = qxt_d().queue.take(id);
+	Metrics::addResource(Metrics::PendingCallbacks, -1);
+	if (slot.object.isNull())
+		return;
+	QMetaObject::invokeMethod(slot.object, qPrintable(slot.slot.name()), Qt::DirectConnection, Q_ARG(uint, id), Q_ARG(ReturnValue, ReturnValue(ReturnValue::Cancelled, "The callback was cancelled")));
+}
+
+/**
+ * @return Returns true while the client is not reading fast enough, and more data is buffered for it than the Server allows
+ */
+bool ServerProtocolInstanceBase::isBackpressured() const
+{
+	return qxt_d().backpressured;
+}
+
+/**
+ * This function is used by child classes to report the state of the outgoing buffer. All the services of the connection are notified when it changes.
+ * @param backpressured True when the buffer went over the high water mark, false once it drained below the low water mark
+ */
+void ServerProtocolInstanceBase::setBackpressured(bool backpressured)
+{
+	if (qxt_d().backpressured == backpressured)
+		return;
+	qxt_d().backpressured = backpressured;
+	foreach(QSharedPointer<ServiceProxy> srv, qxt_d().services.values())
+	{
+		if (srv.isNull())
+			continue;
+		emit srv->backpressureChanged(backpressured);
+	}
+}
+
+/**
+ * This function is called by the service object to send several emits of the same event at once. The default implementation sends them one at a time with sendEvent(), protocols that can send them in a single message reimplement it.
+ * @param id The id of the service emitting the events
+ * @param func The Signature of the event
+ * @param events The argument lists of the events, oldest first
+ */
+void ServerProtocolInstanceBase::sendEvents(quint32 id, Signature func, QList<Arguments> events)
+{
+	foreach(Arguments args, events)
+	{
+		sendEvent(id, func, args);
+	}
+}
+
+/**
+ * This function is called by Server::broadcastEvent() to send an event to one of the services of this connection. The default implementation sends the event with sendEvent(), protocols that can make use of the pre-encoded \a body reimplement it.
+ * @param service The service emitting the event
+ * @param func The Signature of the event
+ * @param args Arguments list for the event
+ * @param body The event encoded with Message::body()
+ */
+void ServerProtocolInstanceBase::sendEncodedEvent(ServiceProxy* service, Signature func, Arguments args, QByteArray body)
+{
+	Q_UNUSED(body);
+	quint32 id = findService(service);
+	if (id != 0 && service->isSubscribed(func, args))
+		sendEvent(id, func, args);
+}
+
+/**
+ * Finds the id of \a service without dereferencing it, so it is safe to use with pointers that were passed across threads. This is a hash lookup, so it stays cheap for connections holding many services.
+ * @param service The service object
+ * @return Returns the id of the service, or 0 if it doesn't belong to this instance
+ */
+quint32 ServerProtocolInstanceBase::findService(const ServiceProxy* service) const
+{
+	return qxt_d().serviceIds.value(service, 0);
+}
+
+/**
+ * @return Returns the Server this instance belongs to
+ */
+Server* ServerProtocolInstanceBase::server() const
+{
+	return qxt_d().serv;
+}
+
 ReturnValue ServerProtocolInstanceBase::listServices()
 {
 	return qxt_d().serv->listServices();
 }
 
+/**
+ * @return Returns the function call statistics of the server, see Server::callStats(), or an error unless the server allows clients to read them and this connection authenticated with a service
+ */
+ReturnValue ServerProtocolInstanceBase::stats()
+{
+	if (qxt_d().serv.isNull() || !qxt_d().serv->remoteStatsEnabled())
+		return ReturnValue(1, "The server does not share its call statistics");
+	if (qxt_d().tokens.isEmpty())
+		return ReturnValue(1, "You must authenticate before reading the call statistics");
+	return qxt_d().serv->callStats();
+}
+
 ReturnValue ServerProtocolInstanceBase::listFunctions(const QString &service)
 {
 	return QVariant::fromValue(qxt_d().serv->listFunctions(service));
@@ -257,5 +539,36 @@ ReturnValue ServerProtocolInstanceBase::listEvents(const QString &service)
 	return QVariant::fromValue(qxt_d().serv->listEvents(service));
 }
 
+/**
+ * Subscribes the client to an event of one of its services.
+ * @sa ServiceProxy::subscribeEvent()
+ * @param serviceid The id of the service
+ * @param sig The signature of the event
+ * @param predicate Maps argument positions to the values those arguments must be equal to
+ * @return Returns true on success, or an error
+ */
+ReturnValue ServerProtocolInstanceBase::subscribeEvent(quint32 serviceid, const Signature& sig, const QVariantMap& predicate)
+{
+	ServiceProxy* srv = service(serviceid);
+	if (srv == 0)
+		return ReturnValue(1, "Invalid service id");
+	return srv->subscribeEvent(sig, predicate);
+}
+
+/**
+ * Unsubscribes the client from an event of one of its services.
+ * @sa ServiceProxy::unsubscribeEvent()
+ * @param serviceid The id of the service
+ * @param sig The signature of the event
+ * @return Returns true if the client was subscribed to the event, or an error
+ */
+ReturnValue ServerProtocolInstanceBase::unsubscribeEvent(quint32 serviceid, const Signature& sig)
+{
+	ServiceProxy* srv = service(serviceid);
+	if (srv == 0)
+		return ReturnValue(1, "Invalid service id");
+	return srv->unsubscribeEvent(sig);
+}
+
 
 }
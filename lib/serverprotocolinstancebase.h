@@ -33,6 +33,7 @@
 #define QTRPC_SERVERPROTOCOLINSTANCEBASE_H
 
 #include <QObject>
+#include <QPointer>
 #include <QxtPimpl>
 #include <Signature>
 #include <QHash>
@@ -65,10 +66,11 @@ class QTRPC2_EXPORT ServerProtocolInstanceBase : public QObject
 {
 	QXT_DECLARE_PRIVATE(ServerProtocolInstanceBase);
 	Q_OBJECT
+	friend class ServerProtocolListenerBase;
 public:
 	struct ReplySlot
 	{
-		QObject* object;
+		QPointer<QObject> object;
 		Signature slot;
 	};
 	ServerProtocolInstanceBase(Server* serv, QObject *parent = 0);
@@ -93,6 +95,7 @@ public:
 	 * @param args Arguments list for the event
 	 */
 	virtual void sendEvent(quint32 id, Signature func, Arguments args) = 0;
+	virtual void sendEvents(quint32 id, Signature func, QList<Arguments> events);
 	void moveToThread(QThread*);
 	AuthToken defaultToken();
 	void parseReturn(ReturnValue& ret);
@@ -115,9 +118,17 @@ public slots:
 	 * @return The id number of the callback function that will be passed to \a slot
 	 */
 	virtual uint callCallback(QObject* obj, Signature slot, quint32 id, Signature func, Arguments args) = 0;
+	virtual void sendEncodedEvent(ServiceProxy* service, Signature func, Arguments args, QByteArray body);
 	quint32 serviceId(ServiceProxy* service) const;
+	AuthToken authToken(const ServiceProxy* service) const;
 	quint32 currentFunctionId() const;
 	virtual void writeMessage(Message) = 0;
+	bool isCancelled(quint32 id) const;
+	void cancelCall(quint32 id);
+	bool finishCall(quint32 id);
+	void cancelCallback(uint id);
+	bool isBackpressured() const;
+	Server* server() const;
 
 signals:
 	void aboutToChangeThreads(QThread*);
@@ -127,14 +138,21 @@ protected:
 	ReturnValue listFunctions(const QString &service);
 	ReturnValue listCallbacks(const QString &service);
 	ReturnValue listEvents(const QString &service);
+	ReturnValue stats();
+	ReturnValue subscribeEvent(quint32 serviceid, const Signature& sig, const QVariantMap& predicate);
+	ReturnValue unsubscribeEvent(quint32 serviceid, const Signature& sig);
 	ReturnValue getServiceObject(QString, QString, QString);
 	ReturnValue getServiceObject(QString service);
 	ServiceProxy* service() const;
 	ServiceProxy* service(quint32 id) const;
 	ReturnValue callFunction(quint32 id, quint32 serviceid, Signature sig, Arguments args);
+	ReturnValue callFunction(quint32 id, quint32 serviceid, Signature sig, Arguments args, const QByteArray& packed);
 	ReturnValue callFunction(const Message &msg);
 	QHash<uint, ReplySlot>& queue();
 	uint nextId();
+	void setBackpressured(bool backpressured);
+	quint32 findService(const ServiceProxy* service) const;
+	void callReturned(quint32 id, bool error, qint64 encoding, qint64 serialization);
 };
 
 }
@@ -38,6 +38,11 @@
 #include <QHash>
 #include <QSharedPointer>
 #include <AuthToken>
+#include <QSet>
+#include <TraceContext>
+#include <Server>
+#include "metrics_p.h"
+#include "serverthread.h"
 #include "serverprotocolinstancebase.h"
 #include <qtrpcprivate.h>
 
@@ -53,15 +58,57 @@ public:
 	ServerProtocolInstanceBasePrivate()
 	{
 	}
+
+	struct PendingCall
+	{
+		quint32 service;
+		QString serviceName;
+		ServiceLimit* limit; // the limit the call was counted against by Server::admitCall()
+	};
+
+	// timestamps of a function call, kept until its reply is encoded
+	struct CallTiming
+	{
+		QString service;
+		QString method;
+		qint64 received;
+		qint64 started;
+		TraceContext trace;
+	};
+
+	void releaseCall(const PendingCall& call)
+	{
+		if (!serv.isNull())
+			serv->releaseCall(call.limit);
+	}
+	quint32 addService(const QSharedPointer<ServiceProxy>& srv)
+	{
+		services.insert(++curServiceId, srv);
+		Metrics::addResource(Metrics::ConnectionServices, 1);
+		serviceIds.insert(srv.data(), curServiceId);
+		return curServiceId;
+	}
 	QString servicename;
 	QPointer<Server> serv;
 	QHash<quint32, QSharedPointer<ServiceProxy> > services;
+	// reverse index of services, so services can find their id without a scan
+	QHash<const ServiceProxy*, quint32> serviceIds;
 	QHash<uint, ServerProtocolInstanceBase::ReplySlot> queue;
-	QList<quint32> needsAuth;
+	QSet<quint32> needsAuth;
+	// the token each service was authenticated with. Services shared between connections can't hold it themselves.
+	QHash<quint32, AuthToken> tokens;
+	// function calls that have been dispatched, but not answered or cancelled yet
+	QHash<quint32, PendingCall> pendingCalls;
+	QHash<quint32, CallTiming> timings;
 	uint curid;
 	uint curServiceId;
 	quint32 currentFunctionId;
+	bool backpressured;
 	AuthToken defaultToken;
+	// connection counters of the listener and thread the connection was given to
+	ListenerMetrics* listener;
+	QPointer<ServerThread> thread;
+	QPointer<QThread> poolThread; //the thread given by Server::requestThread() in the ThreadPool model, released with the instance
 
 };
 }
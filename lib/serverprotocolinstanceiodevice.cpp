@@ -39,8 +39,10 @@
 #include <ReturnValue>
 #include <ServiceProxy>
 #include <authtoken.h>
-
-// #define DEBUG_MESSAGES
+#include <TraceContext>
+#include "callcontext_p.h"
+#include "callstats_p.h"
+#include "metrics_p.h"
 
 namespace QtRpc
 {
@@ -68,6 +70,7 @@ ServerProtocolInstanceIODevice::~ServerProtocolInstanceIODevice()
 	qxt_d().stream.unsetDevice();
 	if (qxt_d().device != 0)
 		qxt_d().device->deleteLater();
+	Metrics::addWriteQueue(-qxt_d().outboundBytes);
 }
 
 void ServerProtocolInstanceIODevicePrivate::moveToThread(QThread* thread)
@@ -95,6 +98,7 @@ uint ServerProtocolInstanceIODevice::callCallback(QObject* obj, Signature slot,
 	queue()[id].object = obj;
 	queue()[id].slot = slot;
 	qxt_d().mutex.unlock();
+	Metrics::addResource(Metrics::PendingCallbacks, 1);
 	qxt_d().writeMessage(Message(id, Message::Function, func, args, servid));
 	return id;
 }
@@ -119,11 +123,37 @@ void ServerProtocolInstanceIODevice::sendEvent(quint32 id, Signature func, Argum
 	qxt_d().writeMessage(Message(0, Message::Event, func, args, id));
 }
 
+/**
+ * This function sends a batch of events in a single message. Clients that don't understand batches get the events one at a time.
+ * @param id The id of the service emitting the events
+ * @param func The Signature of the events
+ * @param events The argument lists of the events, oldest first
+ */
+void ServerProtocolInstanceIODevice::sendEvents(quint32 id, Signature func, QList<Arguments> events)
+{
+	// Batches were added to clients along with version 3, but version 3 was already in use before that. Only clients speaking version 4 are sure to understand them.
+	if (qxt_d().version < 4)
+	{
+		ServerProtocolInstanceBase::sendEvents(id, func, events);
+		return;
+	}
+	QVariantList list;
+	foreach(Arguments args, events)
+	{
+		list << QVariant(args);
+	}
+	qxt_d().writeMessage(Message(0, Message::Event, Signature("QtRpc::eventBatch(QString,QVariantList)"), Arguments() << func.toString() << QVariant(list), id));
+}
+
 /**
  * This function is used internally for reading from the QIODevice. It loops until there is no more new data, reading with readMessage() and parsing the resulting Message object. This function primarily routes the function calls to the correct place, doing some error checking along the way.
  */
 void ServerProtocolInstanceIODevicePrivate::readyRead()
 {
+	// Deadlines are measured from when the data was first seen, so calls that wait behind slow calls in the same batch can expire
+	arrival = CallContext::now();
+	received = CallStats::now();
+	qint64 bytes = 0;
 	while (device->bytesAvailable() != 0)
 	{
 		if (totalSize == 0)
@@ -131,6 +161,7 @@ void ServerProtocolInstanceIODevicePrivate::readyRead()
 			if (device->bytesAvailable() < sizeof(totalSize))
 				break;
 			stream >> totalSize;
+			bytes += sizeof(totalSize);
 			read = 0;
 			buffer.resize(0);
 			buffer.reserve(totalSize);
@@ -145,19 +176,19 @@ void ServerProtocolInstanceIODevicePrivate::readyRead()
 			return;
 		}
 		read += i;
+		bytes += i;
 		if (totalSize <= read)
 		{
 			totalSize = 0;
 			read = 0;
+			if (WireTapPrivate::isActive())
+				WireTapPrivate::capture(tapId, WireTap::ServerReceived, version, buffer);
 			Message msg;
 			msg.setVersion(version);
 			{
 				QDataStream stream(buffer);
 				stream >> msg;
 			}
-#ifdef DEBUG_MESSAGES
-			qDebug() << "R:" << msg.signature();
-#endif
 			if (!parseMessage(msg))
 			{
 				qWarning() << "Received a bad message, attempting to read as version 0";
@@ -166,13 +197,11 @@ void ServerProtocolInstanceIODevicePrivate::readyRead()
 					QDataStream stream(buffer);
 					stream >> msg;
 				}
-#ifdef DEBUG_MESSAGES
-				qDebug() << "R:" << msg.signature();
-#endif
 				parseMessage(msg);
 			}
 		}
 	}
+	Metrics::addBytesReceived(Metrics::ServerSide, bytes);
 }
 
 bool ServerProtocolInstanceIODevicePrivate::parseMessage(Message msg)
@@ -186,6 +215,19 @@ bool ServerProtocolInstanceIODevicePrivate::parseMessage(Message msg)
 				break;
 			}
 			{
+				qint64 deadline = -1;
+				if (msg.timeout() != 0)
+				{
+					deadline = arrival + msg.timeout();
+					if (CallContext::now() >= deadline)
+					{
+						writeMessage(Message(msg.id(), ReturnValue(ReturnValue::DeadlineExceeded, "The deadline for the function call expired before it could be run.")));
+						break;
+					}
+				}
+				CallContext context(deadline, arrival, received);
+				// The call runs in a span of its own, a child of the span of the caller
+				TraceScope trace(msg.traceContext().isValid() ? msg.traceContext().child() : TraceContext());
 				ReturnValue ret = qxt_p().callFunction(msg);
 				if (!ret.isAsyncronous())
 					writeMessage(Message(msg.id(), ret));
@@ -203,6 +245,9 @@ bool ServerProtocolInstanceIODevicePrivate::parseMessage(Message msg)
 			if (qxt_p().queue().contains(msg.id()))
 			{
 				ServerProtocolInstanceBase::ReplySlot slot = qxt_p().queue().take(msg.id());
+				Metrics::addResource(Metrics::PendingCallbacks, -1);
+				if (slot.object.isNull())
+					break;
 				QMetaObject::invokeMethod(slot.object, qPrintable(slot.slot.name()), Qt::DirectConnection, Q_ARG(uint, msg.id()), Q_ARG(ReturnValue, msg.returnValue()));
 			}
 			break;
@@ -236,6 +281,12 @@ bool ServerProtocolInstanceIODevicePrivate::checkProtocolFunction(Message msg)
 		qxt_p().disconnect();
 		return true;
 	}
+	else if (msg.signature().name() == "cancel")
+	{
+		if (msg.arguments().count() > 0)
+			qxt_p().cancelCall(msg.arguments()[0].toUInt());
+		return true;
+	}
 	else if (msg.signature().name() == "selectService")
 	{
 		if (state == ServerProtocolInstanceIODevice::Connecting)
@@ -247,9 +298,11 @@ bool ServerProtocolInstanceIODevicePrivate::checkProtocolFunction(Message msg)
 		}
 		else
 		{
+			qint64 started = CallStats::now();
 			if (version == 0)
 			{
 				ReturnValue ret = qxt_p().getServiceObject(msg.arguments()[0].toString(), msg.arguments()[1].toString(), msg.arguments()[2].toString());
+				Metrics::recordHandshake(Metrics::SelectService, CallStats::now() - started);
 				if (ret.isError())
 				{
 					qxt_p().callProtocolFunction(Signature("error(int,QString)"), Arguments() << 2 << ret.errString());
@@ -267,6 +320,7 @@ bool ServerProtocolInstanceIODevicePrivate::checkProtocolFunction(Message msg)
 				reply = Message(msg.id(), qxt_p().getServiceObject(msg.arguments()[0].toString(), msg.arguments()[1].toString(), msg.arguments()[2].toString()));
 			else
 				reply = Message(msg.id(), qxt_p().getServiceObject(msg.arguments()[0].toString()));
+			Metrics::recordHandshake(Metrics::SelectService, CallStats::now() - started);
 			if (reply.returnValue().isService())
 			{
 				qxt_p().changeState(ServerProtocolInstanceIODevice::Ready);
@@ -298,6 +352,10 @@ bool ServerProtocolInstanceIODevicePrivate::checkProtocolFunction(Message msg)
 	{
 		writeMessage(Message(msg.id(), qxt_p().listServices()));
 	}
+	else if (msg.signature().name() == "stats")
+	{
+		writeMessage(Message(msg.id(), qxt_p().stats()));
+	}
 	else if (msg.signature().name() == "listFunctions")
 	{
 		if (msg.arguments().count() > 0)
@@ -319,6 +377,22 @@ bool ServerProtocolInstanceIODevicePrivate::checkProtocolFunction(Message msg)
 		else
 			writeMessage(Message(msg.id(), ReturnValue(1, "Missing parameters to function listCallbacks")));
 	}
+	else if (msg.signature().name() == "subscribeEvent")
+	{
+		if (msg.arguments().count() > 2)
+			writeMessage(Message(msg.id(), qxt_p().subscribeEvent(msg.arguments()[0].toUInt(), Signature(msg.arguments()[1].toString()), msg.arguments()[2].toMap())));
+		else
+			writeMessage(Message(msg.id(), ReturnValue(1, "Missing parameters to function subscribeEvent")));
+		return true;
+	}
+	else if (msg.signature().name() == "unsubscribeEvent")
+	{
+		if (msg.arguments().count() > 1)
+			writeMessage(Message(msg.id(), qxt_p().unsubscribeEvent(msg.arguments()[0].toUInt(), Signature(msg.arguments()[1].toString()))));
+		else
+			writeMessage(Message(msg.id(), ReturnValue(1, "Missing parameters to function unsubscribeEvent")));
+		return true;
+	}
 	else if (msg.signature().name() == "setDefaultToken")
 	{
 		if (msg.arguments().count() > 0)
@@ -345,13 +419,130 @@ bool ServerProtocolInstanceIODevicePrivate::checkProtocolFunction(Message msg)
 void ServerProtocolInstanceIODevicePrivate::writeMessage(Message msg)
 {
 	msg.setVersion(version);
-#ifdef DEBUG_MESSAGES
-	if (msg.type() == Message::Return)
-		qDebug() << "S:" << msg.returnValue();
-	else
-		qDebug() << "S:" << msg.signature();
-#endif
-	stream << msg.size() << msg;
+	if (msg.type() != Message::Return)
+	{
+		writeFrame(msg, msg.frame(), QByteArray());
+		return;
+	}
+	qint64 encoding = CallStats::now();
+	QByteArray frame = msg.frame();
+	qxt_p().callReturned(msg.id(), msg.returnValue().isError(), encoding, CallStats::now() - encoding);
+	writeFrame(msg, frame, QByteArray());
+}
+
+/**
+ * This function writes an encoded message to the device, or to the outgoing queue if the client isn't keeping up. A frame is always written right away when nothing is waiting to be sent, even if it is larger than the high water mark, otherwise it would never be sent. The message may be split in a connection specific header and a \a body shared with other connections.
+ * @param msg The message being sent
+ * @param head The encoded message, or its header
+ * @param body The shared body of the message, or an empty array
+ */
+void ServerProtocolInstanceIODevicePrivate::writeFrame(const Message& msg, const QByteArray& head, const QByteArray& body)
+{
+	qint64 pending = device->bytesToWrite();
+	if (highWater > 0 && (!outbound.isEmpty() || (pending > 0 && pending + head.size() + body.size() > highWater)))
+	{
+		if (!queueFrame(msg, head, body))
+			return;
+		qxt_p().setBackpressured(true);
+		return;
+	}
+	writeOut(msg.version(), head, body, msg.type() == Message::Event);
+	if (highWater > 0 && device->bytesToWrite() > highWater)
+		qxt_p().setBackpressured(true);
+}
+
+/**
+ * This function writes a frame to the device. Frames are captured by the wire tap and counted here, once the slow client policy let them through, so dropped and coalesced events never show up as sent.
+ * @param version The protocol version the frame is encoded with
+ * @param head The encoded message, or its header
+ * @param body The shared body of the message, or an empty array
+ * @param event True if the frame is an event
+ */
+void ServerProtocolInstanceIODevicePrivate::writeOut(quint32 version, const QByteArray& head, const QByteArray& body, bool event)
+{
+	if (WireTapPrivate::isActive())
+		WireTapPrivate::capture(tapId, WireTap::ServerSent, version, head, sizeof(qint64), body);
+	if (event)
+		Metrics::eventSent();
+	device->write(head);
+	if (!body.isEmpty())
+		device->write(body);
+}
+
+/**
+ * This function is used internally when the client isn't keeping up, and applies the slow client policy to \a msg .
+ * @param msg The message being sent
+ * @param head The encoded message, or its header
+ * @param body The shared body of the message, or an empty array
+ * @return Returns false if the client is being disconnected
+ */
+bool ServerProtocolInstanceIODevicePrivate::queueFrame(const Message& msg, const QByteArray& head, const QByteArray& body)
+{
+	if (policy == Server::DisconnectClient)
+	{
+		if (disconnecting)
+			return false; //already on the way out
+		disconnecting = true;
+		qWarning() << "Disconnecting a client that is not reading its data," << (outboundBytes + device->bytesToWrite()) << "bytes buffered";
+		qxt_p().setBackpressured(true);
+		QMetaObject::invokeMethod(&qxt_p(), "disconnect", Qt::QueuedConnection);
+		return false;
+	}
+
+	OutboundFrame out;
+	out.data = head;
+	out.body = body;
+	out.version = msg.version();
+	out.service = msg.service();
+	if (msg.type() == Message::Event)
+	{
+		if (policy == Server::DropEvents)
+		{
+			Metrics::eventDropped();
+			return true;
+		}
+		out.event = msg.signature().toString();
+		if (policy == Server::CoalesceEvents)
+		{
+			//Replace the buffered emission of the same event, the client only needs the latest value
+			QPair<quint32, QString> key(out.service, out.event);
+			QHash<QPair<quint32, QString>, qint64>::const_iterator it = coalesced.constFind(key);
+			if (it != coalesced.constEnd())
+			{
+				OutboundFrame& queued = outbound[int(it.value() - outboundFirst)];
+				Metrics::addWriteQueue(out.size() - queued.size());
+				Metrics::eventDropped();
+				outboundBytes += out.size() - queued.size();
+				queued = out;
+				return true;
+			}
+			coalesced.insert(key, outboundFirst + outbound.count());
+		}
+	}
+	Metrics::addWriteQueue(out.size());
+	outboundBytes += out.size();
+	outbound.append(out);
+	return true;
+}
+
+/**
+ * This function writes the frames that are waiting in the outgoing queue as the device drains, and lifts the backpressure once the low water mark is reached.
+ */
+void ServerProtocolInstanceIODevicePrivate::bytesWritten(qint64 bytes)
+{
+	Metrics::addBytesSent(Metrics::ServerSide, bytes);
+	while (!outbound.isEmpty() && device->bytesToWrite() < highWater)
+	{
+		OutboundFrame out = outbound.takeFirst();
+		if (!out.event.isEmpty())
+			coalesced.remove(qMakePair(out.service, out.event));
+		++outboundFirst;
+		Metrics::addWriteQueue(-out.size());
+		outboundBytes -= out.size();
+		writeOut(out.version, out.data, out.body, !out.event.isEmpty());
+	}
+	if (outbound.isEmpty() && device->bytesToWrite() <= lowWater && !disconnecting)
+		qxt_p().setBackpressured(false);
 }
 
 /**
@@ -364,10 +555,14 @@ void ServerProtocolInstanceIODevice::prepareDevice(QIODevice* device)
 	qxt_d().device->setParent(this);
 	connect(qxt_d().device, SIGNAL(disconnected()), this, SLOT(disconnect()));
 	connect(qxt_d().device, SIGNAL(readyRead()), &qxt_d(), SLOT(readyRead()), Qt::DirectConnection);
+	connect(qxt_d().device, SIGNAL(bytesWritten(qint64)), &qxt_d(), SLOT(bytesWritten(qint64)), Qt::DirectConnection);
 	qxt_d().stream.setDevice(qxt_d().device);
-#ifdef DEBUG_MESSAGES
-	qDebug() << "Sending welcome message" << qxt_d().version;
-#endif
+	if (server() != 0)
+	{
+		qxt_d().lowWater = server()->writeQueueLowWater();
+		qxt_d().highWater = server()->writeQueueHighWater();
+		qxt_d().policy = server()->slowClientPolicy();
+	}
 	callProtocolFunction(Signature("welcome(quint32)"), Arguments() << Message::currentVersion());
 }
 
@@ -398,4 +593,24 @@ void ServerProtocolInstanceIODevice::writeMessage(Message msg)
 	qxt_d().writeMessage(msg);
 }
 
+/**
+ * Sends an event whose body was already encoded by Server::broadcastEvent(). Only the header of the message is encoded for this connection.
+ * @param service The service emitting the event
+ * @param func The Signature of the event
+ * @param args Arguments list for the event
+ * @param body The encoded body of the event
+ */
+void ServerProtocolInstanceIODevice::sendEncodedEvent(ServiceProxy* service, Signature func, Arguments args, QByteArray body)
+{
+	quint32 id = findService(service);
+	if (id == 0 || !service->isSubscribed(func, args))
+		return;
+	Message msg(0, Message::Event, func, args, id);
+	msg.setVersion(qxt_d().version);
+	if (qxt_d().version == 0)
+		qxt_d().writeMessage(msg);
+	else
+		qxt_d().writeFrame(msg, msg.header(body.size()), body);
+}
+
 }
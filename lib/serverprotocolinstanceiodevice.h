@@ -89,9 +89,11 @@ public:
 	~ServerProtocolInstanceIODevice();
 
 	virtual void sendEvent(quint32 id, Signature, Arguments);
+	virtual void sendEvents(quint32 id, Signature func, QList<Arguments> events);
 	State state();
 public slots:
 	virtual uint callCallback(QObject*, Signature, quint32 id, Signature, Arguments);
+	virtual void sendEncodedEvent(ServiceProxy* service, Signature func, Arguments args, QByteArray body);
 protected slots:
 	void callProtocolFunction(Signature, Arguments);
 protected:
@@ -40,8 +40,13 @@
 #include <Message>
 #include <QObject>
 #include <AuthToken>
+#include <QList>
+#include <QHash>
+#include <QPair>
+#include <Server>
 #include "serverprotocolinstanceiodevice.h"
 #include <qtrpcprivate.h>
+#include "wiretap_p.h"
 
 namespace QtRpc
 {
@@ -54,10 +59,31 @@ class ServerProtocolInstanceIODevicePrivate : public QObject, public QxtPrivate<
 	Q_OBJECT
 public:
 	ServerProtocolInstanceIODevicePrivate()
-			: version(0)
+			: version(0),
+			outboundBytes(0),
+			outboundFirst(0),
+			lowWater(0),
+			highWater(0),
+			policy(Server::BufferAll),
+			disconnecting(false),
+			tapId(WireTapPrivate::nextConnection())
 	{
 	}
 
+	struct OutboundFrame
+	{
+		QByteArray data;
+		QByteArray body;
+		quint32 version;
+		quint32 service;
+		QString event;
+
+		qint64 size() const
+		{
+			return data.size() + body.size();
+		}
+	};
+
 	QMutex mutex;
 	ServerProtocolInstanceIODevice::State state;
 	qint64 totalSize;
@@ -66,12 +92,32 @@ public:
 	QDataStream stream;
 	QIODevice* device;
 	quint32 version;
+	qint64 arrival;
+	qint64 received;
+	// frames that didn't fit under the high water mark, written as the device drains
+	QList<OutboundFrame> outbound;
+	qint64 outboundBytes;
+	// sequence number of the first frame of outbound, frames are numbered as they are queued
+	qint64 outboundFirst;
+	// the sequence number of the queued emission of each event of each service, with the CoalesceEvents policy
+	QHash<QPair<quint32, QString>, qint64> coalesced;
+	qint64 lowWater;
+	qint64 highWater;
+	Server::SlowClientPolicy policy;
+	// set once the DisconnectClient policy gave up on the client
+	bool disconnecting;
+	// id of the connection in wire tap captures
+	quint32 tapId;
 	bool checkProtocolFunction(Message);
 	void writeMessage(Message);
 	bool parseMessage(Message);
+	void writeFrame(const Message& msg, const QByteArray& head, const QByteArray& body);
+	bool queueFrame(const Message& msg, const QByteArray& head, const QByteArray& body);
+	void writeOut(quint32 version, const QByteArray& head, const QByteArray& body, bool event);
 
 public slots:
 	void readyRead();
+	void bytesWritten(qint64 bytes);
 	void moveToThread(QThread*);
 };
 
@@ -40,6 +40,8 @@
 #include <QDateTime>
 #include <QFile>
 #include <QMutexLocker>
+#include "callstats_p.h"
+#include "metrics_p.h"
 
 namespace QtRpc
 {
@@ -228,6 +230,7 @@ void ServerProtocolInstanceTcp::protocolFunction(Signature func, Arguments args)
 				qxt_d().socket->setPrivateKey(qxt_d().cert);
 				callProtocolFunction(Signature("enableSsl()"), Arguments());
 				connect(qxt_d().socket, SIGNAL(encrypted()), &qxt_d(), SLOT(encrypted()));
+				qxt_d().tlsStarted = CallStats::now();
 				qxt_d().socket->startServerEncryption();
 			}
 #endif
@@ -257,6 +260,8 @@ void ServerProtocolInstanceTcp::protocolFunction(Signature func, Arguments args)
  */
 void ServerProtocolInstanceTcpPrivate::encrypted()
 {
+	if (tlsStarted >= 0)
+		Metrics::recordHandshake(Metrics::Tls, CallStats::now() - tlsStarted);
 	qxt_p().changeState(ServerProtocolInstanceTcp::Service);
 }
 
@@ -56,6 +56,7 @@ class ServerProtocolInstanceTcpPrivate : public QObject, public QxtPrivate<Serve
 	Q_OBJECT
 public:
 	ServerProtocolInstanceTcpPrivate()
+			: tlsStarted(-1)
 	{
 	}
 	QPointer<QSslSocket> socket;
@@ -66,6 +67,8 @@ public:
 	QTimer timer;
 	bool timeoutEnabled;
 	int timeout;
+	// when the server started encrypting the connection, as returned by CallStats::now()
+	qint64 tlsStarted;
 public slots:
 
 #ifndef QT_NO_OPENSSL
@@ -38,6 +38,8 @@
 #include <QCoreApplication>
 #include <QFile>
 #include <QStringList>
+#include "serverprotocolinstancebase_p.h"
+#include "serverthread.h"
 #include <errno.h>
 
 namespace QtRpc
@@ -122,9 +124,28 @@ void ServerProtocolListenerBase::prepareInstance(ServerProtocolInstanceBase* ins
 	}
 #endif
 
-	if (thread == 0)
+	bool requested = (thread == 0);
+	if (requested)
 		thread = qxt_d().serv->requestThread();
 	instance->moveToThread(thread);
+	if (qxt_d().metrics == 0)
+	{
+		// Named after the protocol, ServerProtocolInstanceTcp is counted as tcp
+		QString kind = QString(instance->metaObject()->className()).section("::", -1).remove("ServerProtocolInstance").toLower();
+		qxt_d().metrics = Metrics::addListener(kind);
+	}
+	if (qxt_d().metrics != 0)
+	{
+		qxt_d().metrics->open.fetchAndAddRelaxed(1);
+		qxt_d().metrics->accepted.fetchAndAddRelaxed(1);
+		instance->qxt_d().listener = qxt_d().metrics;
+	}
+	ServerThread* serverThread = qobject_cast<ServerThread*>(thread);
+	if (serverThread != 0)
+	{
+		serverThread->connectionOpened();
+		instance->qxt_d().thread = serverThread;
+	}
 	switch (qxt_d().serv->threadType())
 	{
 		case Server::SingleThread:
@@ -135,7 +156,9 @@ void ServerProtocolListenerBase::prepareInstance(ServerProtocolInstanceBase* ins
 				qCritical() << "A null instance was passed to prepareInstance!";
 				return;
 			}
-			QObject::connect(instance, SIGNAL(destroyed()), qxt_d().serv, SLOT(removeService()), Qt::DirectConnection);
+			// The instance releases the thread when it is destroyed, see ~ServerProtocolInstanceBase()
+			if (requested)
+				instance->qxt_d().poolThread = thread;
 			break;
 		case Server::ThreadPerInstance:
 			if (instance == 0)
@@ -34,6 +34,7 @@
 
 #include <QxtPimpl>
 #include "server.h"
+#include "metrics_p.h"
 #include "serverprotocollistenerbase.h"
 #include <qtrpcprivate.h>
 
@@ -47,10 +48,13 @@ class ServerProtocolListenerBasePrivate : public QxtPrivate<ServerProtocolListen
 {
 public:
 	ServerProtocolListenerBasePrivate()
+			: metrics(0)
 	{
 	}
 
 	Server* serv;
+	// connection counters, registered when the first connection is accepted
+	ListenerMetrics* metrics;
 };
 
 }
@@ -31,26 +31,404 @@
  ***************************************************************************/
 #include "serverthread.h"
 #include "serverthread_p.h"
-
+#include "callstats_p.h"
+#include <QDateTime>
 #include <QDebug>
+#include <QMutexLocker>
+#include <QThreadStorage>
 
 namespace QtRpc
 {
 
+/**
+	The ServerThreads of the process, and the slow call threshold they are watched with. The threshold can be set with the QTRPC_SLOW_CALL_MS environment variable, or with Server::setSlowCallThreshold().
+*/
+struct ServerThreadRegistry
+{
+	ServerThreadRegistry()
+			: threshold(qgetenv("QTRPC_SLOW_CALL_MS").toInt()),
+			nextIndex(0),
+			watchdog(0)
+	{
+	}
+	~ServerThreadRegistry()
+	{
+		stopWatchdog();
+	}
+	// Called with the mutex locked
+	void startWatchdog()
+	{
+		if (watchdog != 0 || threshold <= 0)
+			return;
+		watchdog = new ServerThreadWatchdog(this);
+		watchdog->start(QThread::LowPriority);
+	}
+	void stopWatchdog()
+	{
+		ServerThreadWatchdog* old;
+		{
+			QMutexLocker locker(&mutex);
+			old = watchdog;
+			watchdog = 0;
+		}
+		if (old == 0)
+			return;
+		old->stop();
+		delete old;
+	}
+
+	QMutex mutex;
+	QList<ServerThread*> threads;
+	int threshold;
+	int nextIndex;
+	ServerThreadWatchdog* watchdog;
+};
+
+Q_GLOBAL_STATIC(ServerThreadRegistry, registry)
+
+// Mirrors the threshold of the registry, so calls can check it without locking
+static QAtomicInt slowCallLog(qgetenv("QTRPC_SLOW_CALL_MS").toInt() > 0);
+
+struct ServerThreadSlot
+{
+	ServerThreadSlot()
+			: thread(0)
+	{
+	}
+
+	ServerThread* thread;
+};
+
+static QThreadStorage<ServerThreadSlot> currentThread;
+
+static QString summarizeArguments(const QList<QVariant>& args, int packedSize)
+{
+	if (packedSize >= 0)
+		return QString("<%1 packed bytes>").arg(packedSize);
+	QStringList ret;
+	foreach(const QVariant& arg, args)
+	{
+		QString value;
+		if (arg.type() != QVariant::List && arg.type() != QVariant::Map && arg.type() != QVariant::ByteArray && arg.canConvert<QString>())
+			value = arg.toString();
+		else
+			value = QString("<%1>").arg(arg.typeName());
+		if (value.length() > 40)
+			value = value.left(37) + "...";
+		ret << value;
+	}
+	return '(' + ret.join(", ") + ')';
+}
+
 ServerThread::ServerThread(QObject *parent) : QThread(parent)
 {
 	QXT_INIT_PRIVATE(ServerThread);
 	connect(this, SIGNAL(finished()), this, SLOT(deleteLater()));
+	ServerThreadRegistry* reg = registry();
+	if (reg == 0)
+		return;
+	QMutexLocker locker(&reg->mutex);
+	qxt_d().index = ++reg->nextIndex;
+	reg->threads << this;
+	reg->startWatchdog();
+	setObjectName(QString("QtRpc::ServerThread %1").arg(qxt_d().index));
 }
 
 ServerThread::~ServerThread()
 {
 	wait();
+	ServerThreadRegistry* reg = registry();
+	if (reg == 0)
+		return;
+	QMutexLocker locker(&reg->mutex);
+	reg->threads.removeAll(this);
 }
 
 void ServerThread::run()
 {
+	currentThread.localData().thread = this;
 	exec();
+	currentThread.localData().thread = 0;
+}
+
+/**
+ * Marks a function call as running in this thread. Must be called from the thread itself, before the service function runs, and be followed by endCall() once it returns. Calls can nest. The call is only recorded, with a copy of its arguments, while the slow call log is on. Otherwise only the counters of the thread are updated.
+ * @param service The name of the service
+ * @param method The signature of the function
+ * @param args The arguments of the function
+ * @param packedSize The size of the packed arguments, or -1 if the arguments are not packed
+ * @return Returns true if the call was recorded, to be passed on to endCall()
+ */
+bool ServerThread::beginCall(const QString& service, const QString& method, const QList<QVariant>& args, int packedSize)
+{
+	qxt_d().calls.fetchAndAddRelaxed(1);
+	qint64 started = -1;
+	if (qxt_d().depth++ == 0)
+	{
+		started = CallStats::now();
+		qxt_d().busySince.store(started);
+	}
+	if (!ServerThreadPrivate::watching())
+		return false;
+	ServerThreadPrivate::ActiveCall call = {service, method, args, packedSize, TraceContext::current(), started >= 0 ? started : CallStats::now(), false};
+	QMutexLocker locker(&qxt_d().mutex);
+	qxt_d().active << call;
+	return true;
+}
+
+/**
+ * Marks the innermost function call started with beginCall() as finished. Calls that were reported as slow are logged again with the time they took.
+ * @param tracked What beginCall() returned for the call
+ */
+void ServerThread::endCall(bool tracked)
+{
+	if (qxt_d().depth > 0 && --qxt_d().depth == 0)
+		qxt_d().busySince.store(-1);
+	if (!tracked)
+		return;
+	ServerThreadPrivate::ActiveCall call;
+	{
+		QMutexLocker locker(&qxt_d().mutex);
+		if (qxt_d().active.isEmpty())
+			return;
+		call = qxt_d().active.takeLast();
+	}
+	if (call.reported)
+		qWarning() << "QtRpc: slow call" << qPrintable(call.service + '/' + call.method) << "on" << objectName() << "finished after" << (CallStats::now() - call.started) / 1000000 << "ms";
+}
+
+/**
+ * Counts a connection that was given to this thread
+ */
+void ServerThread::connectionOpened()
+{
+	qxt_d().connections.fetchAndAddRelaxed(1);
+}
+
+/**
+ * Counts a connection of this thread that went away
+ */
+void ServerThread::connectionClosed()
+{
+	qxt_d().connections.fetchAndAddRelaxed(-1);
+}
+
+/**
+ * Sets the time after which a function call that is still running is logged as slow, for all ServerThreads of the process. The watchdog thread that looks for slow calls only runs while a threshold is set.
+ * @param msecs The threshold in milliseconds, or 0 to stop looking for slow calls
+ */
+void ServerThread::setSlowCallThreshold(int msecs)
+{
+	ServerThreadRegistry* reg = registry();
+	if (reg == 0)
+		return;
+	if (msecs <= 0)
+	{
+		{
+			QMutexLocker locker(&reg->mutex);
+			reg->threshold = 0;
+			slowCallLog.store(0);
+		}
+		reg->stopWatchdog();
+		return;
+	}
+	QMutexLocker locker(&reg->mutex);
+	reg->threshold = msecs;
+	slowCallLog.store(1);
+	reg->startWatchdog();
+	// Pick up the new threshold right away
+	reg->watchdog->wake();
+}
+
+/**
+ * @return Returns the slow call threshold in milliseconds, or 0 if slow calls are not looked for
+ */
+int ServerThread::slowCallThreshold()
+{
+	ServerThreadRegistry* reg = registry();
+	if (reg == 0)
+		return 0;
+	QMutexLocker locker(&reg->mutex);
+	return reg->threshold;
+}
+
+/**
+ * Returns the state of every ServerThread of the process. See Server::threadStats() for a description of the maps.
+ * @return Returns a list with a map for every thread
+ */
+QVariantList ServerThread::threadStats()
+{
+	QVariantList ret;
+	ServerThreadRegistry* reg = registry();
+	if (reg == 0)
+		return ret;
+	qint64 now = CallStats::now();
+	QMutexLocker locker(&reg->mutex);
+	foreach(ServerThread* thread, reg->threads)
+	{
+		const ServerThreadPrivate& d = thread->qxt_d();
+		QMutexLocker threadLocker(&d.mutex);
+		QVariantMap map;
+		map["thread"] = thread->objectName();
+		map["connections"] = d.connections.load();
+		map["calls"] = d.calls.load();
+		map["slowCalls"] = d.slowCalls.load();
+		qint64 since = d.busySince.load();
+		map["busy"] = since >= 0;
+		if (since >= 0)
+		{
+			map["blockedSince"] = QDateTime::fromMSecsSinceEpoch(CallStats::toUnixTime(since) / 1000000);
+			map["blockedFor"] = (now - since) / 1000000;
+		}
+		// The function is only known while the slow call log is on
+		if (!d.active.isEmpty())
+		{
+			const ServerThreadPrivate::ActiveCall& call = d.active.first();
+			map["service"] = call.service;
+			map["method"] = call.method;
+		}
+		ret << map;
+	}
+	return ret;
+}
+
+/**
+ * Returns the counters of every ServerThread of the process, the maps of ServerThread::threadStats() without the function that is running. Only the atomic counters of the threads are read, so the threads are never waited for.
+ * @return Returns a list with a map for every thread
+ */
+QVariantList ServerThreadPrivate::counters()
+{
+	QVariantList ret;
+	ServerThreadRegistry* reg = registry();
+	if (reg == 0)
+		return ret;
+	qint64 now = CallStats::now();
+	QMutexLocker locker(&reg->mutex);
+	foreach(ServerThread* thread, reg->threads)
+	{
+		const ServerThreadPrivate& d = thread->qxt_d();
+		qint64 since = d.busySince.load();
+		QVariantMap map;
+		map["thread"] = thread->objectName();
+		map["connections"] = d.connections.load();
+		map["calls"] = d.calls.load();
+		map["slowCalls"] = d.slowCalls.load();
+		map["busy"] = since >= 0;
+		if (since >= 0)
+			map["blockedFor"] = (now - since) / 1000000;
+		ret << map;
+	}
+	return ret;
+}
+
+/**
+ * @return Returns the ServerThread the caller runs in, or 0 if it is not running in one
+ */
+ServerThread* ServerThreadPrivate::current()
+{
+	return currentThread.localData().thread;
+}
+
+/**
+ * @return Returns true if calls are recorded for the slow call log. Can be called without locking anything.
+ */
+bool ServerThreadPrivate::watching()
+{
+	return slowCallLog.load() != 0;
+}
+
+/**
+ * Describes a running call for the slow call log
+ */
+QString ServerThreadPrivate::describe(const ActiveCall& call, qint64 now) const
+{
+	QString ret = QString("%1/%2%3 running for %4 ms").arg(call.service).arg(call.method).arg(summarizeArguments(call.args, call.packedSize)).arg((now - call.started) / 1000000);
+	if (call.trace.isValid())
+		ret += QString(", trace %1").arg(call.trace.traceIdString());
+	return ret;
+}
+
+/**
+ * Marks the calls that have been running for longer than \a limit as reported, and describes them with the calls they were made from. Called by the watchdog with the registry locked.
+ * @param threads The threads to look at
+ * @param limit The threshold in nanoseconds
+ * @return Returns a log entry for every thread with a new slow call
+ */
+QStringList ServerThreadPrivate::findSlowCalls(const QList<ServerThread*>& threads, qint64 limit)
+{
+	QStringList ret;
+	qint64 now = CallStats::now();
+	foreach(ServerThread* thread, threads)
+	{
+		ServerThreadPrivate& d = thread->qxt_d();
+		QMutexLocker locker(&d.mutex);
+		bool found = false;
+		for (int i = 0; i < d.active.count(); ++i)
+		{
+			ActiveCall& call = d.active[i];
+			if (!call.reported && now - call.started >= limit)
+			{
+				call.reported = true;
+				d.slowCalls.fetchAndAddRelaxed(1);
+				found = true;
+			}
+		}
+		if (!found)
+			continue;
+		// Innermost call first, like a stack trace
+		QString entry = QString("QtRpc: slow call on %1: %2").arg(thread->objectName()).arg(d.describe(d.active.last(), now));
+		for (int i = d.active.count() - 2; i >= 0; --i)
+			entry += QString("\n    called from %1").arg(d.describe(d.active.at(i), now));
+		ret << entry;
+	}
+	return ret;
+}
+
+ServerThreadWatchdog::ServerThreadWatchdog(ServerThreadRegistry* registry)
+		: m_registry(registry),
+		m_stopping(false)
+{
+	setObjectName("QtRpc::ServerThreadWatchdog");
+}
+
+/**
+ * Stops the watchdog and waits for it to finish. Must not be called with the registry locked.
+ */
+void ServerThreadWatchdog::stop()
+{
+	{
+		QMutexLocker locker(&m_registry->mutex);
+		m_stopping = true;
+		m_wake.wakeAll();
+	}
+	wait();
+}
+
+/**
+ * Wakes the watchdog up early. Must be called with the registry locked.
+ */
+void ServerThreadWatchdog::wake()
+{
+	m_wake.wakeAll();
+}
+
+void ServerThreadWatchdog::run()
+{
+	QMutexLocker locker(&m_registry->mutex);
+	while (!m_stopping)
+	{
+		// A call is logged at most a quarter of the threshold late
+		m_wake.wait(&m_registry->mutex, qBound(10, m_registry->threshold / 4, 1000));
+		if (m_stopping || m_registry->threshold <= 0)
+			continue;
+		QStringList slow = ServerThreadPrivate::findSlowCalls(m_registry->threads, static_cast<qint64>(m_registry->threshold) * 1000000);
+		if (slow.isEmpty())
+			continue;
+		locker.unlock();
+		foreach(const QString& entry, slow)
+			qWarning("%s", qPrintable(entry));
+		locker.relock();
+	}
 }
 
 }
@@ -34,6 +34,7 @@
 
 #include <QThread>
 #include <QxtPimpl>
+#include <QVariant>
 #include <qtrpcprivate.h>
 
 namespace QtRpc
@@ -42,6 +43,7 @@ namespace QtRpc
 class ServerThreadPrivate;
 
 /**
+	A thread that protocol instances and services run in. Every ServerThread keeps track of the function calls it is running, so that calls that block the thread for too long can be found. See Server::setSlowCallThreshold().
 	@author Brendan Powers <brendan@resara.com>
 */
 class ServerThread : public QThread
@@ -52,6 +54,15 @@ public:
 	ServerThread(QObject *parent = 0);
 	~ServerThread();
 
+	bool beginCall(const QString& service, const QString& method, const QList<QVariant>& args, int packedSize);
+	void endCall(bool tracked);
+	void connectionOpened();
+	void connectionClosed();
+
+	static void setSlowCallThreshold(int msecs);
+	static int slowCallThreshold();
+	static QVariantList threadStats();
+
 protected:
 	void run();
 };
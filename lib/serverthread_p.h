@@ -33,12 +33,20 @@
 #define QTRPCSERVERTHREAD_P_H
 
 #include <QxtPimpl>
+#include <QAtomicInteger>
+#include <QList>
+#include <QMutex>
+#include <QStringList>
+#include <QWaitCondition>
+#include <TraceContext>
 #include "serverthread.h"
 #include <qtrpcprivate.h>
 
 namespace QtRpc
 {
 
+struct ServerThreadRegistry;
+
 /**
 	@author Chris Vickery <chris@resara.com>
 */
@@ -46,9 +54,87 @@ class ServerThreadPrivate : public QxtPrivate<ServerThread>
 {
 public:
 	ServerThreadPrivate()
+			: index(0),
+			calls(0),
+			depth(0),
+			slowCalls(0),
+			busySince(-1)
+	{
+	}
+
+	// a function call running in the thread, calls made from inside of it are pushed on top
+	struct ActiveCall
+	{
+		QString service;
+		QString method;
+		QList<QVariant> args;
+		int packedSize;
+		TraceContext trace;
+		qint64 started;
+		bool reported;
+	};
+
+	QString describe(const ActiveCall& call, qint64 now) const;
+	static QStringList findSlowCalls(const QList<ServerThread*>& threads, qint64 limit);
+	static QVariantList counters();
+	static ServerThread* current();
+	static bool watching();
+
+	mutable QMutex mutex;
+	int index;
+	QList<ActiveCall> active; //only the calls made while the slow call log was on
+	int depth; //all running calls, only used by the thread itself
+	// The counters can be read without the mutex
+	QAtomicInteger<quint64> calls;
+	QAtomicInteger<quint64> slowCalls;
+	QAtomicInteger<qint64> busySince; //when the outermost active call started, -1 when idle
+	QAtomicInteger<int> connections;
+};
+
+/**
+	Wakes up a few times per threshold and logs the calls that have been running in a ServerThread for longer than the threshold. Every call is only logged once. The watchdog only runs while a threshold is set.
+	@brief Finds function calls that block a ServerThread
+*/
+class ServerThreadWatchdog : public QThread
+{
+public:
+	ServerThreadWatchdog(ServerThreadRegistry* registry);
+	void stop();
+	void wake();
+
+protected:
+	void run();
+
+private:
+	ServerThreadRegistry* m_registry;
+	QWaitCondition m_wake;
+	bool m_stopping;
+};
+
+/**
+	RAII helper that marks a function call as running in the current thread, if it is a ServerThread. While the slow call log is off only the counters of the thread are updated, the call itself is not recorded.
+	@brief Tracks a function call in the current ServerThread
+*/
+class BlockingCall
+{
+public:
+	BlockingCall(const QString& service, const QString& method, const QList<QVariant>& args, int packedSize)
+			: m_thread(ServerThreadPrivate::current()),
+			m_tracked(false)
+	{
+		if (m_thread)
+			m_tracked = m_thread->beginCall(service, method, args, packedSize);
+	}
+	~BlockingCall()
 	{
+		if (m_thread)
+			m_thread->endCall(m_tracked);
 	}
 
+private:
+	Q_DISABLE_COPY(BlockingCall);
+	ServerThread* m_thread;
+	bool m_tracked;
 };
 
 }
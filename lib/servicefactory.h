@@ -46,10 +46,28 @@ class QTRPC2_EXPORT ServiceFactoryParent
 {
 	QXT_DECLARE_PRIVATE(ServiceFactoryParent);
 public:
+	/**
+	 * This enum represents how instances of a service are shared between the clients that select it.
+	 */
+	enum InstanceMode
+	{
+		PerClient,	/**< Every client gets its own instance. This is the default. */
+		Shared,		/**< All clients share a single instance. Its functions are called from every server thread at the same time, so the service must be thread safe. ServiceProxy::authToken() returns the token of the client making the current call. */
+		PerThread	/**< The clients of each server thread share an instance, which is only ever called from that thread. This allows caches to be sharded without locking. The instance is destroyed when its thread finishes. */
+	};
 	ServiceFactoryParent();
 	virtual ServiceProxy* newInstance() const = 0;
 	ServiceProxy& instance();
 	void init(ServiceProxy* srv);
+	void setInstanceMode(InstanceMode mode);
+	InstanceMode instanceMode() const;
+	void setPoolSize(int size);
+	int poolSize() const;
+	ServiceProxy* acquire();
+	static void release(ServiceProxy* srv);
+
+private:
+	bool recycle(ServiceProxy* srv);
 };
 
 template<class Service>
@@ -31,7 +31,10 @@
  ***************************************************************************/
 #include "servicefactoryparent_p.h"
 #include "servicefactory.h"
+#include "serviceproxy_p.h"
 #include <QStringList>
+#include <QThread>
+#include <QMutexLocker>
 
 namespace QtRpc
 {
@@ -59,13 +62,171 @@ void ServiceFactoryParent::init(ServiceProxy* srv)
 	srv->init(funclist, calllist, eventlist);
 }
 
+/**
+ * Sets how instances of the service are shared between clients. The mode should be set before any client selects the service.
+ * @param mode The instance mode
+ */
+void ServiceFactoryParent::setInstanceMode(InstanceMode mode)
+{
+	QMutexLocker locker(&qxt_d().poolMutex);
+	qxt_d().mode = mode;
+}
+
+/**
+ * @return Returns how instances of the service are shared between clients
+ */
+ServiceFactoryParent::InstanceMode ServiceFactoryParent::instanceMode() const
+{
+	QMutexLocker locker(const_cast<QMutex*>(&qxt_d().poolMutex));
+	return qxt_d().mode;
+}
+
+/**
+ * Sets how many idle instances of the service are kept for reuse, for each thread. Pooled instances skip the construction and initialization of a new ServiceProxy when a client selects the service. An instance is only pooled if its ServiceProxy::reset() returns true.
+ * @param size The number of idle instances kept per thread, or 0 to disable pooling
+ */
+void ServiceFactoryParent::setPoolSize(int size)
+{
+	QList<ServiceProxy*> idle;
+	{
+		QMutexLocker locker(&qxt_d().poolMutex);
+		qxt_d().poolSize = qMax(size, 0);
+		for (QHash<QThread*, QList<ServiceProxy*> >::iterator it = qxt_d().pool.begin(); it != qxt_d().pool.end(); ++it)
+		{
+			while (it.value().count() > qxt_d().poolSize)
+				idle << it.value().takeLast();
+		}
+	}
+	foreach(ServiceProxy* srv, idle)
+	{
+		srv->deleteLater();
+	}
+}
+
+/**
+ * @return Returns the number of idle instances kept per thread
+ */
+int ServiceFactoryParent::poolSize() const
+{
+	QMutexLocker locker(const_cast<QMutex*>(&qxt_d().poolMutex));
+	return qxt_d().poolSize;
+}
+
+/**
+ * Returns the instance a new client should use, depending on the instance mode. In PerClient mode this is an idle instance that lives in the current thread, or a new one. Instances should be destroyed with release(), so they can be pooled or kept for the next client.
+ * @return Returns an instance of the service
+ */
+ServiceProxy* ServiceFactoryParent::acquire()
+{
+	QMutexLocker locker(&qxt_d().poolMutex);
+	if (qxt_d().mode == Shared)
+	{
+		if (qxt_d().shared == 0)
+		{
+			qxt_d().shared = newInstance();
+			qxt_d().shared->qxt_d().factory = this;
+			qxt_d().shared->qxt_d().shared = true;
+			qxt_d().shared->setThreadSafe(true);
+			// don't tie the instance to the thread of the first client, that thread may go away
+			qxt_d().shared->moveToThread(qxt_d().service->thread());
+		}
+		return qxt_d().shared;
+	}
+	if (qxt_d().mode == PerThread)
+	{
+		QThread* thread = QThread::currentThread();
+		ServiceProxy*& srv = qxt_d().perThread[thread];
+		if (srv == 0)
+		{
+			srv = newInstance();
+			srv->qxt_d().factory = this;
+			srv->qxt_d().shared = true;
+			// The instance goes away with its thread, finished() is emitted in the thread itself
+			ServiceProxy* instance = srv;
+			ServiceFactoryParentPrivate* d = &qxt_d();
+			QObject::connect(thread, &QThread::finished, instance, [d, thread, instance]()
+			{
+				{
+					QMutexLocker locker(&d->poolMutex);
+					if (d->perThread.value(thread) != instance)
+						return;
+					d->perThread.remove(thread);
+				}
+				delete instance;
+			}, Qt::DirectConnection);
+		}
+		return srv;
+	}
+	if (qxt_d().poolSize == 0)
+		return newInstance();
+	ServiceProxy* srv = 0;
+	QHash<QThread*, QList<ServiceProxy*> >::iterator it = qxt_d().pool.find(QThread::currentThread());
+	if (it != qxt_d().pool.end() && !it.value().isEmpty())
+		srv = it.value().takeLast();
+	locker.unlock();
+	if (srv == 0)
+		srv = newInstance();
+	srv->qxt_d().factory = this;
+	return srv;
+}
+
+/**
+ * Destroys an instance returned by acquire(), or puts it back in the pool. This is used as the deleter of the shared pointers holding the instances.
+ * @param srv The instance
+ */
+void ServiceFactoryParent::release(ServiceProxy* srv)
+{
+	if (srv == 0)
+		return;
+	ServiceFactoryParent* factory = srv->qxt_d().factory;
+	if (factory != 0 && factory->recycle(srv))
+		return;
+	delete srv;
+}
+
+/**
+ * Resets \a srv and adds it to the pool of its thread
+ * @return Returns false if the instance can't be pooled, and should be deleted
+ */
+bool ServiceFactoryParent::recycle(ServiceProxy* srv)
+{
+	// shared instances belong to the factory, and outlive their clients
+	if (srv->qxt_d().shared)
+		return true;
+	{
+		QMutexLocker locker(&qxt_d().poolMutex);
+		if (qxt_d().pool.value(srv->thread()).count() >= qxt_d().poolSize)
+			return false;
+	}
+	// reset() runs on a clean instance, so the policies it sets up are kept
+	srv->qxt_d().clear();
+	if (!srv->reset())
+		return false;
+
+	QMutexLocker locker(&qxt_d().poolMutex);
+	QList<ServiceProxy*>& idle = qxt_d().pool[srv->thread()];
+	if (idle.count() >= qxt_d().poolSize)
+		return false;
+	idle << srv;
+	return true;
+}
+
 ServiceFactoryParentPrivate::ServiceFactoryParentPrivate()
-		: QxtPrivate<ServiceFactoryParent>()
+		: QxtPrivate<ServiceFactoryParent>(),
+		mode(ServiceFactoryParent::PerClient),
+		shared(0),
+		poolSize(0)
 {
 }
 
 ServiceFactoryParentPrivate::~ServiceFactoryParentPrivate()
 {
+	delete shared;
+	qDeleteAll(perThread);
+	foreach(QList<ServiceProxy*> idle, pool)
+	{
+		qDeleteAll(idle);
+	}
 }
 
 
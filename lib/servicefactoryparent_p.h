@@ -33,8 +33,13 @@
 #define QTRPCSERVICEFACTORYPARENT_P_H
 
 #include <QxtPimpl>
+#include <QHash>
+#include <QList>
+#include <QMutex>
 #include "servicefactory.h"
 
+class QThread;
+
 namespace QtRpc
 {
 
@@ -48,7 +53,12 @@ public:
 	~ServiceFactoryParentPrivate();
 	
 	ServiceProxy* service;
-
+	ServiceFactoryParent::InstanceMode mode;
+	ServiceProxy* shared;
+	QHash<QThread*, ServiceProxy*> perThread;
+	int poolSize;
+	QMutex poolMutex;
+	QHash<QThread*, QList<ServiceProxy*> > pool; //idle instances, by the thread they live in
 };
 
 }
@@ -36,6 +36,10 @@
 #include <QStringList>
 #include <ReturnValue>
 #include <Message>
+#include <QTimer>
+#include <climits>
+#include "callcontext_p.h"
+#include "metrics_p.h"
 
 #include <ServerProtocolInstanceBase>
 
@@ -48,10 +52,14 @@ ServiceProxy::ServiceProxy(QObject *parent)
 	QXT_INIT_PRIVATE(ServiceProxy);
 	qxt_d().server = NULL;
 	qxt_d().instance = NULL;
+	Metrics::addResource(Metrics::ServiceObjects, 1);
 }
 
 ServiceProxy::~ServiceProxy()
 {
+	Metrics::addResource(Metrics::ServiceObjects, -1);
+	if (!qxt_d().server.isNull())
+		qxt_d().server->removeServiceInstance(this);
 }
 
 ServiceProxy *ServiceProxy::newInstance(Server *, ServerProtocolInstanceBase *)
@@ -76,7 +84,13 @@ ReturnValue ServiceProxy::auth(AuthToken token)
 
 AuthToken ServiceProxy::authToken()
 {
-	return qxt_d().token;
+	if (!qxt_d().shared)
+		return qxt_d().token;
+	// Shared instances serve several clients, the token is the one of the client making the current call
+	ServerProtocolInstanceBase* instance = qxt_d().currentInstance();
+	if (!instance)
+		return AuthToken();
+	return instance->authToken(this);
 }
 
 /**
@@ -93,10 +107,29 @@ ReturnValue QtRpc::ServiceProxy::functionCalled(const Signature& sig, const Argu
 		qCritical() << "Synchronous callbacks are not supported" << sig.toString();
 		return(ReturnValue(1, "Synchronous callbacks are not supported"));
 	}
-	if (!qxt_d().instance)
+	if (!qxt_d().instance && !qxt_d().shared)
 		return ReturnValue(1, "Invalid internal object");
 
-	qxt_d().instance->sendEvent(qxt_d().instance->serviceId(this), sig, args);
+	if (!isSubscribed(sig, args))
+		return(true);
+
+	QList<Arguments> ready;
+	int delay = -1;
+	qxt_d().datamutex.lock();
+	bool held = !qxt_d().eventPolicies.isEmpty() && qxt_d().holdEvent(sig.toString(), args, ready, delay);
+	qxt_d().datamutex.unlock();
+	if (held)
+	{
+		if (delay >= 0)
+			QTimer::singleShot(delay, Qt::PreciseTimer, this, SLOT(flushEvents()));
+		qxt_d().sendEvents(sig, ready);
+		return(true);
+	}
+
+	if (qxt_d().shared)
+		qxt_d().sendEvents(sig, QList<Arguments>() << args);
+	else
+		qxt_d().instance->sendEvent(qxt_d().instance->serviceId(this), sig, args);
 
 	return(true);
 }
@@ -119,7 +152,8 @@ ReturnValue QtRpc::ServiceProxy::functionCalled(QObject *obj, const char *slot,
 		return(ReturnValue(1, "Asynchronous events are not supported"));
 
 	}
-	if (!qxt_d().instance)
+	ServerProtocolInstanceBase* instance = qxt_d().currentInstance();
+	if (!instance)
 		return ReturnValue(1, "Invalid internal object");
 
 	//strip the argument list from the slot
@@ -129,7 +163,7 @@ ReturnValue QtRpc::ServiceProxy::functionCalled(QObject *obj, const char *slot,
 		tmpslot = tmpslot.remove(0, 1);
 	Signature s(tmpslot + "()"); //create the signature object from the slot
 
-	return(qxt_d().instance->callCallback(obj, s, qxt_d().instance->serviceId(this), sig, args));
+	return(instance->callCallback(obj, s, instance->serviceId(this), sig, args));
 }
 
 /**
@@ -141,7 +175,8 @@ ReturnValue QtRpc::ServiceProxy::functionCalled(QObject *obj, const char *slot,
 void QtRpc::ServiceProxy::initProxy(Server *server, ServerProtocolInstanceBase *instance, const QHash<QString, void *>& data)
 {
 	qxt_d().server = server;
-	qxt_d().instance = instance;
+	if (!qxt_d().shared)
+		qxt_d().instance = instance;
 	qxt_d().data = data;
 
 	QStringList funclist;
@@ -210,9 +245,10 @@ void * QtRpc::ServiceProxy::setData(const QString& name, void *data)
  */
 bool QtRpc::ServiceProxy::setProtocolData(const QString& name, const QVariant& value)
 {
-	if (!qxt_d().instance)
+	ServerProtocolInstanceBase* instance = qxt_d().currentInstance();
+	if (!instance)
 		return false;
-	qxt_d().instance->setProperty(name, value);
+	instance->setProperty(name, value);
 	return(true);
 }
 
@@ -225,9 +261,10 @@ bool QtRpc::ServiceProxy::setProtocolData(const QString& name, const QVariant& v
  */
 QVariant QtRpc::ServiceProxy::getProtocolProperty(const QString& name) const
 {
-	if (!qxt_d().instance)
+	ServerProtocolInstanceBase* instance = qxt_d().currentInstance();
+	if (!instance)
 		return QVariant();
-	return(qxt_d().instance->getProperty(name));
+	return(instance->getProperty(name));
 }
 
 
@@ -268,11 +305,44 @@ ReturnValue QtRpc::ServiceProxy::callFunction(const Signature& sig, const Argume
 	}
 }
 
+/**
+ * An internal function called by the protocol instance when the client runs a function with packed arguments. Synchronous functions are called without converting the arguments to QVariants, asynchronous functions fall back to callFunction().
+ * @sa Message::setPackedArguments()
+ * @param sig The signature of the function
+ * @param packed The packed arguments to pass to the function
+ * @return Returns the return value of the function, or an error if something goes wrong
+ */
+ReturnValue QtRpc::ServiceProxy::callPackedFunction(const Signature& sig, const QByteArray& packed)
+{
+	Signature asyncSig = sig;
+	QVector<QString> arglist = asyncSig.args();
+	arglist.prepend("const char*");
+	arglist.prepend("QObject*");
+	asyncSig.setArgs(arglist);
+	if (listCallbacks().contains(asyncSig))
+		return callFunction(sig, Message::unpackArguments(sig, packed));
+
+	//catch Exceptions
+	try {
+		return callPackedMetacall(sig, packed);
+	}
+	catch(std::exception &e)
+	{
+		qDebug() << "Trowing Exception!" << e.what();
+		return ReturnValue(1, QString(e.what()));
+	}
+}
+
 void QtRpc::ServiceProxy::disconnected(const QString& reason)
 {
 	Q_UNUSED(reason);
 }
 
+bool QtRpc::ServiceProxy::reset()
+{
+	return false;
+}
+
 void QtRpc::ServiceProxy::setServiceName(const QString& name)
 {
 	QMutexLocker locker(&qxt_d().datamutex);
@@ -288,18 +358,233 @@ QString QtRpc::ServiceProxy::serviceName() const
 quint32 QtRpc::ServiceProxy::currentFunctionId() const
 {
 	QMutexLocker locker(const_cast<QMutex*>(&qxt_d().datamutex));
-	if (!qxt_d().instance)
+	ServerProtocolInstanceBase* instance = qxt_d().currentInstance();
+	if (!instance)
 		return -1;
-	return qxt_d().instance->currentFunctionId();
+	return instance->currentFunctionId();
+}
+
+/**
+ * Returns the time left before the caller gives up on the function call currently being executed. Clients send their timeout with each call, and calls made to other servers from within the function inherit the same deadline. Like currentFunctionId(), this is only valid while the service function is running.
+ * @return Returns the remaining time in milliseconds, 0 if the deadline has passed, or -1 if the call has no deadline
+ */
+int QtRpc::ServiceProxy::remainingTime() const
+{
+	return static_cast<int>(qMin(CallContext::currentRemainingTime(), static_cast<qint64>(INT_MAX)));
+}
+
+/**
+ * Event emitters and asynchronous return paths can check this to avoid piling more data onto a client that isn't reading it.
+ * @return Returns true while more data is buffered for the client than the Server allows
+ * @sa backpressureChanged()
+ */
+bool QtRpc::ServiceProxy::isBackpressured() const
+{
+	QMutexLocker locker(const_cast<QMutex*>(&qxt_d().datamutex));
+	ServerProtocolInstanceBase* instance = qxt_d().currentInstance();
+	if (!instance)
+		return false;
+	return instance->isBackpressured();
+}
+
+/**
+ * Called when the client subscribes to an event. As long as the client has no subscriptions every event is sent to it, after the first subscription only the events it subscribed to are sent. Subscribing to the same event more than once sends the event when any of the predicates match.
+ * @param sig The signature of the event
+ * @param predicate Maps argument positions ("0", "1", ...) to the values those arguments must be equal to. An empty predicate matches every emit of the event.
+ * @return Returns true on success, or an error if the predicate is invalid
+ */
+ReturnValue QtRpc::ServiceProxy::subscribeEvent(const Signature& sig, const QVariantMap& predicate)
+{
+	if (qxt_d().shared)
+		return ReturnValue(1, "Event subscriptions are not supported by shared services");
+	if (!sig.validate())
+		return ReturnValue(1, "Invalid event signature: " + sig.toString());
+	for (QVariantMap::const_iterator it = predicate.constBegin(); it != predicate.constEnd(); ++it)
+	{
+		bool ok;
+		int index = it.key().toInt(&ok);
+		if (!ok || index < 0 || index >= sig.numArgs())
+			return ReturnValue(1, QString("Invalid argument index %1 for event %2").arg(it.key()).arg(sig.toString()));
+	}
+
+	QMutexLocker locker(&qxt_d().datamutex);
+	qxt_d().filtered = true;
+	QList<QVariantMap>& predicates = qxt_d().subscriptions[sig.toString()];
+	if (!predicates.contains(predicate))
+		predicates.append(predicate);
+	return(true);
+}
+
+/**
+ * Called when the client unsubscribes from an event. All predicates for the event are removed. The client keeps receiving only the events it is still subscribed to. Once it unsubscribed from every event, every event is sent to it again, as before the first subscription.
+ * @param sig The signature of the event
+ * @return Returns true if the client was subscribed to the event
+ */
+ReturnValue QtRpc::ServiceProxy::unsubscribeEvent(const Signature& sig)
+{
+	QMutexLocker locker(&qxt_d().datamutex);
+	bool removed = qxt_d().subscriptions.remove(sig.toString()) > 0;
+	if (qxt_d().subscriptions.isEmpty())
+		qxt_d().filtered = false;
+	return(removed);
+}
+
+/**
+ * Checks the client's subscriptions before an event is sent.
+ * @param sig The signature of the event
+ * @param args The arguments the event was emitted with
+ * @return Returns true if the event should be sent to the client
+ */
+bool QtRpc::ServiceProxy::isSubscribed(const Signature& sig, const Arguments& args) const
+{
+	QMutexLocker locker(const_cast<QMutex*>(&qxt_d().datamutex));
+	if (!qxt_d().filtered)
+		return true;
+	QHash<QString, QList<QVariantMap> >::const_iterator sub = qxt_d().subscriptions.constFind(sig.toString());
+	if (sub == qxt_d().subscriptions.constEnd())
+		return false;
+	foreach(const QVariantMap& predicate, sub.value())
+	{
+		bool match = true;
+		for (QVariantMap::const_iterator it = predicate.constBegin(); it != predicate.constEnd() && match; ++it)
+		{
+			int index = it.key().toInt();
+			match = index < args.count() && args.at(index) == it.value();
+		}
+		if (match)
+			return true;
+	}
+	return false;
+}
+
+/**
+ * Coalesces an event that is emitted faster than the client needs it. The first emit starts a window of \a window milliseconds, and only the last emit in the window is sent when it ends.
+ * @code
+ * setEventCoalescing("progress(int)", 100); //at most one progress event every 100ms, always the latest
+ * @endcode
+ * @param event The signature of the event
+ * @param window The length of the window in milliseconds
+ */
+void QtRpc::ServiceProxy::setEventCoalescing(const Signature& event, int window)
+{
+	qxt_d().setEventPolicy(event, ServiceProxyPrivate::EventPolicy::Coalesce, qMax(window, 0), 1);
+}
+
+/**
+ * Limits how often an event is sent to the client. Emits that come too soon after the previous one are coalesced, and the last of them is sent as soon as the rate allows it.
+ * @param event The signature of the event
+ * @param maxPerSecond The maximum number of events to send per second
+ */
+void QtRpc::ServiceProxy::setEventRateLimit(const Signature& event, int maxPerSecond)
+{
+	qxt_d().setEventPolicy(event, ServiceProxyPrivate::EventPolicy::RateLimit, 1000 / qMax(maxPerSecond, 1), 1);
+}
+
+/**
+ * Sends an event in batches instead of one message per emit. Every emit is delivered to the client, in order.
+ * @param event The signature of the event
+ * @param count The number of events to send in one message
+ * @param maxDelay The maximum time in milliseconds an event is held back waiting for the batch to fill up
+ */
+void QtRpc::ServiceProxy::setEventBatching(const Signature& event, int count, int maxDelay)
+{
+	qxt_d().setEventPolicy(event, ServiceProxyPrivate::EventPolicy::Batch, qMax(maxDelay, 0), qMax(count, 1));
+}
+
+/**
+ * Removes the policy set on an event, any events held back by it are sent right away.
+ * @param event The signature of the event
+ */
+void QtRpc::ServiceProxy::clearEventPolicy(const Signature& event)
+{
+	QList<Arguments> held;
+	{
+		QMutexLocker locker(&qxt_d().datamutex);
+		held = qxt_d().eventPolicies.take(event.toString()).held;
+	}
+	qxt_d().sendEvents(event, held);
+}
+
+/**
+ * Sends the events whose policy time ran out. If the timer fired before the time of other held events, it is started again for them.
+ */
+void QtRpc::ServiceProxy::flushEvents()
+{
+	QList<QPair<QString, QList<Arguments> > > due;
+	qint64 next = -1;
+	qint64 now = CallContext::now();
+	{
+		QMutexLocker locker(&qxt_d().datamutex);
+		for (QHash<QString, ServiceProxyPrivate::EventPolicy>::iterator it = qxt_d().eventPolicies.begin(); it != qxt_d().eventPolicies.end(); ++it)
+		{
+			ServiceProxyPrivate::EventPolicy& policy = it.value();
+			if (policy.due < 0)
+				continue;
+			if (policy.due > now)
+			{
+				if (next < 0 || policy.due < next)
+					next = policy.due;
+				continue;
+			}
+			policy.due = -1;
+			policy.lastSent = now;
+			due << qMakePair(it.key(), policy.held);
+			policy.held.clear();
+		}
+	}
+	if (next >= 0)
+		QTimer::singleShot(static_cast<int>(next - now), Qt::PreciseTimer, this, SLOT(flushEvents()));
+	for (int i = 0; i < due.count(); i++)
+	{
+		qxt_d().sendEvents(Signature(due[i].first), due[i].second);
+	}
+}
+
+/**
+ * @return Returns true if the client cancelled the function call currently being executed
+ * @sa callCancelled()
+ */
+bool QtRpc::ServiceProxy::isCancelled() const
+{
+	return isCancelled(currentFunctionId());
+}
+
+/**
+ * Asynchronous functions can poll this to find out if the client is still waiting for the reply.
+ * @param id The id of the function call, as returned by currentFunctionId()
+ * @return Returns true if the client cancelled the function call, or has disconnected
+ * @sa callCancelled()
+ */
+bool QtRpc::ServiceProxy::isCancelled(quint32 id) const
+{
+	QMutexLocker locker(const_cast<QMutex*>(&qxt_d().datamutex));
+	ServerProtocolInstanceBase* instance = qxt_d().currentInstance();
+	if (!instance)
+		return true;
+	return instance->isCancelled(id);
+}
+
+/**
+ * Stops waiting for the reply to an asynchronous callback. The receiving slot is called with a Cancelled error right away, and the reply from the client is ignored.
+ * @param id The id returned by the asynchronous callback
+ */
+void QtRpc::ServiceProxy::cancelCallback(uint id)
+{
+	qxt_d().datamutex.lock();
+	ServerProtocolInstanceBase* instance = qxt_d().currentInstance();
+	qxt_d().datamutex.unlock();
+	// The receiving slot is called directly, and may well send a reply of its own
+	if (instance != 0)
+		instance->cancelCallback(id);
 }
 
 void QtRpc::ServiceProxy::sendReturn(quint32 id, ReturnValue ret) const
 {
 	QMutexLocker locker(const_cast<QMutex*>(&qxt_d().datamutex));
-	if (!qxt_d().instance)
-		return;
-	qxt_d().instance->parseReturn(ret);
-	qxt_d().instance->writeMessage(Message(id, ret));
+	ServerProtocolInstanceBase* instance = qxt_d().currentInstance();
+	if (!instance && qxt_d().shared)
+		qWarning() << "Shared services can only send asynchronous returns with AsyncReturn";
+	const_cast<ServiceProxyPrivate&>(qxt_d()).sendReturn(instance, id, ret);
 }
 
 QWeakPointer<QtRpc::ServiceProxy> QtRpc::ServiceProxy::weakPointer() const
@@ -312,6 +597,159 @@ QWeakPointer<QtRpc::ServiceProxy>& QtRpc::ServiceProxy::weakPointer()
 	return qxt_d().weakPointer;
 }
 
+/**
+ * Applies the policy of an event to one emit of it. Must be called with datamutex locked.
+ * @param event The signature of the event, as a string
+ * @param args The arguments of the emit
+ * @param ready Set to the events that should be sent right away
+ * @param delay Set to the time in milliseconds until flushEvents() must run, or -1
+ * @return Returns false if the event has no policy, and should be sent as usual
+ */
+bool QtRpc::ServiceProxyPrivate::holdEvent(const QString& event, const Arguments& args, QList<Arguments>& ready, int& delay)
+{
+	QHash<QString, EventPolicy>::iterator it = eventPolicies.find(event);
+	if (it == eventPolicies.end())
+		return false;
+	EventPolicy& policy = it.value();
+	qint64 now = CallContext::now();
+	switch (policy.type)
+	{
+		case EventPolicy::Coalesce:
+			policy.held = QList<Arguments>() << args;
+			if (policy.due < 0)
+			{
+				policy.due = now + policy.interval;
+				delay = policy.interval;
+			}
+			break;
+		case EventPolicy::RateLimit:
+			if (policy.due < 0 && (policy.lastSent < 0 || now - policy.lastSent >= policy.interval))
+			{
+				policy.lastSent = now;
+				ready << args;
+				break;
+			}
+			policy.held = QList<Arguments>() << args;
+			if (policy.due < 0)
+			{
+				policy.due = policy.lastSent + policy.interval;
+				delay = static_cast<int>(policy.due - now);
+			}
+			break;
+		case EventPolicy::Batch:
+			policy.held << args;
+			if (policy.held.count() >= policy.count)
+			{
+				ready = policy.held;
+				policy.held.clear();
+				policy.due = -1;
+			}
+			else if (policy.due < 0)
+			{
+				policy.due = now + policy.interval;
+				delay = policy.interval;
+			}
+			break;
+	}
+	return true;
+}
+
+/**
+ * Replaces the policy of an event. Events held back by the old policy are sent right away.
+ */
+void QtRpc::ServiceProxyPrivate::setEventPolicy(const Signature& event, EventPolicy::Type type, int interval, int count)
+{
+	EventPolicy policy;
+	policy.type = type;
+	policy.interval = interval;
+	policy.count = count;
+	policy.lastSent = -1;
+	policy.due = -1;
+
+	QList<Arguments> held;
+	datamutex.lock();
+	held = eventPolicies.value(event.toString(), policy).held;
+	eventPolicies[event.toString()] = policy;
+	datamutex.unlock();
+	sendEvents(event, held);
+}
+
+/**
+ * Clears everything that belongs to the client that used this instance, before it is pooled. The event policies are set up by the service itself, so they are kept, only the events held for the client are dropped.
+ */
+void QtRpc::ServiceProxyPrivate::clear()
+{
+	if (!server.isNull())
+		server->removeServiceInstance(&qxt_p());
+	QMutexLocker locker(&datamutex);
+	server = 0;
+	instance = 0;
+	token = AuthToken();
+	weakPointer = QWeakPointer<ServiceProxy>();
+	id = 0;
+	filtered = false;
+	subscriptions.clear();
+	for (QHash<QString, EventPolicy>::iterator it = eventPolicies.begin(); it != eventPolicies.end(); ++it)
+	{
+		it->held.clear();
+		it->due = -1;
+		it->lastSent = -1;
+	}
+}
+
+/**
+ * @return Returns the protocol instance of the client this service is working for. Instances shared by several clients only know that while one of their functions is being called.
+ */
+QtRpc::ServerProtocolInstanceBase* QtRpc::ServiceProxyPrivate::currentInstance() const
+{
+	if (!shared)
+		return instance;
+	CallContext* context = CallContext::current();
+	if (context == 0)
+		return 0;
+	return context->instance();
+}
+
+/**
+ * Sends the return value of an asynchronous function call to the client.
+ * @param instance The protocol instance of the client that made the call
+ * @param id The id of the function call
+ * @param ret The return value
+ */
+void QtRpc::ServiceProxyPrivate::sendReturn(ServerProtocolInstanceBase* instance, quint32 id, ReturnValue ret)
+{
+	if (!instance)
+		return;
+	if (!instance->finishCall(id))
+		return;
+	instance->parseReturn(ret);
+	instance->writeMessage(Message(id, ret));
+}
+
+/**
+ * Sends events that were held back by a policy. A single event is sent as usual, more are sent as a batch.
+ */
+void QtRpc::ServiceProxyPrivate::sendEvents(const Signature& event, const QList<Arguments>& events)
+{
+	if (shared)
+	{
+		if (server.isNull())
+			return;
+		foreach(Arguments args, events)
+		{
+			server->broadcastEvent(&qxt_p(), event, args);
+		}
+		return;
+	}
+	if (events.isEmpty() || !instance)
+		return;
+	quint32 serviceid = instance->serviceId(&qxt_p());
+	if (events.count() == 1)
+		instance->sendEvent(serviceid, event, events.first());
+	else
+		instance->sendEvents(serviceid, event, events);
+}
+
 
 }
 
@@ -170,6 +170,8 @@ class QTRPC2_EXPORT ServiceProxy : public ProxyBase
 	QXT_DECLARE_PRIVATE(ServiceProxy);
 	friend class ServerProtocolInstanceBase;
 	friend class ReturnValue;
+	friend class AsyncReturn;
+	friend class ServiceFactoryParent;
 	Q_OBJECT
 public slots:
 
@@ -199,10 +201,17 @@ public:
 	 * @param reason The resaon the client disconnected
 	 */
 	virtual void disconnected(const QString& reason);
+	/**
+	 * This function is inherited by a child object of ServiceProxy to allow pooling of the service. It is called when a client is done with the instance, and should put it back in the state it had right after construction, including disconnecting anything connected in auth(). The client's token, subscriptions and held events are already cleared when it is called, event policies set up by the service are kept.
+	 * @sa ServiceFactoryParent::setPoolSize()
+	 * @return Return true if the instance was reset and may be reused by another client. The default implementation returns false, and the instance is deleted.
+	 */
+	virtual bool reset();
 	void initProxy(Server *server, ServerProtocolInstanceBase *instance, const QHash<QString, void *>& data);
 	void * getData(const QString& name);
 	void * setData(const QString& name, void *data);
 	ReturnValue callFunction(const Signature& sig, const Arguments& args);
+	ReturnValue callPackedFunction(const Signature& sig, const QByteArray& packed);
 	QHash<QString, void *> getRawData() const;
 	void setServiceName(const QString& name);
 	QString serviceName() const;
@@ -211,17 +220,45 @@ public:
 
 	quint32 id() const;
 	void setId(quint32 id);
+	bool isBackpressured() const;
+	ReturnValue subscribeEvent(const Signature& sig, const QVariantMap& predicate);
+	ReturnValue unsubscribeEvent(const Signature& sig);
+	bool isSubscribed(const Signature& sig, const Arguments& args) const;
+
+signals:
+	/**
+	 * This signal is emitted when the client cancels an asynchronous function call that has not been answered yet. Any reply sent for \a id after this point is dropped, so long running work can be stopped early.
+	 * @param id The id of the cancelled call, as returned by currentFunctionId()
+	 */
+	void callCancelled(quint32 id);
+	/**
+	 * This signal is emitted when the client stops keeping up with the data sent to it, and again once it catches up. Services that emit a lot of events should slow down while \a backpressured is true.
+	 * @param backpressured True when more data is buffered for the client than the Server allows
+	 * @sa Server::setWriteQueueLimits()
+	 */
+	void backpressureChanged(bool backpressured);
 
 protected:
 	QWeakPointer<ServiceProxy> weakPointer() const;
 	QWeakPointer<ServiceProxy>& weakPointer();
 	AuthToken authToken();
 	quint32 currentFunctionId() const;
+	int remainingTime() const;
+	bool isCancelled() const;
+	bool isCancelled(quint32 id) const;
+	void cancelCallback(uint id);
+	void setEventCoalescing(const Signature& event, int window);
+	void setEventRateLimit(const Signature& event, int maxPerSecond);
+	void setEventBatching(const Signature& event, int count, int maxDelay = 50);
+	void clearEventPolicy(const Signature& event);
 	virtual ReturnValue functionCalled(const Signature& sig, const Arguments& args, const QString& type);
 	virtual ReturnValue functionCalled(QObject *obj, const char *slot, const Signature& sig, const Arguments& args, const QString& type);
 
 protected slots:
 	void sendReturn(quint32 id, ReturnValue ret) const;
+
+private slots:
+	void flushEvents();
 };
 
 }
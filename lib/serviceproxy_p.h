@@ -34,8 +34,11 @@
 
 #include <QxtPimpl>
 #include <QHash>
+#include <QVariantMap>
 #include <QSharedPointer>
 #include <QMutex>
+#include <QPointer>
+#include <Server>
 #include <AuthToken>
 #include "serviceproxy.h"
 #include <qtrpcprivate.h>
@@ -49,18 +52,50 @@ namespace QtRpc
 class ServiceProxyPrivate : public QxtPrivate<ServiceProxy>
 {
 public:
+	struct EventPolicy
+	{
+		enum Type
+		{
+			Coalesce,
+			RateLimit,
+			Batch
+		};
+		Type type;
+		int interval; //the coalescing window, the minimum time between events, or the maximum time a batch is held
+		int count;
+		qint64 lastSent;
+		qint64 due; //when the held events must be sent, or -1 if none are held
+		QList<Arguments> held;
+	};
+
 	ServiceProxyPrivate()
+		: factory(0),
+		shared(false),
+		filtered(false)
 	{
 	}
 
 	AuthToken token;
 	QString serviceName;
 	QWeakPointer<ServiceProxy> weakPointer;
-	Server *server;
+	QPointer<Server> server;
+	ServiceFactoryParent* factory; //set when the instance may be pooled
+	bool shared; //used by more than one client, instance is always NULL
 	ServerProtocolInstanceBase *instance;
 	QHash<QString, void *> data;
 	QMutex datamutex;
 	quint32 id;
+	// Once the client subscribes to anything, only subscribed events are sent
+	bool filtered;
+	QHash<QString, QList<QVariantMap> > subscriptions;
+	QHash<QString, EventPolicy> eventPolicies;
+
+	bool holdEvent(const QString& event, const Arguments& args, QList<Arguments>& ready, int& delay);
+	void setEventPolicy(const Signature& event, EventPolicy::Type type, int interval, int count);
+	void sendEvents(const Signature& event, const QList<Arguments>& events);
+	void clear();
+	ServerProtocolInstanceBase* currentInstance() const;
+	void sendReturn(ServerProtocolInstanceBase* instance, quint32 id, ReturnValue ret);
 };
 
 }
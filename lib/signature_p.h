@@ -39,6 +39,7 @@
 #include <QVariant>
 #include <QSharedData>
 #include <qtrpcprivate.h>
+#include "freelist_p.h"
 
 #include "signature.h"
 
@@ -48,6 +49,8 @@ namespace QtRpc
 class SignatureData : public QSharedData
 {
 public:
+	QTRPC_FREELIST_ALLOCATED(SignatureData)
+
 	QString name;
 	QVector<QString> args;
 };
@@ -58,6 +61,8 @@ public:
 class SignaturePrivate : public QxtPrivate<Signature>
 {
 public:
+	QTRPC_FREELIST_ALLOCATED(SignaturePrivate)
+
 	SignaturePrivate()
 	{
 	}
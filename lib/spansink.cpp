@@ -0,0 +1,101 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include "spansink.h"
+#include <QAtomicInt>
+#include <QMutex>
+#include <QMutexLocker>
+
+namespace QtRpc
+{
+
+static QBasicAtomicInt sinkInstalled = Q_BASIC_ATOMIC_INITIALIZER(0);
+
+struct SpanSinkSlot
+{
+	QMutex mutex;
+	QSharedPointer<SpanSink> sink;
+};
+
+Q_GLOBAL_STATIC(SpanSinkSlot, sinkSlot)
+
+Span::Span()
+		: kind(Server),
+		startTime(0),
+		endTime(0),
+		error(false)
+{
+}
+
+SpanSink::~SpanSink()
+{
+}
+
+/**
+ * Installs the sink that receives the spans of every sampled trace in the process
+ * @param sink The sink, or a null pointer to stop reporting spans
+ */
+void SpanSink::setSink(const QSharedPointer<SpanSink>& sink)
+{
+	QMutexLocker locker(&sinkSlot()->mutex);
+	sinkSlot()->sink = sink;
+	sinkInstalled.store(sink.isNull() ? 0 : 1);
+}
+
+/**
+ * @return Returns the installed sink, or a null pointer
+ */
+QSharedPointer<SpanSink> SpanSink::sink()
+{
+	QMutexLocker locker(&sinkSlot()->mutex);
+	return sinkSlot()->sink;
+}
+
+/**
+ * @return Returns true if a sink is installed
+ */
+bool SpanSink::isEnabled()
+{
+	return sinkInstalled.load() != 0;
+}
+
+/**
+ * Reports \a span to the installed sink, if there is one
+ * @param span The span
+ */
+void SpanSink::submit(const Span& span)
+{
+	QSharedPointer<SpanSink> current = sink();
+	if (!current.isNull())
+		current->report(span);
+}
+
+}
@@ -0,0 +1,95 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCSPANSINK_H
+#define QTRPCSPANSINK_H
+
+#include <QSharedPointer>
+#include <QString>
+#include <QVariantMap>
+#include <TraceContext>
+#include <QtRpcGlobal>
+
+namespace QtRpc
+{
+
+/**
+	A finished span of a sampled trace. Servers report a Server span for every traced function call they answer, clients a Client span for every traced call they make.
+	@brief Span reported to a SpanSink
+*/
+struct QTRPC2_EXPORT Span
+{
+	/**
+	 * The side of the call the span measures
+	 */
+	enum Kind
+	{
+		Server,	/**< The function call as run by the server */
+		Client	/**< The function call as seen by the client */
+	};
+
+	Span();
+
+	TraceContext context;	/**< The context of the span, its parentSpanId() is the parent span */
+	QString name;		/**< The service and function, like "MyService/add(int,int)" */
+	Kind kind;		/**< The side of the call */
+	qint64 startTime;	/**< The start of the span, in nanoseconds since the epoch */
+	qint64 endTime;		/**< The end of the span, in nanoseconds since the epoch */
+	bool error;		/**< True if the call returned an error */
+	QString statusMessage;	/**< The error message */
+	QVariantMap attributes;	/**< Additional attributes of the span */
+};
+
+/**
+	Receives the spans of sampled traces. Install a sink with setSink(), spans are reported from the threads that finish them, so report() must be thread safe and should not block. OtlpFileSpanSink writes spans to a file in the OpenTelemetry format, MemorySpanSink keeps them in memory.
+
+	No spans are built while no sink is installed, and traces that are not sampled never build spans.
+	@brief Pluggable receiver of trace spans
+*/
+class QTRPC2_EXPORT SpanSink
+{
+public:
+	virtual ~SpanSink();
+	/**
+	 * Called for every finished span
+	 * @param span The span
+	 */
+	virtual void report(const Span& span) = 0;
+
+	static void setSink(const QSharedPointer<SpanSink>& sink);
+	static QSharedPointer<SpanSink> sink();
+	static bool isEnabled();
+	static void submit(const Span& span);
+};
+
+}
+
+#endif
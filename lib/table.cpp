@@ -0,0 +1,577 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include "table.h"
+#include "table_p.h"
+#include <QDebug>
+#include <QDataStream>
+#include <QHash>
+#include <QVector>
+#include <QtEndian>
+#include <climits>
+
+using namespace QtRpc;
+
+static void writeValue(QDataStream& out, int type, const QVariant& value)
+{
+	if (type == QMetaType::QVariant)
+	{
+		out << value;
+		return;
+	}
+	if (value.userType() == type)
+	{
+		QMetaType::save(out, type, value.constData());
+		return;
+	}
+	QVariant converted = value;
+	if (!converted.convert(type))
+		converted = QVariant(type, static_cast<const void*>(0));
+	QMetaType::save(out, type, converted.constData());
+}
+
+static QVariant readValue(QDataStream& in, int type)
+{
+	QVariant value;
+	if (type == QMetaType::QVariant)
+		in >> value;
+	else
+	{
+		value = QVariant(type, static_cast<const void*>(0));
+		QMetaType::load(in, type, value.data());
+	}
+	return value;
+}
+
+TableData::TableData(const TableData& other) :
+		QSharedData(other)
+{
+	QMutexLocker locker(&other.mutex);
+	columns = other.columns;
+	rows = other.rows;
+}
+
+/**
+ * Returns the values of a column, expanding the column first if it was received and hasn't been used yet.
+ */
+const QVariantList& TableData::values(int column) const
+{
+	QMutexLocker locker(&mutex);
+	const Column& col = columns[column];
+	if (!col.encoded.isNull())
+	{
+		expand(col, rows);
+		col.encoded = QByteArray();
+	}
+	return col.values;
+}
+
+/**
+ * Encodes a column with whichever of the plain, dictionary and run-length encodings is the smallest.
+ */
+QByteArray TableData::encode(const Column& column, int rows)
+{
+	// Encode every value once, the encodings are compared and built from these bytes
+	QByteArray plain;
+	QVector<int> offsets(rows + 1);
+	{
+		QDataStream out(&plain, QIODevice::WriteOnly);
+		for (int i = 0; i < rows; i++)
+		{
+			offsets[i] = out.device()->pos();
+			writeValue(out, column.type, column.values.value(i));
+		}
+		offsets[rows] = out.device()->pos();
+	}
+
+	QVector<QByteArray> slices(rows);
+	for (int i = 0; i < rows; i++)
+		slices[i] = QByteArray::fromRawData(plain.constData() + offsets[i], offsets[i + 1] - offsets[i]);
+
+	QList<int> runs; //the first row of each run
+	QHash<QByteArray, int> dictionary;
+	QList<int> entries; //the first row of each dictionary entry
+	qint64 runSize = sizeof(quint32);
+	qint64 dictionarySize = sizeof(quint32) + sizeof(quint8);
+	for (int i = 0; i < rows; i++)
+	{
+		if (i == 0 || slices[i] != slices[i - 1])
+		{
+			runs << i;
+			runSize += sizeof(quint32) + slices[i].size();
+		}
+		if (!dictionary.contains(slices[i]))
+		{
+			dictionary.insert(slices[i], entries.count());
+			entries << i;
+			dictionarySize += slices[i].size();
+		}
+	}
+	int width = entries.count() <= 0x100 ? 1 : (entries.count() <= 0x10000 ? 2 : 4);
+	dictionarySize += static_cast<qint64>(rows) * width;
+
+	QByteArray ba;
+	QDataStream out(&ba, QIODevice::WriteOnly);
+	if (runSize < dictionarySize && runSize < plain.size())
+	{
+		out << static_cast<quint8>(RunLength) << static_cast<quint32>(runs.count());
+		for (int i = 0; i < runs.count(); i++)
+		{
+			int end = (i + 1 < runs.count()) ? runs[i + 1] : rows;
+			out << static_cast<quint32>(end - runs[i]);
+			out.writeRawData(slices[runs[i]].constData(), slices[runs[i]].size());
+		}
+	}
+	else if (dictionarySize < plain.size())
+	{
+		out << static_cast<quint8>(Dictionary) << static_cast<quint32>(entries.count());
+		foreach(int row, entries)
+		{
+			out.writeRawData(slices[row].constData(), slices[row].size());
+		}
+		out << static_cast<quint8>(width);
+		for (int i = 0; i < rows; i++)
+		{
+			int index = dictionary.value(slices[i]);
+			if (width == 1)
+				out << static_cast<quint8>(index);
+			else if (width == 2)
+				out << static_cast<quint16>(index);
+			else
+				out << static_cast<quint32>(index);
+		}
+	}
+	else
+	{
+		out << static_cast<quint8>(Plain);
+		out.writeRawData(plain.constData(), plain.size());
+	}
+	return ba;
+}
+
+/**
+ * Reads a received column, checking that it holds exactly the given number of rows. Every value is decoded once. Plain columns keep their values, dictionary columns keep their entries and the entry of every row, and run-length columns keep the value and the length of every run, until expand() turns them into values.
+ * @param column The received column
+ * @param rows The number of rows of the table
+ * @return Returns true if the column is valid
+ */
+bool TableData::read(Column& column, quint32 rows)
+{
+	QDataStream in(column.encoded);
+	quint8 encoding = Plain;
+	in >> encoding;
+	column.encoding = encoding;
+	switch (encoding)
+	{
+		case Plain:
+			// Every value takes at least a byte
+			if (rows > static_cast<quint32>(column.encoded.size()))
+				return false;
+			column.values.reserve(rows);
+			for (quint32 i = 0; i < rows && in.status() == QDataStream::Ok; i++)
+				column.values << readValue(in, column.type);
+			break;
+		case Dictionary:
+		{
+			quint32 count;
+			in >> count;
+			if (count > static_cast<quint32>(column.encoded.size()) || count > rows)
+				return false;
+			for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++)
+				column.values << readValue(in, column.type);
+			quint8 width = 0;
+			in >> width;
+			if (in.status() != QDataStream::Ok || (width != 1 && width != 2 && width != 4))
+				return false;
+			qint64 left = in.device()->size() - in.device()->pos();
+			if (left != static_cast<qint64>(rows) * width)
+				return false;
+			column.indexes.resize(rows);
+			const uchar* data = reinterpret_cast<const uchar*>(column.encoded.constData()) + in.device()->pos();
+			for (quint32 i = 0; i < rows; i++)
+			{
+				quint32 index;
+				if (width == 1)
+					index = data[i];
+				else if (width == 2)
+					index = qFromBigEndian<quint16>(data + i * 2);
+				else
+					index = qFromBigEndian<quint32>(data + i * 4);
+				if (index >= count)
+					return false;
+				column.indexes[i] = index;
+			}
+			in.skipRawData(left);
+			break;
+		}
+		case RunLength:
+		{
+			quint32 count;
+			in >> count;
+			if (count > static_cast<quint32>(column.encoded.size()) || count > rows)
+				return false;
+			quint64 total = 0;
+			for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++)
+			{
+				quint32 length;
+				in >> length;
+				column.indexes << length;
+				column.values << readValue(in, column.type);
+				total += length;
+			}
+			if (total != rows)
+				return false;
+			break;
+		}
+		default:
+			return false;
+	}
+	return in.status() == QDataStream::Ok && in.atEnd();
+}
+
+/**
+ * Turns a column that was read by read() into one value per row
+ */
+void TableData::expand(const Column& column, int rows)
+{
+	switch (column.encoding)
+	{
+		case Dictionary:
+		{
+			QVariantList values;
+			values.reserve(rows);
+			for (int i = 0; i < rows; i++)
+				values << column.values.at(column.indexes.at(i));
+			column.values = values;
+			break;
+		}
+		case RunLength:
+		{
+			QVariantList values;
+			values.reserve(rows);
+			for (int i = 0; i < column.indexes.count(); i++)
+			{
+				for (quint32 j = 0; j < column.indexes.at(i); j++)
+					values << column.values.at(i);
+			}
+			column.values = values;
+			break;
+		}
+		default:
+			break;
+	}
+	column.indexes.clear();
+	Q_ASSERT(column.values.count() == rows);
+}
+
+/**
+ * Creates an empty table without columns
+ */
+Table::Table()
+{
+	qxt_d().data = new TableData();
+}
+
+/**
+ * Creates an empty table
+ * @param columns The names of the columns
+ * @param types The types of the columns, as QMetaType ids. Use QMetaType::QVariant for columns with values of different types.
+ */
+Table::Table(const QStringList& columns, const QList<int>& types)
+{
+	qxt_d().data = new TableData();
+	for (int i = 0; i < columns.count(); i++)
+	{
+		TableData::Column column;
+		column.name = columns[i];
+		column.type = types.value(i, QMetaType::QVariant);
+		qxt_d().data->columns << column;
+	}
+}
+
+Table::Table(const Table& other)
+{
+	qxt_d().data = other.qxt_d().data;
+}
+
+Table& Table::operator=(const Table& other)
+{
+	qxt_d().data = other.qxt_d().data;
+	return *this;
+}
+
+Table::~Table()
+{
+}
+
+/**
+ * Builds a table from a list of records. The columns are the keys of the records, in the order they are first seen, and the type of a column is the type of its values, or QVariant if the values have different types. Records that are missing a key get the default value of the column type.
+ * @param rows The records
+ * @return Returns the table
+ */
+Table Table::fromRows(const QList<QVariantMap>& rows)
+{
+	QStringList columns;
+	QList<int> types;
+	QHash<QString, int> indexes;
+	foreach(QVariantMap row, rows)
+	{
+		for (QVariantMap::const_iterator it = row.constBegin(); it != row.constEnd(); ++it)
+		{
+			int index = indexes.value(it.key(), -1);
+			if (index == -1)
+			{
+				indexes.insert(it.key(), columns.count());
+				columns << it.key();
+				types << it.value().userType();
+			}
+			else if (types[index] == QMetaType::UnknownType)
+				types[index] = it.value().userType();
+			else if (it.value().isValid() && types[index] != it.value().userType())
+				types[index] = QMetaType::QVariant;
+		}
+	}
+	for (int i = 0; i < types.count(); i++)
+	{
+		if (types[i] == QMetaType::UnknownType)
+			types[i] = QMetaType::QVariant;
+	}
+
+	Table table(columns, types);
+	foreach(QVariantMap row, rows)
+	{
+		QVariantList values;
+		foreach(QString column, columns)
+		{
+			values << row.value(column);
+		}
+		table.appendRow(values);
+	}
+	return table;
+}
+
+int Table::columnCount() const
+{
+	return qxt_d().data->columns.count();
+}
+
+int Table::rowCount() const
+{
+	return qxt_d().data->rows;
+}
+
+QStringList Table::columnNames() const
+{
+	QStringList names;
+	foreach(TableData::Column column, qxt_d().data->columns)
+	{
+		names << column.name;
+	}
+	return names;
+}
+
+QString Table::columnName(int column) const
+{
+	if (column < 0 || column >= qxt_d().data->columns.count())
+		return QString();
+	return qxt_d().data->columns[column].name;
+}
+
+/**
+ * @param column The index of the column
+ * @return Returns the QMetaType id of the values of the column
+ */
+int Table::columnType(int column) const
+{
+	if (column < 0 || column >= qxt_d().data->columns.count())
+		return QMetaType::UnknownType;
+	return qxt_d().data->columns[column].type;
+}
+
+/**
+ * @param name The name of the column
+ * @return Returns the index of the column, or -1 if the table has no such column
+ */
+int Table::columnIndex(const QString& name) const
+{
+	const QList<TableData::Column>& columns = qxt_d().data->columns;
+	for (int i = 0; i < columns.count(); i++)
+	{
+		if (columns[i].name == name)
+			return i;
+	}
+	return -1;
+}
+
+/**
+ * Adds a row to the end of the table. Values are converted to the types of their columns, missing values get the default value of the column type.
+ * @param values The values of the row, in column order
+ */
+void Table::appendRow(const QVariantList& values)
+{
+	TableData* data = qxt_d().data.data();
+	for (int i = 0; i < data->columns.count(); i++)
+	{
+		data->values(i);
+		QVariant value = values.value(i);
+		int type = data->columns[i].type;
+		if (type != QMetaType::QVariant && value.userType() != type && !value.convert(type))
+			value = QVariant(type, static_cast<const void*>(0));
+		data->columns[i].values << value;
+	}
+	data->rows++;
+}
+
+QVariant Table::value(int row, int column) const
+{
+	if (row < 0 || row >= qxt_d().data->rows || column < 0 || column >= qxt_d().data->columns.count())
+		return QVariant();
+	return qxt_d().data->values(column).at(row);
+}
+
+QVariant Table::value(int row, const QString& column) const
+{
+	return value(row, columnIndex(column));
+}
+
+/**
+ * @param row The index of the row
+ * @return Returns the values of a row, in column order
+ */
+QVariantList Table::row(int row) const
+{
+	QVariantList values;
+	if (row < 0 || row >= qxt_d().data->rows)
+		return values;
+	for (int i = 0; i < qxt_d().data->columns.count(); i++)
+		values << qxt_d().data->values(i).at(row);
+	return values;
+}
+
+/**
+ * @param row The index of the row
+ * @return Returns a row as a record, mapping the column names to the values
+ */
+QVariantMap Table::rowMap(int row) const
+{
+	QVariantMap map;
+	if (row < 0 || row >= qxt_d().data->rows)
+		return map;
+	for (int i = 0; i < qxt_d().data->columns.count(); i++)
+		map.insert(qxt_d().data->columns[i].name, qxt_d().data->values(i).at(row));
+	return map;
+}
+
+/**
+ * @param column The index of the column
+ * @return Returns all the values of a column
+ */
+QVariantList Table::column(int column) const
+{
+	if (column < 0 || column >= qxt_d().data->columns.count())
+		return QVariantList();
+	return qxt_d().data->values(column);
+}
+
+/**
+ * Converts the table to a list of records, the form functions returned before Table existed.
+ * @return Returns the rows as records
+ */
+QList<QVariantMap> Table::toRows() const
+{
+	QList<QVariantMap> rows;
+	for (int i = 0; i < qxt_d().data->rows; i++)
+		rows << rowMap(i);
+	return rows;
+}
+
+QDataStream& operator<< (QDataStream& s, const QtRpc::Table& table)
+{
+	const TableData* data = table.qxt_d().data.constData();
+	s << static_cast<quint32>(data->columns.count()) << static_cast<quint32>(data->rows);
+	for (int i = 0; i < data->columns.count(); i++)
+	{
+		const TableData::Column& column = data->columns[i];
+		s << column.name << QByteArray(QMetaType::typeName(column.type));
+		QMutexLocker locker(&data->mutex);
+		// Columns that were received and never used are sent on as they are
+		if (!column.encoded.isNull())
+			s << column.encoded;
+		else
+			s << TableData::encode(column, data->rows);
+	}
+	return s;
+}
+
+QDataStream& operator>> (QDataStream& s, QtRpc::Table& table)
+{
+	TableData* data = new TableData();
+	quint32 columns, rows;
+	s >> columns >> rows;
+	// Every row needs encoded data, a table without columns can't have rows
+	if (rows > static_cast<quint32>(INT_MAX) || (rows > 0 && columns == 0))
+		s.setStatus(QDataStream::ReadCorruptData);
+	data->rows = rows;
+	for (quint32 i = 0; i < columns && s.status() == QDataStream::Ok; i++)
+	{
+		TableData::Column column;
+		QByteArray type;
+		s >> column.name >> type >> column.encoded;
+		column.type = QMetaType::type(type.constData());
+		if (column.type == QMetaType::UnknownType)
+		{
+			qWarning() << "Cannot read table column" << column.name << "of unknown type" << type;
+			s.setStatus(QDataStream::ReadCorruptData);
+		}
+		if (column.encoded.isNull())
+			column.encoded = QByteArray("");
+		if (s.status() == QDataStream::Ok && !TableData::read(column, rows))
+		{
+			qWarning() << "Table column" << column.name << "does not hold" << rows << "rows";
+			s.setStatus(QDataStream::ReadCorruptData);
+		}
+		data->columns << column;
+	}
+	if (s.status() != QDataStream::Ok)
+	{
+		delete data;
+		table = Table();
+		return s;
+	}
+	table.qxt_d().data = data;
+	return s;
+}
+
+QDebug operator<<(QDebug dbg, const QtRpc::Table& table)
+{
+	dbg.nospace() << "Table(" << table.columnNames() << ", " << table.rowCount() << " rows)";
+	return dbg.space();
+}
@@ -0,0 +1,100 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCTABLE_H
+#define QTRPCTABLE_H
+
+#include <QMetaType>
+#include <QxtPimpl>
+#include <QVariant>
+#include <QStringList>
+#include <QtRpcGlobal>
+
+namespace QtRpc
+{
+class TablePrivate;
+class Table;
+}
+class QDebug;
+
+QTRPC2_EXPORT QDataStream& operator>> (QDataStream& s, QtRpc::Table& table);
+QTRPC2_EXPORT QDataStream& operator<< (QDataStream& s, const QtRpc::Table& table);
+
+QTRPC2_EXPORT QDebug operator<<(QDebug dbg, const QtRpc::Table& table); //for debugging
+
+namespace QtRpc
+{
+/**
+	A list of records with a fixed set of typed columns, for functions that return large result sets. Unlike a QList of QVariantMaps the column names and types are only sent once, and the values are sent column by column. Columns with few distinct values are sent as a dictionary, and columns with long runs of equal values are run-length encoded.
+
+	A Table that was received is checked and decoded once when it arrives. Columns sent as a dictionary or run-length encoded keep that compact form until a value of the column is first accessed, and a received table that is sent on before any of its values are accessed is not encoded again.
+	@code
+	Table table(QStringList() << "name" << "count", QList<int>() << QMetaType::QString << QMetaType::Int);
+	table.appendRow(QVariantList() << "apples" << 5);
+	return(table);
+	@endcode
+*/
+class QTRPC2_EXPORT Table
+{
+	QXT_DECLARE_PRIVATE(Table);
+	friend QTRPC2_EXPORT QDataStream& ::operator>> (QDataStream& s, QtRpc::Table& table);
+	friend QTRPC2_EXPORT QDataStream& ::operator<< (QDataStream& s, const QtRpc::Table& table);
+public:
+	Table();
+	Table(const QStringList& columns, const QList<int>& types);
+	Table(const Table& other);
+	~Table();
+
+	static Table fromRows(const QList<QVariantMap>& rows);
+
+	int columnCount() const;
+	int rowCount() const;
+	QStringList columnNames() const;
+	QString columnName(int column) const;
+	int columnType(int column) const;
+	int columnIndex(const QString& name) const;
+
+	void appendRow(const QVariantList& values);
+	QVariant value(int row, int column) const;
+	QVariant value(int row, const QString& column) const;
+	QVariantList row(int row) const;
+	QVariantMap rowMap(int row) const;
+	QVariantList column(int column) const;
+	QList<QVariantMap> toRows() const;
+
+	Table& operator=(const Table& other);
+};
+
+}
+
+Q_DECLARE_METATYPE(QtRpc::Table);
+
+#endif
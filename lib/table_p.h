@@ -0,0 +1,96 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCTABLE_P_H
+#define QTRPCTABLE_P_H
+
+#include <QxtPimpl>
+#include <QMutex>
+#include <QSharedDataPointer>
+#include "table.h"
+#include <QVector>
+#include <qtrpcprivate.h>
+
+namespace QtRpc
+{
+
+class TableData : public QSharedData
+{
+public:
+	enum Encoding
+	{
+		Plain = 0,
+		Dictionary = 1,
+		RunLength = 2
+	};
+
+	struct Column
+	{
+		Column()
+				: type(QMetaType::QVariant),
+				encoding(Plain)
+		{
+		}
+
+		QString name;
+		int type;
+		mutable QVariantList values;
+		mutable QByteArray encoded; //the received column, until it is first used
+		// A received column is read once by read(). Until it is first used, values holds the dictionary entries or the run values, and indexes the entry of every row or the length of every run
+		mutable quint8 encoding;
+		mutable QVector<quint32> indexes;
+	};
+
+	TableData() : rows(0) { }
+	TableData(const TableData& other);
+	const QVariantList& values(int column) const;
+	static QByteArray encode(const Column& column, int rows);
+	static bool read(Column& column, quint32 rows);
+	static void expand(const Column& column, int rows);
+
+	QList<Column> columns;
+	int rows;
+	mutable QMutex mutex;
+};
+
+class TablePrivate : public QxtPrivate<Table>
+{
+public:
+	TablePrivate()
+	{
+	}
+
+	QSharedDataPointer<TableData> data;
+};
+
+}
+
+#endif
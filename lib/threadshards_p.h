@@ -0,0 +1,149 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCTHREADSHARDS_P_H
+#define QTRPCTHREADSHARDS_P_H
+
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QThreadStorage>
+#include <qtrpcprivate.h>
+
+namespace QtRpc
+{
+
+/**
+	The part of a shard used by ThreadShards. Shard types derive from it.
+*/
+struct ThreadShard
+{
+	ThreadShard()
+			: owned(1),
+			next(0)
+	{
+	}
+
+	QAtomicInt owned;
+	ThreadShard* next;
+};
+
+/**
+	Gives every thread a shard of type T to write its counters to, so threads never share a cache line or a lock when they count. Readers walk all the shards with first() and next, and add them up without taking a lock.
+
+	A shard is owned by one thread at a time. When the thread exits its shard is handed to the next thread that needs one, with the values it holds, so the list only grows to the highest number of threads that were counting at the same time, and nothing is lost when a thread goes away. Shards are never freed.
+
+	Writers own their shard, so they can update its counters with a relaxed load and store instead of an atomic add. Readers can see one counter of a shard updated before another, but never a torn value.
+	@brief Lock free per thread shards of counters
+*/
+template<typename T>
+class ThreadShards
+{
+public:
+	ThreadShards()
+			: m_head(0)
+	{
+	}
+
+	/**
+	 * @return Returns the shard of the calling thread, claiming one first if needed
+	 */
+	T* local()
+	{
+		if (!m_owners.hasLocalData())
+			m_owners.setLocalData(new Owner(claim()));
+		return m_owners.localData()->shard;
+	}
+
+	/**
+	 * @return Returns the first shard, the others follow through ThreadShard::next
+	 */
+	T* first() const
+	{
+		return static_cast<T*>(m_head.loadAcquire());
+	}
+
+	static T* next(const T* shard)
+	{
+		return static_cast<T*>(shard->next);
+	}
+
+	/**
+	 * Adds to a counter of the shard of the calling thread. Must only be used with the shard of the calling thread.
+	 */
+	template<typename V>
+	static void add(QAtomicInteger<V>& counter, V value)
+	{
+		counter.store(counter.load() + value);
+	}
+
+private:
+	Q_DISABLE_COPY(ThreadShards);
+
+	struct Owner
+	{
+		Owner(T* s)
+				: shard(s)
+		{
+		}
+
+		~Owner()
+		{
+			shard->owned.storeRelease(0);
+		}
+
+		T* shard;
+	};
+
+	T* claim()
+	{
+		for (T* shard = first(); shard != 0; shard = next(shard))
+		{
+			if (shard->owned.testAndSetAcquire(0, 1))
+				return shard;
+		}
+		T* shard = new T();
+		ThreadShard* head;
+		do
+		{
+			head = m_head.loadAcquire();
+			shard->next = head;
+		}
+		while (!m_head.testAndSetRelease(head, shard));
+		return shard;
+	}
+
+	QAtomicPointer<ThreadShard> m_head;
+	QThreadStorage<Owner*> m_owners;
+};
+
+}
+
+#endif
@@ -0,0 +1,254 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include "tracecontext.h"
+#include <QAtomicInt>
+#include <QDateTime>
+#include <QStringList>
+#include <QThread>
+#include <QThreadStorage>
+
+namespace QtRpc
+{
+
+struct TraceState
+{
+	TraceState()
+			: random(0)
+	{
+	}
+
+	TraceContext current;
+	quint64 random;
+};
+
+static QThreadStorage<TraceState> traceState;
+static QBasicAtomicInt seeds = Q_BASIC_ATOMIC_INITIALIZER(0);
+
+// splitmix64, seeded differently for every thread
+static quint64 randomId()
+{
+	TraceState& state = traceState.localData();
+	if (state.random == 0)
+		state.random = quint64(QDateTime::currentMSecsSinceEpoch()) * Q_UINT64_C(1000003) ^ quint64(quintptr(QThread::currentThreadId())) ^ (quint64(seeds.fetchAndAddRelaxed(1)) << 32);
+	quint64 z;
+	do
+	{
+		z = (state.random += Q_UINT64_C(0x9e3779b97f4a7c15));
+		z = (z ^ (z >> 30)) * Q_UINT64_C(0xbf58476d1ce4e5b9);
+		z = (z ^ (z >> 27)) * Q_UINT64_C(0x94d049bb133111eb);
+		z = z ^ (z >> 31);
+	}
+	while (z == 0);
+	return z;
+}
+
+static QString hex(quint64 value)
+{
+	return QString("%1").arg(value, 16, 16, QChar('0'));
+}
+
+/**
+ * Creates an invalid context
+ */
+TraceContext::TraceContext()
+		: m_traceIdHigh(0),
+		m_traceIdLow(0),
+		m_spanId(0),
+		m_parentSpanId(0),
+		m_sampled(false)
+{
+}
+
+/**
+ * Creates a context from its ids
+ * @param traceIdHigh The upper 64 bits of the trace id
+ * @param traceIdLow The lower 64 bits of the trace id
+ * @param spanId The id of the span
+ * @param sampled True if the spans of the trace are reported
+ */
+TraceContext::TraceContext(quint64 traceIdHigh, quint64 traceIdLow, quint64 spanId, bool sampled)
+		: m_traceIdHigh(traceIdHigh),
+		m_traceIdLow(traceIdLow),
+		m_spanId(spanId),
+		m_parentSpanId(0),
+		m_sampled(sampled)
+{
+}
+
+/**
+ * @return Returns true if the context has a trace id and a span id
+ */
+bool TraceContext::isValid() const
+{
+	return (m_traceIdHigh != 0 || m_traceIdLow != 0) && m_spanId != 0;
+}
+
+/**
+ * @return Returns true if the spans of this trace are reported
+ */
+bool TraceContext::isSampled() const
+{
+	return m_sampled && isValid();
+}
+
+quint64 TraceContext::traceIdHigh() const
+{
+	return m_traceIdHigh;
+}
+
+quint64 TraceContext::traceIdLow() const
+{
+	return m_traceIdLow;
+}
+
+quint64 TraceContext::spanId() const
+{
+	return m_spanId;
+}
+
+/**
+ * @return Returns the id of the span this context was created from by child(), or 0. The parent is not sent over the network.
+ */
+quint64 TraceContext::parentSpanId() const
+{
+	return m_parentSpanId;
+}
+
+/**
+ * @return Returns the trace id as 32 hexadecimal digits
+ */
+QString TraceContext::traceIdString() const
+{
+	return hex(m_traceIdHigh) + hex(m_traceIdLow);
+}
+
+/**
+ * @return Returns the span id as 16 hexadecimal digits
+ */
+QString TraceContext::spanIdString() const
+{
+	return hex(m_spanId);
+}
+
+/**
+ * @return Returns a context for a new span in the same trace, whose parent is this span, or an invalid context if this one is invalid
+ */
+TraceContext TraceContext::child() const
+{
+	if (!isValid())
+		return TraceContext();
+	TraceContext context(m_traceIdHigh, m_traceIdLow, randomId(), m_sampled);
+	context.m_parentSpanId = m_spanId;
+	return context;
+}
+
+/**
+ * @return Returns the context as a W3C traceparent header, or an empty string if it is invalid
+ */
+QString TraceContext::toTraceparent() const
+{
+	if (!isValid())
+		return QString();
+	return QString("00-%1-%2-%3").arg(traceIdString(), spanIdString(), m_sampled ? "01" : "00");
+}
+
+/**
+ * Parses a W3C traceparent header
+ * @param traceparent The header
+ * @return Returns the context, or an invalid context if the header could not be parsed
+ */
+TraceContext TraceContext::fromTraceparent(const QString& traceparent)
+{
+	QStringList parts = traceparent.trimmed().split('-');
+	if (parts.count() < 4 || parts.at(0).size() != 2 || parts.at(1).size() != 32 || parts.at(2).size() != 16 || parts.at(3).size() != 2)
+		return TraceContext();
+	bool ok[4];
+	quint64 high = parts.at(1).left(16).toULongLong(&ok[0], 16);
+	quint64 low = parts.at(1).mid(16).toULongLong(&ok[1], 16);
+	quint64 span = parts.at(2).toULongLong(&ok[2], 16);
+	uint flags = parts.at(3).toUInt(&ok[3], 16);
+	if (!ok[0] || !ok[1] || !ok[2] || !ok[3])
+		return TraceContext();
+	return TraceContext(high, low, span, flags & 0x01);
+}
+
+/**
+ * Starts a new trace
+ * @param sampled True if the spans of the trace should be reported
+ * @return Returns the context of the root span of the new trace
+ */
+TraceContext TraceContext::root(bool sampled)
+{
+	return TraceContext(randomId(), randomId(), randomId(), sampled);
+}
+
+/**
+ * @return Returns the context that is current in this thread, or an invalid context if there is none
+ * @sa TraceScope
+ */
+TraceContext TraceContext::current()
+{
+	if (!traceState.hasLocalData())
+		return TraceContext();
+	return traceState.localData().current;
+}
+
+bool TraceContext::operator==(const TraceContext& other) const
+{
+	return m_traceIdHigh == other.m_traceIdHigh && m_traceIdLow == other.m_traceIdLow && m_spanId == other.m_spanId && m_sampled == other.m_sampled;
+}
+
+bool TraceContext::operator!=(const TraceContext& other) const
+{
+	return !(*this == other);
+}
+
+/**
+ * Makes \a context current for this thread
+ * @param context The context, or an invalid context to make no trace current
+ */
+TraceScope::TraceScope(const TraceContext& context)
+{
+	TraceState& state = traceState.localData();
+	m_previous = state.current;
+	state.current = context;
+}
+
+/**
+ * Restores the context that was current before this scope
+ */
+TraceScope::~TraceScope()
+{
+	traceState.localData().current = m_previous;
+}
+
+}
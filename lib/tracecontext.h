@@ -0,0 +1,104 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCTRACECONTEXT_H
+#define QTRPCTRACECONTEXT_H
+
+#include <QString>
+#include <QtRpcGlobal>
+
+namespace QtRpc
+{
+
+/**
+	Identifies a span of a distributed trace: the id of the trace, the id of the span, and whether the trace is sampled. Function calls made while a context is current carry a child of it to the server, which makes its own span a child of the caller's, so the calls of one request can be followed across services.
+
+	A client starts a trace by making a root() context current with a TraceScope:
+	@code
+	TraceScope scope(TraceContext::root());
+	service.doSomething(); // the call and everything the server calls to handle it is traced
+	@endcode
+	Service functions don't have to do anything, the context of the call being run is current while it runs, so calls they make to other services are part of the same trace. Spans of sampled traces are reported to the SpanSink, unsampled traces only pass their ids along.
+
+	The ids and the sampling flag are the same as in W3C trace context, toTraceparent() and fromTraceparent() convert the context to and from a traceparent header.
+	@brief Context of a distributed trace
+*/
+class QTRPC2_EXPORT TraceContext
+{
+public:
+	TraceContext();
+	TraceContext(quint64 traceIdHigh, quint64 traceIdLow, quint64 spanId, bool sampled);
+
+	bool isValid() const;
+	bool isSampled() const;
+	quint64 traceIdHigh() const;
+	quint64 traceIdLow() const;
+	quint64 spanId() const;
+	quint64 parentSpanId() const;
+	QString traceIdString() const;
+	QString spanIdString() const;
+
+	TraceContext child() const;
+	QString toTraceparent() const;
+	static TraceContext fromTraceparent(const QString& traceparent);
+
+	static TraceContext root(bool sampled = true);
+	static TraceContext current();
+
+	bool operator==(const TraceContext& other) const;
+	bool operator!=(const TraceContext& other) const;
+
+private:
+	quint64 m_traceIdHigh;
+	quint64 m_traceIdLow;
+	quint64 m_spanId;
+	quint64 m_parentSpanId;
+	bool m_sampled;
+};
+
+/**
+	Makes a TraceContext current for the calling thread until the scope is destroyed, the previous context is current again afterwards.
+	@brief Sets the current trace context of a thread
+*/
+class QTRPC2_EXPORT TraceScope
+{
+public:
+	explicit TraceScope(const TraceContext& context);
+	~TraceScope();
+
+private:
+	Q_DISABLE_COPY(TraceScope);
+	TraceContext m_previous;
+};
+
+}
+
+#endif
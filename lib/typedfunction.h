@@ -0,0 +1,118 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCTYPEDFUNCTION_H
+#define QTRPCTYPEDFUNCTION_H
+
+#include <QtRpcGlobal>
+#include <QDataStream>
+#include <QMetaType>
+#include <QStringList>
+#include <ClientProxy>
+
+#ifdef Q_COMPILER_VARIADIC_TEMPLATES
+
+namespace QtRpc
+{
+
+/**
+	A function of a service with argument types that are known at compile time. The arguments are packed with their own QDataStream operators and sent with ClientProxy::callPackedFunction(), so they are never wrapped in QVariants. The server reads them the same way, straight into the parameters of the callback.
+	@code
+	TypedFunction<QString, int> setValue("setValue");
+	ReturnValue ret = setValue(proxy, "answer", 42);
+	@endcode
+	All argument types must be registered with stream operators, for example with QTRPC_REGISTER_METATYPE() or QTRPC_REGISTER_POD_METATYPE(). Against servers that don't accept packed arguments the call is converted to a normal call.
+*/
+template <typename... Args>
+class TypedFunction
+{
+public:
+	/**
+	 * Creates a function, the signature is built from \a name and the argument types
+	 * @param name The name of the function on the service
+	 */
+	explicit TypedFunction(const QString& name)
+			: _sig(buildSignature(name))
+	{
+	}
+
+	/**
+	 * Synchronously calls the function on the service selected by \a proxy
+	 * @param proxy The ClientProxy to call the function on
+	 * @return Returns the return value of the function, or an error
+	 */
+	ReturnValue operator()(ClientProxy& proxy, const Args&... args) const
+	{
+		QByteArray packed;
+		{
+			QDataStream out(&packed, QIODevice::WriteOnly);
+			pack(out, args...);
+		}
+		return proxy.callPackedFunction(_sig, packed);
+	}
+
+	/**
+	 * @return Returns the signature of the function
+	 */
+	Signature signature() const
+	{
+		return _sig;
+	}
+
+private:
+	static void pack(QDataStream&)
+	{
+	}
+
+	template <typename T, typename... Rest>
+	static void pack(QDataStream& out, const T& first, const Rest&... rest)
+	{
+		QMetaType::save(out, qMetaTypeId<T>(), &first);
+		pack(out, rest...);
+	}
+
+	static Signature buildSignature(const QString& name)
+	{
+		const char* names[] = {QMetaType::typeName(qMetaTypeId<Args>())..., 0};
+		QStringList types;
+		for (unsigned int i = 0; i < sizeof...(Args); i++)
+			types << names[i];
+		return Signature(name + "(" + types.join(",") + ")");
+	}
+
+	Signature _sig;
+};
+
+}
+
+#endif //#ifdef Q_COMPILER_VARIADIC_TEMPLATES
+
+#endif //#ifndef QTRPCTYPEDFUNCTION_H
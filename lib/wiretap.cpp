@@ -0,0 +1,323 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include "wiretap.h"
+#include "wiretap_p.h"
+#include "callstats_p.h"
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStringList>
+
+namespace QtRpc
+{
+
+QBasicAtomicInt WireTapPrivate::active = Q_BASIC_ATOMIC_INITIALIZER(0);
+
+// protocol instances inside of capture()
+static QBasicAtomicInt users = Q_BASIC_ATOMIC_INITIALIZER(0);
+static QBasicAtomicInt connections = Q_BASIC_ATOMIC_INITIALIZER(0);
+static QBasicAtomicInt environmentChecked = Q_BASIC_ATOMIC_INITIALIZER(0);
+static QBasicAtomicInt capturedFrames = Q_BASIC_ATOMIC_INITIALIZER(0);
+static QBasicAtomicInt droppedFrames = Q_BASIC_ATOMIC_INITIALIZER(0);
+// set before active, and only changed while it is cleared
+static WireTapRing* ring = 0;
+static WireTapWriter* writer = 0;
+static int sampleRate = 1;
+static qint64 startTime = 0;
+
+Q_GLOBAL_STATIC(QMutex, controlMutex)
+
+WireTapRing::WireTapRing(int capacity)
+		: m_enqueue(0),
+		m_dequeue(0)
+{
+	quint32 size = 2;
+	while (size < quint32(capacity) && size < (1u << 30))
+		size <<= 1;
+	m_cells = new Cell[size];
+	m_mask = size - 1;
+	for (quint32 i = 0; i < size; ++i)
+		m_cells[i].sequence.store(i);
+}
+
+WireTapRing::~WireTapRing()
+{
+	delete[] m_cells;
+}
+
+/**
+ * Adds a record to the ring. Safe to call from any number of threads.
+ * @param record The record to add
+ * @return Returns false if the ring is full
+ */
+bool WireTapRing::push(const WireTapRecord& record)
+{
+	quint32 pos = m_enqueue.load();
+	Cell* cell;
+	forever
+	{
+		cell = &m_cells[pos & m_mask];
+		qint32 diff = qint32(cell->sequence.loadAcquire() - pos);
+		if (diff == 0)
+		{
+			if (m_enqueue.testAndSetRelaxed(pos, pos + 1))
+				break;
+			pos = m_enqueue.load();
+		}
+		else if (diff < 0)
+			return false;
+		else
+			pos = m_enqueue.load();
+	}
+	cell->record = record;
+	cell->sequence.storeRelease(pos + 1);
+	return true;
+}
+
+/**
+ * Takes the oldest record from the ring. Only one thread may pop.
+ * @param record Set to the record
+ * @return Returns false if the ring is empty
+ */
+bool WireTapRing::pop(WireTapRecord& record)
+{
+	Cell* cell = &m_cells[m_dequeue & m_mask];
+	if (qint32(cell->sequence.loadAcquire() - (m_dequeue + 1)) != 0)
+		return false;
+	record = cell->record;
+	cell->record = WireTapRecord();
+	cell->sequence.storeRelease(m_dequeue + m_mask + 1);
+	++m_dequeue;
+	return true;
+}
+
+WireTapWriter::WireTapWriter(WireTapRing* ring, const QString& path)
+		: m_ring(ring),
+		m_file(path),
+		m_stopping(0)
+{
+}
+
+/**
+ * Opens the capture file and writes its header
+ * @param sampleRate The sample rate of the capture
+ * @return Returns false if the file could not be opened
+ */
+bool WireTapWriter::open(int sampleRate)
+{
+	if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		return false;
+	QDataStream out(&m_file);
+	out << quint32(WireTapPrivate::CaptureMagic) << quint32(WireTapPrivate::CaptureFormat) << qint64(QDateTime::currentMSecsSinceEpoch()) << qint32(sampleRate);
+	return out.status() == QDataStream::Ok;
+}
+
+/**
+ * Stops the thread after it wrote everything that is left in the ring
+ */
+void WireTapWriter::stop()
+{
+	m_stopping.store(1);
+	wait();
+	m_file.close();
+}
+
+void WireTapWriter::run()
+{
+	QDataStream out(&m_file);
+	forever
+	{
+		// read the flag first, so nothing pushed before stop() is left behind
+		bool stopping = m_stopping.load() != 0;
+		int written = drain(out);
+		if (stopping)
+			break;
+		if (written == 0)
+			msleep(10);
+	}
+	m_file.flush();
+}
+
+int WireTapWriter::drain(QDataStream& out)
+{
+	int count = 0;
+	WireTapRecord record;
+	while (m_ring->pop(record))
+	{
+		quint32 size = record.head.size() - record.skip + record.body.size();
+		out << record.timestamp << record.connection << record.direction << record.version << size;
+		out.writeRawData(record.head.constData() + record.skip, record.head.size() - record.skip);
+		if (!record.body.isEmpty())
+			out.writeRawData(record.body.constData(), record.body.size());
+		++count;
+	}
+	return count;
+}
+
+/**
+ * Hands out the ids protocol instances use for capture(). The first call also starts the tap if the QTRPC_WIRETAP environment variable is set.
+ * @return Returns a new connection id
+ */
+quint32 WireTapPrivate::nextConnection()
+{
+	if (environmentChecked.testAndSetRelaxed(0, 1))
+	{
+		QByteArray env = qgetenv("QTRPC_WIRETAP");
+		if (!env.isEmpty())
+		{
+			QStringList parts = QString::fromLocal8Bit(env).split(',');
+			int rate = parts.count() > 1 ? parts.at(1).toInt() : 1;
+			if (!WireTap::start(parts.at(0), rate))
+				qWarning() << "Failed to start the wire tap on" << parts.at(0);
+		}
+	}
+	return quint32(connections.fetchAndAddRelaxed(1) + 1);
+}
+
+/**
+ * Captures a frame, if the tap is running and \a connection is sampled. Never blocks, the frame is dropped if the ring is full.
+ * @param connection The id of the connection, from nextConnection()
+ * @param direction The direction of the frame
+ * @param version The protocol version the frame is encoded with
+ * @param head The encoded frame, or its header
+ * @param skip The number of bytes at the start of \a head that are not part of the message
+ * @param body The shared body of the frame, or an empty array
+ */
+void WireTapPrivate::capture(quint32 connection, WireTap::Direction direction, quint32 version, const QByteArray& head, int skip, const QByteArray& body)
+{
+	users.ref();
+	if (active.loadAcquire() && connection % sampleRate == 0)
+	{
+		WireTapRecord record;
+		record.timestamp = CallStats::now() - startTime;
+		record.connection = connection;
+		record.direction = direction;
+		record.version = version;
+		record.head = head;
+		record.skip = skip;
+		record.body = body;
+		if (ring->push(record))
+			capturedFrames.ref();
+		else
+			droppedFrames.ref();
+	}
+	users.deref();
+}
+
+/**
+ * Decodes the frame
+ * @return Returns the captured message, or an invalid message if the frame could not be decoded
+ */
+Message WireTap::Frame::message() const
+{
+	Message msg;
+	msg.setVersion(version);
+	QDataStream stream(data);
+	stream >> msg;
+	return msg;
+}
+
+/**
+ * Starts capturing frames to a new capture file. A running capture is stopped first.
+ * @param path The path of the capture file, which is overwritten
+ * @param sampleRate Capture one connection out of \a sampleRate
+ * @param capacity The number of frames the ring buffer holds before frames are dropped
+ * @return Returns false if the capture file could not be opened
+ */
+bool WireTap::start(const QString& path, int sampleRate, int capacity)
+{
+	stop();
+	QMutexLocker locker(controlMutex());
+	WireTapRing* newRing = new WireTapRing(capacity);
+	WireTapWriter* newWriter = new WireTapWriter(newRing, path);
+	if (!newWriter->open(qMax(1, sampleRate)))
+	{
+		delete newWriter;
+		delete newRing;
+		return false;
+	}
+	ring = newRing;
+	writer = newWriter;
+	QtRpc::sampleRate = qMax(1, sampleRate);
+	startTime = CallStats::now();
+	capturedFrames.store(0);
+	droppedFrames.store(0);
+	writer->start(QThread::LowPriority);
+	WireTapPrivate::active.storeRelease(1);
+	return true;
+}
+
+/**
+ * Stops capturing, and waits until the captured frames are written to the capture file
+ */
+void WireTap::stop()
+{
+	QMutexLocker locker(controlMutex());
+	if (!WireTapPrivate::active.fetchAndStoreOrdered(0))
+		return;
+	// wait for the frames being captured right now
+	while (users.loadAcquire() != 0)
+		QThread::yieldCurrentThread();
+	writer->stop();
+	delete writer;
+	delete ring;
+	writer = 0;
+	ring = 0;
+}
+
+/**
+ * @return Returns true if frames are being captured
+ */
+bool WireTap::isRunning()
+{
+	return WireTapPrivate::isActive();
+}
+
+/**
+ * @return Returns the number of frames captured since the capture was started
+ */
+quint32 WireTap::captured()
+{
+	return quint32(capturedFrames.load());
+}
+
+/**
+ * @return Returns the number of frames dropped because the ring buffer was full, since the capture was started
+ */
+quint32 WireTap::dropped()
+{
+	return quint32(droppedFrames.load());
+}
+
+}
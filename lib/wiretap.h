@@ -0,0 +1,91 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCWIRETAP_H
+#define QTRPCWIRETAP_H
+
+#include <QByteArray>
+#include <QString>
+#include <Message>
+#include <QtRpcGlobal>
+
+namespace QtRpc
+{
+
+/**
+	The wire tap records the raw frames read and written by the protocol instances, without a debug build. It can be started and stopped at any time with start() and stop(), or at startup by setting the QTRPC_WIRETAP environment variable to the path of the capture file, optionally followed by a comma and the sample rate.
+
+	Capturing a frame only copies a reference to the already encoded data into a lock free ring buffer, a background thread writes the buffer to the capture file. When the ring buffer is full frames are dropped instead of blocking the connection, dropped() returns how many.
+
+	Sampling is done by connection, so the conversation of every captured connection is complete. With a sample rate of N, one connection out of N is captured.
+
+	Captures are read with WireTapReader, and the qtrpc2-tapdump tool prints them as Message dumps.
+	@brief Runtime capture of the frames sent and received
+*/
+class QTRPC2_EXPORT WireTap
+{
+public:
+	/**
+	 * The side of the connection that captured a frame, and the direction of the frame
+	 */
+	enum Direction
+	{
+		ServerReceived = 0,	/**< A frame read by a server from a client */
+		ServerSent = 1,		/**< A frame written by a server to a client */
+		ClientReceived = 2,	/**< A frame read by a client from a server */
+		ClientSent = 3		/**< A frame written by a client to a server */
+	};
+
+	/**
+		A captured frame, without its size prefix.
+		@brief Captured frame
+	*/
+	struct Frame
+	{
+		qint64 timestamp;	/**< Nanoseconds since the capture was started */
+		quint32 connection;	/**< The connection the frame was captured on */
+		Direction direction;	/**< The direction of the frame */
+		quint32 version;	/**< The protocol version the frame was encoded with */
+		QByteArray data;	/**< The encoded message */
+
+		Message message() const;
+	};
+
+	static bool start(const QString& path, int sampleRate = 1, int capacity = 65536);
+	static void stop();
+	static bool isRunning();
+	static quint32 captured();
+	static quint32 dropped();
+};
+
+}
+
+#endif
@@ -0,0 +1,134 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCWIRETAP_P_H
+#define QTRPCWIRETAP_P_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QFile>
+#include <QThread>
+#include "wiretap.h"
+#include <qtrpcprivate.h>
+
+class QDataStream;
+
+namespace QtRpc
+{
+
+struct WireTapRecord
+{
+	qint64 timestamp;
+	quint32 connection;
+	quint8 direction;
+	quint32 version;
+	QByteArray head;
+	// bytes of the size prefix at the start of head, which are not captured
+	int skip;
+	QByteArray body;
+};
+
+/**
+	A bounded queue that many threads can push to without locking, and one thread pops from. Each cell has a sequence number that tells producers and the consumer whose turn it is, so a push is a compare and swap of the write position and a copy of the record.
+	@brief Lock free ring buffer of captured frames
+*/
+class WireTapRing
+{
+public:
+	explicit WireTapRing(int capacity);
+	~WireTapRing();
+
+	bool push(const WireTapRecord& record);
+	bool pop(WireTapRecord& record);
+
+private:
+	Q_DISABLE_COPY(WireTapRing);
+	struct Cell
+	{
+		QAtomicInteger<quint32> sequence;
+		WireTapRecord record;
+	};
+
+	Cell* m_cells;
+	quint32 m_mask;
+	QAtomicInteger<quint32> m_enqueue;
+	quint32 m_dequeue;
+};
+
+/**
+	Drains the ring buffer to the capture file until it is stopped.
+	@brief Background writer of the wire tap
+*/
+class WireTapWriter : public QThread
+{
+	Q_OBJECT
+public:
+	WireTapWriter(WireTapRing* ring, const QString& path);
+	bool open(int sampleRate);
+	void stop();
+
+protected:
+	void run();
+
+private:
+	int drain(QDataStream& out);
+
+	WireTapRing* m_ring;
+	QFile m_file;
+	QAtomicInt m_stopping;
+};
+
+/**
+	The part of the wire tap used by the protocol instances. isActive() is checked before building anything for capture(), so a stopped tap costs a single load per frame.
+	@brief Capture hooks of the wire tap
+*/
+class WireTapPrivate
+{
+public:
+	enum
+	{
+		CaptureMagic = 0x51525450,
+		CaptureFormat = 1
+	};
+
+	static inline bool isActive()
+	{
+		return active.load() != 0;
+	}
+	static quint32 nextConnection();
+	static void capture(quint32 connection, WireTap::Direction direction, quint32 version, const QByteArray& head, int skip = 0, const QByteArray& body = QByteArray());
+
+	static QBasicAtomicInt active;
+};
+
+}
+
+#endif
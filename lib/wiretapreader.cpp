@@ -0,0 +1,143 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include "wiretapreader.h"
+#include "wiretapreader_p.h"
+#include "wiretap_p.h"
+
+namespace QtRpc
+{
+
+WireTapReader::WireTapReader()
+{
+	QXT_INIT_PRIVATE(WireTapReader);
+}
+
+WireTapReader::~WireTapReader()
+{
+}
+
+/**
+ * Opens a capture file and reads its header
+ * @param path The path of the capture file
+ * @return Returns false if the file can't be opened or is not a capture file, see errorString()
+ */
+bool WireTapReader::open(const QString& path)
+{
+	close();
+	qxt_d().file.setFileName(path);
+	if (!qxt_d().file.open(QIODevice::ReadOnly))
+	{
+		qxt_d().error = qxt_d().file.errorString();
+		return false;
+	}
+	qxt_d().stream.setDevice(&qxt_d().file);
+	quint32 magic;
+	quint32 format;
+	qint32 sampleRate;
+	qxt_d().stream >> magic >> format >> qxt_d().startTime >> sampleRate;
+	if (qxt_d().stream.status() != QDataStream::Ok || magic != quint32(WireTapPrivate::CaptureMagic))
+	{
+		qxt_d().error = "Not a wire tap capture file";
+		close();
+		return false;
+	}
+	if (format > quint32(WireTapPrivate::CaptureFormat))
+	{
+		qxt_d().error = QString("Unsupported capture format %1").arg(format);
+		close();
+		return false;
+	}
+	qxt_d().sampleRate = sampleRate;
+	return true;
+}
+
+/**
+ * Closes the capture file
+ */
+void WireTapReader::close()
+{
+	qxt_d().stream.setDevice(0);
+	qxt_d().file.close();
+}
+
+/**
+ * Reads the next frame
+ * @param frame Set to the frame that was read
+ * @return Returns false at the end of the file, or if the rest of the file is truncated
+ */
+bool WireTapReader::readFrame(WireTap::Frame& frame)
+{
+	if (!qxt_d().file.isOpen() || qxt_d().stream.atEnd())
+		return false;
+	quint8 direction;
+	quint32 size;
+	qxt_d().stream >> frame.timestamp >> frame.connection >> direction >> frame.version >> size;
+	if (qxt_d().stream.status() != QDataStream::Ok || size > qxt_d().file.bytesAvailable())
+	{
+		qxt_d().error = "The capture file is truncated";
+		return false;
+	}
+	frame.direction = static_cast<WireTap::Direction>(direction);
+	frame.data.resize(size);
+	if (qxt_d().stream.readRawData(frame.data.data(), size) != int(size))
+	{
+		qxt_d().error = "The capture file is truncated";
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @return Returns the time the capture was started, in milliseconds since the epoch
+ */
+qint64 WireTapReader::startTime() const
+{
+	return qxt_d().startTime;
+}
+
+/**
+ * @return Returns the sample rate the capture was made with
+ */
+int WireTapReader::sampleRate() const
+{
+	return qxt_d().sampleRate;
+}
+
+/**
+ * @return Returns a description of the last error
+ */
+QString WireTapReader::errorString() const
+{
+	return qxt_d().error;
+}
+
+}
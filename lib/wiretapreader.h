@@ -0,0 +1,77 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCWIRETAPREADER_H
+#define QTRPCWIRETAPREADER_H
+
+#include <QxtPimpl>
+#include <QString>
+#include <WireTap>
+#include <QtRpcGlobal>
+
+namespace QtRpc
+{
+
+class WireTapReaderPrivate;
+
+/**
+	Reads the capture files written by WireTap, one frame at a time.
+	@code
+	WireTapReader reader;
+	if (!reader.open("capture.tap"))
+		qFatal("%s", qPrintable(reader.errorString()));
+	WireTap::Frame frame;
+	while (reader.readFrame(frame))
+		qDebug() << frame.connection << frame.message();
+	@endcode
+	@brief Reader for wire tap capture files
+*/
+class QTRPC2_EXPORT WireTapReader
+{
+	QXT_DECLARE_PRIVATE(WireTapReader);
+public:
+	WireTapReader();
+	~WireTapReader();
+
+	bool open(const QString& path);
+	void close();
+	bool readFrame(WireTap::Frame& frame);
+	qint64 startTime() const;
+	int sampleRate() const;
+	QString errorString() const;
+
+private:
+	Q_DISABLE_COPY(WireTapReader);
+};
+
+}
+
+#endif
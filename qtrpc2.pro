@@ -27,6 +27,20 @@ clientprotocolbase.cpp \
  servicefinder.cpp \
  authtoken.cpp \
  servicefactoryparent.cpp \
+ asyncreturn.cpp \
+ asynccall.cpp \
+ callcontext.cpp \
+ callstats.cpp \
+ clientcallstats.cpp \
+ table.cpp \
+ wiretap.cpp \
+ wiretapreader.cpp \
+ tracecontext.cpp \
+ spansink.cpp \
+ memoryspansink.cpp \
+ otlpfilespansink.cpp \
+ metrics.cpp \
+ metricsexporter.cpp \
  qxtdiscoverableservice.cpp \
  qxtdiscoverableservicename.cpp \
  qxtservicebrowser.cpp
@@ -117,6 +131,31 @@ clientprotocolbase.h \
  qxtzeroconf.h \
  qxtmdns.h \
  sleeper.h \
+ asyncreturn.h \
+ asynccall.h \
+ asynccall_p.h \
+ qtrpccoroutine.h \
+ callcontext_p.h \
+ callstats_p.h \
+ clientcallstats_p.h \
+ typedfunction.h \
+ table.h \
+ table_p.h \
+ wiretap.h \
+ wiretap_p.h \
+ wiretapreader.h \
+ wiretapreader_p.h \
+ tracecontext.h \
+ spansink.h \
+ memoryspansink.h \
+ memoryspansink_p.h \
+ otlpfilespansink.h \
+ otlpfilespansink_p.h \
+ metrics_p.h \
+ metricsexporter.h \
+ metricsexporter_p.h \
+ freelist_p.h \
+ threadshards_p.h \
     qtrpcglobal.h
 
 DISTFILES += ReturnValue \
@@ -146,7 +185,21 @@ ProxyBase \
  QSharedPointer \
  AuthToken \
  QtRpcSharedPointer \
- AutomaticMetatypeRegistry
+ AutomaticMetatypeRegistry \
+ Table \
+ WireTap \
+ WireTapReader \
+ TraceContext \
+ TraceScope \
+ AsyncCall \
+ AsyncReturn \
+ AsyncReturnScope \
+ QtRpcCoroutine \
+ Span \
+ SpanSink \
+ MemorySpanSink \
+ OtlpFileSpanSink \
+ MetricsExporter
 CONFIG -= release \
 exceptions \
 stl
@@ -0,0 +1,89 @@
+/***************************************************************************
+ *  Copyright (c) 2010, Resara LLC
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Resara LLC nor the
+ *       names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***************************************************************************/
+#ifndef ROUNDTRIP_H
+#define ROUNDTRIP_H
+
+#include <ClientProxy>
+#include <QDebug>
+#include <QHash>
+#include <Table>
+
+using namespace QtRpc;
+
+/**
+	Checks features of the library against the RoundTripService of the testserver. Every check calls qFatal() when it fails.
+*/
+class RoundTrip : public ClientProxy
+{
+	Q_OBJECT
+public:
+	RoundTrip(QObject *parent = 0);
+	~RoundTrip();
+
+	void run();
+
+signals:
+	Event data(int index, QByteArray data);
+	ReturnValue echo(QByteArray data);
+	ReturnValue flood(int count, int size);
+	ReturnValue backpressure();
+	ReturnValue slowEcho(QObject *obj, const char *slot, int msecs, QByteArray data);
+	ReturnValue cancelledCalls();
+	ReturnValue table(int rows);
+	ReturnValue echoTable(Table table);
+	ReturnValue delayedAdd(int a, int b);
+
+protected slots:
+	void dataReceived(int index, QByteArray data);
+	void slowEchoReturned(uint id, ReturnValue ret);
+	void limitedReturned(uint id, ReturnValue ret);
+	void echoReturned(uint id, ReturnValue ret);
+
+private:
+	void checkLargeReply();
+	void checkBackpressure();
+	void checkCancel();
+	void checkAdmission();
+	void checkTable();
+	void checkAsync();
+	void checkCoroutine();
+	void checkCodec();
+	void echoNext();
+	void compareTable(const Table& table, int rows, const QString& what);
+	bool waitFor(const int& value, int expected, int msecs);
+
+	int m_received;
+	int m_replies;
+	QList<ReturnValue> m_limited;
+	int m_limitedReplies;
+	QHash<uint, QByteArray> m_echoes; //function id -> payload
+	int m_echoIssued;
+	int m_echoed;
+};
+
+#endif
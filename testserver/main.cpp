@@ -36,6 +36,7 @@
 #include "testserver.h"
 #include "callerservice.h"
 #include "testsyncroserver.h"
+#include "roundtripservice.h"
 
 
 using namespace QtRpc;
@@ -47,6 +48,11 @@ int main(int argc, char *argv[])
 	ServiceProxy* service = srv.registerService<TestServer>("TestService");
 	srv.registerService<CallerService>("CallerService");
 	srv.registerService<CallerService>("StringService");
+	srv.registerService<RoundTripService>("RoundTripService");
+	srv.registerService<RoundTripService>("LimitedService");
+	srv.setMaxConcurrentCalls("LimitedService", 1);
+	// Small enough for the round trip checks to run into it
+	srv.setWriteQueueLimits(16384, 65536);
 	
 	AuthToken auth;
 	QVariant var = QVariant::fromValue(auth);
@@ -0,0 +1,193 @@
+/***************************************************************************
+ *  Copyright (c) 2010, Resara LLC
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Resara LLC nor the
+ *       names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***************************************************************************/
+#include "roundtripservice.h"
+
+#include <QTimer>
+#include <TraceContext>
+#include <QtRpcCoroutine>
+
+#ifdef __cpp_impl_coroutine
+//Resumes the coroutine after a number of milliseconds, from the event loop of the thread running the service
+class Delay
+{
+public:
+	explicit Delay(int msecs) : m_msecs(msecs) {}
+
+	bool await_ready() const
+	{
+		return m_msecs <= 0;
+	}
+
+	void await_suspend(std::coroutine_handle<> handle)
+	{
+		QTimer::singleShot(m_msecs, [handle]() { handle.resume(); });
+	}
+
+	void await_resume() const
+	{
+	}
+
+private:
+	int m_msecs;
+};
+#endif
+
+RoundTripService::RoundTripService(QObject *parent)
+		: ServiceProxy(parent),
+		m_cancelled(0)
+{
+	QObject::connect(this, SIGNAL(backpressureChanged(bool)), this, SLOT(recordBackpressure(bool)));
+	QObject::connect(this, SIGNAL(callCancelled(quint32)), this, SLOT(slowEchoCancelled(quint32)));
+}
+
+RoundTripService::~RoundTripService()
+{
+}
+
+ReturnValue RoundTripService::auth(QString user, QString passwd)
+{
+	Q_UNUSED(user);
+	Q_UNUSED(passwd);
+	return(true);
+}
+
+ReturnValue RoundTripService::echo(QByteArray data)
+{
+	return(data);
+}
+
+/**
+ * Emits \a count events of \a size bytes at once, which is more than the testserver lets a connection buffer
+ */
+ReturnValue RoundTripService::flood(int count, int size)
+{
+	for (int i = 0; i < count; i++)
+		emit data(i, QByteArray(size, 'a' + i % 26));
+	return(count);
+}
+
+/**
+ * @return Returns the backpressure changes since the last call, true when it started and false when it was lifted
+ */
+ReturnValue RoundTripService::backpressure()
+{
+	QVariantList changes = m_backpressure;
+	m_backpressure.clear();
+	return(changes);
+}
+
+void RoundTripService::recordBackpressure(bool backpressured)
+{
+	m_backpressure << backpressured;
+}
+
+/**
+ * Returns a table with a column of every encoding. The values can be computed from the row, see testclient.
+ */
+ReturnValue RoundTripService::table(int rows)
+{
+	static const char* colors[] = {"red", "green", "blue"};
+	Table table(QStringList() << "id" << "color" << "name" << "group", QList<int>() << QMetaType::Int << QMetaType::QString << QMetaType::QString << QMetaType::Int);
+	for (int i = 0; i < rows; i++)
+		table.appendRow(QVariantList() << i << colors[i % 3] << QString("name %1").arg(i % 300) << i / 100);
+	return(table);
+}
+
+/**
+ * Sends a received table back without looking at it
+ */
+ReturnValue RoundTripService::echoTable(Table table)
+{
+	return(table);
+}
+
+/**
+ * A coroutine that adds \a a and \a b after a short wait. The deadline and the trace of the call must be the same after the wait as before it.
+ * @return Returns the sum and the trace id of the call, or a NoExists error if the testserver was built without coroutines
+ */
+ReturnValue RoundTripService::delayedAdd(int a, int b)
+{
+#ifdef __cpp_impl_coroutine
+	TraceContext before = TraceContext::current();
+	int remaining = remainingTime();
+	co_await Delay(50);
+	if (remaining >= 0 && remainingTime() < 0)
+		co_return ReturnValue(1, "The deadline of the call was lost while waiting");
+	if (TraceContext::current() != before)
+		co_return ReturnValue(1, "The trace of the call changed while waiting");
+	co_return QVariantList() << a + b << before.traceIdString();
+#else
+	Q_UNUSED(a);
+	Q_UNUSED(b);
+	return(ReturnValue(ReturnValue::NoExists, "The testserver was built without coroutines"));
+#endif
+}
+
+/**
+ * Answers after \a msecs milliseconds, unless the client cancels the call first
+ */
+ReturnValue RoundTripService::slowEcho(int msecs, QByteArray data)
+{
+	QTimer* timer = new QTimer(this);
+	timer->setSingleShot(true);
+	timer->setProperty("id", currentFunctionId());
+	timer->setProperty("data", data);
+	QObject::connect(timer, SIGNAL(timeout()), this, SLOT(slowEchoDone()));
+	timer->start(msecs);
+	m_slow.insert(currentFunctionId(), timer);
+	return(ReturnValue::asyncronous());
+}
+
+/**
+ * @return Returns the number of slowEcho() calls the client cancelled before they were answered
+ */
+ReturnValue RoundTripService::cancelledCalls()
+{
+	return(m_cancelled);
+}
+
+void RoundTripService::slowEchoDone()
+{
+	QTimer* timer = qobject_cast<QTimer*>(sender());
+	if (timer == 0)
+		return;
+	quint32 id = timer->property("id").toUInt();
+	m_slow.remove(id);
+	sendReturn(id, ReturnValue(timer->property("data")));
+	timer->deleteLater();
+}
+
+void RoundTripService::slowEchoCancelled(quint32 id)
+{
+	if (!m_slow.contains(id))
+		return;
+	if (!isCancelled(id))
+		qFatal("callCancelled() was emitted for a call that is not cancelled");
+	delete m_slow.take(id);
+	m_cancelled++;
+}
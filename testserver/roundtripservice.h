@@ -0,0 +1,76 @@
+/***************************************************************************
+ *  Copyright (c) 2010, Resara LLC
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Resara LLC nor the
+ *       names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***************************************************************************/
+#ifndef ROUNDTRIPSERVICE_H
+#define ROUNDTRIPSERVICE_H
+
+#include <ServiceProxy>
+#include <QHash>
+#include <Table>
+#include <QVariant>
+
+class QTimer;
+
+using namespace QtRpc;
+
+/**
+	The server side of the checks run by testclient --roundtrip. It is also registered as LimitedService, which only runs one call at a time.
+*/
+class RoundTripService : public ServiceProxy
+{
+	Q_OBJECT
+public:
+	RoundTripService(QObject *parent = 0);
+	~RoundTripService();
+
+	virtual ReturnValue auth(QString user, QString passwd);
+
+signals:
+	Event data(int index, QByteArray data);
+
+public slots:
+	ReturnValue echo(QByteArray data);
+	ReturnValue flood(int count, int size);
+	ReturnValue backpressure();
+	ReturnValue slowEcho(int msecs, QByteArray data);
+	ReturnValue cancelledCalls();
+	ReturnValue table(int rows);
+	ReturnValue echoTable(Table table);
+	ReturnValue delayedAdd(int a, int b);
+
+protected slots:
+	void recordBackpressure(bool backpressured);
+	void slowEchoDone();
+	void slowEchoCancelled(quint32 id);
+
+private:
+	QVariantList m_backpressure;
+	QHash<quint32, QTimer*> m_slow; //function id -> timer answering it
+	int m_cancelled;
+};
+
+#endif
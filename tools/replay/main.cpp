@@ -0,0 +1,176 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QLocalSocket>
+#include <QMap>
+#include <QTcpSocket>
+#include <QTextStream>
+#include <QTimer>
+#include <QDebug>
+#include <WireTap>
+#include <WireTapReader>
+#include "replayconnection.h"
+#include "replayreport.h"
+
+using namespace QtRpc;
+
+int main(int argc, char** argv)
+{
+	QCoreApplication app(argc, argv);
+	QCoreApplication::setApplicationName("qtrpc2-replay");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Replays the calls recorded in a QtRpc2 wire tap capture against a server, and reports their latency. Every recorded client is replayed on its own connection, keeping the order of its frames and their timing.");
+	parser.addHelpOption();
+	parser.addPositionalArgument("capture", "The capture file to replay.");
+	QCommandLineOption hostOption("host", "Connect to the tcp server on <host>.", "host", "localhost");
+	QCommandLineOption portOption("port", "Connect to the tcp server on <port>.", "port", "10123");
+	QCommandLineOption socketOption("socket", "Connect to the local socket <path> instead of tcp.", "path");
+	QCommandLineOption speedOption("speed", "Replay at <speed> times the recorded rate, or \"max\" to send as fast as possible.", "speed", "1");
+	QCommandLineOption connectionsOption("connections", "Replay over <n> connections. Recorded clients are reused in turn when there are more connections than clients. Defaults to one per recorded client.", "n");
+	QCommandLineOption timeoutOption("timeout", "Stop waiting for replies <seconds> after the last frame was sent.", "seconds", "30");
+	parser.addOption(hostOption);
+	parser.addOption(portOption);
+	parser.addOption(socketOption);
+	parser.addOption(speedOption);
+	parser.addOption(connectionsOption);
+	parser.addOption(timeoutOption);
+	parser.process(app);
+
+	if (parser.positionalArguments().count() != 1)
+		parser.showHelp(1);
+
+	WireTapReader reader;
+	if (!reader.open(parser.positionalArguments().first()))
+	{
+		qCritical() << "Failed to open the capture:" << reader.errorString();
+		return 1;
+	}
+
+	// The client to server frames, captured by the server or by the clients
+	QMap<quint32, QList<WireTap::Frame> > received;
+	QMap<quint32, QList<WireTap::Frame> > sent;
+	WireTap::Frame frame;
+	while (reader.readFrame(frame))
+	{
+		if (frame.direction == WireTap::ServerReceived)
+			received[frame.connection] << frame;
+		else if (frame.direction == WireTap::ClientSent)
+			sent[frame.connection] << frame;
+	}
+	QList<QList<WireTap::Frame> > clients = received.isEmpty() ? sent.values() : received.values();
+	if (clients.isEmpty())
+	{
+		qCritical() << "The capture contains no frames sent by clients";
+		return 1;
+	}
+	qint64 origin = clients.first().first().timestamp;
+	foreach(const QList<WireTap::Frame>& frames, clients)
+		origin = qMin(origin, frames.first().timestamp);
+
+	double speed = parser.value(speedOption) == "max" ? 0 : parser.value(speedOption).toDouble();
+	if (parser.value(speedOption) != "max" && speed <= 0)
+	{
+		qCritical() << "Invalid speed" << parser.value(speedOption);
+		return 1;
+	}
+	int count = parser.isSet(connectionsOption) ? parser.value(connectionsOption).toInt() : clients.count();
+
+	ReplayReport report;
+	QList<ReplayConnection*> connections;
+	QList<QIODevice*> devices;
+	for (int i = 0; i < count; ++i)
+	{
+		QIODevice* device;
+		if (parser.isSet(socketOption))
+		{
+			QLocalSocket* socket = new QLocalSocket(&app);
+			socket->connectToServer(parser.value(socketOption));
+			if (!socket->waitForConnected())
+			{
+				qCritical() << "Failed to connect:" << socket->errorString();
+				return 1;
+			}
+			device = socket;
+		}
+		else
+		{
+			QTcpSocket* socket = new QTcpSocket(&app);
+			socket->connectToHost(parser.value(hostOption), parser.value(portOption).toUShort());
+			if (!socket->waitForConnected())
+			{
+				qCritical() << "Failed to connect:" << socket->errorString();
+				return 1;
+			}
+			device = socket;
+		}
+		devices << device;
+		ReplayConnection* connection = new ReplayConnection(clients.at(i % clients.count()), origin, speed, &report, &app);
+		QObject::connect(device, SIGNAL(disconnected()), connection, SLOT(abort()));
+		connections << connection;
+	}
+
+	qint64 start = ReplayConnection::now();
+	int finished = 0;
+	QTimer timeout;
+	timeout.setSingleShot(true);
+	foreach(ReplayConnection* connection, connections)
+	{
+		QObject::connect(connection, &ReplayConnection::finished, [&]()
+		{
+			if (++finished == connections.count())
+				app.quit();
+		});
+	}
+	for (int i = 0; i < connections.count(); ++i)
+		connections.at(i)->start(devices.at(i), start);
+
+	// The timeout starts once the last frame is due
+	qint64 last = 0;
+	foreach(const QList<WireTap::Frame>& frames, clients)
+		last = qMax(last, frames.last().timestamp - origin);
+	qint64 lastDue = speed > 0 ? static_cast<qint64>(last / speed) : 0;
+	QObject::connect(&timeout, &QTimer::timeout, [&]()
+	{
+		foreach(ReplayConnection* connection, connections)
+			connection->abort();
+	});
+	timeout.start(static_cast<int>(lastDue / 1000000 + parser.value(timeoutOption).toInt() * 1000));
+
+	if (finished < connections.count())
+		app.exec();
+
+	QTextStream out(stdout);
+	report.print(out, (ReplayConnection::now() - start) / 1e9);
+	return 0;
+}
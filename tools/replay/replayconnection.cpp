@@ -0,0 +1,204 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include "replayconnection.h"
+#include "replayreport.h"
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QIODevice>
+#include <QtEndian>
+#include <Message>
+
+using namespace QtRpc;
+
+static quint32 nextId = 0;
+
+ReplayConnection::ReplayConnection(const QList<WireTap::Frame>& frames, qint64 origin, double speed, ReplayReport* report, QObject* parent)
+		: QObject(parent),
+		m_frames(frames),
+		m_next(0),
+		m_origin(origin),
+		m_speed(speed),
+		m_startTime(0),
+		m_report(report),
+		m_device(0),
+		m_version(0),
+		m_size(0),
+		m_finished(false)
+{
+	m_timer.setSingleShot(true);
+	m_timer.setTimerType(Qt::PreciseTimer);
+	connect(&m_timer, SIGNAL(timeout()), this, SLOT(sendDue()));
+}
+
+/**
+ * @return Returns the nanoseconds since the first call
+ */
+qint64 ReplayConnection::now()
+{
+	static QElapsedTimer timer;
+	static bool started = (timer.start(), true);
+	Q_UNUSED(started);
+	return timer.nsecsElapsed();
+}
+
+/**
+ * Starts sending the frames on \a device, which must already be connected
+ * @param device The connected device
+ * @param startTime The time the replay started, as returned by now()
+ */
+void ReplayConnection::start(QIODevice* device, qint64 startTime)
+{
+	m_device = device;
+	m_startTime = startTime;
+	connect(m_device, SIGNAL(readyRead()), this, SLOT(readyRead()));
+	connect(m_device, SIGNAL(aboutToClose()), this, SLOT(abort()));
+	sendDue();
+}
+
+/**
+ * Stops the replay, the calls that are still waiting for their reply are counted as lost
+ */
+void ReplayConnection::abort()
+{
+	if (m_finished)
+		return;
+	m_timer.stop();
+	m_report->addLost(m_pending.count());
+	m_pending.clear();
+	m_finished = true;
+	emit finished();
+}
+
+bool ReplayConnection::isFinished() const
+{
+	return m_finished;
+}
+
+qint64 ReplayConnection::dueTime(int index) const
+{
+	if (m_speed <= 0)
+		return m_startTime;
+	return m_startTime + static_cast<qint64>((m_frames.at(index).timestamp - m_origin) / m_speed);
+}
+
+void ReplayConnection::sendDue()
+{
+	if (m_finished)
+		return;
+	qint64 time = now();
+	int sent = 0;
+	while (m_next < m_frames.count() && dueTime(m_next) <= time)
+	{
+		send(m_frames.at(m_next++));
+		++sent;
+	}
+	m_report->addSent(sent);
+	if (m_next < m_frames.count())
+		m_timer.start(static_cast<int>(qMax(Q_INT64_C(0), dueTime(m_next) - time) / 1000000));
+	checkFinished();
+}
+
+void ReplayConnection::send(const WireTap::Frame& frame)
+{
+	m_version = frame.version;
+	Message msg = frame.message();
+	if (msg.id() == 0 || (msg.type() != Message::Function && msg.type() != Message::QtRpc))
+	{
+		// replies to callbacks keep the id the server gave them
+		QByteArray size(sizeof(qint64), 0);
+		qToBigEndian<qint64>(frame.data.size(), reinterpret_cast<uchar*>(size.data()));
+		m_device->write(size);
+		m_device->write(frame.data);
+		return;
+	}
+	quint32 id = ++nextId;
+	m_ids[msg.id()] = id;
+	msg.setId(id);
+	if (msg.type() == Message::QtRpc && msg.signature().name() == "cancel" && msg.arguments().count() > 0)
+		msg.setArguments(Arguments() << m_ids.value(msg.arguments().at(0).toUInt(), 0));
+	msg.setVersion(frame.version);
+	Pending pending;
+	pending.method = msg.type() == Message::Function ? msg.signature().toString() : "QtRpc::" + msg.signature().toString();
+	pending.sent = now();
+	m_pending[id] = pending;
+	m_device->write(msg.frame());
+}
+
+void ReplayConnection::readyRead()
+{
+	forever
+	{
+		if (m_size == 0)
+		{
+			if (m_device->bytesAvailable() < qint64(sizeof(qint64)))
+				return;
+			QDataStream stream(m_device);
+			stream >> m_size;
+			m_buffer.clear();
+		}
+		m_buffer += m_device->read(m_size - m_buffer.size());
+		if (m_buffer.size() < m_size)
+			return;
+		m_size = 0;
+		parseFrame(m_buffer);
+	}
+}
+
+void ReplayConnection::parseFrame(const QByteArray& data)
+{
+	Message msg;
+	msg.setVersion(m_version);
+	{
+		QDataStream stream(data);
+		stream >> msg;
+	}
+	if (msg.type() == Message::Invalid)
+	{
+		// the server answers the version negotiation in the old version
+		msg = Message();
+		QDataStream stream(data);
+		stream >> msg;
+	}
+	if (msg.type() != Message::Return || !m_pending.contains(msg.id()))
+		return;
+	Pending pending = m_pending.take(msg.id());
+	m_report->record(pending.method, now() - pending.sent, msg.returnValue().isError());
+	checkFinished();
+}
+
+void ReplayConnection::checkFinished()
+{
+	if (m_finished || m_next < m_frames.count() || !m_pending.isEmpty())
+		return;
+	m_finished = true;
+	emit finished();
+}
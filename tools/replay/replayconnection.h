@@ -0,0 +1,99 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QTRPCREPLAYCONNECTION_H
+#define QTRPCREPLAYCONNECTION_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QTimer>
+#include <WireTap>
+
+class QIODevice;
+class ReplayReport;
+
+/**
+	Replays the frames one client sent during a capture on a new connection. Frames are sent in their recorded order, at their recorded offset from the start of the capture divided by the speed, or as fast as possible with a speed of 0.
+
+	The ids of calls and protocol functions are rewritten, so every call of the replay has a unique id and can be matched with its reply. The time from sending a call to reading its reply is recorded in the report.
+*/
+class ReplayConnection : public QObject
+{
+	Q_OBJECT
+public:
+	ReplayConnection(const QList<QtRpc::WireTap::Frame>& frames, qint64 origin, double speed, ReplayReport* report, QObject* parent = 0);
+
+	void start(QIODevice* device, qint64 startTime);
+	bool isFinished() const;
+
+	static qint64 now();
+
+public slots:
+	void abort();
+
+signals:
+	void finished();
+
+private slots:
+	void sendDue();
+	void readyRead();
+
+private:
+	struct Pending
+	{
+		QString method;
+		qint64 sent;
+	};
+
+	qint64 dueTime(int index) const;
+	void send(const QtRpc::WireTap::Frame& frame);
+	void parseFrame(const QByteArray& data);
+	void checkFinished();
+
+	QList<QtRpc::WireTap::Frame> m_frames;
+	int m_next;
+	qint64 m_origin;
+	double m_speed;
+	qint64 m_startTime;
+	ReplayReport* m_report;
+	QIODevice* m_device;
+	QTimer m_timer;
+	quint32 m_version;
+	qint64 m_size;
+	QByteArray m_buffer;
+	bool m_finished;
+	// recorded ids to replayed ids
+	QHash<quint32, quint32> m_ids;
+	QHash<quint32, Pending> m_pending;
+};
+
+#endif
@@ -0,0 +1,132 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include "replayreport.h"
+#include <QStringList>
+#include <QTextStream>
+#include <QtAlgorithms>
+
+ReplayReport::Method::Method()
+		: errors(0)
+{
+}
+
+ReplayReport::ReplayReport()
+		: m_lost(0),
+		m_sent(0)
+{
+}
+
+/**
+ * Records a call that was answered
+ * @param method The signature of the call
+ * @param latency The time from sending the call to reading its reply, in nanoseconds
+ * @param error True if the reply was an error
+ */
+void ReplayReport::record(const QString& method, qint64 latency, bool error)
+{
+	Method& m = m_methods[method];
+	m.latencies << latency;
+	if (error)
+		++m.errors;
+}
+
+/**
+ * Counts calls that never got a reply
+ * @param calls The number of calls
+ */
+void ReplayReport::addLost(int calls)
+{
+	m_lost += calls;
+}
+
+/**
+ * Counts frames that were sent
+ * @param frames The number of frames
+ */
+void ReplayReport::addSent(int frames)
+{
+	m_sent += frames;
+}
+
+static QString percentile(const QVector<qint64>& sorted, int perMille)
+{
+	if (sorted.isEmpty())
+		return "-";
+	return QString::number(sorted[static_cast<int>((sorted.count() - 1) * qint64(perMille) / 1000)] / 1e3, 'f', 1);
+}
+
+/**
+ * Prints the percentiles of every method, and a histogram of all the calls, with a bucket for every power of two microseconds
+ * @param out The stream to print to
+ * @param seconds The duration of the replay
+ */
+void ReplayReport::print(QTextStream& out, double seconds) const
+{
+	QVector<qint64> all;
+	int errors = 0;
+	out << "method\tcalls\terrors\tp50_us\tp90_us\tp99_us\tp999_us\tmax_us\n";
+	QStringList methods = m_methods.keys();
+	methods.sort();
+	foreach(QString name, methods)
+	{
+		Method m = m_methods.value(name);
+		qSort(m.latencies);
+		all += m.latencies;
+		errors += m.errors;
+		out << name << "\t" << m.latencies.count() << "\t" << m.errors << "\t" << percentile(m.latencies, 500) << "\t" << percentile(m.latencies, 900) << "\t" << percentile(m.latencies, 990) << "\t" << percentile(m.latencies, 999) << "\t" << percentile(m.latencies, 1000) << "\n";
+	}
+	qSort(all);
+	out << "\n" << m_sent << " frames sent, " << all.count() << " replies, " << errors << " errors, " << m_lost << " lost in " << QString::number(seconds, 'f', 2) << "s";
+	if (seconds > 0)
+		out << " (" << QString::number(all.count() / seconds, 'f', 1) << " calls/s)";
+	out << "\n\n";
+	if (all.isEmpty())
+		return;
+
+	QVector<int> buckets;
+	foreach(qint64 latency, all)
+	{
+		int bucket = 0;
+		for (qint64 us = latency / 1000; us > 0; us >>= 1)
+			++bucket;
+		if (buckets.count() <= bucket)
+			buckets.resize(bucket + 1);
+		++buckets[bucket];
+	}
+	int largest = 0;
+	foreach(int count, buckets)
+		largest = qMax(largest, count);
+	for (int i = 0; i < buckets.count(); ++i)
+	{
+		out << QString("%1 %2 ").arg(QString("< %1us").arg(1LL << i), 12).arg(buckets[i], 8) << QString(buckets[i] * 50 / largest, '#') << "\n";
+	}
+}
@@ -0,0 +1,108 @@
+/***************************************************************************
+ *  Copyright (c) 2011, Resara LLC                                         *
+ *  All rights reserved.                                                   *
+ *                                                                         *
+ *  Redistribution and use in source and binary forms, with or without     *
+ *  modification, are permitted provided that the following conditions are *
+ *  met:                                                                   *
+ *      * Redistributions of source code must retain the above copyright   *
+ *        notice, this list of conditions and the following disclaimer.    *
+ *      * Redistributions in binary form must reproduce the above          *
+ *        copyright notice, this list of conditions and the following      *
+ *        disclaimer in the documentation and/or other materials           *
+ *        provided with the distribution.                                  *
+ *      * Neither the name of Resara LLC nor the names of its              *
+ *        contributors may be used to endorse or promote products          *
+ *        derived from this software without specific prior written        *
+ *        permission.                                                      *
+ *                                                                         *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS    *
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT      *
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  *
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL RESARA LLC BE   *
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR    *
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   *
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR        *
+ *  BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  *
+ *  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE   *
+ *  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN *
+ *  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                          *
+ *                                                                         *
+ ***************************************************************************/
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QTextStream>
+#include <QDebug>
+#include <WireTap>
+#include <WireTapReader>
+
+using namespace QtRpc;
+
+static const char* directionName(WireTap::Direction direction)
+{
+	switch (direction)
+	{
+		case WireTap::ServerReceived:
+			return "server <-";
+		case WireTap::ServerSent:
+			return "server ->";
+		case WireTap::ClientReceived:
+			return "client <-";
+		case WireTap::ClientSent:
+			return "client ->";
+	}
+	return "?";
+}
+
+int main(int argc, char** argv)
+{
+	QCoreApplication app(argc, argv);
+	QCoreApplication::setApplicationName("qtrpc2-tapdump");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Prints the messages in a QtRpc2 wire tap capture.");
+	parser.addHelpOption();
+	parser.addPositionalArgument("capture", "The capture file to read.");
+	QCommandLineOption connectionOption("connection", "Only print the frames of connection <id>.", "id");
+	QCommandLineOption hexOption("hex", "Also print the raw bytes of each frame.");
+	parser.addOption(connectionOption);
+	parser.addOption(hexOption);
+	parser.process(app);
+
+	if (parser.positionalArguments().count() != 1)
+		parser.showHelp(1);
+
+	WireTapReader reader;
+	if (!reader.open(parser.positionalArguments().first()))
+	{
+		qCritical() << "Failed to open the capture:" << reader.errorString();
+		return 1;
+	}
+
+	QTextStream out(stdout);
+	out << "Capture started " << QDateTime::fromMSecsSinceEpoch(reader.startTime()).toString(Qt::ISODate) << ", sampling 1 in " << reader.sampleRate() << " connections\n";
+
+	bool filter = parser.isSet(connectionOption);
+	quint32 connection = parser.value(connectionOption).toUInt();
+	int frames = 0;
+	WireTap::Frame frame;
+	while (reader.readFrame(frame))
+	{
+		if (filter && frame.connection != connection)
+			continue;
+		++frames;
+		QString dump;
+		QDebug(&dump).nospace() << frame.message();
+		out << QString::number(frame.timestamp / 1000.0, 'f', 1) << "us #" << frame.connection << " " << directionName(frame.direction) << " v" << frame.version << " " << frame.data.size() << " bytes " << dump << "\n";
+		if (parser.isSet(hexOption))
+			out << "    " << frame.data.toHex() << "\n";
+	}
+	out << frames << " frames\n";
+	if (!reader.errorString().isEmpty())
+	{
+		qCritical() << reader.errorString();
+		return 1;
+	}
+	return 0;
+}